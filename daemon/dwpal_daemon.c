@@ -17,6 +17,7 @@
 #include "hostap_iface.h"
 #include "nl_iface.h"
 #include "stadb.h"
+#include "dwpald_metrics.h"
 
 #include <pthread.h>
 #include <signal.h>
@@ -42,6 +43,7 @@
 
 static char *server_name = DWPALD_SERVER_NAME;
 static unsigned int detach_time = 60; /* 1 minute */
+static bool hostap_sharded = false;
 
 struct _dwpal_daemon {
 	wv_ipserver *ipserver;
@@ -102,12 +104,118 @@ static const char* dwpald_request_name(uint8_t req)
 		case DWPALD_ATTACH_REQ: return "DWPALD_ATTACH_REQ";
 		case DWPALD_DETACH_REQ: return "DWPALD_DETACH_REQ";
 		case DWPALD_UPDATE_EVENT_REQ: return "DWPALD_UPDATE_EVENT_REQ";
+		case DWPALD_METRICS_REQ: return "DWPALD_METRICS_REQ";
 		default: return "(unknown)";
 	}
 }
 
+typedef struct {
+	metrics_text *t;
+	uint8_t iftype;
+} serializer_metrics_ctx;
+
+static void dwpald_serializer_metrics_print(const char *ifname, serializer_stats *stats,
+					    void *arg)
+{
+	serializer_metrics_ctx *ctx = (serializer_metrics_ctx*)arg;
+
+	metrics_text_printf(ctx->t, "%s %s queued=%zu max_queued=%zu delayed=%zu executed=%llu "
+			    "avg_wait_us=%llu max_wait_us=%llu blocked=%llu dropped=%llu "
+			    "coalesced=%llu\n",
+			    dwpald_metrics_iftype_name(ctx->iftype), ifname ? ifname : "(control)",
+			    stats->queued, stats->max_queued, stats->delayed,
+			    (unsigned long long)stats->executed,
+			    (unsigned long long)(stats->executed ?
+						 stats->wait_total_us / stats->executed : 0),
+			    (unsigned long long)stats->wait_max_us,
+			    (unsigned long long)stats->overflow_blocked,
+			    (unsigned long long)stats->overflow_dropped,
+			    (unsigned long long)stats->overflow_coalesced);
+}
+
+static void dwpald_pool_metrics_print(obj_pool *pool, void *arg)
+{
+	metrics_text *t = (metrics_text*)arg;
+	obj_pool_stats stats;
+
+	if (obj_pool_get_stats(pool, &stats))
+		return;
+
+	metrics_text_printf(t, "%s size=%zu in_use=%zu peak_in_use=%zu allocs=%llu grows=%llu "
+			    "trimmed=%llu\n",
+			    obj_pool_get_name(pool), stats.size, stats.in_use, stats.peak_in_use,
+			    (unsigned long long)stats.total_allocs,
+			    (unsigned long long)stats.grows,
+			    (unsigned long long)stats.trimmed);
+}
+
+/* Reply with a text report of the daemon metrics. The report is cut at the
+ * max ipc message size, header[1] of the response is set if it was cut */
+static int dwpald_metrics_reply(wv_ipserver *ipserv, wv_ipstation *ipsta,
+				uint32_t seq_num)
+{
+	wv_ipc_ret ret;
+	wv_ipc_msg *resp;
+	dwpald_header resp_hdr = { 0 };
+	serializer_metrics_ctx ser_ctx;
+	metrics_text t = { 0 };
+
+	if ((resp = wave_ipc_msg_alloc()) == NULL)
+		return 1;
+
+	if (wave_ipc_msg_reserve_data(resp, WAVE_IPC_BUFF_SIZE) != WAVE_IPC_SUCCESS ||
+	    (t.buf = wave_ipc_msg_get_data(resp)) == NULL) {
+		wave_ipc_msg_put(resp);
+		return 1;
+	}
+	t.size = WAVE_IPC_BUFF_SIZE;
+	t.buf[0] = '\0';
+
+	dwpald_metrics_print(&t);
+
+	metrics_text_printf(&t, "[serializers] iftype ifname\n");
+	ser_ctx.t = &t;
+	ser_ctx.iftype = DWPALD_IF_TYPE_HOSTAP;
+	iface_manager_serializers_stats(dwpald.hap_man, dwpald_serializer_metrics_print, &ser_ctx);
+	ser_ctx.iftype = DWPALD_IF_TYPE_KERNEL;
+	iface_manager_serializers_stats(dwpald.nl_man, dwpald_serializer_metrics_print, &ser_ctx);
+
+	metrics_text_printf(&t, "[clients] name\n");
+	LOCK_STA_DB(&dwpald.stadb);
+	list_foreach_start(dwpald.stadb.sta_list, ipsta_tmp, wv_ipstation)
+		wv_ipstation_stats stats;
+
+		if (wave_ipcs_sta_get_stats(ipserv, ipsta_tmp, &stats) != WAVE_IPC_SUCCESS)
+			continue;
+
+		metrics_text_printf(&t, "%s pending_msgs=%zu pending_replies=%zu dropped=%llu\n",
+				    wave_ipcs_sta_name(ipsta_tmp), stats.pending_msgs,
+				    stats.pending_replies, (unsigned long long)stats.dropped_msgs);
+	list_foreach_end
+	UNLOCK_STA_DB(&dwpald.stadb);
+
+	metrics_text_printf(&t, "[pools] name\n");
+	wave_ipc_msg_pools_walk(dwpald_pool_metrics_print, &t);
+
+	wave_ipc_msg_shrink_data(resp, t.len);
+
+	resp_hdr.header[0] = DWPALD_METRICS_RESP;
+	resp_hdr.header[1] = t.truncated;
+	dwpald_header_push(resp, &resp_hdr);
+
+	ret = wave_ipcs_send_response_to(ipserv, ipsta, seq_num, resp, 0);
+	wave_ipc_msg_put(resp);
+	if (ret != WAVE_IPC_SUCCESS) {
+		ELOG("send_response_to '%s' returned err (ret=%d)",
+		     wave_ipcs_sta_name(ipsta), ret);
+		return 1;
+	}
+
+	return 0;
+}
+
 static int dwpald_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta,
-			    uint8_t seq_num, wv_ipc_msg *cmd)
+			    uint32_t seq_num, wv_ipc_msg *cmd)
 {
 	int res;
 	dwpald_header cmd_hdr = { 0 };
@@ -142,6 +250,11 @@ static int dwpald_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta,
 			res = 1;
 		}
 		break;
+	case DWPALD_METRICS_REQ:
+		LOG(2, "received metrics request from '%s'", wave_ipcs_sta_name(ipsta));
+		wave_ipc_msg_put(cmd);
+		res = dwpald_metrics_reply(ipserv, ipsta, seq_num);
+		break;
 #ifdef CONFIG_DWPALD_DEBUG_TOOLS
 	case DWPALD_TERMINATE_REQ:
 		LOG(1, "received terminate command from '%s'",
@@ -301,6 +414,11 @@ static int run_dwpald_daemon(l_list *hostap_ifaces)
 	dwpald.stadb.sta_list = list_init();
 	pthread_mutex_init(&dwpald.stadb.lock, NULL);
 
+	if (dwpald_metrics_init()) {
+		ELOG("failed to init metrics");
+		goto end;
+	}
+
 	LOG(2, "creating ipc server");
 	if (WAVE_IPC_SUCCESS != wave_ipcs_create(&dwpald.ipserver, server_name)) {
 		ELOG("ipcs create returned error");
@@ -309,11 +427,13 @@ static int run_dwpald_daemon(l_list *hostap_ifaces)
 
 	LOG(2, "creating hostap manager");
 	dwpald.hap_man = iface_manager_init(dwpald.ipserver, hostap_man_apis_get(),
-					    hostap_ifaces, DWPALD_IF_TYPE_HOSTAP, detach_time);
+					    hostap_ifaces, DWPALD_IF_TYPE_HOSTAP, detach_time,
+					    hostap_sharded);
 
+	/* nl commands don't carry an interface name, keep them on one serializer */
 	LOG(2, "creating nl manager");
 	dwpald.nl_man = iface_manager_init(dwpald.ipserver, nl_man_apis_get(),
-					   NULL, DWPALD_IF_TYPE_KERNEL, detach_time);
+					   NULL, DWPALD_IF_TYPE_KERNEL, detach_time, false);
 
 	LOG(1, "runnig ipc server");
 	if (WAVE_IPC_SUCCESS != wave_ipcs_run(dwpald.ipserver, &callbacks)) {
@@ -339,17 +459,20 @@ end:
 	if (dwpald.stadb.sta_list)
 		list_free(dwpald.stadb.sta_list);
 
+	dwpald_metrics_deinit();
+
 	return ret;
 }
 
 static void usage(void)
 {
-	printf("\nUsage: dwpal_daemon [-i<ifname>] [-hsdB]\n"
+	printf("\nUsage: dwpal_daemon [-i<ifname>] [-hsdBS]\n"
 	    "Options:\n"
 	    "   -h           help (show this text)\n"
 	    "   -i<ifname>   hostap interface to attach to via dwpal\n"
 	    "   -B           run as daemon in the background\n"
 	    "   -d           increase log level to debug\n"
+	    "   -p           execute every hostap interface on a thread of its own\n"
 #ifdef CONFIG_DWPALD_DEBUG_TOOLS
 	    "   -u           starts the server's sock under different name for unit testing\n"
 #endif
@@ -373,7 +496,7 @@ int main(int argc, char *argv[]) {
 	if (!(hostap_ifaces = list_init()))
 		return 1;
 
-	while ((c = getopt(argc, argv, "i:Bdhsu")) != -1) {
+	while ((c = getopt(argc, argv, "i:Bdhspu")) != -1) {
 		switch (c) {
 		case 'i':
 			ifname = (char*)malloc(IFNAMSIZ + 1);
@@ -391,6 +514,9 @@ int main(int argc, char *argv[]) {
 		case 's':
 			open_syslog = 1;
 			break;
+		case 'p':
+			hostap_sharded = true;
+			break;
 		case 'd':
 			LOG(1, "using log level 2");
 			__log_level = 2;
@@ -40,6 +40,9 @@
 #define DWPALD_CONNECTED_CLIENTS_RESP	(13)
 #endif
 
+#define DWPALD_METRICS_REQ		(14)
+#define DWPALD_METRICS_RESP		(15)
+
 #define DWPALD_IF_TYPE_HOSTAP		(1)
 #define DWPALD_IF_TYPE_DRIVER		(2)
 #define DWPALD_IF_TYPE_KERNEL		(3)
@@ -47,6 +50,7 @@
 /* dwpald Message headers:
  *
  * under ipc command:
+ * [DWPALD_METRICS_REQ]
  * [DWPALD_REG_EVENTS] [DWPALD_IF_TYPE_HOSTAP]
  * [DWPALD_REG_EVENTS] [DWPALD_IF_TYPE_DRIVER]
  * [DWPALD_CMD] [DWPALD_IF_TYPE_HOSTAP] [ifname_len]
@@ -59,6 +63,7 @@
  * [DWPALD_EVENT] [DWPALD_IF_TYPE_KERNEL]
  *
  * under ipc response:
+ * [DWPALD_METRICS_RESP] [truncated]
  * [DWPALD_REG_EVENTS_STATUS] [ failed_flag ]
  * [DWPALD_CMD_RESP] [DWPALD_IF_TYPE_HOSTAP] [dwpal_ext_ret]
  * [DWPALD_CMD_RESP] [DWPALD_IF_TYPE_DRIVER] [dwpal_ext_ret]
@@ -141,9 +146,10 @@ static inline struct nl_msg * dwpald_nl_msg_from_ipc_msg(wv_ipc_msg *ipc_msg)
 static inline wv_ipc_msg * dwpald_ipc_msg_from_nl_msg(struct nl_msg *nlmsg)
 {
 	struct nlmsghdr *hdr = nlmsg_hdr(nlmsg);
-	wv_ipc_msg *ipc_msg = wave_ipc_msg_alloc();
+	size_t size = nlmsg_total_size(nlmsg_datalen(hdr));
+	wv_ipc_msg *ipc_msg = wave_ipc_msg_alloc_size(size);
 
-	wave_ipc_msg_fill_data(ipc_msg, (char *)hdr, nlmsg_total_size(nlmsg_datalen(hdr)));
+	wave_ipc_msg_fill_data(ipc_msg, (char *)hdr, size);
 	return ipc_msg;
 }
 
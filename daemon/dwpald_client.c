@@ -13,6 +13,7 @@
 #include "dwpal_os.h"
 #include "wave_ipc_client.h"
 #include "linked_list.h"
+#include "hash_table.h"
 #include "logs.h"
 
 #include <stdlib.h>
@@ -31,7 +32,8 @@
 static char *server_name = DWPALD_SERVER_NAME;
 
 #define OPCODE_SIZE 64
-#define MAX_NUM_CB_EVENTS 64
+/* "ifname/op_code", the key of the hostap dispatch table */
+#define HOSTAP_EVENT_KEY_SIZE (IFNAMSIZ + 1 + OPCODE_SIZE)
 
 typedef struct _dwpald_hostap_attachment {
 	char ifname[IFNAMSIZ + 1];
@@ -74,6 +76,34 @@ typedef struct _dwpald_drv_nl_attachment {
 	l_list *nl_event_cb;   /* list of dwpald_nl_event_clb_id */
 } dwpald_drv_nl_attachment;
 
+/* The callbacks of one hostap event of one interface, the common handler
+ * of the interface first */
+typedef struct _dwpald_hostap_dispatch {
+	char key[HOSTAP_EVENT_KEY_SIZE];
+	size_t num_clb;
+	hostap_event_clb clb[];
+} dwpald_hostap_dispatch;
+
+typedef struct _dwpald_drv_dispatch {
+	uint32_t nl_id;
+	size_t num_clb;
+	driver_nl_event_clb clb[];
+} dwpald_drv_dispatch;
+
+/* Immutable view of the subscriptions used by the event thread. A new
+ * snapshot is built from the attachment lists under their lock whenever they
+ * change and replaces the published one; events are dispatched from the
+ * snapshot they took a reference to, without holding the attachment locks */
+typedef struct _dwpald_snapshot {
+	int refcnt;
+	/* "ifname/op_code" -> dwpald_hostap_dispatch, hostap snapshot */
+	hash_table *hostap_events;
+	/* nl_id -> dwpald_drv_dispatch, driver snapshot */
+	hash_table *drv_events;
+	size_t num_kernel_clb;
+	nl80211_event_clb *kernel_clb;
+} dwpald_snapshot;
+
 typedef struct _dwpald_connection {
 	wv_ipclient *client_handle;
 	int listener_running;
@@ -85,6 +115,11 @@ typedef struct _dwpald_connection {
 	dwpald_drv_nl_attachment *drv_nl_attch;
 	pthread_mutex_t drv_nl_attach_lock;
 
+	/* published snapshots, the lock only guards taking a reference */
+	dwpald_snapshot *hostap_snapshot;
+	dwpald_snapshot *drv_snapshot;
+	pthread_mutex_t snapshot_lock;
+
 	int nl80211_id;
 
 	termination_cond term_cond;
@@ -590,20 +625,21 @@ static int dwpald_push_kernel_callback(l_list *l, nl80211_event_clb clb, unsigne
 	return 0;
 }
 
-static int dwpald_push_hostap_callback(l_list *l, hostap_event_clb clb, unsigned int id)
+static dwpald_hostap_clb_id * dwpald_push_hostap_callback(l_list *l, hostap_event_clb clb,
+							  unsigned int id)
 {
 	dwpald_hostap_clb_id *new_cb = NULL;
 	new_cb = calloc(1, sizeof(dwpald_hostap_clb_id));
 	if (new_cb == NULL)
-		return -1;
+		return NULL;
 	new_cb->id = id;
 	new_cb->hapd_clb = clb;
 	if (list_push_back(l, new_cb)) {
 		BUG("list push error");
 		free(new_cb);
-		return -1;
+		return NULL;
 	}
-	return 0;
+	return new_cb;
 }
 
 static int dwpald_copy_hostap_events(l_list * hap_events_dst, size_t num_hap_events,
@@ -641,8 +677,8 @@ static int dwpald_copy_hostap_events(l_list * hap_events_dst, size_t num_hap_eve
 			goto err;
 		}
 
-		ret = dwpald_push_hostap_callback(cpy->dwpald_hostap_clb_id_list, hostap_events[i].hapd_clb, id);
-		if (!ret) {
+		ret = 1;
+		if (dwpald_push_hostap_callback(cpy->dwpald_hostap_clb_id_list, hostap_events[i].hapd_clb, id)) {
 			ret = list_push_front(hap_events_dst, cpy);
 		}
 		if (ret) {
@@ -655,7 +691,9 @@ static int dwpald_copy_hostap_events(l_list * hap_events_dst, size_t num_hap_eve
 	return 0;
 
 err:
-	dwpald_free_hostap_events_with_id(hap_events_dst, id);
+	/* the events copied so far were pushed to the front */
+	while (i--)
+		free_hostap_event_with_id(list_pop_front(hap_events_dst));
 	return 1;
 }
 
@@ -722,32 +760,182 @@ err:
 	return 1;
 }
 
-static inline size_t copy_hostap_event(dwpald_hostap_attachment* hap_attach, dwpald_hostap_event_with_id* event,
-				    hostap_event_clb *callback, size_t max_num_events)
+static int hostap_event_key(char *key, const char *ifname, const char *op_code)
 {
-	size_t num_events = 0;
+	int len = sprintf_s(key, HOSTAP_EVENT_KEY_SIZE, "%s/%s", ifname, op_code);
 
-	if (!event || !max_num_events)
-		return 0;
+	return (len < 0) ? 1 : 0;
+}
+
+static int free_dispatch(void *obj, void *arg)
+{
+	(void)arg;
+	free(obj);
+	return 1;
+}
+
+static void dwpald_snapshot_put(dwpald_snapshot *snap)
+{
+	if (!snap || __atomic_sub_fetch(&snap->refcnt, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	if (snap->hostap_events) {
+		hash_table_walk(snap->hostap_events, free_dispatch, NULL);
+		hash_table_free(snap->hostap_events);
+	}
+	if (snap->drv_events) {
+		hash_table_walk(snap->drv_events, free_dispatch, NULL);
+		hash_table_free(snap->drv_events);
+	}
+	free(snap->kernel_clb);
+	free(snap);
+}
+
+static dwpald_snapshot * dwpald_snapshot_get(dwpald_snapshot **published)
+{
+	dwpald_snapshot *snap;
+
+	MUTEX_LOCK(&dwpald_conn->snapshot_lock);
+	snap = *published;
+	if (snap)
+		__atomic_add_fetch(&snap->refcnt, 1, __ATOMIC_SEQ_CST);
+	MUTEX_UNLOCK(&dwpald_conn->snapshot_lock);
+
+	return snap;
+}
+
+static void dwpald_snapshot_publish(dwpald_snapshot **published, dwpald_snapshot *snap)
+{
+	dwpald_snapshot *old;
+
+	MUTEX_LOCK(&dwpald_conn->snapshot_lock);
+	old = *published;
+	*published = snap;
+	MUTEX_UNLOCK(&dwpald_conn->snapshot_lock);
+
+	dwpald_snapshot_put(old);
+}
+
+static int snapshot_add_hostap_event(dwpald_snapshot *snap, dwpald_hostap_attachment *hap_attch,
+				     dwpald_hostap_event_with_id *event)
+{
+	dwpald_hostap_dispatch *dispatch;
+	size_t num_clb = list_get_size(event->dwpald_hostap_clb_id_list) + 1;
+
+	dispatch = (dwpald_hostap_dispatch*)calloc(1, sizeof(dwpald_hostap_dispatch) +
+						   num_clb * sizeof(hostap_event_clb));
+	if (!dispatch)
+		return 1;
+
+	if (hostap_event_key(dispatch->key, hap_attch->ifname, event->op_code)) {
+		free(dispatch);
+		return 1;
+	}
 
 	/* This event can be used as a common handler for all registered events to execute a common code.
 		NOTE: must be called BEFORE event */
-	if (hap_attach->common_event)
-		callback[num_events++] = hap_attach->common_event;
+	if (hap_attch->common_event)
+		dispatch->clb[dispatch->num_clb++] = hap_attch->common_event;
 
 	list_foreach_start(event->dwpald_hostap_clb_id_list, clb, dwpald_hostap_clb_id)
-		if (!clb->hapd_clb)
-			continue;
+		if (clb->hapd_clb)
+			dispatch->clb[dispatch->num_clb++] = clb->hapd_clb;
+	list_foreach_end
 
-		if (num_events >= max_num_events) {
-			BUG("Reached limit for number of supported hostap event callbacks");
-			break;
-		}
+	/* an op_code listed twice is dispatched by its first entry */
+	if (hash_table_insert(snap->hostap_events, dispatch->key, dispatch))
+		free(dispatch);
+
+	return 0;
+}
+
+/* Publish the hostap subscriptions to the event thread, must be called with
+ * hap_attach_lock held after every change of hostap_attachments. On failure
+ * the previous snapshot remains */
+static int dwpald_hostap_snapshot_update(void)
+{
+	dwpald_snapshot *snap;
+
+	snap = (dwpald_snapshot*)calloc(1, sizeof(dwpald_snapshot));
+	if (!snap)
+		goto err;
+	snap->refcnt = 1;
+
+	snap->hostap_events = hash_table_init(0, hash_str, hash_str_cmp);
+	if (!snap->hostap_events)
+		goto err;
+
+	list_foreach_start(dwpald_conn->hostap_attachments, hap_attch, dwpald_hostap_attachment)
+		list_foreach_start(hap_attch->hostap_events, hap_event, dwpald_hostap_event_with_id)
+			if (snapshot_add_hostap_event(snap, hap_attch, hap_event))
+				goto err;
+		list_foreach_end
+	list_foreach_end
+
+	dwpald_snapshot_publish(&dwpald_conn->hostap_snapshot, snap);
+	return 0;
+
+err:
+	ELOG("failed to update hostap events snapshot");
+	dwpald_snapshot_put(snap);
+	return 1;
+}
+
+/* Same as dwpald_hostap_snapshot_update(), for the driver and kernel
+ * subscriptions with drv_nl_attach_lock held */
+static int dwpald_drv_snapshot_update(void)
+{
+	dwpald_drv_nl_attachment *drv_attch = dwpald_conn->drv_nl_attch;
+	dwpald_snapshot *snap = NULL;
+	dwpald_drv_dispatch *dispatch;
+
+	if (!drv_attch) {
+		dwpald_snapshot_publish(&dwpald_conn->drv_snapshot, NULL);
+		return 0;
+	}
+
+	snap = (dwpald_snapshot*)calloc(1, sizeof(dwpald_snapshot));
+	if (!snap)
+		goto err;
+	snap->refcnt = 1;
+
+	snap->drv_events = hash_table_init(0, hash_u32, hash_u32_cmp);
+	if (!snap->drv_events)
+		goto err;
+
+	list_foreach_start(drv_attch->drv_events, drv_event, dwpald_driver_nl_event_with_id)
+		dispatch = (dwpald_drv_dispatch*)calloc(1, sizeof(dwpald_drv_dispatch) +
+			list_get_size(drv_event->drv_clb_id_list) * sizeof(driver_nl_event_clb));
+		if (!dispatch)
+			goto err;
+
+		dispatch->nl_id = drv_event->nl_id;
+		list_foreach_start(drv_event->drv_clb_id_list, drv_clb, dwpald_drv_clb_id)
+			dispatch->clb[dispatch->num_clb++] = drv_clb->drv_clb;
+		list_foreach_end
 
-		callback[num_events++] = clb->hapd_clb;
+		if (hash_table_insert(snap->drv_events, &dispatch->nl_id, dispatch))
+			free(dispatch);
 	list_foreach_end
 
-	return num_events;
+	if (list_get_size(drv_attch->nl_event_cb)) {
+		snap->kernel_clb = (nl80211_event_clb*)calloc(list_get_size(drv_attch->nl_event_cb),
+							      sizeof(nl80211_event_clb));
+		if (!snap->kernel_clb)
+			goto err;
+
+		list_foreach_start(drv_attch->nl_event_cb, clb, dwpald_nl_event_clb_id)
+			snap->kernel_clb[snap->num_kernel_clb++] = clb->nl_event_id;
+		list_foreach_end
+	}
+
+	dwpald_snapshot_publish(&dwpald_conn->drv_snapshot, snap);
+	return 0;
+
+err:
+	ELOG("failed to update driver events snapshot");
+	dwpald_snapshot_put(snap);
+	return 1;
 }
 
 static int dwpald_receive_hostap_event(wv_ipc_msg *event, dwpald_header *hdr)
@@ -758,9 +946,11 @@ static int dwpald_receive_hostap_event(wv_ipc_msg *event, dwpald_header *hdr)
 	uint16_t event_msg_len = wv_aligned_16_bit_fetch(&hdr->header[4]);
 	char *event_data = wave_ipc_msg_get_data(event);
 	size_t event_data_size = wave_ipc_msg_get_size(event);
-	int found = 0, intf_event = 0;
-	size_t i, num_events = 0;
-	hostap_event_clb event_callback[MAX_NUM_CB_EVENTS];
+	char key[HOSTAP_EVENT_KEY_SIZE];
+	int intf_event = 0;
+	size_t i;
+	dwpald_snapshot *snap;
+	dwpald_hostap_dispatch *dispatch = NULL;
 
 	if (event_data_size != (size_t)(hdr->header[2] + hdr->header[3] + event_msg_len)) {
 		BUG("event_data_size=%zu, hdr[2]=%hhu hdr[3]=%hhu event_msg_len=%hu",
@@ -792,44 +982,47 @@ static int dwpald_receive_hostap_event(wv_ipc_msg *event, dwpald_header *hdr)
 		event_msg_len--; /* len should not include '\n' at the end */
 	}
 
-	MUTEX_LOCK(&dwpald_conn->hap_attach_lock);
-	list_foreach_start(dwpald_conn->hostap_attachments, hap_attch, dwpald_hostap_attachment)
-		if (strncmp(hap_attch->ifname, ifname, sizeof(ifname)))
-			continue;
+	/* Only the rare INTERFACE_* events change the attachment */
+	if (!strncmp(op_code, "INTERFACE_", sizeof("INTERFACE_") - 1)) {
+		uint8_t state = INTERFACE_DWPAL_STATE_DISCONNECTED;
 
 		if (!strncmp(op_code, "INTERFACE_CONNECTED_OK", sizeof("INTERFACE_CONNECTED_OK") - 1)) {
-			hap_attch->state = INTERFACE_DWPAL_STATE_CONNECTED;
+			state = INTERFACE_DWPAL_STATE_CONNECTED;
 			intf_event = 1;
 		}
 		else if (!strncmp(op_code, "INTERFACE_RECONNECTED_OK", sizeof("INTERFACE_RECONNECTED_OK") - 1)) {
-			hap_attch->state = INTERFACE_DWPAL_STATE_CONNECTED;
+			state = INTERFACE_DWPAL_STATE_CONNECTED;
 			intf_event = 1;
 		}
 		else if (!strncmp(op_code, "INTERFACE_DISCONNECTED", sizeof("INTERFACE_DISCONNECTED") - 1)) {
-			hap_attch->state = INTERFACE_DWPAL_STATE_DISCONNECTED;
 			intf_event = 1;
 		}
 
-		list_foreach_start(hap_attch->hostap_events, hap_event, dwpald_hostap_event_with_id)
-			if (strncmp(hap_event->op_code, op_code, sizeof(op_code)))
-				continue;
-
-			num_events = copy_hostap_event(hap_attch, hap_event, event_callback, MAX_NUM_CB_EVENTS);
-			found = 1;
-			break;
-		list_foreach_end
+		if (intf_event) {
+			MUTEX_LOCK(&dwpald_conn->hap_attach_lock);
+			list_foreach_start(dwpald_conn->hostap_attachments, hap_attch, dwpald_hostap_attachment)
+				if (!strncmp(hap_attch->ifname, ifname, sizeof(ifname))) {
+					hap_attch->state = state;
+					break;
+				}
+			list_foreach_end
+			MUTEX_UNLOCK(&dwpald_conn->hap_attach_lock);
+		}
+	}
 
-		break;
-	list_foreach_end
-	MUTEX_UNLOCK(&dwpald_conn->hap_attach_lock);
+	snap = dwpald_snapshot_get(&dwpald_conn->hostap_snapshot);
+	if (snap && !hostap_event_key(key, ifname, op_code))
+		dispatch = (dwpald_hostap_dispatch*)hash_table_find(snap->hostap_events, key);
 
 	/* Call events, should not be called under mutex to avoid deadlocks */
-	for (i = 0; i < num_events; i++)
-		event_callback[i](ifname, op_code, event_msg, event_msg_len);
+	for (i = 0; dispatch && i < dispatch->num_clb; i++)
+		dispatch->clb[i](ifname, op_code, event_msg, event_msg_len);
+
+	dwpald_snapshot_put(snap);
 
 	/* INTERFACE_* events can be generated by dwpal/dwpald regardless of the client's subscription state,
 	   so don't report an error if no handler is registered. */
-	if (!found && !intf_event) {
+	if (!dispatch && !intf_event) {
 		LOG(2, "Received event '%s' not registered to", op_code);
 		return 1;
 	}
@@ -844,9 +1037,10 @@ static int dwpald_receive_drv_event(wv_ipc_msg *event, dwpald_header *hdr)
 	size_t event_data_size = wave_ipc_msg_get_size(event);
 	uint16_t data_size = wv_aligned_16_bit_fetch(&hdr->header[3]);
 	int event_id;
-	int found = 0;
-	int i, num_events = 0;
-	driver_nl_event_clb event_callback[MAX_NUM_CB_EVENTS];
+	uint32_t nl_id;
+	size_t i;
+	dwpald_snapshot *snap;
+	dwpald_drv_dispatch *dispatch;
 
 	if (event_data == NULL) {
 		BUG("event_data is NULL");
@@ -872,34 +1066,22 @@ static int dwpald_receive_drv_event(wv_ipc_msg *event, dwpald_header *hdr)
 
 	event_data += hdr->header[2];
 
-	MUTEX_LOCK(&dwpald_conn->drv_nl_attach_lock);
-	if (!dwpald_conn->drv_nl_attch) {
+	snap = dwpald_snapshot_get(&dwpald_conn->drv_snapshot);
+	if (!snap) {
 		BUG("received drv event wile not attached");
-		MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
 		return 1;
 	}
 
-	list_foreach_start(dwpald_conn->drv_nl_attch->drv_events, drv_event, dwpald_driver_nl_event_with_id)
-		if (drv_event->nl_id != (uint32_t)event_id)
-			continue;
-
-		list_foreach_start(drv_event->drv_clb_id_list, drv_clb, dwpald_drv_clb_id)
-			if (num_events >= MAX_NUM_CB_EVENTS) {
-				BUG("Reached limit for number of supported drv event callbacks");
-				break;
-			}
-			event_callback[num_events++] = drv_clb->drv_clb;
-		list_foreach_end
-		found = 1;
-		break;
-	list_foreach_end
-	MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
+	nl_id = (uint32_t)event_id;
+	dispatch = (dwpald_drv_dispatch*)hash_table_find(snap->drv_events, &nl_id);
 
 	/* Call events, should not be called under mutex to avoid deadlocks */
-	for (i = 0; i < num_events; i++)
-		event_callback[i](ifname, event_id, event_data, data_size);
+	for (i = 0; dispatch && i < dispatch->num_clb; i++)
+		dispatch->clb[i](ifname, event_id, event_data, data_size);
+
+	dwpald_snapshot_put(snap);
 
-	if (!found) {
+	if (!dispatch) {
 		LOG(2, "Received event '%d' not registered to", event_id);
 		return 1;
 	}
@@ -910,38 +1092,26 @@ static int dwpald_receive_drv_event(wv_ipc_msg *event, dwpald_header *hdr)
 static int dwpald_receive_kernel_event(wv_ipc_msg *event)
 {
 	struct nl_msg *msg = dwpald_nl_msg_from_ipc_msg(event);
-	int i, num_events = 0;
-	nl80211_event_clb event_callback[MAX_NUM_CB_EVENTS];
+	dwpald_snapshot *snap;
+	size_t i;
 
 	if (msg == NULL) {
 		ELOG("got NULL nl_msg");
 		return 1;
 	}
 
-	MUTEX_LOCK(&dwpald_conn->drv_nl_attach_lock);
-	if (!dwpald_conn->drv_nl_attch) {
+	snap = dwpald_snapshot_get(&dwpald_conn->drv_snapshot);
+	if (!snap) {
 		BUG("received nl event while not attached");
-		MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
 		nlmsg_free(msg);
 		return 1;
 	}
 
-	if (dwpald_conn->drv_nl_attch->nl_event_cb)
-	{
-		list_foreach_start(dwpald_conn->drv_nl_attch->nl_event_cb, clb, dwpald_nl_event_clb_id)
-			if (num_events >= MAX_NUM_CB_EVENTS) {
-				BUG("Reached limit for number of supported kernel event callbacks");
-				break;
-			}
-			event_callback[num_events++] = clb->nl_event_id;
-		list_foreach_end
-	}
-	MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
-
 	/* Call events, should not be called under mutex to avoid deadlocks */
-	for (i = 0; i < num_events; i++)
-		event_callback[i](msg);
+	for (i = 0; i < snap->num_kernel_clb; i++)
+		snap->kernel_clb[i](msg);
 
+	dwpald_snapshot_put(snap);
 	nlmsg_free(msg);
 	return 0;
 }
@@ -1211,6 +1381,68 @@ err:
 }
 #endif
 
+dwpald_ret dwpald_get_metrics(char *reply, size_t *reply_len)
+{
+	wv_ipc_msg *msg, *response = NULL;
+	dwpald_header cmd_hdr = { 0 }, resp_hdr;
+	wv_ipc_ret ipc_ret;
+	char *resp_data;
+	size_t resp_data_size;
+
+	if (reply == NULL || reply_len == NULL || *reply_len == 0) {
+		ELOG("invalid parameters");
+		return DWPALD_ERROR;
+	}
+
+	if (dwpald_conn == NULL) {
+		ELOG("dwpald client is not connected");
+		return DWPALD_ERROR;
+	}
+
+	if ((msg = wave_ipc_msg_alloc()) == NULL)
+		return DWPALD_ERROR;
+
+	cmd_hdr.header[0] = DWPALD_METRICS_REQ;
+	dwpald_header_push(msg, &cmd_hdr);
+
+	ipc_ret = wave_ipcc_send_cmd(dwpald_conn->client_handle,
+				     msg, &response);
+	wave_ipc_msg_put(msg);
+	if (ipc_ret != WAVE_IPC_SUCCESS) {
+		ELOG("ipcc_send_cmd returned err (ret=%d)", ipc_ret);
+		goto err;
+	}
+
+	if (dwpald_header_pop(response, &resp_hdr) ||
+	    resp_hdr.header[0] != DWPALD_METRICS_RESP) {
+		BUG("response header is corrupted");
+		goto err;
+	}
+
+	if (resp_hdr.header[1])
+		LOG(1, "metrics report was truncated by dwpald");
+
+	resp_data = wave_ipc_msg_get_data(response);
+	resp_data_size = wave_ipc_msg_get_size(response);
+	if (*reply_len <= resp_data_size) {
+		ELOG("reply_len(%zu) <= resp_data_size (%zu)", *reply_len, resp_data_size);
+		goto err;
+	}
+
+	if (resp_data_size)
+		memcpy_s(reply, *reply_len, resp_data, resp_data_size);
+	reply[resp_data_size] = '\0';
+	*reply_len = resp_data_size;
+
+	wave_ipc_msg_put(response);
+	return DWPALD_SUCCESS;
+
+err:
+	if (response)
+		wave_ipc_msg_put(response);
+	return DWPALD_ERROR;
+}
+
 bool dwpald_connected(void)
 {
 	return (dwpald_conn != NULL);
@@ -1245,6 +1477,7 @@ dwpald_ret dwpald_connect(const char *prog_name)
 
 	DWPAL_CHECK_RET(pthread_mutex_init(&conn->hap_attach_lock, NULL));
 	DWPAL_CHECK_RET(pthread_mutex_init(&conn->drv_nl_attach_lock, NULL));
+	DWPAL_CHECK_RET(pthread_mutex_init(&conn->snapshot_lock, NULL));
 
 	dwpald_conn = conn;
 
@@ -1271,11 +1504,16 @@ dwpald_ret dwpald_disconnect(void)
 		wave_ipcc_stop_listener(dwpald_conn->client_handle);
 	}
 
+	wave_ipcc_disconnect(&dwpald_conn->client_handle);
+
+	/* no event is dispatched anymore */
+	dwpald_snapshot_put(dwpald_conn->hostap_snapshot);
+	dwpald_snapshot_put(dwpald_conn->drv_snapshot);
+
+	DWPAL_CHECK_RET(pthread_mutex_destroy(&dwpald_conn->snapshot_lock));
 	DWPAL_CHECK_RET(pthread_mutex_destroy(&dwpald_conn->drv_nl_attach_lock));
 	DWPAL_CHECK_RET(pthread_mutex_destroy(&dwpald_conn->hap_attach_lock));
 
-	wave_ipcc_disconnect(&dwpald_conn->client_handle);
-
 	list_delete_all(dwpald_conn->hostap_attachments, free_hostap_attachment, dwpald_hostap_attachment);
 	list_free(dwpald_conn->hostap_attachments);
 
@@ -1430,14 +1668,38 @@ static int dwpald_add_kernel_events(l_list *kernel_clb, nl80211_event_clb kernel
 	return 0;
 }
 
+/* Undoes dwpald_add_hostap_events(): removes the callbacks listed in 'added'
+ * and the events left without callbacks */
+static void dwpald_remove_hostap_callbacks(l_list *events, l_list *added)
+{
+	list_foreach_start(events, hap_event, dwpald_hostap_event_with_id)
+		list_foreach_start(hap_event->dwpald_hostap_clb_id_list, clb, dwpald_hostap_clb_id)
+			if (!list_remove(added, clb)) {
+				free_hostap_clb_id(clb);
+				list_foreach_remove_current_entry()
+			}
+		list_foreach_end
+
+		if (0 == list_get_size(hap_event->dwpald_hostap_clb_id_list)) {
+			free_hostap_event_with_id(hap_event);
+			list_foreach_remove_current_entry()
+		}
+	list_foreach_end
+}
+
+/* The callbacks added are listed in 'added', also on failure, for
+ * dwpald_remove_hostap_callbacks() */
 static int dwpald_add_hostap_events(l_list *events, const dwpald_hostap_event *hostap_events,
-					size_t num_hap_events, unsigned int id)
+					size_t num_hap_events, unsigned int id, l_list *added)
 {
 	unsigned int i = 0;
 	bool evt_found = false, clb_found = false;
+	dwpald_hostap_event_with_id *new_event;
+	dwpald_hostap_clb_id *new_clb;
 
 	for (i = 0; i < num_hap_events; i++) { // loop through all events
 		evt_found = false;
+		clb_found = false;
 		list_foreach_start(events, hap_event, dwpald_hostap_event_with_id) // search if event already exists
 			if (!strncmp(hap_event->op_code, hostap_events[i].op_code, hostap_events[i].op_code_len)) {
 				evt_found = true;
@@ -1452,8 +1714,15 @@ static int dwpald_add_hostap_events(l_list *events, const dwpald_hostap_event *h
 				if (!clb_found) {
 					/* new callback registration for existing event */
 					// DLOG("Adding callback for %s", hap_event->op_code);
-					if (dwpald_push_hostap_callback(hap_event->dwpald_hostap_clb_id_list, hostap_events[i].hapd_clb, id))
+					new_clb = dwpald_push_hostap_callback(hap_event->dwpald_hostap_clb_id_list,
+									      hostap_events[i].hapd_clb, id);
+					if (!new_clb)
+						return -1;
+					if (list_push_back(added, new_clb)) {
+						list_remove(hap_event->dwpald_hostap_clb_id_list, new_clb);
+						free_hostap_clb_id(new_clb);
 						return -1;
+					}
 				}
 				break;
 			}
@@ -1463,6 +1732,12 @@ static int dwpald_add_hostap_events(l_list *events, const dwpald_hostap_event *h
 			// DLOG("Adding new event for %s", hostap_events[i].op_code);
 			if (dwpald_copy_hostap_events(events, 1, &hostap_events[i], id))
 				return -1;
+			/* the new event is pushed to the front, with its only callback */
+			new_event = (dwpald_hostap_event_with_id*)list_peek_front(events);
+			if (list_push_back(added, list_peek_front(new_event->dwpald_hostap_clb_id_list))) {
+				free_hostap_event_with_id(list_pop_front(events));
+				return -1;
+			}
 		}
 	}
 
@@ -1529,11 +1804,21 @@ dwpald_ret dwpald_hostap_attach_ex_with_id(const char *ifname, size_t num_hap_ev
 			if (id != DEFAULT_ATTACH_ID)
 			{
 				size_t event_size_before_push = list_get_size(hap_attch->hostap_events);
-				if (dwpald_add_hostap_events(hap_attch->hostap_events, hostap_events, num_hap_events, id))
+				l_list *added = list_init();
+
+				/* on failure, the events added are removed again so the
+				 * list stays in sync with the snapshot */
+				if (!added ||
+				    dwpald_add_hostap_events(hap_attch->hostap_events, hostap_events, num_hap_events, id, added) ||
+				    dwpald_hostap_snapshot_update())
 				{
+					if (added)
+						dwpald_remove_hostap_callbacks(hap_attch->hostap_events, added);
+					list_free(added);
 					MUTEX_UNLOCK(&dwpald_conn->hap_attach_lock);
 					return DWPALD_ERROR;
 				}
+				list_free(added);
 				if (event_size_before_push != list_get_size(hap_attch->hostap_events))
 				{
 					if (DWPALD_SUCCESS != dwpald_send_hostap_update_event(ifname, hap_attch->hostap_events)) {
@@ -1587,6 +1872,12 @@ dwpald_ret dwpald_hostap_attach_ex_with_id(const char *ifname, size_t num_hap_ev
 
 	/* update events handlers */
 	list_push_back(dwpald_conn->hostap_attachments, hap_attachment);
+	if (dwpald_hostap_snapshot_update()) {
+		list_remove(dwpald_conn->hostap_attachments, hap_attachment);
+		dwpald_send_hostap_detach(ifname);
+		ret = DWPALD_ERROR;
+		goto err;
+	}
 
 	/* finalize */
 	bConnected = (hap_attachment->state == INTERFACE_DWPAL_STATE_CONNECTED);
@@ -1677,6 +1968,7 @@ dwpald_ret dwpald_hostap_detach_with_id(const char *ifname, unsigned int id)
 			else
 				ret = dwpald_send_hostap_update_event(ifname,
 						hap_attch->hostap_events);
+			dwpald_hostap_snapshot_update();
 			break;
 		}
 	list_foreach_end
@@ -1742,6 +2034,11 @@ dwpald_ret dwpald_nl_drv_attach_with_id(size_t num_drv_events,
 						return DWPALD_ERROR;
 					}
 				}
+
+				if (dwpald_drv_snapshot_update()) {
+					MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
+					return DWPALD_ERROR;
+				}
 		}
 		MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
 		return DWPALD_SUCCESS;
@@ -1776,6 +2073,11 @@ dwpald_ret dwpald_nl_drv_attach_with_id(size_t num_drv_events,
 	}
 
 	dwpald_conn->drv_nl_attch = drv_nl_attachment;
+	if (dwpald_drv_snapshot_update()) {
+		dwpald_conn->drv_nl_attch = NULL;
+		ret = DWPALD_ERROR;
+		goto err;
+	}
 	MUTEX_UNLOCK(&dwpald_conn->drv_nl_attach_lock);
 
 	return DWPALD_SUCCESS;
@@ -1807,8 +2109,20 @@ static const char* _dwpal_ret_to_string(DWPAL_Ret val)
 	}
 }
 
+void dwpald_deadline_after_ms(struct timespec *deadline, unsigned int ms)
+{
+	wave_ipc_deadline_after_ms(deadline, ms);
+}
+
 dwpald_ret dwpald_hostap_cmd(const char *ifname, const char *cmd, size_t len,
 			     char *reply, size_t *reply_len)
+{
+	return dwpald_hostap_cmd_deadline(ifname, cmd, len, reply, reply_len, NULL);
+}
+
+dwpald_ret dwpald_hostap_cmd_deadline(const char *ifname, const char *cmd, size_t len,
+				      char *reply, size_t *reply_len,
+				      const struct timespec *deadline)
 {
 	wv_ipc_msg *msg, *response = NULL;
 	dwpald_header cmd_hdr = { 0 }, resp_hdr;
@@ -1839,8 +2153,8 @@ dwpald_ret dwpald_hostap_cmd(const char *ifname, const char *cmd, size_t len,
 	if (cmd[len - 1] != '\0')
 		wave_ipc_msg_append_data(msg, "\0", 1);
 
-	ipc_ret = wave_ipcc_send_cmd(dwpald_conn->client_handle,
-				     msg, &response);
+	ipc_ret = wave_ipcc_send_cmd_deadline(dwpald_conn->client_handle,
+					      msg, &response, deadline);
 	wave_ipc_msg_put(msg);
 	if (ipc_ret != WAVE_IPC_SUCCESS) {
 		ELOG("'%s': ipcc_send_cmd() returned err (ret=%d)", ifname, ipc_ret);
@@ -1920,7 +2234,8 @@ err:
 }
 
 static dwpald_ret dwpald_send_nl_command_to_daemon(struct nl_msg *msg,
-						   wv_ipc_msg **reply)
+						   wv_ipc_msg **reply,
+						   const struct timespec *deadline)
 {
 	wv_ipc_msg *ipc_cmd = dwpald_ipc_msg_from_nl_msg(msg);
 	dwpald_header hdr = { 0 };
@@ -1935,7 +2250,8 @@ static dwpald_ret dwpald_send_nl_command_to_daemon(struct nl_msg *msg,
 	if (dwpald_header_push(ipc_cmd, &hdr))
 		goto err;
 
-	ipc_ret = wave_ipcc_send_cmd(dwpald_conn->client_handle, ipc_cmd, &local_reply);
+	ipc_ret = wave_ipcc_send_cmd_deadline(dwpald_conn->client_handle, ipc_cmd,
+					      &local_reply, deadline);
 	wave_ipc_msg_put(ipc_cmd);
 	if (ipc_ret != WAVE_IPC_SUCCESS) {
 		ELOG("ipcc_send_cmd() returned err (ret=%d)", ipc_ret);
@@ -1956,6 +2272,15 @@ err:
 dwpald_ret dwpald_drv_get(char *ifname, unsigned int command_id, int *cmd_res,
 			  void *in_data, size_t in_data_size,
 			  void *out_data, size_t *out_data_size)
+{
+	return dwpald_drv_get_deadline(ifname, command_id, cmd_res, in_data,
+				       in_data_size, out_data, out_data_size, NULL);
+}
+
+dwpald_ret dwpald_drv_get_deadline(char *ifname, unsigned int command_id, int *cmd_res,
+				   void *in_data, size_t in_data_size,
+				   void *out_data, size_t *out_data_size,
+				   const struct timespec *deadline)
 {
 	struct nl_msg *msg;
 	struct nl_msg *reply = NULL;
@@ -1985,7 +2310,7 @@ dwpald_ret dwpald_drv_get(char *ifname, unsigned int command_id, int *cmd_res,
 	    nla_put(msg, NL80211_ATTR_VENDOR_DATA, in_data_size, in_data) < 0)
 		goto err;
 
-	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply);
+	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply, deadline);
 	if (ret != DWPALD_SUCCESS) {
 		ELOG("sending nl command to daemon failed, ret=%d (%s)", ret, dwpald_ret_to_string(ret));
 		goto err;
@@ -2085,7 +2410,7 @@ dwpald_ret dwpald_drv_set(char *ifname, unsigned int command_id, int *cmd_res,
 	    nla_put(msg, NL80211_ATTR_VENDOR_DATA, vendor_data_size, vendor_data) < 0)
 		goto err;
 
-	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply);
+	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply, NULL);
 	if (ret != DWPALD_SUCCESS) {
 		ELOG("sending nl command to daemon failed, ret=%d (%s)", ret, dwpald_ret_to_string(ret));
 		goto err;
@@ -2188,6 +2513,13 @@ dwpald_ret dwpald_nl80211_id_get(int *nl80211_id)
 
 dwpald_ret dwpald_nl80211_cmd_send(struct nl_msg *msg, nl80211_cmd_clb cmd_cb,
 				   int *cmd_res, void *cb_arg)
+{
+	return dwpald_nl80211_cmd_send_deadline(msg, cmd_cb, cmd_res, cb_arg, NULL);
+}
+
+dwpald_ret dwpald_nl80211_cmd_send_deadline(struct nl_msg *msg, nl80211_cmd_clb cmd_cb,
+					    int *cmd_res, void *cb_arg,
+					    const struct timespec *deadline)
 {
 	wv_ipc_msg *ipc_reply = NULL;
 	dwpald_header resp_hdr = { 0 };
@@ -2205,7 +2537,7 @@ dwpald_ret dwpald_nl80211_cmd_send(struct nl_msg *msg, nl80211_cmd_clb cmd_cb,
 	if (cmd_res == NULL)
 		goto err;
 
-	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply);
+	ret = dwpald_send_nl_command_to_daemon(msg, &ipc_reply, deadline);
 	if (ret != DWPALD_SUCCESS) {
 		ELOG("sending nl command to daemon failed, ret=%d (%s)", ret, dwpald_ret_to_string(ret));
 		goto err;
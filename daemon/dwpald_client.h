@@ -14,6 +14,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include <libnl3/netlink/genl/genl.h>
 #include <net/if.h>
 
@@ -73,6 +74,13 @@ static inline void dwpald_unit_test_mode(void) { }
 static inline dwpald_ret dwpald_term_daemon(void) { return DWPALD_ERROR; }
 #endif
 
+/* Get the runtime metrics report of the daemon: command latency histograms,
+ * event rates, serializer queues, pending messages of the clients and ipc
+ * message pools. 'reply' gets the NUL terminated text, 'reply_len' is its size
+ * on input and the length of the text on output */
+#define DWPALD_METRICS_MAX_LEN		(20 * 1024) /* WAVE_IPC_BUFF_SIZE */
+dwpald_ret dwpald_get_metrics(char *reply, size_t *reply_len);
+
 /* Check if current code is executed in events thread context */
 bool dwpald_is_events_thread_context(void);
 
@@ -119,12 +127,25 @@ dwpald_ret dwpald_nl_drv_attach_with_id(size_t num_drv_events,
 				const dwpald_driver_nl_event *driver_events,
 				nl80211_event_clb nl_event_cb, unsigned int id);
 
+/* The _deadline variants give up at 'deadline', an absolute CLOCK_MONOTONIC
+ * time, instead of after the default timeout (20 sec). The daemon drops the
+ * command if it didn't start running it by then. A NULL deadline means the
+ * default timeout */
+void dwpald_deadline_after_ms(struct timespec *deadline, unsigned int ms);
+
 dwpald_ret dwpald_hostap_cmd(const char *ifname, const char *cmd, size_t len,
 			     char *reply, size_t *reply_len);
+dwpald_ret dwpald_hostap_cmd_deadline(const char *ifname, const char *cmd, size_t len,
+				      char *reply, size_t *reply_len,
+				      const struct timespec *deadline);
 
 dwpald_ret dwpald_drv_get(char *ifname, unsigned int command_id, int *cmd_res,
 			  void *in_data, size_t in_data_size,
 			  void *out_data, size_t *out_data_size);
+dwpald_ret dwpald_drv_get_deadline(char *ifname, unsigned int command_id, int *cmd_res,
+				   void *in_data, size_t in_data_size,
+				   void *out_data, size_t *out_data_size,
+				   const struct timespec *deadline);
 
 dwpald_ret dwpald_drv_set(char *ifname, unsigned int command_id, int *cmd_res,
 			  const void *vendor_data, size_t vendor_data_size);
@@ -133,6 +154,9 @@ dwpald_ret dwpald_nl80211_id_get(int *nl80211_id);
 
 dwpald_ret dwpald_nl80211_cmd_send(struct nl_msg *msg, nl80211_cmd_clb cmd_cb,
 				   int *cmd_res, void *cb_arg);
+dwpald_ret dwpald_nl80211_cmd_send_deadline(struct nl_msg *msg, nl80211_cmd_clb cmd_cb,
+					    int *cmd_res, void *cb_arg,
+					    const struct timespec *deadline);
 
 dwpald_ret dwpald_ieee80211_scan_trigger(char *ifname, scan_params *params,
 					 int *cmd_res);
@@ -149,6 +149,8 @@ int main(int argc, char *argv[])
 	char cmd1[] = "STATUS", cmd2[] = "PING";
 	char reply[4096];
 	size_t reply_len;
+	static char metrics[DWPALD_METRICS_MAX_LEN + 1];
+	size_t metrics_len;
 	int res = 0, wait_count = 0;
 	scan_params params = { 0 };
 	bg_scan_params_t scan_params_old = { 0 }, scan_params_new = { 0 };
@@ -325,6 +327,13 @@ int main(int argc, char *argv[])
 	else if (res < 0)
 		ELOG("res=%d", res);
 
+	LOG(1, "sending GET METRICS command");
+	metrics_len = sizeof(metrics);
+	if (dwpald_get_metrics(metrics, &metrics_len) != DWPALD_SUCCESS)
+		ELOG("dwpald_get_metrics returned err");
+	else
+		LOG(1, "dwpald metrics:\n%s", metrics);
+
 end:
 	LOG(1, "detaching from dwpal daemon");
 	ret = dwpald_disconnect();
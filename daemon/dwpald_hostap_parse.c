@@ -37,6 +37,12 @@
 #define ARRAY_SIZE(__array) (sizeof(__array) / sizeof(typeof((__array)[0])) + MUST_BE_ARRAY(__array))
 #endif
 
+/* Numeric values are converted from a copy, longer values are truncated */
+#define PARSE_NUM_VALUE_LENGTH	64
+
+/* The parser state of fieldsToParse[] up to this size is kept on the stack */
+#define PARSE_LOCAL_FIELDS	128
+
 
 /* Convert regular string to hex string */
 static inline void _char_to_hex(const char c, char *out)
@@ -88,20 +94,15 @@ failure:
 	return false;
 }
 
-bool dwpald_hex_to_str(char *out_str, size_t size, const char *hex_str)
+static bool _hex_span_to_str(char *out_str, size_t size, const char *hex_str, size_t len)
 {
-	size_t len;
-	if (size == 0)
-		return false;
-
-	len = strnlen_s(hex_str, (size+1)*2);
 	if (len/2 + 1 > size)
 		goto failure;
 
 	if ((len & 1) != 0)
 		goto failure;
 
-	while (*hex_str) {
+	for (; len; len -= 2) {
 		int c = _hex_to_byte(hex_str);
 		if (c < 0) goto failure;
 		*out_str = (char)c;
@@ -115,6 +116,14 @@ failure:
 	return false;
 }
 
+bool dwpald_hex_to_str(char *out_str, size_t size, const char *hex_str)
+{
+	if (size == 0)
+		return false;
+
+	return _hex_span_to_str(out_str, size, hex_str, strnlen_s(hex_str, (size+1)*2));
+}
+
 
 /**************************************************************************/
 /*! \fn int dwpald_hostap_cmd_build(char *out, size_t size,
@@ -291,366 +300,6 @@ int dwpald_hostap_cmd_format(char *out, size_t size,
 }
 
 
-static bool isColumnOfFields(const char *msg, const char *endFieldName[])
-{
-	int i = 0, numOfFieldsInLine = 0;
-
-	//LOG(2,"%s; line= '%s'", __FUNCTION__, msg);
-
-	if (endFieldName == NULL)
-	{
-		ELOG("%s; endFieldName= 'NULL' ==> not a column!", __FUNCTION__);
-		return false;
-	}
-
-	while (strncmp(endFieldName[i], "\n", 1))
-	{  /* run over all field names in the string */
-		if (strstr(msg, endFieldName[i]) != NULL)
-		{
-			numOfFieldsInLine++;
-
-			if (numOfFieldsInLine > 1)
-			{
-				//LOG(2,"%s; Not a column (numOfFieldsInLine= %d) ==> return!", __FUNCTION__, numOfFieldsInLine);
-				return false;
-			}
-
-			/* Move ahead inside the line, to avoid double recognition (like "PacketsSent" and "DiscardPacketsSent") */
-			msg += strnlen_s(endFieldName[i], HOSTAPD_TO_DWPAL_MSG_LENGTH);
-		}
-
-		i++;
-	}
-
-	//LOG(2,"%s; It is a column (numOfFieldsInLine= %d)", __FUNCTION__, numOfFieldsInLine);
-
-	return true;
-}
-
-
-static bool mandatoryFieldValueGet(char *buf, size_t *bufLen, char **p2str, size_t totalSizeOfArg, char fieldValue[] /*OUT*/)
-{
-	char *param = strtok_s(buf, bufLen, " ", p2str);
-
-	if (param == NULL)
-	{
-		ELOG("%s; param is NULL ==> Abort!", __FUNCTION__);
-		return false;
-	}
-
-	if (fieldValue != NULL)
-	{
-		if (strcpy_s(fieldValue, totalSizeOfArg, param)) {
-			ELOG("%s; param ('%s') size (%zu) is higher than allocated size (%zu) ==> Abort!", __FUNCTION__,
-				param, strnlen_s(param, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH) + 1, totalSizeOfArg);
-			return false;
-		}
-	}
-
-	return true;
-}
-
-
-static bool arrayValuesGet(char *stringOfValues, size_t totalSizeOfArg, ParamParsingType paramParsingType, size_t *numOfValidArgs /*OUT*/, void *array /*OUT*/)
-{
-	/* fill in the output array with list of integer elements (from decimal/hex base), for example:
-	   "SupportedRates=2 4 11 22 12 18 24 36 48 72 96 108" or "HT_MCS=FF FF FF 00 00 00 00 00 00 00 C2 01 01 00 00 00"
-	   also, in case of "DWPAL_STR_ARRAY_PARAM", handle multiple repetitive field, for example:
-	   "... non_pref_chan=81:200:1:5 non_pref_chan=81:100:2:9 non_pref_chan=81:200:1:7 non_pref_chan=81:100:2:5 ..." or
-	   "... non_pref_chan=81:200:1:5 81:100:2:9 81:200:1:7 81:100:2:5 ..." */
-
-	size_t  idx = 0;
-	char    *p2str, *param, *tokenString;
-	rsize_t dmaxLen = strnlen_s(stringOfValues, DWPAL_TO_HOSTAPD_MSG_LENGTH);
-
-	tokenString = stringOfValues;
-
-	switch (paramParsingType) {
-		case DWPALD_TYPE_INT_ARRAY:
-		case DWPALD_TYPE_HEX_ARRAY:
-			totalSizeOfArg /= sizeof(int);
-			break;
-		case DWPALD_TYPE_STR_ARRAY:
-			totalSizeOfArg /= sizeof(dwpald_string);
-			break;
-		default:
-			break;
-	}
-
-	do
-	{
-		param = strtok_s(tokenString, &dmaxLen, " ", &p2str);
-		if (param == NULL)
-		{
-			((int *)array)[idx] = 0;
-			break;
-		}
-
-		if (idx < totalSizeOfArg)
-		{
-			if (numOfValidArgs != NULL)
-			{
-				(*numOfValidArgs)++;
-			}
-
-			switch (paramParsingType) {
-			case DWPALD_TYPE_HEX_ARRAY:
-				((int *)array)[idx] = strtol(param, NULL, 16);
-				break;
-			case DWPALD_TYPE_INT_ARRAY:
-				((int *)array)[idx] = strtol(param, NULL, 0);
-				break;
-			case DWPALD_TYPE_STR_ARRAY:
-				strcpy_s(&(((char *)array)[idx * HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH]), HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH, param);
-				break;
-			default:
-				ELOG("%s; Invalid type  ==> Abort!", __FUNCTION__);
-				return false;
-				break;
-			}
-		}
-
-		tokenString = NULL;
-
-		idx++;
-	} while (idx < DWPAL_MAX_NUM_OF_ELEMENTS);  /* allow up to 512 elements per field (array) */
-
-	if (idx > totalSizeOfArg)
-	{
-		ELOG("%s; actual number of arguments (%zu) is bigger/equal then totalSizeOfArg (%zu) ==> Abort!", __FUNCTION__, idx, totalSizeOfArg);
-		return false;
-	}
-
-	return true;
-}
-
-
-static bool fieldValuesGet(char *buf, size_t bufLen, ParamParsingType parsingType, const char *stringToSearch, const char *endFieldName[], char *stringOfValues /*OUT*/)
-{
-	/* handles list of fields, one by one in the same row, for example: "... btm_supported=1 ..." or
-	   "... SupportedRates=2 4 11 22 12 18 24 36 48 72 96 108 ..." */
-
-	char    *stringStart, *stringEnd, *restOfStringStart, *closerStringEnd = NULL;
-	char    *localBuf = NULL;
-	char    *localStringToSearch = NULL;
-	int     i, idx=0, numOfCharacters = 0, numOfCharactersToCopy = 0;
-	bool    isFirstEndOfString = true, ret = false;
-	char    *tempStringOfValues=NULL, *localEndFieldName=NULL;
-	int		status;
-
-	tempStringOfValues = (char *)malloc(HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
-	if (tempStringOfValues == NULL)
-	{
-		ELOG("%s; malloc failed ==> Abort!", __FUNCTION__);
-		goto failure;
-	}
-
-	localEndFieldName = (char *)malloc(HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
-	if (localEndFieldName == NULL)
-	{
-		ELOG("%s; malloc failed ==> Abort!", __FUNCTION__);
-		goto failure;
-	}
-
-	localBuf = (char *)malloc(bufLen + 2 /* '\0' & 'blank' */);
-	if (localBuf == NULL)
-	{
-		ELOG("%s; malloc failed ==> Abort!", __FUNCTION__);
-		goto failure;
-	}
-
-	/* Add ' ' at the beginning of a string - to handle a case in which the buf starts with the
-	   value of stringToSearch, like buf= 'candidate=d8:fe:e3:3e:bd:14,2178,83,5,7,255 candidate=...' */
-	status = sprintf_s(localBuf, bufLen + 2, " %s", buf);
-	if (status <= 0)
-		ELOG("%s; sprintf_s failed!", __FUNCTION__);
-
-	/* localStringToSearch set to stringToSearch with addition of " " at the beginning -
-	   it is a MUST in order to differentiate between "ssid" and "bssid" */
-	localStringToSearch = (char *)malloc(strnlen_s(stringToSearch, DWPAL_FIELD_NAME_LENGTH) + 2 /*'\0' & 'blank' */);
-	if (localStringToSearch == NULL)
-	{
-		ELOG("%s; localStringToSearch is NULL ==> Abort!", __FUNCTION__);
-		goto failure;
-	}
-
-	status = sprintf_s(localStringToSearch, DWPAL_FIELD_NAME_LENGTH, " %s", stringToSearch);
-	if (status <= 0)
-		ELOG("%s; sprintf_s failed!", __FUNCTION__);
-
-	restOfStringStart = localBuf;
-
-	while ( (stringStart = strstr(restOfStringStart, localStringToSearch)) != NULL )
-	{
-		ret = true;  /* mark that at least one fiels was found */
-
-		/* move the string pointer to the beginning of the field's value */
-		restOfStringStart = stringStart + strnlen_s(localStringToSearch, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
-		//LOG(2,"%s; stringStart= 0x%x, strlen of ('%s')= %d ==> restOfStringStart= 0x%x",
-			   //__FUNCTION__, (unsigned int)stringStart, localStringToSearch, strnlen_s(localStringToSearch, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH), (unsigned int)restOfStringStart);
-
-		/* find all beginning of all other fields (and get the closest to the current field) in order to know where the field's value ends */
-		i = 0;
-		while (strncmp(endFieldName[i], "\n", 1))
-		{  /* run over all field names in the string */
-			status = sprintf_s(localEndFieldName, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH, " %s", endFieldName[i]);  /* in order to differentiate between VHT_MCS and HT_MCS */
-			if (status <= 0)
-				ELOG("%s; sprintf_s failed!", __FUNCTION__);
-			stringEnd = strstr(restOfStringStart, localEndFieldName);
-			if (stringEnd != NULL)
-			{
-				stringEnd++;  /* move one character ahead due to the ' ' at the beginning of localEndFieldName */
-				//LOG(2,"%s; localEndFieldName= '%s' FOUND! (i= %d)", __FUNCTION__, localEndFieldName, i);
-				if (isFirstEndOfString)
-				{
-					isFirstEndOfString = false;
-					closerStringEnd = stringEnd;
-				}
-				else
-				{  /* Make sure that closerStringEnd will point to the closest field ahead */
-					closerStringEnd = (stringEnd < closerStringEnd)? stringEnd : closerStringEnd;
-				}
-
-				//LOG(2,"%s; inside the 'while': closerStringEnd= 0x%x", __FUNCTION__, (unsigned int)closerStringEnd);
-			}
-
-			i++;
-		}
-
-		//LOG(2,"%s; after the 'while': closerStringEnd= 0x%x", __FUNCTION__, (unsigned int)closerStringEnd);
-
-		if (closerStringEnd == NULL)
-		{  /* Meaning, this is the last parameter in the string */
-			//LOG(2,"%s; closerStringEnd is NULL; restOfStringStart= '%s'", __FUNCTION__, restOfStringStart);
-			closerStringEnd = restOfStringStart + strnlen_s(restOfStringStart, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH) + 1 /* for '\0' */;
-			//LOG(2,"%s; closerStringEnd is 'NULL': closerStringEnd= 0x%x", __FUNCTION__, (unsigned int)closerStringEnd);
-
-			//LOG(2,"%s; String end did NOT found ==> set closerStringEnd to the end of buf; closerStringEnd= 0x%x", __FUNCTION__, (unsigned int)closerStringEnd);
-		}
-
-		//LOG(2,"%s; stringToSearch= '%s'; restOfStringStart= '%s'; buf= '%s'", __FUNCTION__, stringToSearch, restOfStringStart, buf);
-		//LOG(2,"%s; restOfStringStart= 0x%x, closerStringEnd= 0x%x ==> characters to copy = %d", __FUNCTION__, (unsigned int)restOfStringStart, (unsigned int)closerStringEnd, closerStringEnd - restOfStringStart);
-
-		/* set 'numOfCharacters' with the number of characters to copy (including the blank or end-of-string at the end) */
-		numOfCharacters = closerStringEnd - restOfStringStart;
-		if (numOfCharacters <= 0)
-		{
-			ELOG("%s; numOfCharacters= %d ==> Abort!", __FUNCTION__, numOfCharacters);
-			ret = false;
-			goto failure;
-		}
-
-		if (numOfCharacters >= (int)HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH)
-		{
-			ELOG("%s; numOfCharacters (%d) >= HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH (%d) ==> Abort!", __FUNCTION__, numOfCharacters, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
-			ret = false;
-			goto failure;
-		}
-
-		/* Copy the characters of the value, and set the last one to '\0' */
-		strncpy_s(tempStringOfValues, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH, restOfStringStart, numOfCharacters);
-		tempStringOfValues[numOfCharacters - 1] = '\0';
-		//LOG(2,"%s; stringToSearch= '%s'; tempStringOfValues= '%s'", __FUNCTION__, stringToSearch, tempStringOfValues);
-
-		/* Check if all elements are valid; if an element of an array contains "=", it is NOT valid ==> do NOT copy it! */
-		for (i=0; i < numOfCharacters; i++)
-		{
-			if ( (parsingType == DWPALD_TYPE_STR_ARRAY) ||
-			     (parsingType == DWPALD_TYPE_INT_ARRAY) ||
-				 (parsingType == DWPALD_TYPE_HEX_ARRAY) )
-			{
-				if ( (tempStringOfValues[i] == '=') || (tempStringOfValues[i] == '\0') )
-				{
-					numOfCharactersToCopy = i + 1 /* convert index to number-of */;
-					break;  /* Only in case of array of values, do NOT allow "=" character */
-				}
-			}
-			else if ( (tempStringOfValues[i] == ' ') || (tempStringOfValues[i] == '\0') )
-			{
-				numOfCharactersToCopy = i + 1 /* convert index to number-of */;
-				break;
-			}
-		}
-
-		strncpy_s(&stringOfValues[idx], HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH, restOfStringStart, numOfCharactersToCopy);
-		idx += numOfCharactersToCopy;
-		stringOfValues[idx] = '\0';
-
-		//LOG(2,"%s; stringToSearch= '%s'; stringOfValues= '%s'", __FUNCTION__, stringToSearch, stringOfValues);
-
-		closerStringEnd = NULL;
-	}
-
-	/* Remove all ' ' from the end of the string */
-	for (i= idx-1; i > 0; i--)
-	{
-		if (stringOfValues[i] != ' ')
-		{
-			break;  /* Stop removing the ' ' characters when the first non-blank character was found! */
-		}
-		stringOfValues[i] = '\0';
-	}
-
-	//LOG(2,"%s; stringToSearch= '%s'; stringOfValues= '%s'", __FUNCTION__, stringToSearch, stringOfValues);
-
-failure:
-	free(localBuf);
-	free(localStringToSearch);
-	free(tempStringOfValues);
-	free(localEndFieldName);
-
-	//LOG(2,"%s; ret= %d, stringToSearch= '%s'; stringOfValues= '%s'", __FUNCTION__, ret, stringToSearch, stringOfValues);
-
-	return ret;
-}
-
-static bool columnOfParamsToRowConvert(char *msg, size_t msgLen, const char *endFieldName[])
-{
-	char    *localMsg = strdup(msg), *lineMsg, *p2str;
-	rsize_t dmaxLen = (rsize_t)msgLen;
-	bool    isColumn = true;
-	size_t  i;
-
-	if (localMsg == NULL)
-	{
-		ELOG("%s; strdup error ==> Abort!", __FUNCTION__);
-		return false;
-	}
-
-	lineMsg = strtok_s(localMsg, &dmaxLen, "\n", &p2str);
-
-	while (lineMsg != NULL)
-	{
-		isColumn = isColumnOfFields(lineMsg, endFieldName);
-
-		if (isColumn == false)
-		{
-			//console_printf("%s; Not a column ==> break!", __FUNCTION__);
-			break;
-		}
-
-		lineMsg = strtok_s(NULL, &dmaxLen, "\n", &p2str);
-	}
-
-	free (localMsg);
-
-	if (isColumn)
-	{
-		/* Modify the column string to be in ONE raw  */
-		for (i=0; i < msgLen; i++)
-		{
-			if (msg[i] == '\n')
-			{
-				msg[i] = ' ';
-			}
-		}
-
-		msg[msgLen] = '\0';
-	}
-
-	return true;
-}
-
 static inline bool is_array_field(dwpald_type type)
 {
 	return (
@@ -722,8 +371,23 @@ static size_t get_field_size(dwpald_fields_to_parse *field)
 	}
 }
 
-static bool set_field(void *field, dwpald_fields_to_parse *fieldToParse, const char *stringOfValues)
+/* Copy a value span into a terminated buffer for the numeric conversions */
+static const char * value_to_num_str(char num[PARSE_NUM_VALUE_LENGTH], const char *value, size_t len)
+{
+	if (len >= PARSE_NUM_VALUE_LENGTH)
+		len = PARSE_NUM_VALUE_LENGTH - 1;
+
+	if (len)
+		memcpy_s(num, PARSE_NUM_VALUE_LENGTH, value, len);
+	num[len] = '\0';
+
+	return num;
+}
+
+static bool set_field(void *field, dwpald_fields_to_parse *fieldToParse, const char *value, size_t len)
 {
+	char num[PARSE_NUM_VALUE_LENGTH];
+
 	switch (fieldToParse->type)
 	{
 		case DWPALD_TYPE_DUMMY:
@@ -731,18 +395,20 @@ static bool set_field(void *field, dwpald_fields_to_parse *fieldToParse, const c
 			return true;
 
 		case DWPALD_TYPE_STR:
-			if (0 != strcpy_s(field, fieldToParse->totalSizeOfArg, stringOfValues))
+			if (len >= fieldToParse->totalSizeOfArg)
 			{
 				ELOG("%s; string length (%zu) is bigger the allocated string size (%zu)",
-							__FUNCTION__, strnlen_s(stringOfValues, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH) + 1,
-							fieldToParse->totalSizeOfArg);
+							__FUNCTION__, len + 1, fieldToParse->totalSizeOfArg);
 				/* longer string then allocated ==> Abort! */
 				return false;
 			}
+			if (len)
+				memcpy_s(field, fieldToParse->totalSizeOfArg, value, len);
+			((char *)field)[len] = '\0';
 			break;
 
 		case DWPALD_TYPE_HEXSTR:
-			if (!dwpald_hex_to_str(field, fieldToParse->totalSizeOfArg, stringOfValues))
+			if (!_hex_span_to_str(field, fieldToParse->totalSizeOfArg, value, len))
 			{
 				ELOG("%s; hex string to regular string conversion error", __FUNCTION__);
 				return false;
@@ -750,47 +416,47 @@ static bool set_field(void *field, dwpald_fields_to_parse *fieldToParse, const c
 			break;
 
 		case DWPALD_TYPE_CHAR:
-			*(char *)field = stringOfValues[0];
+			*(char *)field = len ? value[0] : '\0';
 			break;
 
 		case DWPALD_TYPE_INT8:
-			*(int8_t *)field = (int8_t)strtol(stringOfValues, NULL, 0);
+			*(int8_t *)field = (int8_t)strtol(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_UINT8:
-			*(uint8_t *)field = (uint8_t)strtol(stringOfValues, NULL, 0);
+			*(uint8_t *)field = (uint8_t)strtol(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_SHORT:
-			*(short*)field = (short)strtol(stringOfValues, NULL, 0);
+			*(short*)field = (short)strtol(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_USHORT:
-			*(unsigned short*)field = (unsigned short)strtol(stringOfValues, NULL, 0);
+			*(unsigned short*)field = (unsigned short)strtol(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_INT:
-			*(int *)field = strtol(stringOfValues, NULL, 0);
+			*(int *)field = strtol(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_UINT:
-			*(unsigned int *)field = strtoul(stringOfValues, NULL, 0);
+			*(unsigned int *)field = strtoul(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_INT64:
-			*(int64_t*)field = strtoll(stringOfValues, NULL, 0);
+			*(int64_t*)field = strtoll(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_UINT64:
-			*(uint64_t*)field = strtoull(stringOfValues, NULL, 0);
+			*(uint64_t*)field = strtoull(value_to_num_str(num, value, len), NULL, 0);
 			break;
 
 		case DWPALD_TYPE_HEX:
-			*(int *)field = strtol(stringOfValues, NULL, 16);
+			*(int *)field = strtol(value_to_num_str(num, value, len), NULL, 16);
 			break;
 
 		case DWPALD_TYPE_BOOL:
-			*(bool*)field = atoi(stringOfValues);
+			*(bool*)field = atoi(value_to_num_str(num, value, len));
 			break;
 
 		case DWPALD_TYPE_STR_ARRAY:
@@ -833,6 +499,362 @@ static void cleanup_all_fields(dwpald_fields_to_parse fields[])
 	}
 }
 
+/* The reply is split once into blank separated tokens. A token that starts
+   with a prefix of fieldsToParse[] is a key, its value follows the prefix.
+   Arrays take the following tokens as well, up to the next key or up to an
+   unknown "name=value" token. Prefixes that end with their first '=' are
+   found by hashing the token up to its first '=', others are compared one
+   by one (usually there are none). Values are written straight into the
+   output fields. */
+
+typedef struct _parse_field
+{
+	size_t prefix_len;
+	int    next;   /* next field in the same hash bucket or list, -1 at the end */
+	size_t count;  /* values found in the current line */
+} parse_field;
+
+typedef struct _parse_ctx
+{
+	dwpald_fields_to_parse *fields;
+	int          num_fields;
+	parse_field *pf;
+	int         *buckets;
+	size_t       num_buckets;  /* power of 2 */
+	int          loose;        /* list of fields with a prefix which isn't hashed */
+	int          mandatory;    /* list of the fields without prefix, in order */
+	size_t       sizeOfStruct;
+	size_t       userBufLen;
+	size_t       lineIdx;
+	int          array;        /* array field taking the following tokens, -1 if none */
+} parse_ctx;
+
+static inline bool is_delimiter(char c)
+{
+	return (c == ' ' || c == '\n');
+}
+
+/* FNV-1a */
+static size_t parse_hash(const char *key, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h ^= (unsigned char)*key++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static inline void * parse_line_field(parse_ctx *ctx, dwpald_fields_to_parse *f)
+{
+	/* the output of the n-th line is the n-th element of the user array */
+	return (char *)f->field + (ctx->lineIdx * ctx->sizeOfStruct);
+}
+
+static bool parse_ctx_init(parse_ctx *ctx)
+{
+	int i;
+	size_t b;
+
+	ctx->loose = -1;
+	ctx->mandatory = -1;
+	ctx->array = -1;
+
+	for (b = 0; b < ctx->num_buckets; b++)
+		ctx->buckets[b] = -1;
+
+	/* lists are built backwards to keep the order of fieldsToParse[] */
+	for (i = ctx->num_fields - 1; i >= 0; i--) {
+		dwpald_fields_to_parse *f = &ctx->fields[i];
+		parse_field *pf = &ctx->pf[i];
+		const char *eq;
+
+		pf->next = -1;
+		pf->count = 0;
+
+		if (f->type == DWPALD_TYPE_DUMMY)
+			continue;
+
+		if (!f->prefix) {
+			if (is_array_field(f->type)) {
+				ELOG("%s; array type %u must have a prefix ==> Abort!", __FUNCTION__, f->type);
+				return false;
+			}
+			pf->next = ctx->mandatory;
+			ctx->mandatory = i;
+			continue;
+		}
+
+		pf->prefix_len = strnlen_s(f->prefix, DWPAL_FIELD_NAME_LENGTH);
+		if (!pf->prefix_len)
+			continue;
+
+		eq = memchr(f->prefix, '=', pf->prefix_len);
+		if (eq == f->prefix + pf->prefix_len - 1) {
+			b = parse_hash(f->prefix, pf->prefix_len) & (ctx->num_buckets - 1);
+			pf->next = ctx->buckets[b];
+			ctx->buckets[b] = i;
+		} else {
+			pf->next = ctx->loose;
+			ctx->loose = i;
+		}
+	}
+
+	return true;
+}
+
+/* Writes the end mark of an array if it isn't full */
+static void parse_array_end(parse_ctx *ctx)
+{
+	dwpald_fields_to_parse *f;
+	size_t count;
+	char *array;
+
+	if (ctx->array < 0)
+		return;
+
+	f = &ctx->fields[ctx->array];
+	count = ctx->pf[ctx->array].count;
+	array = parse_line_field(ctx, f);
+	ctx->array = -1;
+
+	if (f->type == DWPALD_TYPE_STR_ARRAY) {
+		if (count < f->totalSizeOfArg / sizeof(dwpald_string))
+			((dwpald_string *)array)[count][0] = '\0';
+	} else if (count < f->totalSizeOfArg / sizeof(int)) {
+		((int *)array)[count] = 0;
+	}
+}
+
+static bool parse_array_value(parse_ctx *ctx, const char *value, size_t len)
+{
+	dwpald_fields_to_parse *f = &ctx->fields[ctx->array];
+	parse_field *pf = &ctx->pf[ctx->array];
+	char *array = parse_line_field(ctx, f);
+	size_t max = f->totalSizeOfArg;
+	char num[PARSE_NUM_VALUE_LENGTH];
+
+	max /= (f->type == DWPALD_TYPE_STR_ARRAY) ? sizeof(dwpald_string) : sizeof(int);
+	if (pf->count >= max) {
+		ELOG("%s; number of values of '%s' is bigger than the array size (%zu) ==> Abort!",
+		     __FUNCTION__, f->prefix, max);
+		return false;
+	}
+
+	switch (f->type) {
+		case DWPALD_TYPE_STR_ARRAY:
+		{
+			char *str = ((dwpald_string *)array)[pf->count];
+
+			if (len >= sizeof(dwpald_string)) {
+				ELOG("%s; string length (%zu) of '%s' is bigger the string size (%zu) ==> Abort!",
+				     __FUNCTION__, len + 1, f->prefix, sizeof(dwpald_string));
+				return false;
+			}
+			if (len)
+				memcpy_s(str, sizeof(dwpald_string), value, len);
+			str[len] = '\0';
+			break;
+		}
+		case DWPALD_TYPE_INT_ARRAY:
+			((int *)array)[pf->count] = strtol(value_to_num_str(num, value, len), NULL, 0);
+			break;
+		case DWPALD_TYPE_HEX_ARRAY:
+			((int *)array)[pf->count] = strtol(value_to_num_str(num, value, len), NULL, 16);
+			break;
+		default:
+			ELOG("%s; Invalid type  ==> Abort!", __FUNCTION__);
+			return false;
+	}
+
+	pf->count++;
+	if (f->numOfValidArgs)
+		(*f->numOfValidArgs)++;
+
+	return true;
+}
+
+static bool parse_key_value(parse_ctx *ctx, int i, const char *value, const char *end)
+{
+	dwpald_fields_to_parse *f = &ctx->fields[i];
+	parse_field *pf = &ctx->pf[i];
+	size_t len = 0;
+	char *field;
+
+	while (value + len < end && !is_delimiter(value[len]))
+		len++;
+
+	if (!f->field)
+		return true;
+
+	if (is_array_field(f->type)) {
+		/* a repeated array field continues from its last value */
+		ctx->array = i;
+		if (!len)
+			return true;
+		if (memchr(value, '=', len)) {
+			parse_array_end(ctx);
+			return true;
+		}
+		return parse_array_value(ctx, value, len);
+	}
+
+	field = parse_line_field(ctx, f);
+	if (pf->count++ == 0)
+		return set_field(field, f, value, len);
+
+	/* values of a repeated string field are separated by a blank */
+	if (f->type == DWPALD_TYPE_STR && len) {
+		size_t cur = strnlen_s(field, f->totalSizeOfArg);
+
+		if (cur + 1 + len >= f->totalSizeOfArg) {
+			ELOG("%s; string length (%zu) is bigger the allocated string size (%zu)",
+			     __FUNCTION__, cur + len + 2, f->totalSizeOfArg);
+			return false;
+		}
+		field[cur] = ' ';
+		memcpy_s(field + cur + 1, f->totalSizeOfArg - cur - 1, value, len);
+		field[cur + 1 + len] = '\0';
+	}
+
+	return true;
+}
+
+/* Returns the number of fields the token is a key of, or -1 on failure. If
+   'apply' is not set, the values are not parsed */
+static int parse_token_keys(parse_ctx *ctx, const char *tok, size_t tok_len,
+			    const char *end, bool apply)
+{
+	const char *eq = memchr(tok, '=', tok_len);
+	int i, matches = 0;
+
+	if (eq) {
+		size_t key_len = eq - tok + 1;
+
+		i = ctx->buckets[parse_hash(tok, key_len) & (ctx->num_buckets - 1)];
+		for (; i >= 0; i = ctx->pf[i].next) {
+			if (ctx->pf[i].prefix_len != key_len ||
+			    strncmp(tok, ctx->fields[i].prefix, key_len))
+				continue;
+
+			/* any key ends the values of the previous array */
+			if (apply && !matches)
+				parse_array_end(ctx);
+			matches++;
+			if (apply && !parse_key_value(ctx, i, tok + key_len, end))
+				return -1;
+		}
+	}
+
+	for (i = ctx->loose; i >= 0; i = ctx->pf[i].next) {
+		size_t len = ctx->pf[i].prefix_len;
+
+		if ((size_t)(end - tok) < len || strncmp(tok, ctx->fields[i].prefix, len))
+			continue;
+
+		if (apply && !matches)
+			parse_array_end(ctx);
+		matches++;
+		if (apply && !parse_key_value(ctx, i, tok + len, end))
+			return -1;
+	}
+
+	return matches;
+}
+
+static inline const char * token_end(const char *tok, const char *end)
+{
+	while (tok < end && !is_delimiter(*tok))
+		tok++;
+	return tok;
+}
+
+/* A reply in which no line has more than one key is a column of fields,
+   it is parsed as one line */
+static bool parse_is_column(parse_ctx *ctx, const char *msg, const char *end)
+{
+	const char *tok = msg;
+	int keys_in_line = 0;
+
+	while (tok < end) {
+		const char *tok_end;
+
+		if (*tok == '\n')
+			keys_in_line = 0;
+		if (is_delimiter(*tok)) {
+			tok++;
+			continue;
+		}
+
+		tok_end = token_end(tok, end);
+		keys_in_line += parse_token_keys(ctx, tok, tok_end - tok, end, false);
+		if (keys_in_line > 1)
+			return false;
+		tok = tok_end;
+	}
+
+	return true;
+}
+
+static bool parse_line(parse_ctx *ctx, const char *line, const char *end)
+{
+	const char *tok = line;
+	int i, mandatory = ctx->mandatory;
+
+	if (ctx->sizeOfStruct && ctx->lineIdx * ctx->sizeOfStruct >= ctx->userBufLen) {
+		ELOG("%s; user did not allocate enough buffer for receiving all lines ==> Abort!", __FUNCTION__);
+		return false;
+	}
+
+	for (i = 0; i < ctx->num_fields; i++)
+		ctx->pf[i].count = 0;
+	ctx->array = -1;
+
+	while (tok < end) {
+		const char *tok_end;
+		int keys;
+
+		if (is_delimiter(*tok)) {
+			tok++;
+			continue;
+		}
+		tok_end = token_end(tok, end);
+
+		/* parameters without prefix take the first tokens of the line */
+		if (mandatory >= 0) {
+			dwpald_fields_to_parse *f = &ctx->fields[mandatory];
+
+			if (f->field && !set_field(parse_line_field(ctx, f), f, tok, tok_end - tok))
+				return false;
+			mandatory = ctx->pf[mandatory].next;
+		}
+
+		keys = parse_token_keys(ctx, tok, tok_end - tok, end, true);
+		if (keys < 0)
+			return false;
+
+		if (!keys && ctx->array >= 0) {
+			if (memchr(tok, '=', tok_end - tok))
+				parse_array_end(ctx);
+			else if (!parse_array_value(ctx, tok, tok_end - tok))
+				return false;
+		}
+
+		tok = tok_end;
+	}
+
+	parse_array_end(ctx);
+
+	if (mandatory >= 0) {
+		ELOG("%s; mandatory parameter is missing ==> Abort!", __FUNCTION__);
+		return false;
+	}
+
+	return true;
+}
+
 /**************************************************************************/
 /*! \fn bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		dwpald_fields_to_parse fieldsToParse[], size_t userBufLen)
@@ -848,16 +870,14 @@ bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		dwpald_fields_to_parse fieldsToParse[], size_t userBufLen)
 {
 	bool ret = false;
-	int       i = 0, idx = 0, numOfNameArrayArgs = 0, lineIdx = 0;
-	bool      isEndFieldNameAllocated = false;
-	char      *stringOfValues = NULL;
-	char      *lineMsg, *localMsg, *p2str = NULL, *p2strMandatory = NULL;
-	rsize_t   dmaxLen, dmaxLenMandatory;
-	size_t    sizeOfStruct = 0, msgStringLen;
-	const char **endFieldName = NULL;
-	char      *localMsgDup = NULL;
-
-	//LOG(0, "#### %s() start: %s", __FUNCTION__, msg);
+	int       i = 0, numOfNameArrayArgs = 0;
+	size_t    sizeOfStruct = 0, msgStringLen, num_buckets;
+	const char *line, *end;
+	parse_ctx ctx;
+	/* scratch of the parser, allocated only for very long fieldsToParse[] */
+	parse_field local_pf[PARSE_LOCAL_FIELDS];
+	int       local_buckets[PARSE_LOCAL_FIELDS * 2];
+	void      *scratch = NULL;
 
 	if (!fieldsToParse)
 	{
@@ -878,13 +898,6 @@ bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		goto failure;
 	}
 
-	stringOfValues = (char *)malloc(HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
-	if (!stringOfValues)
-	{
-		ELOG("%s; malloc failed ==> Abort!", __FUNCTION__);
-		goto failure;
-	}
-
 	/* Check for failure strings */
 	if (strncmp(msg, "UNKNOWN", sizeof("UNKNOWN")-1) == 0)
 	{
@@ -897,9 +910,6 @@ bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		goto failure;
 	}
 
-	/* Convert msgLen to string length format (without the '\0' character) */
-	msgLen = dmaxLen = msgStringLen;
-
 	/* Set values for 'numOfNameArrayArgs' and 'sizeOfStruct' */
 	for (i = 0; fieldsToParse[i].type < DWPALD_TYPE_MAXCOUNT
 			 && fieldsToParse[i].type != DWPALD_TYPE_END; i++)
@@ -907,7 +917,7 @@ bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		if (DWPALD_TYPE_DUMMY == fieldsToParse[i].type)
 			continue;
 
-		/* Set numOfNameArrayArgs with the number of endFieldName arguments - needed for the dynamic allocation */
+		/* Set numOfNameArrayArgs with the number of prefixed fields - needed for the size of the hash index */
 		if (fieldsToParse[i].prefix)
 		{
 			numOfNameArrayArgs++;
@@ -971,174 +981,69 @@ bool dwpald_hostap_response_parse(char *msg, size_t msgLen,
 		}
 	}
 
-	/* Allocate and set the value for each endFieldName[] string */
-	if (numOfNameArrayArgs > 0)
-	{
-		numOfNameArrayArgs++;  /* for the last allocated argument */
-
-		endFieldName = calloc(numOfNameArrayArgs, sizeof(typeof(*endFieldName)));
-		if (!endFieldName)
-		{
-			ELOG("%s; malloc endFieldName failed ==> Abort!", __FUNCTION__);
-			goto failure;
-		}
+	/* Hash index of the prefixes, kept at most half full */
+	for (num_buckets = 2; num_buckets < (size_t)numOfNameArrayArgs * 2; num_buckets <<= 1);
 
-		idx = 0;
-		for (i = 0; fieldsToParse[i].type < DWPALD_TYPE_MAXCOUNT
-				 && fieldsToParse[i].type != DWPALD_TYPE_END
-				 && idx < (numOfNameArrayArgs-1); i++)
-		{
-			if (fieldsToParse[i].prefix)
-			{
-				/* Just copy pointer to the prefix string into array */
-				endFieldName[idx] = fieldsToParse[i].prefix;
-				idx++;
-			}
-		}
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.fields = fieldsToParse;
+	ctx.num_fields = i;
+	ctx.num_buckets = num_buckets;
+	ctx.sizeOfStruct = sizeOfStruct;
+	ctx.userBufLen = userBufLen;
 
-		endFieldName[idx] = "\n";
-		isEndFieldNameAllocated = true;
+	if (ctx.num_fields <= PARSE_LOCAL_FIELDS && num_buckets <= ARRAY_SIZE(local_buckets))
+	{
+		ctx.pf = local_pf;
+		ctx.buckets = local_buckets;
 	}
-
-	/* In case of a column, convert it to one raw */
-	if ( isEndFieldNameAllocated )
+	else
 	{
-		if (!columnOfParamsToRowConvert(msg, msgLen , endFieldName))
+		scratch = malloc(ctx.num_fields * sizeof(parse_field) + num_buckets * sizeof(int));
+		if (!scratch)
 		{
-			ELOG("%s; columnOfParamsToRowConvert error ==> Abort!", __FUNCTION__);
+			ELOG("%s; malloc failed ==> Abort!", __FUNCTION__);
 			goto failure;
 		}
+		ctx.pf = (parse_field *)scratch;
+		ctx.buckets = (int *)(ctx.pf + ctx.num_fields);
 	}
 
+	if (!parse_ctx_init(&ctx))
+		goto failure;
 
-	/* Perform the actual parsing */
-	lineMsg = strtok_s(msg, &dmaxLen, "\n", &p2str);
-	localMsg = lineMsg;
-	lineIdx = 0;
-	localMsgDup = NULL;
+	end = msg + msgStringLen;
 
-	while (lineMsg)
+	/* In case of a column, parse it as one row */
+	if (numOfNameArrayArgs > 0 && parse_is_column(&ctx, msg, end))
 	{
-		void *field;
-
-		/* Handle mandatory parameters WITHOUT any string-prefix */
-		if (localMsg)
-		{
-			localMsgDup = strdup(localMsg);
-			if (!localMsgDup)
-			{
-				ELOG("%s; localMsgDup is NULL, Failed strdup ==> Abort!", __FUNCTION__);
-				goto failure;
-			}
-			dmaxLenMandatory = strnlen_s(localMsgDup, HOSTAPD_TO_DWPAL_MSG_LENGTH);
-			//LOG(2, "dmaxLenMandatory=%u", dmaxLenMandatory);
-		}
-
-		for (i = 0; fieldsToParse[i].type < DWPALD_TYPE_MAXCOUNT
-				 && fieldsToParse[i].type != DWPALD_TYPE_END; i++)
+		if (msgStringLen && !parse_line(&ctx, msg, end))
+			goto failure;
+	}
+	else
+	{
+		/* Perform the actual parsing, line by line */
+		for (line = msg; line < end; line++)
 		{
-			if (DWPAL_DUMMY_PARAM == fieldsToParse[i].type)
-				continue;
-
-			if (fieldsToParse[i].field == NULL)
-			{
-				field = NULL;
-			}
-			else
-			{
-				if (lineIdx * sizeOfStruct >= userBufLen)
-				{
-					ELOG("%s; user did not allocate enough buffer for receiving all lines ==> Abort!", __FUNCTION__);
-					goto failure;
-				}
-				/* set the output parameter - move it to the next array index (needed when parsing many lines) */
-				field = (void *)((char*)fieldsToParse[i].field + (lineIdx * sizeOfStruct));
-				//LOG(2,"%s; lineIdx= %d, sizeOfStruct= %d, field= 0x%x", __FUNCTION__, lineIdx, sizeOfStruct, (unsigned int)field);
-			}
+			const char *line_end = memchr(line, '\n', end - line);
 
-			/* reset the string value array */
-			memset(stringOfValues, 0, HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH);
+			if (!line_end)
+				line_end = end;
 
-			if (!is_array_field(fieldsToParse[i].type))
+			if (line_end > line)
 			{
-				/* Common processing for all fields which can be mandatory */
-				if (fieldsToParse[i].prefix == NULL)
-				{
-					/* Mandatory field: parse parameter always */
-					if (mandatoryFieldValueGet(((localMsg != NULL)? localMsgDup : NULL) /*will be NULL starting from 2nd param*/,
-											   &dmaxLenMandatory,
-											   &p2strMandatory,
-											   HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH,
-											   stringOfValues /*OUT*/) == false)
-					{
-						ELOG("%s; mandatory parameter is missing ==> Abort!", __FUNCTION__);
-						goto failure;
-					}
-
-					/* If necessary, copy the value into the resulting variable */
-					if (field)
-					{
-						if (!set_field(field, &fieldsToParse[i], stringOfValues))
-							goto failure;
-					}
-				}
-				else if (field)
-				{
-					if (!endFieldName)
-						goto failure;
-					/* Trying to parse named parameter */
-					if (fieldValuesGet(lineMsg, msgLen, fieldsToParse[i].type, fieldsToParse[i].prefix, endFieldName, stringOfValues) == true)
-					{
-						/* Parameter was found, copy the value into the resulting variable */
-						if (!set_field(field, &fieldsToParse[i], stringOfValues))
-							goto failure;
-					}
-				}
-			}
-			else {
-				/* Array fields must have prefix string */
-				if (isEndFieldNameAllocated == false)
-				{
-					ELOG("%s; array type %u; isEndFieldNameAllocated=false ==> Abort!", __FUNCTION__, fieldsToParse[i].type);
+				if (!parse_line(&ctx, line, line_end))
 					goto failure;
-				}
-
-				if (field)
-				{
-					/* Trying to parse named parameter */
-					if (fieldValuesGet(lineMsg, msgLen, fieldsToParse[i].type, fieldsToParse[i].prefix, endFieldName, stringOfValues) == true)
-					{
-						if (arrayValuesGet(stringOfValues,
-								fieldsToParse[i].totalSizeOfArg,
-								fieldsToParse[i].type,
-								fieldsToParse[i].numOfValidArgs, (char *)field) == false)
-						{
-							ELOG("%s; arrayValuesGet ERROR", __FUNCTION__);
-							goto failure;
-						}
-					}
-				}
+				ctx.lineIdx++;
 			}
 
-			//LOG(2, "dmaxLenMandatory=%u, p2strMandatory=%s", dmaxLenMandatory, p2strMandatory);
-			localMsg = NULL;  /* for 2nd, 3rd, ... parameter */
+			line = line_end;
 		}
-
-		free(localMsgDup); localMsgDup = NULL;
-
-		lineMsg = strtok_s(NULL, &dmaxLen, "\n", &p2str);
-		lineIdx++;
-		localMsg = lineMsg;
 	}
 
 	ret = true;
 
 failure:
-	/* free the allocated string array (if needed) */
-	free(localMsgDup);
-	free(endFieldName);
-	free(stringOfValues);
-	//LOG(0, "#### %s() end", __FUNCTION__);
+	free(scratch);
 	return ret;
 }
 
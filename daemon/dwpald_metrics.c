@@ -0,0 +1,447 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "dwpald_metrics.h"
+#include "dwpal_daemon.h"
+#include "hash_table.h"
+#include "logs.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <net/if.h>
+
+#if defined YOCTO
+#include <slibc/string.h>
+#include <slibc/stdio.h>
+#else
+#include <stddef.h>
+#include "libsafec/safe_str_lib.h"
+#include "libsafec/safe_mem_lib.h"
+#endif
+
+#define METRICS_CMD_NAME_SIZE	(32)
+#define METRICS_OPCODE_SIZE	(64)
+#define METRICS_OTHER		"(other)"
+
+/* Upper bounds (msec) of the latency buckets, the last bucket is unbounded */
+static const unsigned int lat_bounds_ms[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000 };
+#define METRICS_LAT_BUCKETS	(sizeof(lat_bounds_ms) / sizeof(lat_bounds_ms[0]) + 1)
+
+/* Keys are compared and hashed as raw bytes, they must be zeroed before filled */
+typedef struct _cmd_key {
+	uint8_t iftype;
+	int ifindex;
+	char ifname[IFNAMSIZ + 1];
+	char cmd[METRICS_CMD_NAME_SIZE];
+} cmd_key;
+
+/* Counters are updated with atomic operations under the read lock of the
+ * metrics, so commands and events of different threads don't serialize */
+typedef struct _cmd_metrics {
+	cmd_key key;
+	uint64_t count;
+	uint64_t failed;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint32_t hist[METRICS_LAT_BUCKETS];
+} cmd_metrics;
+
+typedef struct _event_key {
+	uint8_t iftype;
+	char op_code[METRICS_OPCODE_SIZE];
+} event_key;
+
+typedef struct _event_metrics {
+	event_key key;
+	uint64_t count;
+	uint64_t sec;		/* second the events of sec_count arrived in */
+	uint32_t sec_count;
+	uint32_t peak_per_sec;
+} event_metrics;
+
+/* The write lock is taken only to create or free the tables and to add
+ * entries, which happens once per command or event type */
+static struct {
+	pthread_rwlock_t lock;
+	hash_table *cmds;
+	hash_table *events;
+	uint64_t start_us;
+	uint64_t expired_cmds;
+} metrics = { PTHREAD_RWLOCK_INITIALIZER, NULL, NULL, 0, 0 };
+
+static size_t metrics_key_hash(const void *key, size_t size)
+{
+	const unsigned char *p = (const unsigned char*)key;
+	uint32_t h = 2166136261u;
+
+	while (size--) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static size_t cmd_key_hash(const void *key)
+{
+	return metrics_key_hash(key, sizeof(cmd_key));
+}
+
+static int cmd_key_cmp(const void *key1, const void *key2)
+{
+	return memcmp(key1, key2, sizeof(cmd_key));
+}
+
+static size_t event_key_hash(const void *key)
+{
+	return metrics_key_hash(key, sizeof(event_key));
+}
+
+static int event_key_cmp(const void *key1, const void *key2)
+{
+	return memcmp(key1, key2, sizeof(event_key));
+}
+
+static void metrics_copy_name(char *dst, size_t size, const char *src, size_t len)
+{
+	if (len >= size)
+		len = size - 1;
+	if (len)
+		memcpy_s(dst, size, src, len);
+	dst[len] = '\0';
+}
+
+/* Must be called with the write lock held */
+static void metrics_entry_create(hash_table *ht, void *key, size_t key_size,
+				 size_t entry_size)
+{
+	void *entry;
+
+	if (hash_table_find(ht, key))
+		return;
+
+	entry = calloc(1, entry_size);
+	if (!entry)
+		return;
+
+	/* the key is the first field of the entry */
+	memcpy_s(entry, entry_size, key, key_size);
+	if (hash_table_insert(ht, entry, entry))
+		free(entry);
+}
+
+/* Must be called with the read lock held, which is dropped meanwhile if the
+ * entry is created. Returns the entry of 'key', or of 'other_key' once the
+ * table is full; NULL if the metrics are not initialized */
+static void * metrics_entry_get(hash_table **ht, void *key, void *other_key,
+				size_t key_size, size_t entry_size)
+{
+	void *entry;
+
+	if (!*ht)
+		return NULL;
+
+	entry = hash_table_find(*ht, key);
+	if (!entry && hash_table_get_size(*ht) >= DWPALD_METRICS_MAX_ENTRIES) {
+		key = other_key;
+		entry = hash_table_find(*ht, key);
+	}
+	if (entry)
+		return entry;
+
+	pthread_rwlock_unlock(&metrics.lock);
+	pthread_rwlock_wrlock(&metrics.lock);
+	if (*ht) {
+		if (!hash_table_find(*ht, key) &&
+		    hash_table_get_size(*ht) >= DWPALD_METRICS_MAX_ENTRIES)
+			key = other_key;
+		metrics_entry_create(*ht, key, key_size, entry_size);
+	}
+	pthread_rwlock_unlock(&metrics.lock);
+	pthread_rwlock_rdlock(&metrics.lock);
+
+	/* the tables may have been freed meanwhile */
+	return *ht ? hash_table_find(*ht, key) : NULL;
+}
+
+static void metrics_atomic_max_u64(uint64_t *max, uint64_t val)
+{
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur &&
+	       !__atomic_compare_exchange_n(max, &cur, val, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void metrics_atomic_max_u32(uint32_t *max, uint32_t val)
+{
+	uint32_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur &&
+	       !__atomic_compare_exchange_n(max, &cur, val, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static int metrics_entry_free(void *obj, void *arg)
+{
+	(void)arg;
+
+	free(obj);
+	return 1;
+}
+
+uint64_t dwpald_metrics_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int dwpald_metrics_init(void)
+{
+	pthread_rwlock_wrlock(&metrics.lock);
+	if (metrics.cmds) {
+		pthread_rwlock_unlock(&metrics.lock);
+		return 0;
+	}
+
+	metrics.cmds = hash_table_init(0, cmd_key_hash, cmd_key_cmp);
+	metrics.events = hash_table_init(0, event_key_hash, event_key_cmp);
+	if (!metrics.cmds || !metrics.events) {
+		if (metrics.cmds)
+			hash_table_free(metrics.cmds);
+		if (metrics.events)
+			hash_table_free(metrics.events);
+		metrics.cmds = NULL;
+		metrics.events = NULL;
+		pthread_rwlock_unlock(&metrics.lock);
+		return 1;
+	}
+
+	metrics.start_us = dwpald_metrics_now_us();
+	pthread_rwlock_unlock(&metrics.lock);
+
+	return 0;
+}
+
+void dwpald_metrics_deinit(void)
+{
+	pthread_rwlock_wrlock(&metrics.lock);
+	if (metrics.cmds) {
+		hash_table_walk(metrics.cmds, metrics_entry_free, NULL);
+		hash_table_free(metrics.cmds);
+		metrics.cmds = NULL;
+	}
+	if (metrics.events) {
+		hash_table_walk(metrics.events, metrics_entry_free, NULL);
+		hash_table_free(metrics.events);
+		metrics.events = NULL;
+	}
+	pthread_rwlock_unlock(&metrics.lock);
+}
+
+uint64_t dwpald_metrics_cmd_done(uint8_t iftype, const char *ifname, int ifindex,
+				 const char *cmd, size_t cmd_len,
+				 uint64_t start_us, bool failed)
+{
+	uint64_t now_us = dwpald_metrics_now_us();
+	uint64_t lat_us = now_us > start_us ? now_us - start_us : 0;
+	cmd_metrics *entry;
+	cmd_key key, other_key;
+	size_t i;
+
+	memset(&key, 0, sizeof(key));
+	key.iftype = iftype;
+	if (ifname)
+		metrics_copy_name(key.ifname, sizeof(key.ifname), ifname,
+				  strnlen_s(ifname, IFNAMSIZ));
+	else
+		key.ifindex = ifindex;
+	metrics_copy_name(key.cmd, sizeof(key.cmd), cmd, cmd ? cmd_len : 0);
+
+	for (i = 0; i < METRICS_LAT_BUCKETS - 1; i++) {
+		if (lat_us < (uint64_t)lat_bounds_ms[i] * 1000)
+			break;
+	}
+
+	memset(&other_key, 0, sizeof(other_key));
+	other_key.iftype = iftype;
+	metrics_copy_name(other_key.cmd, sizeof(other_key.cmd), METRICS_OTHER,
+			  sizeof(METRICS_OTHER) - 1);
+
+	pthread_rwlock_rdlock(&metrics.lock);
+	entry = (cmd_metrics*)metrics_entry_get(&metrics.cmds, &key, &other_key,
+						sizeof(key), sizeof(cmd_metrics));
+	if (entry) {
+		__atomic_add_fetch(&entry->count, 1, __ATOMIC_RELAXED);
+		if (failed)
+			__atomic_add_fetch(&entry->failed, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&entry->total_us, lat_us, __ATOMIC_RELAXED);
+		metrics_atomic_max_u64(&entry->max_us, lat_us);
+		__atomic_add_fetch(&entry->hist[i], 1, __ATOMIC_RELAXED);
+	}
+	pthread_rwlock_unlock(&metrics.lock);
+
+	return lat_us;
+}
+
+void dwpald_metrics_cmd_expired(void)
+{
+	__atomic_add_fetch(&metrics.expired_cmds, 1, __ATOMIC_RELAXED);
+}
+
+void dwpald_metrics_event(uint8_t iftype, const char *op_code, size_t op_code_len)
+{
+	uint64_t sec = dwpald_metrics_now_us() / 1000000;
+	event_metrics *entry;
+	event_key key, other_key;
+	uint64_t entry_sec;
+
+	memset(&key, 0, sizeof(key));
+	key.iftype = iftype;
+	metrics_copy_name(key.op_code, sizeof(key.op_code), op_code,
+			  op_code ? op_code_len : 0);
+
+	memset(&other_key, 0, sizeof(other_key));
+	other_key.iftype = iftype;
+	metrics_copy_name(other_key.op_code, sizeof(other_key.op_code), METRICS_OTHER,
+			  sizeof(METRICS_OTHER) - 1);
+
+	pthread_rwlock_rdlock(&metrics.lock);
+	entry = (event_metrics*)metrics_entry_get(&metrics.events, &key, &other_key,
+						  sizeof(key), sizeof(event_metrics));
+	if (entry) {
+		__atomic_add_fetch(&entry->count, 1, __ATOMIC_RELAXED);
+
+		/* the thread moving the entry to a new second restarts its count,
+		 * events racing with it may be accounted to either second */
+		entry_sec = __atomic_load_n(&entry->sec, __ATOMIC_RELAXED);
+		if (entry_sec != sec &&
+		    __atomic_compare_exchange_n(&entry->sec, &entry_sec, sec, false,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			__atomic_store_n(&entry->sec_count, 0, __ATOMIC_RELAXED);
+		metrics_atomic_max_u32(&entry->peak_per_sec,
+				       __atomic_add_fetch(&entry->sec_count, 1, __ATOMIC_RELAXED));
+	}
+	pthread_rwlock_unlock(&metrics.lock);
+}
+
+void metrics_text_printf(metrics_text *t, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (t->truncated || t->len + 1 >= t->size) {
+		t->truncated = true;
+		return;
+	}
+
+	va_start(args, fmt);
+	len = vsprintf_s(t->buf + t->len, t->size - t->len, fmt, args);
+	va_end(args);
+
+	if (len < 0 || (size_t)len >= t->size - t->len) {
+		/* drop the partial line */
+		t->buf[t->len] = '\0';
+		t->truncated = true;
+		return;
+	}
+
+	t->len += len;
+}
+
+const char * dwpald_metrics_iftype_name(uint8_t iftype)
+{
+	switch (iftype) {
+		case DWPALD_IF_TYPE_HOSTAP: return "hostap";
+		case DWPALD_IF_TYPE_DRIVER: return "driver";
+		case DWPALD_IF_TYPE_KERNEL: return "nl";
+		default: return "(unknown)";
+	}
+}
+
+static int cmd_metrics_print(void *obj, void *arg)
+{
+	cmd_metrics *entry = (cmd_metrics*)obj;
+	metrics_text *t = (metrics_text*)arg;
+	char ifname[IFNAMSIZ + 1];
+	const char *name = entry->key.ifname;
+	uint64_t count;
+	size_t i;
+
+	if (!name[0] && entry->key.ifindex) {
+		if (if_indextoname(entry->key.ifindex, ifname))
+			name = ifname;
+		else {
+			sprintf_s(ifname, sizeof(ifname), "ifindex%d", entry->key.ifindex);
+			name = ifname;
+		}
+	} else if (!name[0])
+		name = "-";
+
+	count = __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+	metrics_text_printf(t, "%s %s %s count=%llu failed=%llu avg_us=%llu max_us=%llu hist=",
+			    dwpald_metrics_iftype_name(entry->key.iftype), name, entry->key.cmd,
+			    (unsigned long long)count,
+			    (unsigned long long)__atomic_load_n(&entry->failed, __ATOMIC_RELAXED),
+			    (unsigned long long)(__atomic_load_n(&entry->total_us, __ATOMIC_RELAXED) /
+						 (count ? count : 1)),
+			    (unsigned long long)__atomic_load_n(&entry->max_us, __ATOMIC_RELAXED));
+	for (i = 0; i < METRICS_LAT_BUCKETS; i++)
+		metrics_text_printf(t, "%u%s", __atomic_load_n(&entry->hist[i], __ATOMIC_RELAXED),
+				    i < METRICS_LAT_BUCKETS - 1 ? "," : "\n");
+
+	return 0;
+}
+
+static int event_metrics_print(void *obj, void *arg)
+{
+	event_metrics *entry = (event_metrics*)obj;
+	metrics_text *t = (metrics_text*)arg;
+	uint64_t uptime_sec = (dwpald_metrics_now_us() - metrics.start_us) / 1000000;
+	uint64_t count = __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+
+	metrics_text_printf(t, "%s %s count=%llu avg_per_min=%llu peak_per_sec=%u\n",
+			    dwpald_metrics_iftype_name(entry->key.iftype), entry->key.op_code,
+			    (unsigned long long)count,
+			    (unsigned long long)(count * 60 / (uptime_sec ? uptime_sec : 1)),
+			    __atomic_load_n(&entry->peak_per_sec, __ATOMIC_RELAXED));
+
+	return 0;
+}
+
+void dwpald_metrics_print(metrics_text *t)
+{
+	size_t i;
+
+	pthread_rwlock_rdlock(&metrics.lock);
+	if (!metrics.cmds) {
+		pthread_rwlock_unlock(&metrics.lock);
+		return;
+	}
+
+	metrics_text_printf(t, "uptime_sec=%llu\n",
+			    (unsigned long long)((dwpald_metrics_now_us() - metrics.start_us) / 1000000));
+	metrics_text_printf(t, "expired_cmds=%llu\n",
+			    (unsigned long long)__atomic_load_n(&metrics.expired_cmds, __ATOMIC_RELAXED));
+
+	metrics_text_printf(t, "[commands] iftype ifname cmd, hist msec buckets:");
+	for (i = 0; i < METRICS_LAT_BUCKETS - 1; i++)
+		metrics_text_printf(t, " <%u", lat_bounds_ms[i]);
+	metrics_text_printf(t, " >=%u\n", lat_bounds_ms[i - 1]);
+	hash_table_walk(metrics.cmds, cmd_metrics_print, t);
+
+	metrics_text_printf(t, "[events] iftype op_code\n");
+	hash_table_walk(metrics.events, event_metrics_print, t);
+	pthread_rwlock_unlock(&metrics.lock);
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#ifndef __WAVE_DWPALD_METRICS__H__
+#define __WAVE_DWPALD_METRICS__H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Runtime metrics of the daemon: latency histograms of the commands per
+ * interface and command type, and the rate of the events per opcode. They
+ * are always collected and reported by DWPALD_METRICS_REQ.
+ * All functions are thread safe and do nothing before dwpald_metrics_init() */
+
+/* Max number of commands/events tracked. Beyond it new commands and events
+ * are accounted under "(other)" */
+#define DWPALD_METRICS_MAX_ENTRIES	(256)
+
+/* Text buffer the report is printed to. Printing stops once the buffer is
+ * full and 'truncated' is set */
+typedef struct _metrics_text {
+	char *buf;
+	size_t size;
+	size_t len;
+	bool truncated;
+} metrics_text;
+
+void metrics_text_printf(metrics_text *t, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+int dwpald_metrics_init(void);
+
+void dwpald_metrics_deinit(void);
+
+/* Monotonic time in usec, taken as the start time of a command */
+uint64_t dwpald_metrics_now_us(void);
+
+/* Account a command which started at 'start_us'. The command runs on 'ifname',
+ * or if it is NULL on the interface with index 'ifindex' (0 if unknown). 'cmd'
+ * is the command type, it doesn't have to be NUL terminated. Returns the
+ * latency of the command in usec */
+uint64_t dwpald_metrics_cmd_done(uint8_t iftype, const char *ifname, int ifindex,
+				 const char *cmd, size_t cmd_len,
+				 uint64_t start_us, bool failed);
+
+/* Account a command dropped since its deadline passed before it ran */
+void dwpald_metrics_cmd_expired(void);
+
+/* Account an event, 'op_code' doesn't have to be NUL terminated */
+void dwpald_metrics_event(uint8_t iftype, const char *op_code, size_t op_code_len);
+
+/* Print the command and event metrics */
+void dwpald_metrics_print(metrics_text *t);
+
+const char * dwpald_metrics_iftype_name(uint8_t iftype);
+
+#endif /* __WAVE_DWPALD_METRICS__H__ */
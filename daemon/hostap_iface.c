@@ -12,6 +12,8 @@
 #include "dwpal_daemon.h"
 #include "dwpal_ext.h"
 #include "linked_list.h"
+#include "hash_table.h"
+#include "dwpald_metrics.h"
 #include "logs.h"
 
 #include <stdlib.h>
@@ -34,6 +36,9 @@
 #include <uci_wrapper.h>
 #endif
 
+/* Commands taking longer than this are logged */
+#define HOSTAP_CMD_SLOW_US	(200 * 1000)
+
 typedef struct _hostap_event {
 	char op_code[64];
 	l_list *registered_stations;
@@ -245,7 +250,7 @@ static void hostap_process_wds_sta_interface_added(const char* ifname, char* msg
 /****/
 
 static int hostap_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
-				  wv_ipstation *ipsta, uint8_t seq_num)
+				  wv_ipstation *ipsta, uint32_t seq_num)
 {
 	wv_ipc_msg *response;
 	char *reply;
@@ -256,6 +261,8 @@ static int hostap_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
 	char vap_name[IFNAMSIZ + 1] = { 0 };
 	char *cmd_data = wave_ipc_msg_get_data(cmd);
 	size_t cmd_data_size = wave_ipc_msg_get_size(cmd);
+	char *cmd_name_end;
+	uint64_t start_us, lat_us;
 
 	LOG(2, "executing hostapd command from serializer ctx");
 
@@ -288,11 +295,20 @@ static int hostap_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
 		return 1;
 	}
 
-	WV_TIMER_START
+	start_us = dwpald_metrics_now_us();
 	dpal_ret = dwpal_ext_hostap_cmd_send(vap_name, cmd_data, NULL,
 						reply, &reply_len);
-	WV_TIMER_ACTION_TOOK_LONGER_THAN(0, 200, "vap_name: '%s' cmd: '%s' dpal_ret=%d",
-						vap_name, cmd_data, dpal_ret)
+
+	/* the command type is the first word of the command */
+	cmd_name_end = memchr(cmd_data, ' ', cmd_data_size);
+	lat_us = dwpald_metrics_cmd_done(DWPALD_IF_TYPE_HOSTAP, vap_name, 0, cmd_data,
+					 cmd_name_end ? (size_t)(cmd_name_end - cmd_data) :
+							strnlen_s(cmd_data, cmd_data_size),
+					 start_us, dpal_ret != DWPAL_SUCCESS);
+	if (lat_us > HOSTAP_CMD_SLOW_US)
+		ELOG("command took %llu.%06llu seconds - vap_name: '%s' cmd: '%s' dpal_ret=%d",
+		     (unsigned long long)(lat_us / 1000000), (unsigned long long)(lat_us % 1000000),
+		     vap_name, cmd_data, dpal_ret);
 	if (dpal_ret == DWPAL_SUCCESS) {
 		wave_ipc_msg_shrink_data(response, reply_len + 1);
 		reply[reply_len] = '\0';
@@ -333,6 +349,8 @@ static int dwpal_ext_hostap_event_callback(char *vap_name, char *op_code,
 	LOG(2, "received hostap event '%s' from iface '%s' (len=%zu)",
 	    op_code, vap_name, msg_len);
 
+	dwpald_metrics_event(DWPALD_IF_TYPE_HOSTAP, op_code, strlen(op_code));
+
 	e_msg = wave_ipc_msg_alloc();
 	if (e_msg == NULL)
 		return DWPAL_FAILURE;
@@ -429,18 +447,12 @@ static int hostap_iface_detach(char *ifname)
 	return 0;
 }
 
-static int hostap_register_sta_to_event(l_list *events, wv_ipstation *ipsta,
+static int hostap_register_sta_to_event(hash_table *events, wv_ipstation *ipsta,
 					const char *op_code)
 {
-	hostap_event *event = NULL;
-
-	list_foreach_start(events, tmp, hostap_event)
-		if (!strncmp(op_code, tmp->op_code, sizeof(tmp->op_code))) {
-			event = tmp;
-			break;
-		}
-	list_foreach_end
+	hostap_event *event;
 
+	event = (hostap_event*)hash_table_find(events, op_code);
 	if (event) {
 		list_remove(event->registered_stations, ipsta);
 		list_push_front(event->registered_stations, ipsta);
@@ -458,8 +470,12 @@ static int hostap_register_sta_to_event(l_list *events, wv_ipstation *ipsta,
 
 		strncpy_s(event->op_code, sizeof(event->op_code),
 			  op_code, sizeof(event->op_code) - 1);
+		if (hash_table_insert(events, event->op_code, event)) {
+			list_free(event->registered_stations);
+			free(event);
+			return 1;
+		}
 		list_push_front(event->registered_stations, ipsta);
-		list_push_front(events, event);
 		LOG(2, "registered %s to newly created hostap event %s",
 		    wave_ipcs_sta_name(ipsta), op_code);
 	}
@@ -487,7 +503,7 @@ static const struct reg_intf_event g_intf_events[] = {
 	{ "INTERFACE_DISCONNECTED",   sizeof("INTERFACE_DISCONNECTED")-1   },
 };
 
-static int hostap_register_sta_to_events(l_list *events, wv_ipstation *ipsta,
+static int hostap_register_sta_to_events(hash_table *events, wv_ipstation *ipsta,
 					 const char *reg_str, size_t len)
 {
 	size_t i = 0, idx;
@@ -537,30 +553,36 @@ static int hostap_register_sta_to_events(l_list *events, wv_ipstation *ipsta,
 	return 0;
 }
 
-static int hostap_unregister_sta_from_events(l_list *events, wv_ipstation *ipsta)
+static int hostap_unregister_sta_from_event(void *obj, void *arg)
 {
-	list_foreach_start(events, event, hostap_event)
-		list_remove(event->registered_stations, ipsta);
-		if (!list_get_size(event->registered_stations)) {
-			list_foreach_remove_current_entry();
-			LOG(2, "hostap event %s is deleted due to no stations left",
-			    event->op_code);
+	hostap_event *event = (hostap_event*)obj;
 
-			list_free(event->registered_stations);
-			free(event);
-		}
-	list_foreach_end
+	list_remove(event->registered_stations, (wv_ipstation*)arg);
+	if (list_get_size(event->registered_stations))
+		return 0;
+
+	LOG(2, "hostap event %s is deleted due to no stations left",
+	    event->op_code);
+
+	list_free(event->registered_stations);
+	free(event);
+	return 1;
+}
+
+static int hostap_unregister_sta_from_events(hash_table *events, wv_ipstation *ipsta)
+{
+	hash_table_walk(events, hostap_unregister_sta_from_event, ipsta);
 
 	return 0;
 }
 
 static int hostap_send_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *event,
-			     void *info, l_list *events, uint8_t *state)
+			     void *info, hash_table *events, uint8_t *state)
 {
 	hostap_extra_info *extra_info = (hostap_extra_info*)info;
 	char *op_code = extra_info->data;
 	char *msg = extra_info->data + extra_info->msg_ofs;
-	hostap_event *hap_event = NULL;
+	hostap_event *hap_event;
 
 	if (!strncmp(op_code, "INTERFACE_RECONNECTED_OK",
 		     sizeof("INTERFACE_RECONNECTED_OK") - 1)) {
@@ -585,13 +607,7 @@ static int hostap_send_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *even
 		hostap_process_wds_sta_interface_added(ifname, msg, extra_info->msg_len);
 	}
 
-	list_foreach_start(events, tmp, hostap_event)
-		if (!strncmp(op_code, tmp->op_code, sizeof(tmp->op_code))) {
-			hap_event = tmp;
-			break;
-		}
-	list_foreach_end
-
+	hap_event = (hostap_event*)hash_table_find(events, op_code);
 	if (hap_event == NULL) {
 		LOG(2, "no station registered to '%s' event", op_code);
 		return 0;
@@ -611,6 +627,8 @@ static int hostap_send_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *even
 }
 
 static manager_apis apis = {
+	.events_hash = hash_str,
+	.events_cmp = hash_str_cmp,
 	.execute_command = hostap_execute_command,
 	.iface_attach = hostap_iface_attach,
 	.iface_detach = hostap_iface_detach,
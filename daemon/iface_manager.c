@@ -11,10 +11,13 @@
 #include "iface_manager.h"
 #include "work_serializer.h"
 #include "dwpal_daemon.h"
+#include "dwpald_metrics.h"
 #include "linked_list.h"
+#include "hash_table.h"
 #include "logs.h"
 
 #include <stdlib.h>
+#include <pthread.h>
 
 #if defined YOCTO
 #include <slibc/string.h>
@@ -26,47 +29,92 @@
 #endif
 
 typedef struct _attached_interface {
+	dl_node link;	/* on attached_ifaces */
 	char ifname[IFNAMSIZ + 1];
 	uint8_t state;
-	l_list *events;
+	hash_table *events;
 	l_list *attached_clients;
 	bool keep_attached;
+	/* pending detach on the manager's serializer, used only from it */
+	serializer_timer detach_timer;
+
+	/* Commands and events of this interface. In sharded mode every interface
+	 * has its own serializer, otherwise it is the manager's serializer */
+	work_serializer *serializer;
+	/* protects state, events and attached_clients */
+	pthread_mutex_t lock;
+	/* one reference is held by attached_ifaces, others by the work queued to
+	 * its serializer until the work is freed */
+	int refcnt;
 } attached_interface;
 
+/* Commands of an interface that is not attached run on the manager's
+ * serializer. While any of them is pending, later commands of the interface
+ * are queued there as well (even once it is attached) to keep their order */
+typedef struct _fallback_iface {
+	dl_node link;	/* on fallback_ifaces */
+	char ifname[IFNAMSIZ + 1];
+	unsigned int pending;
+} fallback_iface;
+
+/* Work of attach/detach/sta disconnect (anything touching the list of
+ * interfaces or more than one interface) runs on the manager's serializer.
+ * Only that serializer adds or removes entries of attached_ifaces; in sharded
+ * mode ifaces_lock protects the list (and fallback_ifaces) against lookups done
+ * while queuing work to an interface serializer. Work is queued after dropping
+ * ifaces_lock, holding a reference to the interface. Interface serializers
+ * never take ifaces_lock */
 typedef struct _iface_manager {
 	wv_ipserver *ipserver;
 	manager_apis *man_apis;
 	unsigned int detach_time;
 	uint8_t iftype;
+	bool sharded;
 	work_serializer *serializer;
-	l_list *attached_ifaces;
+	dl_list attached_ifaces;
+	dl_list fallback_ifaces;
+	pthread_mutex_t ifaces_lock;
+	/* interfaces not freed yet, attached or not, protected by ifaces_lock.
+	 * Deinit waits on ifaces_cond for all of them */
+	unsigned int num_ifaces;
+	pthread_cond_t ifaces_cond;
+	/* set by deinit, queued work is freed without running */
+	volatile bool stopping;
 } iface_manager;
 
 typedef struct {
 	char ifname[IFNAMSIZ + 1];
-	uint8_t seq_num;
+	uint32_t seq_num;
 	wv_ipstation *ipsta;
 } detach_work;
 
 typedef struct {
 	wv_ipc_msg *cmd;
-	uint8_t seq_num;
+	uint32_t seq_num;
 	wv_ipstation *ipsta;
+	fallback_iface *fallback; /* set if queued as a fallback command */
+	attached_interface *attached_if; /* set if queued to the interface serializer */
 } cmd_work;
 
 typedef struct {
 	wv_ipc_msg *event;
 	char ifname[IFNAMSIZ + 1];
+	attached_interface *attached_if; /* resolved on queuing in sharded mode */
 	void *info;
 } event_work;
 
+static void fallback_iface_put(iface_manager *manager, fallback_iface *fallback);
+static void attached_iface_put(iface_manager *manager, attached_interface *attached_if);
+
 static int cmd_work_obj_clean(void *work_obj, void *ctx)
 {
 	cmd_work *cmd_w = (cmd_work*)work_obj;
 
-	(void)ctx;
-
 	if (cmd_w == NULL) return 1;
+	if (cmd_w->fallback)
+		fallback_iface_put((iface_manager*)ctx, cmd_w->fallback);
+	if (cmd_w->attached_if)
+		attached_iface_put((iface_manager*)ctx, cmd_w->attached_if);
 	wave_ipcs_sta_decref(cmd_w->ipsta);
 	wave_ipc_msg_put(cmd_w->cmd);
 	free(cmd_w);
@@ -77,9 +125,9 @@ static int event_work_obj_clean(void *work_obj, void *ctx)
 {
 	event_work *event_w = (event_work*)work_obj;
 
-	(void)ctx;
-
 	if (!event_w) return 1;
+	if (event_w->attached_if)
+		attached_iface_put((iface_manager*)ctx, event_w->attached_if);
 	wave_ipc_msg_put(event_w->event);
 	if (event_w->info)
 		free(event_w->info);
@@ -130,6 +178,9 @@ static int iface_attach_work(work_serializer *s, void *work_obj, void *ctx);
 static int iface_detach_work(work_serializer *s, void *work_obj, void *ctx);
 static int sta_disconnect_work(work_serializer *s, void *work_obj, void *ctx);
 static int iface_update_event_work(work_serializer *s, void *work_obj, void *ctx);
+static int iface_free_work(work_serializer *s, void *work_obj, void *ctx);
+static int iface_remove_all_work(work_serializer *s, void *work_obj, void *ctx);
+static int iface_free_work_obj_clean(void *work_obj, void *ctx);
 
 
 enum {
@@ -139,6 +190,8 @@ enum {
 	IFACE_MAN_DETACH_WORK,
 	IFACE_MAN_DISCONN_WORK,
 	IFACE_MAN_UPDATE_EVENT_WORK,
+	IFACE_MAN_FREE_WORK,
+	IFACE_MAN_REMOVE_ALL_WORK,
 
 	/* keep last */
 	IFACE_MAN_NUM_WORK_TYPES,
@@ -147,15 +200,186 @@ enum {
 static work_ops_t work_ops[] = {
 	[IFACE_MAN_CMD_WORK] = { execute_cmd_work, cmd_work_obj_clean, NULL },
 	[IFACE_MAN_EVENT_WORK] = { send_event_work, event_work_obj_clean, NULL },
-	[IFACE_MAN_ATTACH_WORK] = { iface_attach_work, cmd_work_obj_clean, NULL },
-	[IFACE_MAN_DETACH_WORK] = { iface_detach_work, detach_work_obj_clean, detach_work_obj_cmp },
-	[IFACE_MAN_DISCONN_WORK] = { sta_disconnect_work, sta_disconn_work_obj_clean, NULL },
+	/* control works are never dropped, the clients of the interfaces and the
+	 * event registrations hold stations without a reference */
+	[IFACE_MAN_ATTACH_WORK] = { iface_attach_work, cmd_work_obj_clean, NULL, 1 },
+	[IFACE_MAN_DETACH_WORK] = { iface_detach_work, detach_work_obj_clean, detach_work_obj_cmp, 1 },
+	[IFACE_MAN_DISCONN_WORK] = { sta_disconnect_work, sta_disconn_work_obj_clean, NULL, 1 },
 	[IFACE_MAN_UPDATE_EVENT_WORK] = { iface_update_event_work, cmd_work_obj_clean, NULL },
+	[IFACE_MAN_FREE_WORK] = { iface_free_work, iface_free_work_obj_clean, NULL, 1 },
+	[IFACE_MAN_REMOVE_ALL_WORK] = { iface_remove_all_work, NULL, NULL },
 };
 
+/* Max time the ipc server thread waits for room in a full serializer; after it
+ * the command fails or the event is dropped instead of stalling all clients.
+ * Control works aren't limited */
+#define IFACE_MAN_QUEUE_BLOCK_MS	(1000)
+#define IFACE_MAN_QUEUE_MAX_SIZE	(500)
+
+/* Max time deinit waits for the control serializer to remove the interfaces */
+#define IFACE_MAN_DEINIT_TIMEOUT_MS	(15000)
+
+static work_serializer * iface_manager_serializer_create(void)
+{
+	work_serializer *s = serializer_create(work_ops, IFACE_MAN_NUM_WORK_TYPES, 1);
+
+	if (s && serializer_set_overflow_policy(s, SERIALIZER_OVERFLOW_BLOCK,
+						IFACE_MAN_QUEUE_MAX_SIZE,
+						IFACE_MAN_QUEUE_BLOCK_MS)) {
+		serializer_destroy(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+static attached_interface * attached_iface_create(iface_manager *manager,
+						  const char *ifname,
+						  bool keep_attached)
+{
+	attached_interface *attached_if;
+
+	attached_if = (attached_interface*)calloc(1, sizeof(attached_interface));
+	if (attached_if == NULL)
+		return NULL;
+
+	attached_if->events = hash_table_init(0, manager->man_apis->events_hash,
+					      manager->man_apis->events_cmp);
+	if (!attached_if->events)
+		goto err;
+
+	attached_if->attached_clients = list_init();
+	if (!attached_if->attached_clients)
+		goto err;
+
+	if (manager->sharded) {
+		attached_if->serializer = iface_manager_serializer_create();
+		if (!attached_if->serializer)
+			goto err;
+	} else
+		attached_if->serializer = manager->serializer;
+
+	strncpy_s(attached_if->ifname, sizeof(attached_if->ifname),
+		  ifname, sizeof(attached_if->ifname) - 1);
+	attached_if->state = INTERFACE_DWPAL_STATE_UNKNOWN;
+	attached_if->keep_attached = keep_attached;
+	attached_if->refcnt = 1;
+	pthread_mutex_init(&attached_if->lock, NULL);
+
+	pthread_mutex_lock(&manager->ifaces_lock);
+	manager->num_ifaces++;
+	pthread_mutex_unlock(&manager->ifaces_lock);
+
+	return attached_if;
+
+err:
+	if (attached_if->attached_clients)
+		list_free(attached_if->attached_clients);
+	if (attached_if->events)
+		hash_table_free(attached_if->events);
+	free(attached_if);
+	return NULL;
+}
+
+/* The interface must already be removed from attached_ifaces. Its serializer
+ * is idle: no work is queued without a reference to the interface */
+static void attached_iface_free(iface_manager *manager, attached_interface *attached_if)
+{
+	/* waits for the work which dropped the last reference */
+	if (manager->sharded && attached_if->serializer)
+		serializer_destroy(attached_if->serializer);
+
+	pthread_mutex_destroy(&attached_if->lock);
+	hash_table_free(attached_if->events);
+	list_free(attached_if->attached_clients);
+	free(attached_if);
+
+	pthread_mutex_lock(&manager->ifaces_lock);
+	if (--manager->num_ifaces == 0)
+		pthread_cond_broadcast(&manager->ifaces_cond);
+	pthread_mutex_unlock(&manager->ifaces_lock);
+}
+
+static void attached_iface_get(attached_interface *attached_if)
+{
+	__atomic_add_fetch(&attached_if->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+/* The last reference is dropped only after the interface left attached_ifaces.
+ * It may be dropped by the work of the interface or while queuing it, so the
+ * interface is freed on the manager's serializer */
+static void attached_iface_put(iface_manager *manager, attached_interface *attached_if)
+{
+	if (__atomic_sub_fetch(&attached_if->refcnt, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	if (serializer_in_context(manager->serializer)) {
+		attached_iface_free(manager, attached_if);
+		return;
+	}
+
+	if (serializer_exec_work_async(manager->serializer, IFACE_MAN_FREE_WORK,
+				       attached_if, manager)) {
+		ELOG("failed to queue the free of interface %s", attached_if->ifname);
+		if (!serializer_in_context(attached_if->serializer))
+			attached_iface_free(manager, attached_if);
+	}
+}
+
+static attached_interface * attached_iface_find(iface_manager *manager,
+						const char *ifname)
+{
+	dl_list_foreach_start(&manager->attached_ifaces, tmp, attached_interface, link)
+		if (!strncmp(tmp->ifname, ifname, sizeof(tmp->ifname)))
+			return tmp;
+	dl_list_foreach_end
+
+	return NULL;
+}
+
+/* Called with ifaces_lock held */
+static fallback_iface * fallback_iface_find(iface_manager *manager, const char *ifname)
+{
+	dl_list_foreach_start(&manager->fallback_ifaces, tmp, fallback_iface, link)
+		if (!strncmp(tmp->ifname, ifname, sizeof(tmp->ifname)))
+			return tmp;
+	dl_list_foreach_end
+
+	return NULL;
+}
+
+/* Called with ifaces_lock held */
+static fallback_iface * fallback_iface_get(iface_manager *manager, const char *ifname)
+{
+	fallback_iface *fallback = fallback_iface_find(manager, ifname);
+
+	if (!fallback) {
+		fallback = (fallback_iface*)calloc(1, sizeof(fallback_iface));
+		if (!fallback)
+			return NULL;
+
+		strncpy_s(fallback->ifname, sizeof(fallback->ifname),
+			  ifname, sizeof(fallback->ifname) - 1);
+		dl_list_push_back(&manager->fallback_ifaces, &fallback->link);
+	}
+
+	fallback->pending++;
+	return fallback;
+}
+
+static void fallback_iface_put(iface_manager *manager, fallback_iface *fallback)
+{
+	pthread_mutex_lock(&manager->ifaces_lock);
+	if (--fallback->pending == 0) {
+		dl_list_remove(&manager->fallback_ifaces, &fallback->link);
+		free(fallback);
+	}
+	pthread_mutex_unlock(&manager->ifaces_lock);
+}
+
 iface_manager * iface_manager_init(wv_ipserver *ipserver, manager_apis *man_apis,
 				   l_list *seed_ifaces, uint8_t iftype,
-				   unsigned int detach_time)
+				   unsigned int detach_time, bool sharded)
 {
 	iface_manager *manager;
 	int ret;
@@ -167,71 +391,50 @@ iface_manager * iface_manager_init(wv_ipserver *ipserver, manager_apis *man_apis
 	manager->man_apis = man_apis;
 	manager->iftype = iftype;
 	manager->detach_time = detach_time;
+	manager->sharded = sharded;
+	manager->ipserver = ipserver;
+	pthread_mutex_init(&manager->ifaces_lock, NULL);
+	pthread_cond_init(&manager->ifaces_cond, NULL);
+	dl_list_init(&manager->attached_ifaces);
+	dl_list_init(&manager->fallback_ifaces);
 
-	if ((manager->attached_ifaces = list_init()) == NULL)
+	manager->serializer = iface_manager_serializer_create();
+	if (manager->serializer == NULL)
 		goto err;
 
 	if (!seed_ifaces)
 		goto after_seed;
 
 	list_foreach_start(seed_ifaces, ifname, char)
-		attached_interface *attached_if = calloc(1, sizeof(attached_interface));
+		attached_interface *attached_if = attached_iface_create(manager, ifname, true);
 		if (attached_if == NULL)
 			goto err;
 
-		attached_if->events = list_init();
-		if (!attached_if->events) {
-			free(attached_if);
-			goto err;
-		}
-
-		attached_if->attached_clients = list_init();
-		if (!attached_if->attached_clients) {
-			list_free(attached_if->events);
-			free(attached_if);
-			goto err;
-		}
-
-		strncpy_s(attached_if->ifname, sizeof(attached_if->ifname),
-			  ifname, sizeof(attached_if->ifname) - 1);
-		attached_if->state = INTERFACE_DWPAL_STATE_UNKNOWN;
-		attached_if->keep_attached = true;
-
-		list_push_back(manager->attached_ifaces, attached_if);
+		dl_list_push_back(&manager->attached_ifaces, &attached_if->link);
 	list_foreach_end
 
 after_seed:
-	manager->ipserver = ipserver;
-	manager->serializer = serializer_create(work_ops, IFACE_MAN_NUM_WORK_TYPES, 1);
-	if (manager->serializer == NULL)
-		goto err;
-
-	list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
+	dl_list_foreach_start(&manager->attached_ifaces, attached_if, attached_interface, link)
 		ret = man_apis->iface_attach(manager, attached_if->ifname,
 					     &attached_if->state);
 		if (ret)
 			goto err;
-	list_foreach_end
+	dl_list_foreach_end
 
 	return manager;
 
 err:
-	if (manager->attached_ifaces) {
-		list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
-			man_apis->iface_detach(attached_if->ifname);
-		list_foreach_end
-	}
+	dl_list_foreach_start(&manager->attached_ifaces, attached_if, attached_interface, link)
+		man_apis->iface_detach(attached_if->ifname);
+	dl_list_foreach_end
+	dl_list_foreach_start(&manager->attached_ifaces, attached_if, attached_interface, link)
+		dl_list_foreach_remove_current_entry();
+		attached_iface_free(manager, attached_if);
+	dl_list_foreach_end
 	if (manager->serializer)
 		serializer_destroy(manager->serializer);
-	if (manager->attached_ifaces) {
-		list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
-			list_free(attached_if->events);
-			list_free(attached_if->attached_clients);
-			free(attached_if);
-			list_foreach_remove_current_entry()
-		list_foreach_end
-		list_free(manager->attached_ifaces);
-	}
+	pthread_cond_destroy(&manager->ifaces_cond);
+	pthread_mutex_destroy(&manager->ifaces_lock);
 	free(manager);
 	return NULL;
 }
@@ -241,31 +444,70 @@ int iface_manager_deinit(iface_manager *manager)
 	if (manager == NULL)
 		return 1;
 
-	list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
-		manager->man_apis->iface_detach(attached_if->ifname);
-	list_foreach_end
+	/* From now on queued work is freed without running. The interfaces are
+	 * removed by the control serializer and freed on it once their work is
+	 * gone, so it is stopped last */
+	manager->stopping = true;
+	if (serializer_exec_work(manager->serializer, IFACE_MAN_REMOVE_ALL_WORK,
+				 NULL, manager, NULL, IFACE_MAN_DEINIT_TIMEOUT_MS)) {
+		ELOG("failed to remove the interfaces");
+	} else {
+		pthread_mutex_lock(&manager->ifaces_lock);
+		while (manager->num_ifaces)
+			pthread_cond_wait(&manager->ifaces_cond, &manager->ifaces_lock);
+		pthread_mutex_unlock(&manager->ifaces_lock);
+	}
 
 	serializer_destroy(manager->serializer);
 
-	list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
-		list_free(attached_if->events);
-		list_free(attached_if->attached_clients);
-		free(attached_if);
-		list_foreach_remove_current_entry()
-	list_foreach_end
-	list_free(manager->attached_ifaces);
-
+	pthread_cond_destroy(&manager->ifaces_cond);
+	pthread_mutex_destroy(&manager->ifaces_lock);
 	free(manager);
 	return 0;
 }
 
+/* Queue a command of an interface on its serializer; falls back to the
+ * manager's serializer if the interface is not attached or earlier commands of
+ * it are still pending there. Queuing may block, so it is done without
+ * ifaces_lock, holding a reference to the interface instead */
+static int iface_manager_exec_cmd_work(iface_manager *manager, const char *ifname,
+				       cmd_work *cmd_w)
+{
+	attached_interface *attached_if = NULL;
+
+	pthread_mutex_lock(&manager->ifaces_lock);
+	if (!fallback_iface_find(manager, ifname))
+		attached_if = attached_iface_find(manager, ifname);
+	if (attached_if)
+		attached_iface_get(attached_if);
+	else
+		cmd_w->fallback = fallback_iface_get(manager, ifname);
+	pthread_mutex_unlock(&manager->ifaces_lock);
+
+	/* the work keeps the reference until it is freed */
+	if (attached_if) {
+		cmd_w->attached_if = attached_if;
+		return serializer_exec_work_async(attached_if->serializer,
+						  IFACE_MAN_CMD_WORK, cmd_w, manager);
+	}
+
+	if (!cmd_w->fallback)
+		return 1;
+
+	return serializer_exec_work_async(manager->serializer, IFACE_MAN_CMD_WORK,
+					  cmd_w, manager);
+}
+
 int iface_manager_sta_cmd_async(iface_manager *manager, wv_ipstation *ipsta,
-				uint8_t seq_num, wv_ipc_msg *cmd)
+				uint32_t seq_num, wv_ipc_msg *cmd)
 {
 	dwpald_header cmd_hdr = { 0 };
 	void *work_obj = NULL;
 	unsigned int work_id;
 	free_cb work_obj_free_func;
+	char ifname[IFNAMSIZ + 1] = { 0 };
+	bool iface_work = false;
+	int ret;
 
 	if (manager == NULL || cmd == NULL || ipsta == NULL)
 		goto err;
@@ -291,9 +533,10 @@ int iface_manager_sta_cmd_async(iface_manager *manager, wv_ipstation *ipsta,
 			work_obj = work;
 			work_obj_free_func = cmd_work_obj_clean;
 
-			if (cmd_hdr.header[0] == DWPALD_CMD)
+			if (cmd_hdr.header[0] == DWPALD_CMD) {
 				work_id = IFACE_MAN_CMD_WORK;
-			else
+				iface_work = true;
+			} else
 				work_id = IFACE_MAN_ATTACH_WORK;
 		}
 		break;
@@ -346,8 +589,22 @@ int iface_manager_sta_cmd_async(iface_manager *manager, wv_ipstation *ipsta,
 		goto err;
 	}
 
-	if (serializer_exec_work_async(manager->serializer, work_id,
-				       work_obj, manager)) {
+	/* Commands are ordered per interface, [DWPALD_CMD] [iftype] [ifname_len]
+	 * is followed by the ifname. Other requests go to the manager's serializer */
+	if (iface_work && manager->sharded) {
+		char *data = wave_ipc_msg_get_data(cmd);
+
+		if (data && cmd_hdr.header[2] < sizeof(ifname) &&
+		    wave_ipc_msg_get_size(cmd) >= cmd_hdr.header[2])
+			memcpy_s(ifname, sizeof(ifname), data, cmd_hdr.header[2]);
+	}
+
+	if (ifname[0])
+		ret = iface_manager_exec_cmd_work(manager, ifname, (cmd_work*)work_obj);
+	else
+		ret = serializer_exec_work_async(manager->serializer, work_id,
+						 work_obj, manager);
+	if (ret) {
 		work_obj_free_func(work_obj, manager);
 		return 1;
 	}
@@ -362,9 +619,15 @@ err:
 int iface_manager_event_received(iface_manager *manager, wv_ipc_msg *event,
 				 const char *ifname, size_t ifnamsiz, void *info)
 {
-	event_work *work = (event_work*)calloc(1, sizeof(event_work));
+	attached_interface *attached_if;
+	event_work *work;
+	int ret = 1;
+
+	work = (event_work*)calloc(1, sizeof(event_work));
 	if (!work) {
 		wave_ipc_msg_put(event);
+		if (info)
+			free(info);
 		return 1;
 	}
 
@@ -372,8 +635,26 @@ int iface_manager_event_received(iface_manager *manager, wv_ipc_msg *event,
 	work->info = info;
 	strncpy_s(work->ifname, sizeof(work->ifname), ifname, ifnamsiz - 1);
 
-	if (serializer_exec_work_async(manager->serializer, IFACE_MAN_EVENT_WORK,
-				       work, manager)) {
+	if (!manager->sharded) {
+		ret = serializer_exec_work_async(manager->serializer, IFACE_MAN_EVENT_WORK,
+						 work, manager);
+	} else {
+		/* The work runs on the serializer of its interface and keeps
+		 * a reference to it until the work is freed */
+		pthread_mutex_lock(&manager->ifaces_lock);
+		attached_if = attached_iface_find(manager, work->ifname);
+		if (attached_if)
+			attached_iface_get(attached_if);
+		pthread_mutex_unlock(&manager->ifaces_lock);
+
+		if (attached_if) {
+			work->attached_if = attached_if;
+			ret = serializer_exec_work_async(attached_if->serializer,
+							 IFACE_MAN_EVENT_WORK, work, manager);
+		}
+	}
+
+	if (ret) {
 		event_work_obj_clean(work, manager);
 		return 1;
 	}
@@ -387,6 +668,7 @@ int iface_manager_sta_disconnected(iface_manager *manager, wv_ipstation *ipsta)
 
 	if (serializer_exec_work_async(manager->serializer, IFACE_MAN_DISCONN_WORK,
 				       ipsta, manager)) {
+		ELOG("failed to queue the disconnection of '%s'", wave_ipcs_sta_name(ipsta));
 		wave_ipcs_sta_decref(ipsta);
 		return 1;
 	}
@@ -394,6 +676,29 @@ int iface_manager_sta_disconnected(iface_manager *manager, wv_ipstation *ipsta)
 	return 0;
 }
 
+void iface_manager_serializers_stats(iface_manager *manager,
+				     iface_serializer_stats_cb cb, void *arg)
+{
+	serializer_stats stats;
+
+	if (manager == NULL || cb == NULL)
+		return;
+
+	if (!serializer_get_stats(manager->serializer, &stats))
+		cb(NULL, &stats, arg);
+
+	if (!manager->sharded)
+		return;
+
+	/* interface serializers are destroyed only after leaving the list */
+	pthread_mutex_lock(&manager->ifaces_lock);
+	dl_list_foreach_start(&manager->attached_ifaces, attached_if, attached_interface, link)
+		if (!serializer_get_stats(attached_if->serializer, &stats))
+			cb(attached_if->ifname, &stats, arg);
+	dl_list_foreach_end
+	pthread_mutex_unlock(&manager->ifaces_lock);
+}
+
 static int execute_cmd_work(work_serializer *s, void *work_obj, void *ctx)
 {
 	iface_manager *manager = (iface_manager*)ctx;
@@ -403,6 +708,14 @@ static int execute_cmd_work(work_serializer *s, void *work_obj, void *ctx)
 	(void)s;
 
 	if (cmd_w == NULL || manager == NULL) return 1;
+	if (manager->stopping) return 1;
+
+	/* the client has given up on the command already, don't run it */
+	if (wave_ipc_msg_deadline_passed(cmd_w->cmd)) {
+		LOG(1, "dropping expired command of '%s'", wave_ipcs_sta_name(cmd_w->ipsta));
+		dwpald_metrics_cmd_expired();
+		return 1;
+	}
 
 	ret = manager->man_apis->execute_command(manager->ipserver, cmd_w->cmd,
 						 cmd_w->ipsta, cmd_w->seq_num);
@@ -435,29 +748,36 @@ static int send_event_work(work_serializer *s, void *work_obj, void *ctx)
 {
 	iface_manager *manager = (iface_manager*)ctx;
 	event_work *event_w = (event_work*)work_obj;
+	attached_interface *attached_if;
+	int ret;
 
 	(void)s;
 
 	if (!event_w || manager == NULL) return 1;
+	if (manager->stopping) return 1;
+
+	/* not sharded: running on the manager's serializer, the only one that
+	 * modifies the list of interfaces */
+	attached_if = event_w->attached_if;
+	if (!attached_if)
+		attached_if = attached_iface_find(manager, event_w->ifname);
+	if (!attached_if)
+		return 1;
 
-	list_foreach_start(manager->attached_ifaces, attached_if, attached_interface)
-		if (!strncmp(event_w->ifname, attached_if->ifname, sizeof(attached_if->ifname))) {
-
-			if (!event_w->info)
-				return send_event_to_sta_list(manager,
-							      attached_if->attached_clients,
-							      event_w->event);
-
-			return manager->man_apis->send_event(manager->ipserver,
-							     attached_if->ifname,
-							     event_w->event,
-							     event_w->info,
-							     attached_if->events,
-							     &attached_if->state);
-		}
-	list_foreach_end
-
-	return 1;
+	pthread_mutex_lock(&attached_if->lock);
+	if (!event_w->info)
+		ret = send_event_to_sta_list(manager, attached_if->attached_clients,
+					     event_w->event);
+	else
+		ret = manager->man_apis->send_event(manager->ipserver,
+						    attached_if->ifname,
+						    event_w->event,
+						    event_w->info,
+						    attached_if->events,
+						    &attached_if->state);
+	pthread_mutex_unlock(&attached_if->lock);
+
+	return ret;
 }
 
 static int iface_attach_work(work_serializer *s, void *work_obj, void *ctx)
@@ -477,6 +797,7 @@ static int iface_attach_work(work_serializer *s, void *work_obj, void *ctx)
 	(void)s;
 
 	if (cmd_w == NULL || manager == NULL) return 1;
+	if (manager->stopping) return 1;
 
 	cmd = cmd_w->cmd;
 	ipsta = cmd_w->ipsta;
@@ -491,68 +812,61 @@ static int iface_attach_work(work_serializer *s, void *work_obj, void *ctx)
 	data += sizeof(ifname);
 	data_size -= sizeof(ifname);
 
-	list_foreach_start(manager->attached_ifaces, tmp, attached_interface)
-		if (!strncmp(tmp->ifname, ifname, sizeof(tmp->ifname))) {
-			attached_iface = tmp;
-			break;
-		}
-	list_foreach_end
+	attached_iface = attached_iface_find(manager, ifname);
 
 	if (!attached_iface) {
-		attached_iface = (attached_interface*)calloc(1, sizeof(attached_interface));
-		if (!attached_iface)
-			goto err;
+		uint8_t state = INTERFACE_DWPAL_STATE_UNKNOWN;
 
-		attached_iface->events = list_init();
-		if (!attached_iface->events) {
-			free(attached_iface);
-			goto err;
-		}
-
-		attached_iface->attached_clients = list_init();
-		if (!attached_iface->attached_clients) {
-			list_free(attached_iface->events);
-			free(attached_iface);
+		attached_iface = attached_iface_create(manager, ifname, false);
+		if (!attached_iface)
 			goto err;
-		}
 
-		strncpy_s(attached_iface->ifname, sizeof(attached_iface->ifname),
-			  ifname, sizeof(attached_iface->ifname));
-		attached_iface->keep_attached = false;
-
-		ret = manager->man_apis->iface_attach(manager, ifname,
-						      &attached_iface->state);
+		ret = manager->man_apis->iface_attach(manager, ifname, &state);
 		if (ret) {
-			list_free(attached_iface->attached_clients);
-			list_free(attached_iface->events);
-			free(attached_iface);
+			attached_iface_free(manager, attached_iface);
 			goto err;
 		}
+		attached_iface->state = state;
 
-		list_push_back(manager->attached_ifaces, attached_iface);
+		pthread_mutex_lock(&manager->ifaces_lock);
+		dl_list_push_back(&manager->attached_ifaces, &attached_iface->link);
+		pthread_mutex_unlock(&manager->ifaces_lock);
 	} else {
-		ret = manager->man_apis->iface_attach(manager, ifname,
-						      &attached_iface->state);
+		uint8_t state;
+
+		pthread_mutex_lock(&attached_iface->lock);
+		state = attached_iface->state;
+		pthread_mutex_unlock(&attached_iface->lock);
+
+		ret = manager->man_apis->iface_attach(manager, ifname, &state);
 		if (ret)
 			goto err;
+
+		pthread_mutex_lock(&attached_iface->lock);
+		attached_iface->state = state;
+		pthread_mutex_unlock(&attached_iface->lock);
 	}
 
+	pthread_mutex_lock(&attached_iface->lock);
 	list_remove(attached_iface->attached_clients, ipsta);
 	list_push_back(attached_iface->attached_clients, ipsta);
 
 	if (data_size) {
 		ret = manager->man_apis->register_sta_to_events(attached_iface->events,
 								ipsta, data, data_size);
-		if (ret)
+		if (ret) {
+			pthread_mutex_unlock(&attached_iface->lock);
 			goto err;
+		}
 	}
+	hdr.header[2] = attached_iface->state;
+	pthread_mutex_unlock(&attached_iface->lock);
 
 	if ((resp = wave_ipc_msg_alloc()) == NULL)
 		goto err;
 
 	hdr.header[0] = DWPALD_ATTACH_RESP;
 	hdr.header[1] = manager->iftype;
-	hdr.header[2] = attached_iface->state;
 	dwpald_header_push(resp, &hdr);
 	wave_ipcs_send_response_to(manager->ipserver, ipsta, cmd_w->seq_num, resp, 0);
 	wave_ipc_msg_put(resp);
@@ -579,6 +893,7 @@ static int iface_update_event_work(work_serializer *s, void *work_obj, void *ctx
 	(void)s;
 
 	if (cmd_w == NULL || manager == NULL) return 1;
+	if (manager->stopping) return 1;
 
 	cmd = cmd_w->cmd;
 	ipsta = cmd_w->ipsta;
@@ -593,24 +908,21 @@ static int iface_update_event_work(work_serializer *s, void *work_obj, void *ctx
 	data += sizeof(ifname);
 	data_size -= sizeof(ifname);
 
-	list_foreach_start(manager->attached_ifaces, tmp, attached_interface)
-		if (!strncmp(tmp->ifname, ifname, sizeof(tmp->ifname))) {
-			attached_iface = tmp;
-			break;
-		}
-	list_foreach_end
+	attached_iface = attached_iface_find(manager, ifname);
 
 	if (!attached_iface)
 			goto err;
 	if (data_size) {
-		if(!manager->man_apis->unregister_sta_from_events(attached_iface->events,
-								ipsta)) {
-			if(manager->man_apis->register_sta_to_events(attached_iface->events,
-								ipsta, data, data_size)) {
-				goto err;
-			}
-		}
-		else
+		int ret;
+
+		pthread_mutex_lock(&attached_iface->lock);
+		ret = manager->man_apis->unregister_sta_from_events(attached_iface->events,
+								    ipsta);
+		if (!ret)
+			ret = manager->man_apis->register_sta_to_events(attached_iface->events,
+									ipsta, data, data_size);
+		pthread_mutex_unlock(&attached_iface->lock);
+		if (ret)
 			goto err;
 	}
 
@@ -629,48 +941,65 @@ err:
 	return 1;
 }
 
-static int iface_detach_work(work_serializer *s, void *work_obj, void *ctx)
+/* (Re)starts the timer detaching the interface once it has no clients */
+static void attached_iface_schedule_detach(iface_manager *manager,
+					   attached_interface *attached_iface)
 {
-	iface_manager *manager = (iface_manager*)ctx;
-	detach_work *detach_w = (detach_work*)work_obj;
-	attached_interface *attached_iface = NULL;
-	detach_work *future_detach = NULL;
+	detach_work *future_detach;
 
-	(void)s;
+	serializer_cancel_timer(manager->serializer, attached_iface->detach_timer);
+	attached_iface->detach_timer = SERIALIZER_NO_TIMER;
 
 	future_detach = (detach_work*)calloc(1, sizeof(detach_work));
 	if (!future_detach)
-		return 1;
+		return;
 
 	strncpy_s(future_detach->ifname, sizeof(future_detach->ifname),
-		  detach_w->ifname, sizeof(future_detach->ifname) - 1);
+		  attached_iface->ifname, sizeof(future_detach->ifname) - 1);
 	future_detach->ipsta = NULL;
 
-	serializer_cancel_delayed_work(manager->serializer, IFACE_MAN_DETACH_WORK,
-				       future_detach, manager);
+	if (serializer_add_delayed_work_ex(manager->serializer, IFACE_MAN_DETACH_WORK,
+					   future_detach, manager, manager->detach_time, 0,
+					   &attached_iface->detach_timer)) {
+		ELOG("failed to schedule detach of %s", attached_iface->ifname);
+		free(future_detach);
+	}
+}
 
-	list_foreach_start(manager->attached_ifaces, tmp, attached_interface)
-		if (!strncmp(tmp->ifname, detach_w->ifname, sizeof(tmp->ifname))) {
-			attached_iface = tmp;
-			break;
-		}
-	list_foreach_end
+static int iface_detach_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	iface_manager *manager = (iface_manager*)ctx;
+	detach_work *detach_w = (detach_work*)work_obj;
+	attached_interface *attached_iface = NULL;
+
+	(void)s;
+
+	if (manager->stopping) return 1;
+
+	attached_iface = attached_iface_find(manager, detach_w->ifname);
 
 	if (!attached_iface)
 		goto err;
 
+	/* cancel the pending detach, unless it is the one running now */
+	serializer_cancel_timer(manager->serializer, attached_iface->detach_timer);
+	attached_iface->detach_timer = SERIALIZER_NO_TIMER;
+
 	if (detach_w->ipsta) {
 		wv_ipc_msg *resp;
 		dwpald_header hdr = { 0 };
+		size_t num_clients;
 
+		pthread_mutex_lock(&attached_iface->lock);
 		manager->man_apis->unregister_sta_from_events(attached_iface->events,
 							      detach_w->ipsta);
 
 		list_remove(attached_iface->attached_clients, detach_w->ipsta);
-		if (attached_iface->keep_attached == false &&
-		    list_get_size(attached_iface->attached_clients) == 0)
-			serializer_add_delayed_work(manager->serializer, IFACE_MAN_DETACH_WORK,
-						    future_detach, manager, manager->detach_time, 0);
+		num_clients = list_get_size(attached_iface->attached_clients);
+		pthread_mutex_unlock(&attached_iface->lock);
+
+		if (attached_iface->keep_attached == false && num_clients == 0)
+			attached_iface_schedule_detach(manager, attached_iface);
 
 		hdr.header[0] = DWPALD_DETACH_RESP;
 		hdr.header[1] = manager->iftype;
@@ -683,25 +1012,22 @@ static int iface_detach_work(work_serializer *s, void *work_obj, void *ctx)
 					   detach_w->seq_num, resp, 0);
 		wave_ipc_msg_put(resp);
 	} else {
-		free(future_detach);
-
+		/* only this serializer adds clients, no lock needed to read */
 		if (attached_iface->keep_attached == false &&
 		    list_get_size(attached_iface->attached_clients) == 0) {
 			manager->man_apis->iface_detach(detach_w->ifname);
 
 			LOG(1, "removing attached interface %s", attached_iface->ifname);
-			list_free(attached_iface->events);
-			list_free(attached_iface->attached_clients);
-			list_remove(manager->attached_ifaces, attached_iface);
-			free(attached_iface);
+			pthread_mutex_lock(&manager->ifaces_lock);
+			dl_list_remove(&manager->attached_ifaces, &attached_iface->link);
+			pthread_mutex_unlock(&manager->ifaces_lock);
+			attached_iface_put(manager, attached_iface);
 		}
 	}
 
 	return 0;
 
 err:
-	if (future_detach)
-		free(future_detach);
 	if (detach_w->ipsta)
 		wave_ipcs_send_req_failed_to(manager->ipserver, detach_w->ipsta,
 					     detach_w->seq_num);
@@ -715,30 +1041,59 @@ static int sta_disconnect_work(work_serializer *s, void *work_obj, void *ctx)
 
 	(void)s;
 
-	if (!ipsta) return 1;
+	if (!ipsta || manager->stopping) return 1;
+
+	dl_list_foreach_start(&manager->attached_ifaces, attached_iface, attached_interface, link)
+		size_t num_clients;
 
-	list_foreach_start(manager->attached_ifaces, attached_iface, attached_interface)
+		pthread_mutex_lock(&attached_iface->lock);
 		manager->man_apis->unregister_sta_from_events(attached_iface->events,
 							      ipsta);
 		list_remove(attached_iface->attached_clients, ipsta);
-		if (attached_iface->keep_attached == false &&
-		    list_get_size(attached_iface->attached_clients) == 0) {
-			detach_work *future_detach = NULL;
+		num_clients = list_get_size(attached_iface->attached_clients);
+		pthread_mutex_unlock(&attached_iface->lock);
 
-			future_detach = (detach_work*)calloc(1, sizeof(detach_work));
-			if (!future_detach)
-				continue;
+		if (attached_iface->keep_attached == false && num_clients == 0)
+			attached_iface_schedule_detach(manager, attached_iface);
+	dl_list_foreach_end
 
-			strncpy_s(future_detach->ifname, sizeof(future_detach->ifname),
-				  attached_iface->ifname, sizeof(attached_iface->ifname) - 1);
-			future_detach->ipsta = NULL;
+	return 0;
+}
 
-			serializer_cancel_delayed_work(manager->serializer, IFACE_MAN_DETACH_WORK,
-						       future_detach, manager);
-			serializer_add_delayed_work(manager->serializer, IFACE_MAN_DETACH_WORK,
-						    future_detach, manager, manager->detach_time, 0);
-		}
-	list_foreach_end
+static int iface_free_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	(void)s;
+	(void)work_obj;
+	(void)ctx;
+
+	/* freed by iface_free_work_obj_clean(), also if the work is dropped */
+	return 0;
+}
+
+static int iface_free_work_obj_clean(void *work_obj, void *ctx)
+{
+	if (!work_obj || !ctx) return 1;
+	attached_iface_free((iface_manager*)ctx, (attached_interface*)work_obj);
+	return 0;
+}
+
+static int iface_remove_all_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	iface_manager *manager = (iface_manager*)ctx;
+
+	(void)work_obj;
+
+	dl_list_foreach_start(&manager->attached_ifaces, attached_iface, attached_interface, link)
+		manager->man_apis->iface_detach(attached_iface->ifname);
+
+		serializer_cancel_timer(s, attached_iface->detach_timer);
+		attached_iface->detach_timer = SERIALIZER_NO_TIMER;
+
+		pthread_mutex_lock(&manager->ifaces_lock);
+		dl_list_foreach_remove_current_entry();
+		pthread_mutex_unlock(&manager->ifaces_lock);
+		attached_iface_put(manager, attached_iface);
+	dl_list_foreach_end
 
 	return 0;
 }
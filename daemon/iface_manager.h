@@ -14,32 +14,50 @@
 #include "wave_ipc_server.h"
 #include "wave_ipc_core.h"
 #include "stadb.h"
+#include "hash_table.h"
+#include "work_serializer.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct _iface_manager iface_manager;
 
+/* 'events' of an interface are indexed by the event key of the manager,
+ * 'events_hash' and 'events_cmp' are applied on that key */
 typedef struct _manager_apis {
-  int (*execute_command)(wv_ipserver *ipserv, wv_ipc_msg *cmd, wv_ipstation *ipsta, uint8_t seq_num);
+  hash_func events_hash;
+  hash_key_cmp events_cmp;
+  int (*execute_command)(wv_ipserver *ipserv, wv_ipc_msg *cmd, wv_ipstation *ipsta, uint32_t seq_num);
   int (*iface_attach)(iface_manager *manager, char *ifname, uint8_t *state);
   int (*iface_detach)(char *ifname);
-  int (*register_sta_to_events)(l_list *events, wv_ipstation *ipsta, const char *reg_str, size_t len);
-  int (*unregister_sta_from_events)(l_list *events, wv_ipstation *ipsta);
-  int (*send_event)(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *event, void *info, l_list *events, uint8_t *state);
+  int (*register_sta_to_events)(hash_table *events, wv_ipstation *ipsta, const char *reg_str, size_t len);
+  int (*unregister_sta_from_events)(hash_table *events, wv_ipstation *ipsta);
+  int (*send_event)(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *event, void *info, hash_table *events, uint8_t *state);
 } manager_apis;
 
+/* If 'sharded' is set, commands and events of every attached interface are
+ * executed by a serializer of its own, so interfaces progress in parallel while
+ * keeping a strict order per interface. Otherwise a single serializer is used */
 iface_manager * iface_manager_init(wv_ipserver *ipserver, manager_apis *man_apis,
 				   l_list *seed_ifaces, uint8_t iftype,
-				   unsigned int detach_time);
+				   unsigned int detach_time, bool sharded);
 
 int iface_manager_deinit(iface_manager *manager);
 
 int iface_manager_sta_cmd_async(iface_manager *manager, wv_ipstation *ipsta,
-				uint8_t seq_num, wv_ipc_msg *cmd);
+				uint32_t seq_num, wv_ipc_msg *cmd);
 
 int iface_manager_event_received(iface_manager *manager, wv_ipc_msg *event,
 				 const char *ifname, size_t ifnamsiz, void *info);
 
 int iface_manager_sta_disconnected(iface_manager *manager, wv_ipstation *ipsta);
 
+/* Calls 'cb' with the statistics of every serializer of the manager. 'ifname'
+ * is the interface of a sharded serializer, NULL for the manager's serializer */
+typedef void (*iface_serializer_stats_cb)(const char *ifname, serializer_stats *stats,
+					  void *arg);
+
+void iface_manager_serializers_stats(iface_manager *manager,
+				     iface_serializer_stats_cb cb, void *arg);
+
 #endif /* __WAVE_IFACE_MANAGER__H__ */
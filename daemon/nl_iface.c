@@ -12,6 +12,8 @@
 #include "dwpal_daemon.h"
 #include "dwpal_ext.h"
 #include "linked_list.h"
+#include "hash_table.h"
+#include "dwpald_metrics.h"
 #include "logs.h"
 
 #include <stdlib.h>
@@ -36,7 +38,7 @@ static int is_attached = 0;
 typedef struct {
 	wv_ipserver *ipserver;
 	wv_ipstation *ipsta;
-	uint8_t seq_num;
+	uint32_t seq_num;
 	int is_multi_msg;
 	int invoked;
 } nl_response_forward_to;
@@ -79,13 +81,41 @@ static int dwpal_ext_nl80211_callback(struct nl_msg *msg, void *arg)
 	return NL_SKIP;
 }
 
+/* Commands are accounted by nl80211 command, vendor commands by subcommand */
+static void nl_cmd_metrics_done(struct nlmsghdr *hdr, uint64_t start_us, bool failed)
+{
+	struct genlmsghdr *ghdr = (struct genlmsghdr *)nlmsg_data(hdr);
+	struct nlattr *attr;
+	char cmd_name[32];
+	int ifindex = 0, len;
+
+	if (hdr->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN)
+		return;
+
+	attr = nlmsg_find_attr(hdr, GENL_HDRLEN, NL80211_ATTR_IFINDEX);
+	if (attr)
+		ifindex = (int)nla_get_u32(attr);
+
+	attr = nlmsg_find_attr(hdr, GENL_HDRLEN, NL80211_ATTR_VENDOR_SUBCMD);
+	if (ghdr->cmd == NL80211_CMD_VENDOR && attr)
+		len = sprintf_s(cmd_name, sizeof(cmd_name), "vendor_%u", nla_get_u32(attr));
+	else
+		len = sprintf_s(cmd_name, sizeof(cmd_name), "cmd_%u", ghdr->cmd);
+	if (len <= 0)
+		return;
+
+	dwpald_metrics_cmd_done(DWPALD_IF_TYPE_KERNEL, NULL, ifindex, cmd_name, len,
+				start_us, failed);
+}
+
 static int nl_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
-			      wv_ipstation *ipsta, uint8_t seq_num)
+			      wv_ipstation *ipsta, uint32_t seq_num)
 {
 	struct nl_msg *msg = NULL;
 	struct nlmsghdr *hdr;
 	nl_response_forward_to to;
 	DWPAL_Ret dpal_ret;
+	uint64_t start_us;
 	int res = 0;
 
 	LOG(2, "executing nl command from serializer ctx");
@@ -104,9 +134,11 @@ static int nl_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
 	to.invoked = 0;
 	to.is_multi_msg = !!(hdr->nlmsg_flags & NLM_F_DUMP);
 
+	start_us = dwpald_metrics_now_us();
 	dpal_ret = dwpal_ext_nl80211_cmd_send(msg, &res, dwpal_ext_nl80211_callback, &to, false);
 	if (dpal_ret != DWPAL_SUCCESS)
 		ELOG("nl80211 cmd send returned err %d", dpal_ret);
+	nl_cmd_metrics_done(hdr, start_us, dpal_ret != DWPAL_SUCCESS || res < 0);
 
 	if (!to.invoked || to.is_multi_msg) {
 		wv_ipc_msg *resp;
@@ -139,6 +171,8 @@ static DWPAL_Ret dwpal_nlVendorEventCallback(char *ifname, int event, int subeve
 	size_t total_msg_size = 0, reserve_size;
 	uint16_t data_size = (uint16_t)len;
 	int *extra_info = NULL;
+	char op_code[32];
+	int op_code_len;
 
 	LOG(2, "got dwpal_nlVendorEventCallback ifname=%s event=%d sub=%d len=%zu",
 	    ifname, event, subevent, len);
@@ -153,6 +187,10 @@ static DWPAL_Ret dwpal_nlVendorEventCallback(char *ifname, int event, int subeve
 		return DWPAL_FAILURE;
 	}
 
+	op_code_len = sprintf_s(op_code, sizeof(op_code), "vendor_%d", subevent);
+	if (op_code_len > 0)
+		dwpald_metrics_event(DWPALD_IF_TYPE_DRIVER, op_code, op_code_len);
+
 	if ((e_msg = wave_ipc_msg_alloc()) == NULL)
 		return DWPAL_FAILURE;
 
@@ -201,6 +239,21 @@ static DWPAL_Ret dwpal_nlVendorEventCallback(char *ifname, int event, int subeve
 	return DWPAL_SUCCESS;
 }
 
+static void nl_event_metrics(struct nl_msg *msg)
+{
+	struct nlmsghdr *hdr = nlmsg_hdr(msg);
+	struct genlmsghdr *ghdr = (struct genlmsghdr *)nlmsg_data(hdr);
+	char op_code[32];
+	int len;
+
+	if (hdr->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN)
+		return;
+
+	len = sprintf_s(op_code, sizeof(op_code), "cmd_%u", ghdr->cmd);
+	if (len > 0)
+		dwpald_metrics_event(DWPALD_IF_TYPE_KERNEL, op_code, len);
+}
+
 static DWPAL_Ret dwpal_nlNonVendorEventCallback(struct nl_msg *msg)
 {
 	wv_ipc_msg *e_msg;
@@ -208,6 +261,8 @@ static DWPAL_Ret dwpal_nlNonVendorEventCallback(struct nl_msg *msg)
 
 	LOG(2, "got dwpal_nlNonVendorEventCallback");
 
+	nl_event_metrics(msg);
+
 	e_msg = dwpald_ipc_msg_from_nl_msg(msg);
 	if (e_msg == NULL) {
 		ELOG("failed to copy nl_msg into ipc_msg");
@@ -272,18 +327,12 @@ static int nl_iface_detach(char *ifname)
 	return 0;
 }
 
-static int nl_manager_register_sta_to_drv_event(l_list *events, wv_ipstation *ipsta,
+static int nl_manager_register_sta_to_drv_event(hash_table *events, wv_ipstation *ipsta,
 						uint32_t nl_id)
 {
-	drv_event *event = NULL;
-
-	list_foreach_start(events, tmp, drv_event)
-		if (tmp->nl_id == nl_id) {
-			event = tmp;
-			break;
-		}
-	list_foreach_end
+	drv_event *event;
 
+	event = (drv_event*)hash_table_find(events, &nl_id);
 	if (event) {
 		list_remove(event->registered_stations, ipsta);
 		list_push_front(event->registered_stations, ipsta);
@@ -300,8 +349,12 @@ static int nl_manager_register_sta_to_drv_event(l_list *events, wv_ipstation *ip
 		}
 
 		event->nl_id = nl_id;
+		if (hash_table_insert(events, &event->nl_id, event)) {
+			list_free(event->registered_stations);
+			free(event);
+			return 1;
+		}
 		list_push_front(event->registered_stations, ipsta);
-		list_push_front(events, event);
 		LOG(2, "registered %s to newly created drv event %u",
 		    wave_ipcs_sta_name(ipsta), nl_id);
 	}
@@ -309,7 +362,7 @@ static int nl_manager_register_sta_to_drv_event(l_list *events, wv_ipstation *ip
 	return 0;
 }
 
-static int nl_register_sta_to_events(l_list *events, wv_ipstation *ipsta,
+static int nl_register_sta_to_events(hash_table *events, wv_ipstation *ipsta,
 				     const char *reg_str, size_t len)
 {
 	const uint32_t *data = (const uint32_t*)reg_str;
@@ -338,40 +391,40 @@ static int nl_register_sta_to_events(l_list *events, wv_ipstation *ipsta,
 	return 0;
 }
 
-static int nl_unregister_sta_from_events(l_list *events, wv_ipstation *ipsta)
+static int nl_unregister_sta_from_drv_event(void *obj, void *arg)
 {
-	list_foreach_start(events, event, drv_event)
-		list_remove(event->registered_stations, ipsta);
-		if (!list_get_size(event->registered_stations)) {
-			list_foreach_remove_current_entry();
-			LOG(2, "drv event %u is deleted due to no stations left",
-			    event->nl_id);
+	drv_event *event = (drv_event*)obj;
 
-			list_free(event->registered_stations);
-			free(event);
-		}
-	list_foreach_end
+	list_remove(event->registered_stations, (wv_ipstation*)arg);
+	if (list_get_size(event->registered_stations))
+		return 0;
+
+	LOG(2, "drv event %u is deleted due to no stations left",
+	    event->nl_id);
+
+	list_free(event->registered_stations);
+	free(event);
+	return 1;
+}
+
+static int nl_unregister_sta_from_events(hash_table *events, wv_ipstation *ipsta)
+{
+	hash_table_walk(events, nl_unregister_sta_from_drv_event, ipsta);
 
 	return 0;
 }
 
 static int nl_send_drv_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *e_msg,
-			     void *info, l_list *events, uint8_t *state)
+			     void *info, hash_table *events, uint8_t *state)
 {
-	drv_event *event = NULL;
+	drv_event *event;
 	uint32_t nl_id;
 
 	(void)state;
 	(void)ifname;
 
 	nl_id = *(int *)info;
-	list_foreach_start(events, tmp, drv_event)
-		if (tmp->nl_id == nl_id) {
-			event = tmp;
-			break;
-		}
-	list_foreach_end
-
+	event = (drv_event*)hash_table_find(events, &nl_id);
 	if (event == NULL) {
 		LOG(2, "no station registered to this event");
 		return 0;
@@ -391,6 +444,8 @@ static int nl_send_drv_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *e_ms
 }
 
 static manager_apis apis = {
+	.events_hash = hash_u32,
+	.events_cmp = hash_u32_cmp,
 	.execute_command = nl_execute_command,
 	.iface_attach = nl_iface_attach,
 	.iface_detach = nl_iface_detach,
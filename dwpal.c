@@ -18,11 +18,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <fcntl.h>
 
 #include <linux/types.h>
 #include <libnl3/netlink/socket.h>
 #include <libnl3/netlink/genl/ctrl.h>
 #include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include <net/if.h>
 
@@ -89,6 +91,12 @@ nlService_t gNlServices[] = { { NL_SERVICE_VENDOR, "vendor"} ,
 static pthread_mutex_t hostap_context = PTHREAD_MUTEX_INITIALIZER;
 #endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
 
+typedef struct
+{
+	char     ifname[DWPAL_VAP_NAME_STRING_LENGTH];
+	unsigned ifindex;  /* 0 if the entry is free */
+} DWPAL_ifindexCacheEntry;
+
 typedef struct
 {
 	union
@@ -102,6 +110,7 @@ typedef struct
 			struct wpa_ctrl *wpaCtrlPtr;
 			struct wpa_ctrl *listenerWpaCtrlPtr;   /*needed when closing it*/
 			int    fd;
+			bool   isEventSocketFailed;  /* set once receiving an event failed on the socket */
 			DWPAL_wpaCtrlEventCallback wpaCtrlEventCallback;  /* callback function for hostapd received events while command is being sent; can be NULL */
 		} hostapd;
 #endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
@@ -111,6 +120,19 @@ typedef struct
 			int    fd, fdCmdGet, nl80211_id;
 			DWPAL_nlVendorEventCallback nlEventCallback, nlCmdGetCallback;
 			DWPAL_nlNonVendorEventCallback nlNonVendorEventCallback;
+			DWPAL_nl80211Request *inFlight[DWPAL_NL_MAX_IN_FLIGHT];  /* pipelined commands on nlSocketCmdGet */
+			size_t numInFlight;
+			size_t numOfDone;  /* commands completed by the current dwpal_nl80211_cmd_complete() */
+			/* allocated once by the attach and reused by every call */
+			struct nl_cb  *cbEvent, *cbCmdGet, *cbPipeline;
+			int    cbEventErr, cbCmdGetErr;
+			struct nl_msg *cmdMsg;
+			pthread_mutex_t cmdMsgLock;
+			/* ifname to ifindex, an entry is dropped once RTNETLINK notifies on rtnlFd a change of its link */
+			DWPAL_ifindexCacheEntry ifindexCache[DWPAL_NL_IFINDEX_CACHE_SIZE];
+			size_t ifindexCacheNext;  /* entry replaced when the cache is full */
+			int    rtnlFd;
+			pthread_mutex_t ifindexLock;
 		} driver;
 	} interface;
 } DWPAL_Context;
@@ -641,6 +663,130 @@ static DWPAL_Ret scanParamHandle(struct nl_msg *msg, ScanParams *scanParams)
 }
 
 
+static int rtnlLinkSocketCreate(void)
+{
+	struct sockaddr_nl addr;
+	int                fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0)
+	{
+		console_printf("%s; socket() failed; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		console_printf("%s; bind() failed; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Reads the pending link notifications and drops the entries of the links
+   which were changed or removed. Must be called with ifindexLock held */
+static void ifindexCacheUpdate(DWPAL_Context *localContext)
+{
+	char                    buf[4096] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+	DWPAL_ifindexCacheEntry *cache = localContext->interface.driver.ifindexCache;
+	struct nlmsghdr         *nlh;
+	struct ifinfomsg        *ifi;
+	ssize_t                 len;
+	size_t                  i;
+
+	while (true)
+	{
+		len = recv(localContext->interface.driver.rtnlFd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == ENOBUFS)
+			{
+				/* notifications were lost */
+				memset(cache, 0, sizeof(localContext->interface.driver.ifindexCache));
+				continue;
+			}
+
+			if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) )
+				console_printf("%s; recv() failed; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+			return;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+		{
+			if ( ((nlh->nlmsg_type != RTM_NEWLINK) && (nlh->nlmsg_type != RTM_DELLINK)) ||
+			     (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi))) )
+			{
+				continue;
+			}
+
+			ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+			for (i = 0; i < ARRAY_SIZE(localContext->interface.driver.ifindexCache); i++)
+			{
+				if (cache[i].ifindex == (unsigned)ifi->ifi_index)
+					cache[i].ifindex = 0;
+			}
+		}
+	}
+}
+
+/* if_nametoindex() of the interface, cached until its link changes */
+static unsigned ifindexGet(DWPAL_Context *localContext, const char *ifname)
+{
+	DWPAL_ifindexCacheEntry *cache = localContext->interface.driver.ifindexCache;
+	size_t                  i, freeIdx = ARRAY_SIZE(localContext->interface.driver.ifindexCache);
+	unsigned                ifindex;
+
+	/* without the notifications the entries can't be invalidated */
+	if (localContext->interface.driver.rtnlFd < 0)
+		return if_nametoindex(ifname);
+
+	MUTEX_LOCK(&localContext->interface.driver.ifindexLock);
+
+	ifindexCacheUpdate(localContext);
+
+	for (i = 0; i < ARRAY_SIZE(localContext->interface.driver.ifindexCache); i++)
+	{
+		if (cache[i].ifindex == 0)
+		{
+			if (freeIdx == ARRAY_SIZE(localContext->interface.driver.ifindexCache))
+				freeIdx = i;
+			continue;
+		}
+
+		if (!strncmp(cache[i].ifname, ifname, sizeof(cache[i].ifname)))
+		{
+			ifindex = cache[i].ifindex;
+			MUTEX_UNLOCK(&localContext->interface.driver.ifindexLock);
+			return ifindex;
+		}
+	}
+
+	ifindex = if_nametoindex(ifname);
+	if (ifindex != 0)
+	{
+		if (freeIdx == ARRAY_SIZE(localContext->interface.driver.ifindexCache))
+		{
+			freeIdx = localContext->interface.driver.ifindexCacheNext;
+			localContext->interface.driver.ifindexCacheNext = (freeIdx + 1) % ARRAY_SIZE(localContext->interface.driver.ifindexCache);
+		}
+
+		if (strcpy_s(cache[freeIdx].ifname, sizeof(cache[freeIdx].ifname), ifname) == 0)
+			cache[freeIdx].ifindex = ifindex;
+	}
+
+	MUTEX_UNLOCK(&localContext->interface.driver.ifindexLock);
+	return ifindex;
+}
+
+
 static DWPAL_Ret scanPerform(void *context, char *ifname, enum nl80211_commands nl80211Command, int flags, DWPAL_nlNonVendorEventCallback nlEventCallback, ScanParams *scanParams)
 {
 	int              res;
@@ -683,7 +829,7 @@ static DWPAL_Ret scanPerform(void *context, char *ifname, enum nl80211_commands
 	/* calling genlmsg_put() is a must! without it, the callback won't be called! */
 	genlmsg_put(msg, 0, 0, localContext->interface.driver.nl80211_id, 0, flags, nl80211Command, 0);
 
-	devidx = if_nametoindex(ifname);
+	devidx = ifindexGet(localContext, ifname);
 	if (devidx < 0)
 	{
 		console_printf("%s; devidx ERROR (devidx= %lld) ==> Abort!\n", __FUNCTION__, devidx);
@@ -725,7 +871,7 @@ static DWPAL_Ret scanPerform(void *context, char *ifname, enum nl80211_commands
 }
 
 
-static DWPAL_Ret nlSocketCreate(struct nl_sock **nlSocket, int *fd)
+static DWPAL_Ret nlSocketCreate(struct nl_sock **nlSocket, int *fd, int rxBufSize)
 {
 	int res = 1;
 
@@ -744,7 +890,7 @@ static DWPAL_Ret nlSocketCreate(struct nl_sock **nlSocket, int *fd)
 		return DWPAL_FAILURE;
 	}
 
-	if (nl_socket_set_buffer_size(*nlSocket, DRIVER_NL_TO_DWPAL_MSG_LENGTH, DRIVER_NL_TO_DWPAL_MSG_LENGTH) != 0)
+	if (nl_socket_set_buffer_size(*nlSocket, rxBufSize, DRIVER_NL_TO_DWPAL_MSG_LENGTH) != 0)
 	{
 		console_printf("%s; nl_socket_set_buffer_size ERROR ==> Abort!\n", __FUNCTION__);
 		nl_socket_free(*nlSocket);
@@ -1198,92 +1344,36 @@ DWPAL_Ret dwpal_driver_nl_scan_trigger(void *context, char *ifname, ScanParams *
 	return scanPerform(context, ifname, NL80211_CMD_TRIGGER_SCAN, 0, NULL, scanParams);
 }
 
-/**************************************************************************/
-/*! \fn DWPAL_Ret dwpal_driver_nl_cmd_send(void *context, DWPAL_NlEventType nlEventType, char *ifname, enum nl80211_commands nl80211Command, CmdIdType cmdIdType, enum ltq_nl80211_vendor_subcmds subCommand, unsigned char *vendorData, size_t vendorDataSize)
- **************************************************************************
- *  \brief driver-NL send command
- *  \param[in] void *context - Provides all the interface information
- *  \param[in] DWPAL_NlEventType nlEventType - Indicates which command it is: regular command or a "get" command
- *  \param[in] char *ifname - the radio interface
- *  \param[in] unsigned int nl80211Command - NL 80211 command. Note: currently we support ONLY NL80211_CMD_VENDOR (0x67)
- *  \param[in] CmdIdType cmdIdType - The command ID type: NETDEV, PHY or WDEV
- *  \param[in] unsigned int subCommand - the vendor’s sub-command
- *  \param[in] unsigned char *vendorData - the vendor’s data (can be NULL)
- *  \param[in] size_t vendorDataSize - the vendor’s data length (if the vendor data is NULL, it should be ‘0’)
- *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
- ***************************************************************************/
-DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
-                                   DWPAL_NlEventType nlEventType,
-								   char *ifname,
-								   enum nl80211_commands nl80211Command,
-								   CmdIdType cmdIdType,
-								   enum ltq_nl80211_vendor_subcmds subCommand,
-								   unsigned char *vendorData,
-								   size_t vendorDataSize)
+/* Empties a message for reuse, genlmsg_put() fills its header again */
+static void nlMsgReset(struct nl_msg *msg)
 {
-	int              i, res;
-	struct nl_msg    *msg;
-	DWPAL_Context    *localContext = (DWPAL_Context *)(context);
-	signed long long devidx = 0;
-	struct nl_sock   *nlSocket = NULL;
-
-	console_printf("%s Entry\n", __FUNCTION__);
-
-	if (nl80211Command != NL80211_CMD_VENDOR /*0x67*/)
-	{
-		console_printf("%s; non supported command (0x%x); currently we support ONLY NL80211_CMD_VENDOR (0x67) ==> Abort!\n", __FUNCTION__, (unsigned int)nl80211Command);
-		return DWPAL_FAILURE;
-	}
-
-	for (i=0; i < (int)vendorDataSize; i++)
-	{
-		console_printf("%s; vendorData[%d]= 0x%02x\n", __FUNCTION__, i, ((const char*)vendorData)[i]);
-	}
-
-	if (nlEventType == DWPAL_NL_UNSOLICITED_EVENT)
-	{
-		nlSocket = localContext->interface.driver.nlSocketEvent;
-	}
-	else if (nlEventType == DWPAL_NL_SOLICITED_EVENT)
-	{
-		nlSocket = localContext->interface.driver.nlSocketCmdGet;
-	}
-	else
-	{
-		console_printf("%s; invalid nlEventType (%d) ==> Abort!\n", __FUNCTION__, nlEventType);
-		return DWPAL_FAILURE;
-	}
-
-	if (localContext == NULL)
-	{
-		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
 
-	if (nlSocket == NULL)
-	{
-		console_printf("%s; nlSocket is NULL ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
+	memset(nlh, 0, NLMSG_HDRLEN);
+	nlh->nlmsg_len = NLMSG_HDRLEN;
+}
 
-	msg = nlmsg_alloc();
-	if (msg == NULL)
-	{
-		console_printf("%s; nlmsg_alloc returned NULL ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
+static DWPAL_Ret nlVendorMsgBuild(DWPAL_Context *localContext,
+				  struct nl_msg *msg,
+				  char *ifname,
+				  CmdIdType cmdIdType,
+				  enum ltq_nl80211_vendor_subcmds subCommand,
+				  unsigned char *vendorData,
+				  size_t vendorDataSize)
+{
+	int              res;
+	signed long long devidx = 0;
 
-	console_printf("%s; nl80211_id= %d, nl80211Command= %d\n", __FUNCTION__, localContext->interface.driver.nl80211_id, nl80211Command);
+	console_printf("%s; nl80211_id= %d, subCommand= %d\n", __FUNCTION__, localContext->interface.driver.nl80211_id, subCommand);
 
 	/* calling genlmsg_put() is a must! without it, the callback won't be called! */
-	genlmsg_put(msg, 0, 0, localContext->interface.driver.nl80211_id, 0,0, nl80211Command /* NL80211_CMD_VENDOR=0x67*/, 0);
+	genlmsg_put(msg, 0, 0, localContext->interface.driver.nl80211_id, 0,0, NL80211_CMD_VENDOR /*0x67*/, 0);
 
 	//iw dev wlan0 vendor recv 0xAC9A96 0x69 0x00 ==> send "0xAC9A96 0x69 0x00"
-	devidx = if_nametoindex(ifname);
+	devidx = ifindexGet(localContext, ifname);
 	if (devidx < 0)
 	{
 		console_printf("%s; devidx ERROR (devidx= %lld) ==> Abort!\n", __FUNCTION__, devidx);
-		nlmsg_free(msg);
 		return DWPAL_FAILURE;
 	}
 
@@ -1306,14 +1396,12 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 
 		default:
 			console_printf("%s; cmdIdType ERROR (cmdIdType= %d) ==> Abort!\n", __FUNCTION__, cmdIdType);
-			nlmsg_free(msg);
 			return DWPAL_FAILURE;
 	}
 
 	if (res < 0)
 	{
 		console_printf("%s; building message failed ==> Abort!\n", __FUNCTION__);
-		nlmsg_free(msg);
 		return DWPAL_FAILURE;
 	}
 
@@ -1322,7 +1410,6 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 	if (res < 0)
 	{
 		console_printf("%s; building message failed ==> Abort!\n", __FUNCTION__);
-		nlmsg_free(msg);
 		return DWPAL_FAILURE;
 	}
 
@@ -1331,7 +1418,6 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 	if (res < 0)
 	{
 		console_printf("%s; building message failed ==> Abort!\n", __FUNCTION__);
-		nlmsg_free(msg);
 		return DWPAL_FAILURE;
 	}
 
@@ -1342,22 +1428,152 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 		if (res < 0)
 		{
 			console_printf("%s; building message failed ==> Abort!\n", __FUNCTION__);
-			nlmsg_free(msg);
 			return DWPAL_FAILURE;
 		}
 	}
 
+	return DWPAL_SUCCESS;
+}
+
+/**************************************************************************/
+/*! \fn struct nl_msg *dwpal_driver_nl_vendor_msg_alloc(void *context, char *ifname, CmdIdType cmdIdType, enum ltq_nl80211_vendor_subcmds subCommand, unsigned char *vendorData, size_t vendorDataSize)
+ **************************************************************************
+ *  \brief driver-NL build a vendor command, e.g. for dwpal_nl80211_cmd_submit()
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[in] char *ifname - the radio interface
+ *  \param[in] CmdIdType cmdIdType - The command ID type: NETDEV, PHY or WDEV
+ *  \param[in] unsigned int subCommand - the vendor’s sub-command
+ *  \param[in] unsigned char *vendorData - the vendor’s data (can be NULL)
+ *  \param[in] size_t vendorDataSize - the vendor’s data length (if the vendor data is NULL, it should be ‘0’)
+ *  \return struct nl_msg * (the message, to be freed by the caller; NULL for failure)
+ ***************************************************************************/
+struct nl_msg *dwpal_driver_nl_vendor_msg_alloc(void *context,
+						char *ifname,
+						CmdIdType cmdIdType,
+						enum ltq_nl80211_vendor_subcmds subCommand,
+						unsigned char *vendorData,
+						size_t vendorDataSize)
+{
+	struct nl_msg    *msg;
+	DWPAL_Context    *localContext = (DWPAL_Context *)(context);
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	msg = nlmsg_alloc();
+	if (msg == NULL)
+	{
+		console_printf("%s; nlmsg_alloc returned NULL ==> Abort!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	if (nlVendorMsgBuild(localContext, msg, ifname, cmdIdType, subCommand, vendorData, vendorDataSize) == DWPAL_FAILURE)
+	{
+		nlmsg_free(msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_driver_nl_cmd_send(void *context, DWPAL_NlEventType nlEventType, char *ifname, enum nl80211_commands nl80211Command, CmdIdType cmdIdType, enum ltq_nl80211_vendor_subcmds subCommand, unsigned char *vendorData, size_t vendorDataSize)
+ **************************************************************************
+ *  \brief driver-NL send command
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[in] DWPAL_NlEventType nlEventType - Indicates which command it is: regular command or a "get" command
+ *  \param[in] char *ifname - the radio interface
+ *  \param[in] unsigned int nl80211Command - NL 80211 command. Note: currently we support ONLY NL80211_CMD_VENDOR (0x67)
+ *  \param[in] CmdIdType cmdIdType - The command ID type: NETDEV, PHY or WDEV
+ *  \param[in] unsigned int subCommand - the vendor’s sub-command
+ *  \param[in] unsigned char *vendorData - the vendor’s data (can be NULL)
+ *  \param[in] size_t vendorDataSize - the vendor’s data length (if the vendor data is NULL, it should be ‘0’)
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
+                                   DWPAL_NlEventType nlEventType,
+								   char *ifname,
+								   enum nl80211_commands nl80211Command,
+								   CmdIdType cmdIdType,
+								   enum ltq_nl80211_vendor_subcmds subCommand,
+								   unsigned char *vendorData,
+								   size_t vendorDataSize)
+{
+	int              res;
+	struct nl_msg    *msg;
+	DWPAL_Context    *localContext = (DWPAL_Context *)(context);
+	struct nl_sock   *nlSocket = NULL;
+
+	console_printf("%s Entry\n", __FUNCTION__);
+
+	if (nl80211Command != NL80211_CMD_VENDOR /*0x67*/)
+	{
+		console_printf("%s; non supported command (0x%x); currently we support ONLY NL80211_CMD_VENDOR (0x67) ==> Abort!\n", __FUNCTION__, (unsigned int)nl80211Command);
+		return DWPAL_FAILURE;
+	}
+
+#if defined DWPAL_NL_VENDOR_DATA_DUMP
+	{
+		size_t i;
+
+		for (i = 0; i < vendorDataSize; i++)
+		{
+			console_printf("%s; vendorData[%zu]= 0x%02x\n", __FUNCTION__, i, vendorData[i]);
+		}
+	}
+#endif
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (nlEventType == DWPAL_NL_UNSOLICITED_EVENT)
+	{
+		nlSocket = localContext->interface.driver.nlSocketEvent;
+	}
+	else if (nlEventType == DWPAL_NL_SOLICITED_EVENT)
+	{
+		nlSocket = localContext->interface.driver.nlSocketCmdGet;
+	}
+	else
+	{
+		console_printf("%s; invalid nlEventType (%d) ==> Abort!\n", __FUNCTION__, nlEventType);
+		return DWPAL_FAILURE;
+	}
+
+	if (nlSocket == NULL)
+	{
+		console_printf("%s; nlSocket is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	/* the message is built in the context's message, instead of allocating one per command */
+	MUTEX_LOCK(&localContext->interface.driver.cmdMsgLock);
+	msg = localContext->interface.driver.cmdMsg;
+	nlMsgReset(msg);
+
+	if (nlVendorMsgBuild(localContext, msg, ifname, cmdIdType, subCommand, vendorData, vendorDataSize) == DWPAL_FAILURE)
+	{
+		MUTEX_UNLOCK(&localContext->interface.driver.cmdMsgLock);
+		console_printf("%s; nlVendorMsgBuild returned ERROR ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
 	/* will trigger nlInternalEventCallback() / nlInternalCmdGetCallback() function call */
 	res = nl_send_auto(nlSocket, msg);  // can use nl_send_auto_complete(nlSocket, msg) instead
+	MUTEX_UNLOCK(&localContext->interface.driver.cmdMsgLock);
 	if (res < 0)
 	{
 		console_printf("%s; nl_send_auto returned ERROR (res= %d) ==> Abort!\n", __FUNCTION__, res);
-		nlmsg_free(msg);
 		return DWPAL_FAILURE;
 	}
 
-	nlmsg_free(msg);
-
 	return DWPAL_SUCCESS;
 }
 
@@ -1374,7 +1590,6 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 DWPAL_Ret dwpal_driver_nl_msg_get(void *context, DWPAL_NlEventType nlEventType, DWPAL_nlVendorEventCallback nlEventCallback, DWPAL_nlNonVendorEventCallback nlNonVendorEventCallback)
 {
 	int           res, err = 0;
-	struct nl_cb  *cb;
 	DWPAL_Context *localContext = (DWPAL_Context *)(context);
 
 	console_printf("%s Entry; nlEventType= %d (DWPAL_NL_UNSOLICITED_EVENT=0, DWPAL_NL_SOLICITED_EVENT=1)\n", __FUNCTION__, nlEventType);
@@ -1392,47 +1607,32 @@ DWPAL_Ret dwpal_driver_nl_msg_get(void *context, DWPAL_NlEventType nlEventType,
 		return DWPAL_FAILURE;
 	}
 
-	/* Connect the nl socket to its message callback function */
-	cb = nl_cb_alloc(NL_CB_DEFAULT);
-
-	if (cb == NULL)
-	{
-		console_printf("%s; failed to allocate netlink callbacks ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
-
-	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, &err);
-	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
-	nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, finish, context);
-	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, NULL);
-	if (nlEventType == DWPAL_NL_UNSOLICITED_EVENT)
+	/* The nl sockets are connected to their message callback functions by the attach (see nlCbCreate()) */
+	if (nlEventType == DWPAL_NL_UNSOLICITED_EVENT)
 	{
 		/* nlEventCallback can be NULL; in that case, the D-WPAL client's callback function won't be called */
 		localContext->interface.driver.nlEventCallback = nlEventCallback;
 		if (nlNonVendorEventCallback != NULL)
 			localContext->interface.driver.nlNonVendorEventCallback = nlNonVendorEventCallback;
 
-		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, nlInternalEventCallback, context);
-
 		/* will trigger nlEventCallback() function call */
-		res = nl_recvmsgs(localContext->interface.driver.nlSocketEvent, cb);
-		nl_cb_put(cb);
+		localContext->interface.driver.cbEventErr = 0;
+		res = nl_recvmsgs(localContext->interface.driver.nlSocketEvent, localContext->interface.driver.cbEvent);
+		err = localContext->interface.driver.cbEventErr;
 	}
 	else if (nlEventType == DWPAL_NL_SOLICITED_EVENT)
 	{
 		/* nlEventCallback can be NULL; in that case, the D-WPAL client's callback function won't be called */
 		localContext->interface.driver.nlCmdGetCallback = nlEventCallback;
 
-		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, nlInternalCmdGetCallback, context);
-
 		/* will trigger nlEventCallback() function call */
-		res = nl_recvmsgs(localContext->interface.driver.nlSocketCmdGet, cb);
-		nl_cb_put(cb);
+		localContext->interface.driver.cbCmdGetErr = 0;
+		res = nl_recvmsgs(localContext->interface.driver.nlSocketCmdGet, localContext->interface.driver.cbCmdGet);
+		err = localContext->interface.driver.cbCmdGetErr;
 	}
 	else
 	{
 		console_printf("%s; invalid nlEventType (%d) ==> Abort!\n", __FUNCTION__, nlEventType);
-		nl_cb_put(cb);
 		return DWPAL_FAILURE;
 	}
 
@@ -1442,234 +1642,673 @@ DWPAL_Ret dwpal_driver_nl_msg_get(void *context, DWPAL_NlEventType nlEventType,
 		return DWPAL_FAILURE;
 	}
 
-	return DWPAL_SUCCESS;
+	return DWPAL_SUCCESS;
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_driver_nl_fd_get(void *context, int *fd , int *fdCmdGet)
+ **************************************************************************
+ *  \brief Driver-NL fd get, Will fill up the fd output parameters - one of the event, and the other of the "get" command
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[out] int *fd - Provides the interface's fd value
+ *  \param[out] int *fdCmdGet - Provides the interface's fd value of the "get" command
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_driver_nl_fd_get(void *context, int *fd /*OUT*/, int *fdCmdGet /*OUT*/)
+{
+	if ( (context == NULL) || (fd == NULL) || (fdCmdGet == NULL) )
+	{
+		console_printf("%s; context and/or fd, fdCmdGet is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	*fd = ((DWPAL_Context *)context)->interface.driver.fd;
+	if (*fd == (-1))
+	{
+		console_printf("%s; fd value is (-1) ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	*fdCmdGet = ((DWPAL_Context *)context)->interface.driver.fdCmdGet;
+	if (*fdCmdGet == (-1))
+	{
+		console_printf("%s; fdCmdGet value is (-1) ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	return DWPAL_SUCCESS;
+}
+
+
+static int finish_handler(struct nl_msg *msg, void *arg)
+{
+	int *ret = arg;
+	(void)msg;
+
+	if (ret)
+		*ret = 0;
+	return NL_SKIP;
+}
+
+
+static int dwpal_empty_nl80211Callback(struct nl_msg *msg, void *arg)
+{
+	(void)msg;
+	(void)arg;
+	return NL_SKIP;
+}
+
+
+/* Pipelined commands: replies of the commands in flight on nlSocketCmdGet are
+   matched to their request by the netlink sequence number */
+
+static DWPAL_nl80211Request *nlInFlightFind(DWPAL_Context *localContext, unsigned int seq)
+{
+	size_t i;
+
+	for (i = 0; i < localContext->interface.driver.numInFlight; i++)
+	{
+		if (localContext->interface.driver.inFlight[i]->seq == seq)
+			return localContext->interface.driver.inFlight[i];
+	}
+
+	return NULL;
+}
+
+static void nlInFlightDone(DWPAL_Context *localContext, DWPAL_nl80211Request *req, int cmd_res)
+{
+	size_t i, last = localContext->interface.driver.numInFlight - 1;
+
+	for (i = 0; i <= last; i++)
+	{
+		if (localContext->interface.driver.inFlight[i] == req)
+		{
+			localContext->interface.driver.inFlight[i] = localContext->interface.driver.inFlight[last];
+			localContext->interface.driver.numInFlight--;
+			break;
+		}
+	}
+
+	req->cmd_res = cmd_res;
+	if (req->doneCallback)
+		req->doneCallback(req);
+}
+
+static void nlInFlightAbort(DWPAL_Context *localContext, int cmd_res)
+{
+	while (localContext->interface.driver.numInFlight > 0)
+	{
+		DWPAL_nl80211Request *req = localContext->interface.driver.inFlight[0];
+
+		console_printf("%s; seq= %u aborted (cmd_res= %d)\n", __FUNCTION__, req->seq, cmd_res);
+		nlInFlightDone(localContext, req, cmd_res);
+	}
+}
+
+static bool nlInFlightHasDump(DWPAL_Context *localContext)
+{
+	size_t i;
+
+	for (i = 0; i < localContext->interface.driver.numInFlight; i++)
+	{
+		if (localContext->interface.driver.inFlight[i]->isDump)
+			return true;
+	}
+
+	return false;
+}
+
+/* Note: the handlers below never return NL_STOP, it would drop the replies of
+   other requests which are in the same buffer */
+
+static int nlPipelineValid(struct nl_msg *msg, void *arg)
+{
+	DWPAL_Context        *localContext = (DWPAL_Context *)arg;
+	struct nlmsghdr      *hdr = nlmsg_hdr(msg);
+	DWPAL_nl80211Request *req = nlInFlightFind(localContext, hdr->nlmsg_seq);
+
+	if (req == NULL)
+	{
+		console_printf("%s; no request for seq= %u ==> ignored\n", __FUNCTION__, hdr->nlmsg_seq);
+		return NL_SKIP;
+	}
+
+	if (hdr->nlmsg_flags & NLM_F_DUMP_INTR)
+		req->isDumpIntr = true;
+
+	if (req->nlCallback)
+		req->nlCallback(msg, req->cb_arg);
+
+	return NL_SKIP;
+}
+
+static int nlPipelineFinish(struct nl_msg *msg, void *arg)
+{
+	DWPAL_Context        *localContext = (DWPAL_Context *)arg;
+	struct nlmsghdr      *hdr = nlmsg_hdr(msg);
+	DWPAL_nl80211Request *req = nlInFlightFind(localContext, hdr->nlmsg_seq);
+
+	if (req == NULL)
+		return NL_SKIP;
+
+	if (hdr->nlmsg_flags & NLM_F_DUMP_INTR)
+		req->isDumpIntr = true;
+
+	nlInFlightDone(localContext, req, req->isDumpIntr ? -EAGAIN : 0);
+	localContext->interface.driver.numOfDone++;
+
+	return NL_SKIP;
+}
+
+static int nlPipelineError(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
+{
+	DWPAL_Context        *localContext = (DWPAL_Context *)arg;
+	DWPAL_nl80211Request *req;
+
+	(void)nla;
+	if (!err)
+		return NL_SKIP;
+
+	req = nlInFlightFind(localContext, err->msg.nlmsg_seq);
+	if (req == NULL)
+		return NL_SKIP;
+
+	console_printf_err(" ERROR: seq= %u, %s\n", req->seq, strerror(-(err->error)));
+	nlInFlightDone(localContext, req, err->error);
+	localContext->interface.driver.numOfDone++;
+
+	return NL_SKIP;
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_send(void *context, struct nl_msg *msg, DWPAL_nl80211Callback cb)
+ **************************************************************************
+ *  \brief NL80211 send command
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[in] struct nl_msg *msg - the nl command to send
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_nl80211_cmd_send(void *context, struct nl_msg *msg, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg)
+{
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
+	struct nl_sock	*nlSocket = NULL;
+	struct nl_cb 	*cb = NULL;
+	int		res = 0;
+	DWPAL_Ret	ret = DWPAL_FAILURE;
+	bool		nl_socket_clean = false;
+	int		fdCmdGet;
+
+	console_printf("%s Entry\n", __FUNCTION__);
+
+	if (msg == NULL)
+	{
+		console_printf("%s; msg is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (cmd_res == NULL)
+	{
+		console_printf("%s; cmd_res is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		goto err;
+	}
+
+	nlSocket = localContext->interface.driver.nlSocketCmdGet;
+	if (nlSocket == NULL)
+	{
+		console_printf("%s; nlSocket is NULL ==> Abort!\n", __FUNCTION__);
+		goto err;
+	}
+
+	cb = nl_cb_alloc(NL_CB_DEFAULT);
+	if (cb == NULL)
+	{
+		console_printf("%s; failed to allocate netlink callbacks ==> Abort!\n", __FUNCTION__);
+		goto err;
+	}
+
+	fdCmdGet = localContext->interface.driver.fdCmdGet;
+	if (fdCmdGet == (-1))
+	{
+		console_printf("%s; fdCmdGet value is (-1) ==> Abort!\n", __FUNCTION__);
+		goto err;
+	}
+
+	/* complete the pipelined commands first, the cleanup below would drop their replies */
+	while (localContext->interface.driver.numInFlight > 0)
+		dwpal_nl80211_cmd_complete(localContext);
+
+	while (nl_socket_clean == false)
+	{
+		fd_set		rfds;
+		struct timeval	tv;
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		FD_ZERO(&rfds);
+		FD_SET(fdCmdGet, &rfds);
+
+		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
+		if (res == -1 && errno == EINTR)
+		{
+			usleep(1000);
+			continue;
+		}
+		else if (res == -1)
+		{
+			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
+			goto err;
+		}
+		else if (res > 0 && FD_ISSET(fdCmdGet, &rfds))
+		{
+			struct nl_cb *cleanup_cb = NULL;
+
+			console_printf("%s; need to perform cleanup\n", __FUNCTION__);
+
+			cleanup_cb = nl_cb_alloc(NL_CB_DEFAULT);
+			if (cleanup_cb == NULL)
+			{
+				console_printf("%s; failed to allocate netlink callbacks ==> Abort!\n", __FUNCTION__);
+				goto err;
+			}
+
+			nl_cb_err(cleanup_cb, NL_CB_CUSTOM, error_handler, NULL);
+			nl_cb_set(cleanup_cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
+			nl_cb_set(cleanup_cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, NULL);
+			nl_cb_set(cleanup_cb, NL_CB_FINISH, NL_CB_CUSTOM, finish_handler, NULL);
+			nl_cb_set(cleanup_cb, NL_CB_VALID, NL_CB_CUSTOM, dwpal_empty_nl80211Callback, NULL);
+
+			nl_recvmsgs(nlSocket, cleanup_cb);
+			nl_cb_put(cleanup_cb);
+		}
+		else
+		{
+			nl_socket_clean = true;
+		}
+	}
+
+	res = nl_send_auto(nlSocket, msg);
+	if (res < 0)
+	{
+		console_printf("%s; nl_send_auto returned ERROR (res= %d) ==> Abort!\n", __FUNCTION__, res);
+		goto err;
+	}
+
+	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, cmd_res);
+	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
+	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, cmd_res);
+	nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, finish_handler, cmd_res);
+
+	if (nlCallback)
+	{
+		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, nlCallback, cb_arg);
+	}
+
+	*cmd_res = 1;
+	while (*cmd_res > 0)
+	{
+		fd_set		rfds;
+		struct timeval	tv;
+
+		tv.tv_sec = 2;
+		tv.tv_usec = 0;
+		FD_ZERO(&rfds);
+		FD_SET(fdCmdGet, &rfds);
+
+		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
+		if (res == -1 && errno == EINTR)
+		{
+			usleep(1000);
+			continue;
+		}
+		else if (res == -1)
+		{
+			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
+			goto err;
+		}
+		else if (res == 0)
+		{
+			console_printf("%s; Timeout ==> Abort!\n", __FUNCTION__);
+			goto err;
+		}
+
+		res = nl_recvmsgs(nlSocket, cb);
+		if (res == -NLE_DUMP_INTR)
+		{
+			console_printf("%s; nl_recvmsgs returned NLE_DUMP_INTR\n", __FUNCTION__);
+			*cmd_res = -EAGAIN;
+		}
+		else if (res < 0)
+		{
+			console_printf("%s; nl_recvmsgs returned ERROR (res= %d)\n", __FUNCTION__, res);
+		}
+	}
+
+	ret = DWPAL_SUCCESS;
+err:
+	if (cb)
+		nl_cb_put(cb);
+	nlmsg_free(msg);
+	return ret;
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_complete(void *context)
+ **************************************************************************
+ *  \brief NL80211 pipelined commands, wait until at least one of the commands in flight is completed
+ *  \param[in] void *context - Provides all the interface information
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \note if no reply is received for DWPAL_NL_CMD_TIMEOUT_MS, all the commands in flight are aborted with -ETIMEDOUT
+ ***************************************************************************/
+DWPAL_Ret dwpal_nl80211_cmd_complete(void *context)
+{
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
+	int		res, fdCmdGet;
+	DWPAL_Ret	ret = DWPAL_FAILURE;
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (localContext->interface.driver.numInFlight == 0)
+		return DWPAL_SUCCESS;
+
+	localContext->interface.driver.numOfDone = 0;
+
+	fdCmdGet = localContext->interface.driver.fdCmdGet;
+
+	while (localContext->interface.driver.numOfDone == 0 && localContext->interface.driver.numInFlight > 0)
+	{
+		fd_set		rfds;
+		struct timeval	tv;
+
+		tv.tv_sec = DWPAL_NL_CMD_TIMEOUT_MS / 1000;
+		tv.tv_usec = (DWPAL_NL_CMD_TIMEOUT_MS % 1000) * 1000;
+		FD_ZERO(&rfds);
+		FD_SET(fdCmdGet, &rfds);
+
+		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
+		if (res == -1 && errno == EINTR)
+		{
+			usleep(1000);
+			continue;
+		}
+		else if (res == -1)
+		{
+			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
+			nlInFlightAbort(localContext, -EIO);
+			goto err;
+		}
+		else if (res == 0)
+		{
+			console_printf("%s; Timeout ==> Abort!\n", __FUNCTION__);
+			nlInFlightAbort(localContext, -ETIMEDOUT);
+			goto err;
+		}
+
+		res = nl_recvmsgs(localContext->interface.driver.nlSocketCmdGet, localContext->interface.driver.cbPipeline);
+		if (res == -NLE_NOMEM)
+		{
+			/* socket buffer overrun, replies were lost */
+			console_printf("%s; nl_recvmsgs returned NLE_NOMEM ==> Abort!\n", __FUNCTION__);
+			nlInFlightAbort(localContext, -ENOBUFS);
+			goto err;
+		}
+		else if (res < 0 && res != -NLE_DUMP_INTR)
+		{
+			console_printf("%s; nl_recvmsgs returned ERROR (res= %d)\n", __FUNCTION__, res);
+		}
+	}
+
+	ret = DWPAL_SUCCESS;
+err:
+	return ret;
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_poll(void *context)
+ **************************************************************************
+ *  \brief NL80211 pipelined commands, deliver the replies which were already received, without waiting
+ *  \param[in] void *context - Provides all the interface information
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \note unlike dwpal_nl80211_cmd_complete(), no command is aborted on timeout
+ ***************************************************************************/
+DWPAL_Ret dwpal_nl80211_cmd_poll(void *context)
+{
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
+	int		res, fdCmdGet, flags;
+	DWPAL_Ret	ret = DWPAL_SUCCESS;
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (localContext->interface.driver.numInFlight == 0)
+		return DWPAL_SUCCESS;
+
+	fdCmdGet = localContext->interface.driver.fdCmdGet;
+
+	/* the rest of a multipart reply may not be received yet, don't wait for it */
+	flags = fcntl(fdCmdGet, F_GETFL);
+	if ( (flags == -1) || (fcntl(fdCmdGet, F_SETFL, flags | O_NONBLOCK) == -1) )
+	{
+		console_printf("%s; fcntl() failed, errno = %d ==> Abort!\n", __FUNCTION__, errno);
+		return DWPAL_FAILURE;
+	}
+
+	while (localContext->interface.driver.numInFlight > 0)
+	{
+		fd_set		rfds;
+		struct timeval	tv;
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		FD_ZERO(&rfds);
+		FD_SET(fdCmdGet, &rfds);
+
+		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
+		if (res == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (res == -1)
+		{
+			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
+			ret = DWPAL_FAILURE;
+			break;
+		}
+		else if (res == 0)
+		{
+			break;
+		}
+
+		res = nl_recvmsgs(localContext->interface.driver.nlSocketCmdGet, localContext->interface.driver.cbPipeline);
+		if (res == -NLE_NOMEM)
+		{
+			/* socket buffer overrun, replies were lost */
+			console_printf("%s; nl_recvmsgs returned NLE_NOMEM ==> Abort!\n", __FUNCTION__);
+			nlInFlightAbort(localContext, -ENOBUFS);
+			ret = DWPAL_FAILURE;
+			break;
+		}
+		else if (res < 0 && res != -NLE_DUMP_INTR && res != -NLE_AGAIN)
+		{
+			console_printf("%s; nl_recvmsgs returned ERROR (res= %d)\n", __FUNCTION__, res);
+		}
+	}
+
+	fcntl(fdCmdGet, F_SETFL, flags);
+	return ret;
 }
 
 
 /**************************************************************************/
-/*! \fn DWPAL_Ret dwpal_driver_nl_fd_get(void *context, int *fd , int *fdCmdGet)
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_cancel(void *context, DWPAL_nl80211Request *req, int cmd_res)
  **************************************************************************
- *  \brief Driver-NL fd get, Will fill up the fd output parameters - one of the event, and the other of the "get" command
+ *  \brief NL80211 pipelined commands, complete a command in flight without its reply
  *  \param[in] void *context - Provides all the interface information
- *  \param[out] int *fd - Provides the interface's fd value
- *  \param[out] int *fdCmdGet - Provides the interface's fd value of the "get" command
- *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \param[in,out] DWPAL_nl80211Request *req - the command; its cmd_res is set to 'cmd_res'
+ *  \param[in] int cmd_res - negative errno, e.g. -ETIMEDOUT
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, DWPAL_FAILURE if the command is not in flight)
+ *  \note a reply received later for the command is ignored, the other commands in flight are not affected
  ***************************************************************************/
-DWPAL_Ret dwpal_driver_nl_fd_get(void *context, int *fd /*OUT*/, int *fdCmdGet /*OUT*/)
+DWPAL_Ret dwpal_nl80211_cmd_cancel(void *context, DWPAL_nl80211Request *req, int cmd_res)
 {
-	if ( (context == NULL) || (fd == NULL) || (fdCmdGet == NULL) )
-	{
-		console_printf("%s; context and/or fd, fdCmdGet is NULL ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
 
-	*fd = ((DWPAL_Context *)context)->interface.driver.fd;
-	if (*fd == (-1))
+	if (localContext == NULL || req == NULL)
 	{
-		console_printf("%s; fd value is (-1) ==> Abort!\n", __FUNCTION__);
+		console_printf("%s; context or req is NULL ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
-	*fdCmdGet = ((DWPAL_Context *)context)->interface.driver.fdCmdGet;
-	if (*fdCmdGet == (-1))
-	{
-		console_printf("%s; fdCmdGet value is (-1) ==> Abort!\n", __FUNCTION__);
+	if (req->cmd_res <= 0 || nlInFlightFind(localContext, req->seq) != req)
 		return DWPAL_FAILURE;
-	}
+
+	console_printf("%s; seq= %u cancelled (cmd_res= %d)\n", __FUNCTION__, req->seq, cmd_res);
+	nlInFlightDone(localContext, req, cmd_res);
 
 	return DWPAL_SUCCESS;
 }
 
 
-static int finish_handler(struct nl_msg *msg, void *arg)
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_in_flight_get(void *context, size_t *numInFlight)
+ **************************************************************************
+ *  \brief NL80211 pipelined commands, get the number of commands in flight
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[out] size_t *numInFlight - dwpal_nl80211_cmd_submit() blocks once it is DWPAL_NL_MAX_IN_FLIGHT
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_nl80211_cmd_in_flight_get(void *context, size_t *numInFlight /*OUT*/)
 {
-	int *ret = arg;
-	(void)msg;
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
 
-	if (ret)
-		*ret = 0;
-	return NL_SKIP;
-}
+	if (localContext == NULL || numInFlight == NULL)
+	{
+		console_printf("%s; context or numInFlight is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
 
+	*numInFlight = localContext->interface.driver.numInFlight;
 
-static int dwpal_empty_nl80211Callback(struct nl_msg *msg, void *arg)
-{
-	(void)msg;
-	(void)arg;
-	return NL_SKIP;
+	return DWPAL_SUCCESS;
 }
 
 
 /**************************************************************************/
-/*! \fn DWPAL_Ret dwpal_nl80211_cmd_send(void *context, struct nl_msg *msg, DWPAL_nl80211Callback cb)
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_submit(void *context, DWPAL_nl80211Request *req)
  **************************************************************************
- *  \brief NL80211 send command
+ *  \brief NL80211 pipelined commands, send a command without waiting for its reply
  *  \param[in] void *context - Provides all the interface information
- *  \param[in] struct nl_msg *msg - the nl command to send
+ *  \param[in,out] DWPAL_nl80211Request *req - the command; must stay valid until it is completed
  *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \note blocks while DWPAL_NL_MAX_IN_FLIGHT commands are in flight, dump commands are sent one at a time.
+ *        The replies are delivered by dwpal_nl80211_cmd_complete()
  ***************************************************************************/
-DWPAL_Ret dwpal_nl80211_cmd_send(void *context, struct nl_msg *msg, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg)
+DWPAL_Ret dwpal_nl80211_cmd_submit(void *context, DWPAL_nl80211Request *req)
 {
 	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
-	struct nl_sock	*nlSocket = NULL;
-	struct nl_cb 	*cb = NULL;
-	int		res = 0;
-	DWPAL_Ret	ret = DWPAL_FAILURE;
-	bool		nl_socket_clean = false;
-	int		fdCmdGet;
-
-	console_printf("%s Entry\n", __FUNCTION__);
+	int		res;
 
-	if (msg == NULL)
+	if (req == NULL)
 	{
-		console_printf("%s; msg is NULL ==> Abort!\n", __FUNCTION__);
+		console_printf("%s; req is NULL ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
-	if (cmd_res == NULL)
+	req->cmd_res = -EINVAL;
+
+	if (req->msg == NULL)
 	{
-		console_printf("%s; cmd_res is NULL ==> Abort!\n", __FUNCTION__);
+		console_printf("%s; msg is NULL ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
-	if (localContext == NULL)
+	if (localContext == NULL || localContext->interface.driver.nlSocketCmdGet == NULL)
 	{
-		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		console_printf("%s; context or nlSocket is NULL ==> Abort!\n", __FUNCTION__);
 		goto err;
 	}
 
-	nlSocket = localContext->interface.driver.nlSocketCmdGet;
-	if (nlSocket == NULL)
-	{
-		console_printf("%s; nlSocket is NULL ==> Abort!\n", __FUNCTION__);
-		goto err;
-	}
+	/* the kernel runs one dump at a time per socket */
+	req->isDump = (nlmsg_hdr(req->msg)->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP;
+	req->isDumpIntr = false;
 
-	cb = nl_cb_alloc(NL_CB_DEFAULT);
-	if (cb == NULL)
+	while ( (localContext->interface.driver.numInFlight == DWPAL_NL_MAX_IN_FLIGHT) ||
+		(req->isDump && nlInFlightHasDump(localContext)) )
 	{
-		console_printf("%s; failed to allocate netlink callbacks ==> Abort!\n", __FUNCTION__);
-		goto err;
+		dwpal_nl80211_cmd_complete(localContext);
 	}
 
-	fdCmdGet = localContext->interface.driver.fdCmdGet;
-	if (fdCmdGet == (-1))
+	res = nl_send_auto(localContext->interface.driver.nlSocketCmdGet, req->msg);
+	if (res < 0)
 	{
-		console_printf("%s; fdCmdGet value is (-1) ==> Abort!\n", __FUNCTION__);
+		console_printf("%s; nl_send_auto returned ERROR (res= %d) ==> Abort!\n", __FUNCTION__, res);
+		req->cmd_res = -EIO;
 		goto err;
 	}
 
-	while (nl_socket_clean == false)
-	{
-		fd_set		rfds;
-		struct timeval	tv;
-
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		FD_ZERO(&rfds);
-		FD_SET(fdCmdGet, &rfds);
+	req->seq = nlmsg_hdr(req->msg)->nlmsg_seq;
+	req->cmd_res = 1;
+	localContext->interface.driver.inFlight[localContext->interface.driver.numInFlight++] = req;
 
-		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
-		if (res == -1 && errno == EINTR)
-		{
-			usleep(1000);
-			continue;
-		}
-		else if (res == -1)
-		{
-			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
-			goto err;
-		}
-		else if (res > 0 && FD_ISSET(fdCmdGet, &rfds))
-		{
-			struct nl_cb *cleanup_cb = NULL;
+	nlmsg_free(req->msg);
+	req->msg = NULL;
+	return DWPAL_SUCCESS;
 
-			console_printf("%s; need to perform cleanup\n", __FUNCTION__);
+err:
+	nlmsg_free(req->msg);
+	req->msg = NULL;
+	return DWPAL_FAILURE;
+}
 
-			cleanup_cb = nl_cb_alloc(NL_CB_DEFAULT);
-			if (cleanup_cb == NULL)
-			{
-				console_printf("%s; failed to allocate netlink callbacks ==> Abort!\n", __FUNCTION__);
-				goto err;
-			}
 
-			nl_cb_err(cleanup_cb, NL_CB_CUSTOM, error_handler, NULL);
-			nl_cb_set(cleanup_cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
-			nl_cb_set(cleanup_cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, NULL);
-			nl_cb_set(cleanup_cb, NL_CB_FINISH, NL_CB_CUSTOM, finish_handler, NULL);
-			nl_cb_set(cleanup_cb, NL_CB_VALID, NL_CB_CUSTOM, dwpal_empty_nl80211Callback, NULL);
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_nl80211_cmd_send_batch(void *context, DWPAL_nl80211Request *reqs[], size_t numOfReqs)
+ **************************************************************************
+ *  \brief NL80211 pipelined commands, send all the commands and wait until all of them are completed
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[in,out] DWPAL_nl80211Request *reqs[] - the commands; cmd_res of each one holds its result
+ *  \param[in] size_t numOfReqs - number of commands
+ *  \return DWPAL_Ret (DWPAL_SUCCESS if all the commands were sent, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_nl80211_cmd_send_batch(void *context, DWPAL_nl80211Request *reqs[], size_t numOfReqs)
+{
+	DWPAL_Context	*localContext = (DWPAL_Context *)(context);
+	DWPAL_Ret	ret = DWPAL_SUCCESS;
+	size_t		i;
 
-			nl_recvmsgs(nlSocket, cleanup_cb);
-			nl_cb_put(cleanup_cb);
-		}
-		else
-		{
-			nl_socket_clean = true;
-		}
-	}
+	console_printf("%s Entry; numOfReqs= %zu\n", __FUNCTION__, numOfReqs);
 
-	res = nl_send_auto(nlSocket, msg);
-	if (res < 0)
+	if (reqs == NULL)
 	{
-		console_printf("%s; nl_send_auto returned ERROR (res= %d) ==> Abort!\n", __FUNCTION__, res);
-		goto err;
+		console_printf("%s; reqs is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
 	}
 
-	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, cmd_res);
-	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
-	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, cmd_res);
-	nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, finish_handler, cmd_res);
-
-	if (nlCallback)
+	for (i = 0; i < numOfReqs; i++)
 	{
-		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, nlCallback, cb_arg);
+		if (dwpal_nl80211_cmd_submit(localContext, reqs[i]) != DWPAL_SUCCESS)
+			ret = DWPAL_FAILURE;
 	}
 
-	*cmd_res = 1;
-	while (*cmd_res > 0)
-	{
-		fd_set		rfds;
-		struct timeval	tv;
-
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
-		FD_ZERO(&rfds);
-		FD_SET(fdCmdGet, &rfds);
-
-		res = select(fdCmdGet + 1, &rfds, NULL, NULL, &tv);
-		if (res == -1 && errno == EINTR)
-		{
-			usleep(1000);
-			continue;
-		}
-		else if (res == -1)
-		{
-			console_printf("%s; select() returned error, errno = %d ==> Abort!\n", __FUNCTION__, errno);
-			goto err;
-		}
-		else if (res == 0)
-		{
-			console_printf("%s; Timeout ==> Abort!\n", __FUNCTION__);
-			goto err;
-		}
-
-		res = nl_recvmsgs(nlSocket, cb);
-		if (res == -NLE_DUMP_INTR)
-		{
-			console_printf("%s; nl_recvmsgs returned NLE_DUMP_INTR\n", __FUNCTION__);
-			*cmd_res = -EAGAIN;
-		}
-		else if (res < 0)
-		{
-			console_printf("%s; nl_recvmsgs returned ERROR (res= %d)\n", __FUNCTION__, res);
-		}
-	}
+	while (localContext != NULL && localContext->interface.driver.numInFlight > 0)
+		dwpal_nl80211_cmd_complete(localContext);
 
-	ret = DWPAL_SUCCESS;
-err:
-	if (cb)
-		nl_cb_put(cb);
-	nlmsg_free(msg);
 	return ret;
 }
 
@@ -1707,7 +2346,7 @@ DWPAL_Ret dwpal_driver_nl_scan_dump_sync(void *context, char *ifname, int *cmd_r
 	/* calling genlmsg_put() is a must! without it, the callback won't be called! */
 	genlmsg_put(msg, 0, 0, localContext->interface.driver.nl80211_id, 0, NLM_F_DUMP, NL80211_CMD_GET_SCAN, 0);
 
-	devidx = if_nametoindex(ifname);
+	devidx = ifindexGet(localContext, ifname);
 	if (devidx < 0)
 	{
 		console_printf("%s; devidx ERROR (devidx= %lld) ==> Abort!\n", __FUNCTION__, devidx);
@@ -1760,7 +2399,7 @@ DWPAL_Ret dwpal_driver_nl_scan_trigger_sync(void *context, char *ifname, int *cm
 	/* calling genlmsg_put() is a must! without it, the callback won't be called! */
 	genlmsg_put(msg, 0, 0, localContext->interface.driver.nl80211_id, 0, 0, NL80211_CMD_TRIGGER_SCAN, 0);
 
-	devidx = if_nametoindex(ifname);
+	devidx = ifindexGet(localContext, ifname);
 	if (devidx < 0)
 	{
 		console_printf("%s; devidx ERROR (devidx= %lld) ==> Abort!\n", __FUNCTION__, devidx);
@@ -1810,6 +2449,92 @@ DWPAL_Ret dwpal_nl80211_id_get(void *context, int *nl80211_id /*OUT*/)
 }
 
 
+/* The ifindex the driver commands use for the interface, e.g. for the
+   messages sent by dwpal_nl80211_cmd_send(). Cached until the link changes */
+DWPAL_Ret dwpal_driver_nl_ifindex_get(void *context, const char *ifname, unsigned *ifindex /*OUT*/)
+{
+	DWPAL_Context *localContext = (DWPAL_Context *)(context);
+
+	if ( (ifname == NULL) || (ifindex == NULL) )
+	{
+		console_printf("%s; ifname and/or ifindex is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (localContext == NULL)
+	{
+		console_printf("%s; context is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	*ifindex = ifindexGet(localContext, ifname);
+	return (*ifindex == 0) ? DWPAL_FAILURE : DWPAL_SUCCESS;
+}
+
+
+static struct nl_cb *nlCbCreate(int *err, nl_recvmsg_msg_cb_t validCallback, DWPAL_Context *localContext)
+{
+	struct nl_cb *cb = nl_cb_alloc(NL_CB_DEFAULT);
+
+	if (cb == NULL)
+		return NULL;
+
+	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, err);
+	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
+	nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, finish, localContext);
+	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_recv, NULL);
+	nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, validCallback, localContext);
+
+	return cb;
+}
+
+/* Creates the netlink objects and the ifindex cache, which are reused by all the commands */
+static DWPAL_Ret nlReusableObjectsCreate(DWPAL_Context *localContext)
+{
+	pthread_mutex_init(&localContext->interface.driver.cmdMsgLock, NULL);
+	pthread_mutex_init(&localContext->interface.driver.ifindexLock, NULL);
+
+	/* the ifindex is not cached if the link notifications can't be received */
+	localContext->interface.driver.rtnlFd = rtnlLinkSocketCreate();
+
+	localContext->interface.driver.cbEvent = nlCbCreate(&localContext->interface.driver.cbEventErr, nlInternalEventCallback, localContext);
+	localContext->interface.driver.cbCmdGet = nlCbCreate(&localContext->interface.driver.cbCmdGetErr, nlInternalCmdGetCallback, localContext);
+	localContext->interface.driver.cbPipeline = nl_cb_alloc(NL_CB_DEFAULT);
+	localContext->interface.driver.cmdMsg = nlmsg_alloc();
+
+	if ( (localContext->interface.driver.cbEvent == NULL) || (localContext->interface.driver.cbCmdGet == NULL) ||
+	     (localContext->interface.driver.cbPipeline == NULL) || (localContext->interface.driver.cmdMsg == NULL) )
+	{
+		console_printf("%s; failed to allocate netlink callbacks/message ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	nl_cb_err(localContext->interface.driver.cbPipeline, NL_CB_CUSTOM, nlPipelineError, localContext);
+	nl_cb_set(localContext->interface.driver.cbPipeline, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
+	nl_cb_set(localContext->interface.driver.cbPipeline, NL_CB_ACK, NL_CB_CUSTOM, nlPipelineFinish, localContext);
+	nl_cb_set(localContext->interface.driver.cbPipeline, NL_CB_FINISH, NL_CB_CUSTOM, nlPipelineFinish, localContext);
+	nl_cb_set(localContext->interface.driver.cbPipeline, NL_CB_VALID, NL_CB_CUSTOM, nlPipelineValid, localContext);
+
+	return DWPAL_SUCCESS;
+}
+
+static void nlReusableObjectsFree(DWPAL_Context *localContext)
+{
+	if (localContext->interface.driver.cbEvent != NULL)
+		nl_cb_put(localContext->interface.driver.cbEvent);
+	if (localContext->interface.driver.cbCmdGet != NULL)
+		nl_cb_put(localContext->interface.driver.cbCmdGet);
+	if (localContext->interface.driver.cbPipeline != NULL)
+		nl_cb_put(localContext->interface.driver.cbPipeline);
+	if (localContext->interface.driver.cmdMsg != NULL)
+		nlmsg_free(localContext->interface.driver.cmdMsg);
+	if (localContext->interface.driver.rtnlFd >= 0)
+		close(localContext->interface.driver.rtnlFd);
+
+	pthread_mutex_destroy(&localContext->interface.driver.cmdMsgLock);
+	pthread_mutex_destroy(&localContext->interface.driver.ifindexLock);
+}
+
 /**************************************************************************/
 /*! \fn DWPAL_Ret dwpal_driver_nl_detach(void **context)
  **************************************************************************
@@ -1842,10 +2567,13 @@ DWPAL_Ret dwpal_driver_nl_detach(void **context /*IN/OUT*/)
 		return DWPAL_FAILURE;
 	}
 
+	nlInFlightAbort(localContext, -ECANCELED);
+
 	/* Note: calling nl_close() is NOT needed - The socket is closed automatically when using nl_socket_free() */
 	console_printf("%s; close NL sockets\n", __FUNCTION__);
 	nl_socket_free(localContext->interface.driver.nlSocketEvent);
 	nl_socket_free(localContext->interface.driver.nlSocketCmdGet);
+	nlReusableObjectsFree(localContext);
 
 	free(*context);
 	*context = NULL;
@@ -1885,7 +2613,7 @@ DWPAL_Ret dwpal_driver_nl_attach(void **context /*OUT*/)
 	memset(localContext, 0, sizeof(DWPAL_Context));
 
 	/* Create the NL socket for the events (unsolicited events) */
-	if (nlSocketCreate(&localContext->interface.driver.nlSocketEvent, &localContext->interface.driver.fd) == DWPAL_FAILURE)
+	if (nlSocketCreate(&localContext->interface.driver.nlSocketEvent, &localContext->interface.driver.fd, DRIVER_NL_TO_DWPAL_MSG_LENGTH) == DWPAL_FAILURE)
 	{
 		console_printf("%s; nlSocketCreate failed ==> Abort!\n", __FUNCTION__);
 		free(*context);
@@ -1908,8 +2636,9 @@ DWPAL_Ret dwpal_driver_nl_attach(void **context /*OUT*/)
 		}
 	}
 
-	/* Create the NL socket for the 'get commands' (solicited events) */
-	if (nlSocketCreate(&localContext->interface.driver.nlSocketCmdGet, &localContext->interface.driver.fdCmdGet) == DWPAL_FAILURE)
+	/* Create the NL socket for the 'get commands' (solicited events); room for the replies of all pipelined commands */
+	if (nlSocketCreate(&localContext->interface.driver.nlSocketCmdGet, &localContext->interface.driver.fdCmdGet,
+			   DRIVER_NL_TO_DWPAL_MSG_LENGTH * DWPAL_NL_MAX_IN_FLIGHT) == DWPAL_FAILURE)
 	{
 		console_printf("%s; nlSocketCreate failed ==> Abort!\n", __FUNCTION__);
 		free(*context);
@@ -1930,6 +2659,17 @@ DWPAL_Ret dwpal_driver_nl_attach(void **context /*OUT*/)
 	}
 	console_printf("%s; driver.nl80211_id= %d\n", __FUNCTION__, localContext->interface.driver.nl80211_id);
 
+	if (nlReusableObjectsCreate(localContext) == DWPAL_FAILURE)
+	{
+		console_printf("%s; nlReusableObjectsCreate ERROR ==> Abort!\n", __FUNCTION__);
+		nlReusableObjectsFree(localContext);
+		nl_socket_free(localContext->interface.driver.nlSocketEvent);
+		nl_socket_free(localContext->interface.driver.nlSocketCmdGet);
+		free(*context);
+		*context = NULL;
+		return DWPAL_FAILURE;
+	}
+
 	console_printf("%s; driver.nlSocketEvent= %p, fd= %d, driver.nlEventCallback= %p, driver.nlNonVendorEventCallback = %p driver.nl80211_id= %d; nlSocketCmdGet= %p, fdCmdGet= %d\n",
 	       __FUNCTION__, (void *)localContext->interface.driver.nlSocketEvent, localContext->interface.driver.fd,
 		   (void *)localContext->interface.driver.nlEventCallback, (void *)localContext->interface.driver.nlNonVendorEventCallback, localContext->interface.driver.nl80211_id,
@@ -3055,6 +3795,7 @@ DWPAL_Ret dwpal_hostap_cmd_send(void *context, const char *cmdHeader, FieldsToCm
  *  \param[in,out] size_t *msgLen - input is buffer size, output is the actual event buffer length copied
  *  \param[out] char *opCode - output the parsed event opcode
  *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \note on failure, dwpal_hostap_event_socket_failed_get() tells if the socket itself failed
  ***************************************************************************/
 DWPAL_Ret dwpal_hostap_event_get(void *context, char *msg /*OUT*/, size_t *msgLen /*IN/OUT*/, char *opCode /*OUT*/)
 {
@@ -3091,6 +3832,7 @@ DWPAL_Ret dwpal_hostap_event_get(void *context, char *msg /*OUT*/, size_t *msgLe
 	{
 		case -1:  /* error */
 			console_printf("%s; wpa_ctrl_pending() returned ERROR ==> Abort!\n", __FUNCTION__);
+			((DWPAL_Context *)context)->interface.hostapd.isEventSocketFailed = true;
 			res = DWPAL_FAILURE;
 			goto end;
 
@@ -3135,6 +3877,7 @@ DWPAL_Ret dwpal_hostap_event_get(void *context, char *msg /*OUT*/, size_t *msgLe
 	else
 	{
 		console_printf("%s; wpa_ctrl_recv() returned ERROR ==> Abort!\n", __FUNCTION__);
+		((DWPAL_Context *)context)->interface.hostapd.isEventSocketFailed = true;
 		res = DWPAL_FAILURE;
 	}
 
@@ -3144,6 +3887,30 @@ end:
 }
 
 
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_hostap_event_socket_failed_get(void *context, bool *isFailed)
+ **************************************************************************
+ *  \brief did receiving an event fail on the socket itself (e.g. ECONNREFUSED once hostapd is gone)?
+ *  \param[in] void *context - Provides all the interface information
+ *  \param[out] bool *isFailed - Provides the answer; stays true until the interface is attached again
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_hostap_event_socket_failed_get(void *context, bool *isFailed /*OUT*/)
+{
+	if ( (context == NULL) || (isFailed == NULL) )
+	{
+		console_printf("%s; context and/or isFailed is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	MUTEX_LOCK(&hostap_context);
+	*isFailed = ((DWPAL_Context *)context)->interface.hostapd.isEventSocketFailed;
+	MUTEX_UNLOCK(&hostap_context);
+
+	return DWPAL_SUCCESS;
+}
+
+
 /**************************************************************************/
 /*! \fn DWPAL_Ret dwpal_hostap_event_fd_get(void *context, int *fd)
  **************************************************************************
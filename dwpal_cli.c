@@ -3940,7 +3940,7 @@ static void dwpalCliStart(void)
 }
 
 static int dwpalclid_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta,
-			    uint8_t seq_num, wv_ipc_msg *cmd)
+			    uint32_t seq_num, wv_ipc_msg *cmd)
 {
 	char *data = wave_ipc_msg_get_data(cmd);
 	size_t data_size = wave_ipc_msg_get_size(cmd);
@@ -22,6 +22,8 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <time.h>
+#include <limits.h>
+#include <sys/inotify.h>
 
 #if defined YOCTO
 #include <slibc/string.h>
@@ -48,9 +50,17 @@
 /* Dedicated thread for hostapd event callbacks */
 //#define EVENT_CALLBACK_THREAD
 
+/* hostapd going down/up is detected by watching its control sockets and by
+   the errors of the event sockets. PING is only a fallback: every
+   PING_CHECK_TIME seconds if the control directories can't be watched,
+   otherwise every PING_FALLBACK_CHECK_TIME seconds (0 disables it) */
 #define PING_CHECK_TIME 3
-#define RECOVERY_RETRY_TIME 1
-#define EVENT_HANDLER_SOCKET "/tmp/dwpal_event_handler_socket"
+#define PING_FALLBACK_CHECK_TIME 30
+/* Max time (msec) until an interface found down by a command is reconnected */
+#define RECOVERY_RETRY_TIME_MS 1000
+/* Reconnect attempts of an interface back off exponentially (msec) */
+#define RECOVERY_BACKOFF_MIN_MS 50
+#define RECOVERY_BACKOFF_MAX_MS 4000
 
 
 typedef enum
@@ -65,8 +75,11 @@ typedef struct
 	int                         fd, fdCmdGet;
 	bool                        isConnectionEstablishNeeded;
 	bool                        isReconnectEventNeeded;
+	volatile bool               isEventSocketFailed;  /* set by the listener thread */
+	long long                   recoveryTimeMs;       /* next reconnect attempt */
+	int                         recoveryBackoffMs;
 	DwpalExtHostapEventCallback hostapEventCallback;
-	DwpalExtNlEventCallback     nlEventCallback, nlCmdGetCallback;
+	DwpalExtNlEventCallback     nlEventCallback;
 	DwpalExtNlNonVendorEventCallback nlNonVendorEventCallback;
 	DwpalConnectionType         connectionType;
 } DwpalService;
@@ -76,8 +89,8 @@ typedef struct
 	int    serviceIdx;
 	char   VAPName[DWPAL_VAP_NAME_STRING_LENGTH];
 	char   opCode[64];
-	char   msg[HOSTAPD_TO_DWPAL_MSG_LENGTH];
 	size_t msgStringLen;
+	char   msg[HOSTAPD_TO_DWPAL_MSG_LENGTH];  /* keep last, only msgStringLen + 1 bytes of it are sent */
 } EventData;
 
 typedef struct
@@ -98,18 +111,19 @@ static threadData_t g_listenerThreadInfo;
 #ifndef DISABLE_DWPAL_HOSTAP_SUPPORT
 static threadData_t g_monitorThreadInfo;
 #endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
-static pthread_mutex_t context_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* serviceLock[i] serializes the commands and the connection changes of
+   dwpalService[i]/context[i], so a slow command blocks only its own VAP.
+   services_mutex guards only assigning the entries of dwpalService[].
+   Lock order: serviceLock[] before services_mutex */
+static pthread_mutex_t serviceLock[ARRAY_SIZE(dwpalService)] = { [0 ... NUM_OF_SUPPORTED_VAPS ] = PTHREAD_MUTEX_INITIALIZER };
+static pthread_mutex_t services_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t attach_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t nl_cmd_mutex = PTHREAD_MUTEX_INITIALIZER;
-static unsigned char *nl_response_data = NULL;
-static size_t *nl_response_len = NULL;
-static bool nl_response_received = false;
-static bool nl_response_save_data = false;
 
 #if defined EVENT_CALLBACK_THREAD
-static int dwpal_event_handler = (-1);
-static pthread_t eventHandlerThreadId = (pthread_t)0;
+static int eventChannelFDs[2] = { -1, -1 };  /* [0] is read by the event handler thread */
+static threadData_t g_eventHandlerThreadInfo;
 #endif
 
 static const size_t numOfServices = ARRAY_SIZE(dwpalService);
@@ -126,6 +140,36 @@ static const char* connectionTypeToStr(DwpalConnectionType connectionType)
 	}
 }
 
+static long long timeMsGet(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Entries are assigned only under attach_mutex, which makes the lock free
+   lookups of the attach/detach paths safe */
+static void serviceSet(int idx, DwpalService *service)
+{
+	MUTEX_LOCK(&services_mutex);
+	dwpalService[idx] = service;
+	MUTEX_UNLOCK(&services_mutex);
+}
+
+/* Removes the entry and frees it, after a command in progress on it is done */
+static void serviceFree(int idx)
+{
+	DwpalService *service;
+
+	MUTEX_LOCK(&serviceLock[idx]);
+	service = dwpalService[idx];
+	serviceSet(idx, NULL);
+	MUTEX_UNLOCK(&serviceLock[idx]);
+
+	free(service);
+}
+
 static DWPAL_Ret interfaceIndexGet(DwpalConnectionType connectionType, const char *VAPName, int *idx)
 {
 	unsigned i;
@@ -161,9 +205,9 @@ static DWPAL_Ret interfaceIndexCreate(DwpalConnectionType connectionType, const
 		            __FUNCTION__, connectionTypeToStr(connectionType), VAPName);
 
 		/* Even if 'idx' already exist, the attach may have failed ==> check if the attach succeeded */
-		MUTEX_LOCK(&context_mutex);
+		MUTEX_LOCK(&serviceLock[*idx]);
 		l_context = context[*idx];
-		MUTEX_UNLOCK(&context_mutex);
+		MUTEX_UNLOCK(&serviceLock[*idx]);
 
 		if (l_context == NULL)
 		{  /* the attach failed, meaning the interface is down but the rest of 'dwpalService' is ready */
@@ -180,15 +224,16 @@ static DWPAL_Ret interfaceIndexCreate(DwpalConnectionType connectionType, const
 	{
 		if (dwpalService[i] == NULL)
 		{  /* First empty entry ==> use it */
-			dwpalService[i] = (DwpalService *)calloc(1, sizeof(DwpalService));
-			if (dwpalService[i] == NULL)
+			DwpalService *service = (DwpalService *)calloc(1, sizeof(DwpalService));
+			if (service == NULL)
 			{
 				console_printf("%s; malloc failed ==> Abort!\n", __FUNCTION__);
 				return DWPAL_FAILURE;
 			}
 
-			dwpalService[i]->connectionType = connectionType;
-			strcpy_s(dwpalService[i]->VAPName, sizeof(dwpalService[i]->VAPName), VAPName);
+			service->connectionType = connectionType;
+			strcpy_s(service->VAPName, sizeof(service->VAPName), VAPName);
+			serviceSet(i, service);
 
 			*idx = i;
 			return DWPAL_SUCCESS;
@@ -220,69 +265,176 @@ static bool isAnyInterfaceActive(void)
 
 
 #if defined EVENT_CALLBACK_THREAD
-static DWPAL_Ret socket_data_send(char *socketPrefixName, char *data, size_t size)
+/* The events are carried to the event handler thread over a socket pair which
+   lives as long as any interface is attached. Each record is the EventData
+   header followed by the NUL terminated message, padded to keep the next
+   record aligned. The records of one listener round are batched and written
+   at once (see eventBatchFlush()) */
+#define EVENT_RECORD_HDR_SIZE offsetof(EventData, msg)
+#define EVENT_RECORD_LEN(_msgStringLen) \
+	((EVENT_RECORD_HDR_SIZE + (_msgStringLen) + 1 + __alignof__(EventData) - 1) & ~(__alignof__(EventData) - 1))
+#define EVENT_BATCH_SIZE      (2 * sizeof(EventData))
+
+static char   eventBatch[EVENT_BATCH_SIZE] __attribute__((aligned(__alignof__(EventData))));
+static size_t eventBatchLen = 0;
+static pthread_mutex_t event_batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* the monitor thread was woken up to write the rest of the batch */
+static bool   eventBatchTailNotified = false;
+
+/* What the event handler thread read of the channel and didn't deliver yet.
+   It belongs to the channel, since the thread is stopped and created again
+   on every attach/detach in the middle of the stream */
+static char   eventRcvBuf[EVENT_BATCH_SIZE] __attribute__((aligned(__alignof__(EventData))));
+static size_t eventRcvLen = 0;
+
+static DWPAL_Ret eventChannelOpen(void)
 {
-    int                	fd = -1, byte;
-	struct sockaddr_un 	un;
-	size_t             	len;
-	char               	socketName[SOCKET_NAME_LENGTH] = "\0";
-	pid_t              	pid = getpid();
-	int					status;
-
-	//console_printf("%s Entry; socketPrefixName= '%s', size= %d\n", __FUNCTION__, socketPrefixName, size);
+	if (eventChannelFDs[0] != (-1))
+		return DWPAL_SUCCESS;
 
-	/* create a UNIX domain stream socket */
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	/* non-blocking, a slow event callback must not block the event producers */
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, eventChannelFDs) < 0)
 	{
-		console_printf("%s; create socket fail; pid= %d; errno= %d ('%s')\n", __FUNCTION__, pid, errno, strerror(errno));
+		console_printf("%s; socketpair() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+		eventChannelFDs[0] = eventChannelFDs[1] = (-1);
 		return DWPAL_FAILURE;
-    }
-
-	/* fill socket address structure with server's address */
-	memset(&un, 0, sizeof(un));
-	un.sun_family = AF_UNIX;
+	}
+	eventRcvLen = 0;
 
-	status = sprintf_s(socketName, sizeof(socketName), "%s_%d", socketPrefixName, pid);
-	if (status <= 0)
-		console_printf("%s; sprintf_s failed!\n", __FUNCTION__);
+	return DWPAL_SUCCESS;
+}
 
-	strcpy_s(un.sun_path, sizeof(un.sun_path), socketName);
-	len = offsetof(struct sockaddr_un, sun_path) + strnlen_s(socketName, sizeof(socketName));
+/* Called once no interface is attached and the event handler thread is stopped */
+static void eventChannelClose(void)
+{
+	int i;
 
-	if (connect(fd, (struct sockaddr *)&un, len) < 0)
+	MUTEX_LOCK(&event_batch_mutex);
+	for (i = 0; i < 2; i++)
 	{
-		console_printf("%s; connect() fail; pid= %d; errno= %d ('%s')\n",
-		       __FUNCTION__, pid, errno, strerror(errno));
-
-		if (close(fd) == (-1))
+		if ((eventChannelFDs[i] != (-1)) && (close(eventChannelFDs[i]) == (-1)))
 		{
-			console_printf("%s; close() fail; pid= %d; errno= %d ('%s')\n",
-				   __FUNCTION__, pid, errno, strerror(errno));
+			console_printf("%s; close() fail; fd= %d; errno= %d ('%s')\n", __FUNCTION__, eventChannelFDs[i], errno, strerror(errno));
 		}
-
-		return DWPAL_FAILURE;
+		eventChannelFDs[i] = (-1);
 	}
+	eventBatchLen = 0;
+	eventRcvLen = 0;
+	MUTEX_UNLOCK(&event_batch_mutex);
+}
 
-	if ((byte = write(fd, data, size)) == -1)
-	{
-		console_printf("%s; write() fail; pid= %d; errno= %d ('%s')\n",
-		       __FUNCTION__, pid, errno, strerror(errno));
+/* Must be called with event_batch_mutex held. Wakes the monitor thread up,
+   which writes the rest of the batch once the channel has room */
+static void eventBatchTailNotify(void)
+{
+#ifndef DISABLE_DWPAL_HOSTAP_SUPPORT
+	if ( eventBatchTailNotified || (g_monitorThreadInfo.threadID == 0) ||
+	     (pthread_self() == g_monitorThreadInfo.threadID) )
+		return;
+
+	eventBatchTailNotified = true;
+	if (write(g_monitorThreadInfo.pipeFDs[1], "F", 1) < 0)
+		console_printf("%s; write to g_monitorThreadInfo->pipeFDs[1] FAILED (errno= %d)\n", __FUNCTION__, errno);
+#endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
+}
 
-		if (close(fd) == (-1))
+/* Must be called with event_batch_mutex held. Never blocks; what doesn't fit
+   in the channel stays at the head of the batch and is written first the
+   next time. The stream stays in order, but the reader may get the head of
+   a record long before its rest. Returns DWPAL_FAILURE if part of the batch
+   was not written */
+static DWPAL_Ret eventBatchWrite(void)
+{
+	size_t  offset = 0;
+	ssize_t byte;
+
+	while (offset < eventBatchLen)
+	{
+		byte = write(eventChannelFDs[1], eventBatch + offset, eventBatchLen - offset);
+		if (byte < 0)
 		{
-			console_printf("%s; close() fail; pid= %d; errno= %d ('%s')\n",
-				   __FUNCTION__, pid, errno, strerror(errno));
+			if (errno == EINTR)
+				continue;
+
+			if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+				break;
+
+			console_printf("%s; write() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+			eventBatchLen = 0;
+			return DWPAL_FAILURE;
 		}
+		offset += byte;
+	}
+
+	eventBatchLen -= offset;
+	if (eventBatchLen && offset)
+		memmove_s(eventBatch, sizeof(eventBatch), eventBatch + offset, eventBatchLen);
+
+	if (eventBatchLen)
+		eventBatchTailNotify();
+
+	return eventBatchLen ? DWPAL_FAILURE : DWPAL_SUCCESS;
+}
+
+static DWPAL_Ret eventBatchFlush(void)
+{
+	DWPAL_Ret ret = DWPAL_SUCCESS;
+
+	MUTEX_LOCK(&event_batch_mutex);
+	if (eventBatchLen && (eventChannelFDs[1] != (-1)))
+		ret = eventBatchWrite();
+	MUTEX_UNLOCK(&event_batch_mutex);
+
+	return ret;
+}
+
+/* Returns the fd to write the rest of the batch to, or -1 if nothing is left.
+   Called by the monitor thread before waiting for the channel to have room */
+static int eventBatchTailFdGet(void)
+{
+	int fd;
 
+	MUTEX_LOCK(&event_batch_mutex);
+	eventBatchTailNotified = false;
+	fd = eventBatchLen ? eventChannelFDs[1] : (-1);
+	MUTEX_UNLOCK(&event_batch_mutex);
+
+	return fd;
+}
+
+/* Appends the event to the batch. The listener thread flushes the batch at
+   the end of each round, the events of other threads are written right away.
+   The event is dropped if the event handler thread is too far behind */
+static DWPAL_Ret eventBatchAdd(const EventData *eventData)
+{
+	size_t recordLen = EVENT_RECORD_LEN(eventData->msgStringLen);
+
+	MUTEX_LOCK(&event_batch_mutex);
+	if (eventChannelFDs[1] == (-1))
+	{
+		MUTEX_UNLOCK(&event_batch_mutex);
+		console_printf("%s; event channel is closed ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
-	if (close(fd) == (-1))
+	if (eventBatchLen + recordLen > sizeof(eventBatch))
+		eventBatchWrite();
+
+	if (eventBatchLen + recordLen > sizeof(eventBatch))
 	{
-		console_printf("%s; close() fail; pid= %d; errno= %d ('%s')\n",
-		       __FUNCTION__, pid, errno, strerror(errno));
+		MUTEX_UNLOCK(&event_batch_mutex);
+		console_printf("%s; event channel is full, opCode '%s' dropped ==> Abort!\n", __FUNCTION__, eventData->opCode);
+		return DWPAL_FAILURE;
 	}
 
+	memcpy_s(eventBatch + eventBatchLen, sizeof(eventBatch) - eventBatchLen, eventData, recordLen);
+	eventBatchLen += recordLen;
+
+	/* the rest of a partial write is written by the monitor thread */
+	if (pthread_self() != g_listenerThreadInfo.threadID)
+		eventBatchWrite();
+	MUTEX_UNLOCK(&event_batch_mutex);
+
 	return DWPAL_SUCCESS;
 }
 #endif
@@ -365,7 +517,9 @@ static DWPAL_Ret interfaceEventSend(uint serviceIdx, char* opCode, char* msg, si
 #if defined EVENT_CALLBACK_THREAD
 	{
 		EventData eventData;
-		memset(&eventData, 0, sizeof(eventData));
+		/* only the header and the message string are sent */
+		memset(&eventData, 0, EVENT_RECORD_HDR_SIZE);
+		eventData.msg[0] = '\0';
 		eventData.serviceIdx = serviceIdx;
 		strcpy_s(eventData.VAPName, sizeof(eventData.VAPName), dwpalService[serviceIdx]->VAPName);
 		strcpy_s(eventData.opCode, sizeof(eventData.opCode), opCode);
@@ -375,12 +529,12 @@ static DWPAL_Ret interfaceEventSend(uint serviceIdx, char* opCode, char* msg, si
 				return DWPAL_FAILURE;
 			}
 		}
-		eventData.msgStringLen = msgStringLen;
+		eventData.msgStringLen = msg ? msgStringLen : 0;
 
-		/* Send the event via the callback */
-		if (socket_data_send(EVENT_HANDLER_SOCKET, (char *)&eventData, sizeof(EventData)) == DWPAL_FAILURE)
+		/* Send the event to the event handler thread */
+		if (eventBatchAdd(&eventData) == DWPAL_FAILURE)
 		{
-			console_printf("%s; socket_data_send failed, opCode '%s' ==> cont...\n", __FUNCTION__, opCode);
+			console_printf("%s; eventBatchAdd failed, opCode '%s' ==> cont...\n", __FUNCTION__, opCode);
 		}
 	}
 #else
@@ -424,10 +578,53 @@ static DWPAL_Ret interfaceReconnectedOkSent(uint serviceIdx)
 	return interfaceEventSend(serviceIdx, "INTERFACE_RECONNECTED_OK", vaps, strnlen_s(vaps, sizeof(vaps) - 1));
 }
 
-static void interfacesRecoverIfNeeded(void)
+/* Must be called with serviceLock[i] held; the first reconnect attempt is
+   right away */
+static void interfaceDownMark(unsigned i)
 {
-	unsigned i;
+	dwpalService[i]->isConnectionEstablishNeeded = true;
+	dwpalService[i]->fd = -1;
+	dwpalService[i]->recoveryTimeMs = 0;
+	dwpalService[i]->recoveryBackoffMs = RECOVERY_BACKOFF_MIN_MS;
+}
+
+/* Marks the interface down and closes its connection; interfacesRecoverIfNeeded()
+   will reconnect it. The interface may already be marked down by a failed
+   command, then only what is left of its connection is closed */
+static void interfaceDownSet(unsigned i, const char *reason)
+{
+	bool isDownNew = false;
+
+	MUTEX_LOCK(&serviceLock[i]);
+	if (!dwpalService[i]->isConnectionEstablishNeeded)
+	{
+		console_printf("%s; VAPName= '%s' interface needs to be recovered (%s)\n", __FUNCTION__, dwpalService[i]->VAPName, reason);
+		interfaceDownMark(i);
+		isDownNew = true;
+	}
+	else
+	{
+		dwpalService[i]->fd = -1;
+	}
+
+	/* Close 'wpaCtrlPtr', and free 'context' */
+	if ( (context[i] != NULL) && (dwpal_hostap_interface_detach(&context[i]) == DWPAL_FAILURE) )
+	{
+		console_printf("%s; dwpal_hostap_interface_detach (VAPName= '%s') returned ERROR ==> cont...\n", __FUNCTION__, dwpalService[i]->VAPName);
+	}
+	MUTEX_UNLOCK(&serviceLock[i]);
+
+	if (isDownNew)
+		interfaceDisconnectedSend(i);
+}
+
+/* Reconnects the interfaces which are down and whose retry time has come.
+   Returns the time of the next retry, LLONG_MAX if none is needed */
+static long long interfacesRecoverIfNeeded(long long now)
+{
+	unsigned  i;
 	DWPAL_Ret ret;
+	long long nextTimeMs = LLONG_MAX;
 
 	//console_printf("%s Entry\n", __FUNCTION__);
 
@@ -442,10 +639,10 @@ static void interfacesRecoverIfNeeded(void)
 		/* In case of recovery needed, try recover; in case of interface init, try to establish the connection */
 		if (DWPAL_CONN_TYPE_HOSTAP == dwpalService[i]->connectionType)
 		{
-			MUTEX_LOCK(&context_mutex);
-			if (dwpalService[i]->isConnectionEstablishNeeded)
+			MUTEX_LOCK(&serviceLock[i]);
+			if (dwpalService[i]->isConnectionEstablishNeeded && (now >= dwpalService[i]->recoveryTimeMs))
 			{
-				/* If needed, close 'wpaCtrlPtr' and free 'context' (probably it was performed already by interfacesPingCheck) */
+				/* If needed, close 'wpaCtrlPtr' and free 'context' (probably it was performed already by interfaceDownSet) */
 				if ( (context[i] != NULL) && (dwpal_hostap_interface_detach(&context[i] /*OUT*/) != DWPAL_SUCCESS) )
 				{
 					console_printf("%s; dwpal_hostap_interface_detach (VAPName= '%s') returned ERROR ==> cont...\n", __FUNCTION__, dwpalService[i]->VAPName);
@@ -456,10 +653,25 @@ static void interfacesRecoverIfNeeded(void)
 				if (ret == DWPAL_SUCCESS) {
 					dwpalService[i]->isConnectionEstablishNeeded = false;
 					dwpalService[i]->isReconnectEventNeeded = true;
+					dwpalService[i]->isEventSocketFailed = false;
+					dwpalService[i]->recoveryBackoffMs = RECOVERY_BACKOFF_MIN_MS;
 					console_printf("%s; VAPName= '%s' interface recovered successfully!\n", __FUNCTION__, dwpalService[i]->VAPName);
 				}
+				else {
+					/* hostapd is still down; wait twice as long before the next retry */
+					if (dwpalService[i]->recoveryBackoffMs < RECOVERY_BACKOFF_MIN_MS)
+						dwpalService[i]->recoveryBackoffMs = RECOVERY_BACKOFF_MIN_MS;
+					dwpalService[i]->recoveryTimeMs = now + dwpalService[i]->recoveryBackoffMs;
+					if (dwpalService[i]->recoveryBackoffMs < RECOVERY_BACKOFF_MAX_MS / 2)
+						dwpalService[i]->recoveryBackoffMs *= 2;
+					else
+						dwpalService[i]->recoveryBackoffMs = RECOVERY_BACKOFF_MAX_MS;
+				}
 			}
-			MUTEX_UNLOCK(&context_mutex);
+
+			if (dwpalService[i]->isConnectionEstablishNeeded && (dwpalService[i]->recoveryTimeMs < nextTimeMs))
+				nextTimeMs = dwpalService[i]->recoveryTimeMs;
+			MUTEX_UNLOCK(&serviceLock[i]);
 
 			if (dwpalService[i]->isReconnectEventNeeded)
 			{
@@ -471,6 +683,24 @@ static void interfacesRecoverIfNeeded(void)
 			}
 		}
 	}
+
+	return nextTimeMs;
+}
+
+/* Marks down the interfaces whose event socket failed in the listener thread */
+static void interfacesEventSocketCheck(void)
+{
+	unsigned i;
+
+	for (i = 0; i < numOfServices; i++)
+	{
+		if ( (dwpalService[i] != NULL) &&
+		     (DWPAL_CONN_TYPE_HOSTAP == dwpalService[i]->connectionType) &&
+		     dwpalService[i]->isEventSocketFailed )
+		{
+			interfaceDownSet(i, "event socket error");
+		}
+	}
 }
 
 static void interfacesPingCheck(void)
@@ -497,93 +727,241 @@ static void interfacesPingCheck(void)
 				replyLen = sizeof(reply) - 1;
 				if (dwpal_ext_hostap_cmd_send(dwpalService[i]->VAPName, "PING", NULL, reply, &replyLen) == DWPAL_FAILURE)
 				{
-					dwpalService[i]->fd = -1;
-
-					MUTEX_LOCK(&context_mutex);
-					if (dwpalService[i]->isConnectionEstablishNeeded == false)
-					{
-						/* dwpal_ext_hostap_cmd_send() failed for a reason other than sending error,
-						   so need to "detach" here */
-						console_printf("%s; VAPName= '%s' interface needs to be recovered\n", __FUNCTION__, dwpalService[i]->VAPName);
-						dwpalService[i]->isConnectionEstablishNeeded = true;
-
-						/* Close 'wpaCtrlPtr', and free 'context' */
-						if ( (context[i] != NULL) && (dwpal_hostap_interface_detach(&context[i]) == DWPAL_FAILURE) )
-						{
-							console_printf("%s; dwpal_hostap_interface_detach (VAPName= '%s') returned ERROR ==> cont...\n", __FUNCTION__, dwpalService[i]->VAPName);
-						}
-						MUTEX_UNLOCK(&context_mutex);
-						interfaceDisconnectedSend(i);
-					}
-					else {
-						MUTEX_UNLOCK(&context_mutex);
-					}
+					/* dwpal_ext_hostap_cmd_send() may have failed for a reason other than sending error,
+					   so need to "detach" here */
+					interfaceDownSet(i, "PING failed");
 				}
 			}
 		}
 	}
 }
-#endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
 
-#if defined EVENT_CALLBACK_THREAD
-static void *eventHandlerThreadStart(void *temp)
+static const char *hostapCtrlDirs[] = { "/var/run/hostapd", "/var/run/wpa_supplicant" };
+
+/* Watches the control directories which aren't watched yet. Returns true if
+   any of them is watched */
+static bool ctrlDirsWatch(int inotifyFd, int ctrlDirWd[])
 {
-	int                clientfd = -1, byte;
-	size_t             len;
-	char               rcv_buf[sizeof(EventData)];
-	EventData          *eventData = NULL;
-	struct sockaddr_un un;
+	unsigned i;
+	bool     isWatched = false;
 
-	(void)temp;
+	for (i = 0; i < ARRAY_SIZE(hostapCtrlDirs); i++)
+	{
+		if (ctrlDirWd[i] < 0)
+			ctrlDirWd[i] = inotify_add_watch(inotifyFd, hostapCtrlDirs[i], IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
 
-	console_printf("%s Entry\n", __FUNCTION__);
+		if (ctrlDirWd[i] >= 0)
+			isWatched = true;
+	}
+
+	return isWatched;
+}
+
+/* hostapd creates the control socket of an interface once it is up and
+   removes it when it goes down */
+static void ctrlDirEventsHandle(int inotifyFd, int ctrlDirWd[])
+{
+	char     buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t  len, offset;
+	unsigned i;
 
-	if (dwpal_event_handler == -1)
+	len = read(inotifyFd, buf, sizeof(buf));
+	if (len < 0)
 	{
-		console_printf("%s; dwpal_event_handler not valid ==> Abort!\n", __FUNCTION__);
-		return NULL;
+		if (errno != EAGAIN)
+			console_printf("%s; read() failed; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+		return;
 	}
 
-	/* Receive the msg */
-	while (true)
+	for (offset = 0; offset < len; offset += sizeof(struct inotify_event) + ((struct inotify_event *)&buf[offset])->len)
 	{
-		/* Handle the COMMAND_SOCKET */
-		len = sizeof(un);
-		if ((clientfd = accept(dwpal_event_handler, (struct sockaddr *)&un, &len)) < 0)
-		{ // wait for client to connect to me (server)
-			console_printf_err("%s; ERROR: accept() received; clientfd= %d; errno= %d ('%s') ==> cont...\n", __FUNCTION__, clientfd, errno, strerror(errno));
+		const struct inotify_event *event = (const struct inotify_event *)&buf[offset];
+
+		if (event->mask & IN_IGNORED)
+		{
+			/* the directory was removed, it is watched again once it exists */
+			for (i = 0; i < ARRAY_SIZE(hostapCtrlDirs); i++)
+			{
+				if (ctrlDirWd[i] == event->wd)
+					ctrlDirWd[i] = -1;
+			}
 			continue;
 		}
 
-		memset(rcv_buf, '\0', sizeof(rcv_buf));
+		if (event->len == 0)
+			continue;
 
-		if ((byte = read(clientfd, rcv_buf, sizeof(rcv_buf))) == -1)
-		{   // wait for client to write/send data to me (server)
-			console_printf("%s; read() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+		for (i = 0; i < numOfServices; i++)
+		{
+			if ( (dwpalService[i] == NULL) ||
+			     (DWPAL_CONN_TYPE_HOSTAP != dwpalService[i]->connectionType) ||
+			     strncmp(event->name, dwpalService[i]->VAPName, DWPAL_VAP_NAME_STRING_LENGTH) )
+			{
+				continue;
+			}
 
-			if (close(clientfd) == (-1))
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM))
 			{
-				console_printf("%s; close() fail; clientfd= %d; errno= %d ('%s')\n", __FUNCTION__, clientfd, errno, strerror(errno));
+				interfaceDownSet(i, "control socket removed");
 			}
+			else
+			{
+				/* hostapd is up, reconnect right away */
+				MUTEX_LOCK(&serviceLock[i]);
+				if (dwpalService[i]->isConnectionEstablishNeeded)
+				{
+					dwpalService[i]->recoveryTimeMs = 0;
+					dwpalService[i]->recoveryBackoffMs = RECOVERY_BACKOFF_MIN_MS;
+				}
+				MUTEX_UNLOCK(&serviceLock[i]);
+			}
+		}
+	}
+}
+#endif /* DISABLE_DWPAL_HOSTAP_SUPPORT */
+
+#if defined EVENT_CALLBACK_THREAD
+/* Delivers the complete records in the buffer, returns the number of bytes
+   consumed, or -1 if a record is corrupted and the stream can't be followed */
+static ssize_t eventRecordsDeliver(char *buf, size_t len)
+{
+	size_t    offset = 0, recordLen;
+	EventData *eventData;
+
+	while (len - offset >= EVENT_RECORD_HDR_SIZE)
+	{
+		eventData = (EventData *)(buf + offset);
+		if ( (eventData->serviceIdx < 0) || ((size_t)eventData->serviceIdx >= numOfServices) ||
+		     (eventData->msgStringLen >= sizeof(eventData->msg)) )
+		{
+			console_printf("%s; bad record (serviceIdx= %d, msgStringLen= %zu) ==> Abort!\n",
+			               __FUNCTION__, eventData->serviceIdx, eventData->msgStringLen);
+			return -1;
+		}
+
+		recordLen = EVENT_RECORD_LEN(eventData->msgStringLen);
+		if (len - offset < recordLen)
+			break;
+
+		eventData->msg[eventData->msgStringLen] = '\0';
+		eventData->VAPName[sizeof(eventData->VAPName) - 1] = '\0';
+		eventData->opCode[sizeof(eventData->opCode) - 1] = '\0';
+
+		if ( (dwpalService[eventData->serviceIdx] != NULL) &&
+		     (dwpalService[eventData->serviceIdx]->hostapEventCallback != NULL) )
+		{
+			dwpalService[eventData->serviceIdx]->hostapEventCallback(eventData->VAPName, eventData->opCode, eventData->msg, eventData->msgStringLen);
+		}
+
+		offset += recordLen;
+	}
+
+	return (ssize_t)offset;
+}
+
+/* The records can't be told apart anymore. Draining the channel isn't
+   enough, since the rest of a record may still wait in the batch of a
+   writer; the channel is replaced by a new one, and what was received or is
+   still batched is dropped */
+static void eventChannelResync(void)
+{
+	int     newChannelFDs[2], i;
+	ssize_t byte;
+
+	console_printf("%s; event channel out of sync ==> reopen\n", __FUNCTION__);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, newChannelFDs) < 0)
+	{
+		/* keep the channel, the records are lost until a record start is read */
+		console_printf("%s; socketpair() fail; errno= %d ('%s') ==> drain\n", __FUNCTION__, errno, strerror(errno));
+		eventRcvLen = 0;
+		do {
+			byte = read(eventChannelFDs[0], eventRcvBuf, sizeof(eventRcvBuf));
+		} while ( (byte > 0) || ((byte < 0) && (errno == EINTR)) );
+		return;
+	}
+
+	MUTEX_LOCK(&event_batch_mutex);
+	for (i = 0; i < 2; i++)
+	{
+		if (close(eventChannelFDs[i]) == (-1))
+		{
+			console_printf("%s; close() fail; fd= %d; errno= %d ('%s')\n", __FUNCTION__, eventChannelFDs[i], errno, strerror(errno));
+		}
+		eventChannelFDs[i] = newChannelFDs[i];
+	}
+	eventBatchLen = 0;
+	eventRcvLen = 0;
+	MUTEX_UNLOCK(&event_batch_mutex);
+}
+
+static void *eventHandlerThreadStart(void *temp)
+{
+	ssize_t     byte, consumed;
+	int         highestValFD, ret;
+	fd_set      rfds;
+
+	(void)temp;
+
+	console_printf("%s Entry\n", __FUNCTION__);
+
+	while (!g_eventHandlerThreadInfo.threadShouldStop)
+	{
+		FD_ZERO(&rfds);
+		FD_SET(g_eventHandlerThreadInfo.pipeFDs[0], &rfds);
+		highestValFD = g_eventHandlerThreadInfo.pipeFDs[0];
+
+		if (eventChannelFDs[0] != (-1))
+		{
+			FD_SET(eventChannelFDs[0], &rfds);
+			highestValFD = (eventChannelFDs[0] > highestValFD) ? eventChannelFDs[0] : highestValFD;
+		}
+
+		ret = select(highestValFD + 1, &rfds, NULL, NULL, NULL);
+		if (ret < 0)
+		{
+			console_printf("%s; select() return value= %d ==> cont...; errno= %d ('%s')\n", __FUNCTION__, ret, errno, strerror(errno));
 			continue;
 		}
 
-		if (close(clientfd) == (-1))
+		if (FD_ISSET(g_eventHandlerThreadInfo.pipeFDs[0], &rfds))
 		{
-			console_printf("%s; close() fail; clientfd= %d; errno= %d ('%s')\n", __FUNCTION__, clientfd, errno, strerror(errno));
+			/* the events which were not read yet are delivered once the thread is created again */
+			console_printf("%s; received message from main thread => shutting down\n", __FUNCTION__);
+			break;
 		}
 
-		if ( (byte > (int)sizeof(EventData)) || (byte < 1) )
+		if ((eventChannelFDs[0] == (-1)) || !FD_ISSET(eventChannelFDs[0], &rfds))
+			continue;
+
+		/* read as many records as fit, a partial record is completed by the next read */
+		byte = read(eventChannelFDs[0], eventRcvBuf + eventRcvLen, sizeof(eventRcvBuf) - eventRcvLen);
+		if (byte == 0)
 		{
-			console_printf_err("%s; ERROR: read() returned buffer size (%d) out of range (1 <-> %d) ==> cont...\n", __FUNCTION__, byte, sizeof(EventData));
+			console_printf("%s; event channel was closed => shutting down\n", __FUNCTION__);
+			break;
+		}
+		else if (byte < 0)
+		{
+			if ( (errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK) )
+				console_printf("%s; read() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
 			continue;
 		}
+		eventRcvLen += byte;
 
-		eventData = (EventData *)rcv_buf;
+		consumed = eventRecordsDeliver(eventRcvBuf, eventRcvLen);
+		if (consumed < 0)
+		{
+			eventChannelResync();
+			continue;
+		}
 
-		dwpalService[eventData->serviceIdx]->hostapEventCallback(eventData->VAPName, eventData->opCode, eventData->msg, eventData->msgStringLen);
+		eventRcvLen -= consumed;
+		if (eventRcvLen && consumed)
+			memmove_s(eventRcvBuf, sizeof(eventRcvBuf), eventRcvBuf + consumed, eventRcvLen);
 	}
 
+	console_printf("%s; exit\n", __FUNCTION__);
 	return NULL;
 }
 #endif
@@ -624,6 +1002,12 @@ static void *listenerThreadStart(void *temp)
 #ifndef DISABLE_DWPAL_HOSTAP_SUPPORT
 			if (DWPAL_CONN_TYPE_HOSTAP == dwpalService[i]->connectionType)
 			{
+				/* the failed socket is polled again once the iface is recovered */
+				if (dwpalService[i]->isEventSocketFailed)
+				{
+					continue;
+				}
+
 				if (dwpal_hostap_event_fd_get(context[i], &dwpalService[i]->fd) == DWPAL_FAILURE)
 				{
 					/*console_printf("%s; dwpal_hostap_event_fd_get returned error ==> cont. (VAPName= '%s')\n",
@@ -707,12 +1091,19 @@ static void *listenerThreadStart(void *temp)
 				msgLen = HOSTAPD_TO_DWPAL_MSG_LENGTH - 1;  //was "msgLen = HOSTAPD_TO_DWPAL_MSG_LENGTH;"
 				if (dwpal_hostap_event_get(context[i], msg /*OUT*/, &msgLen /*IN/OUT*/, opCode /*OUT*/) == DWPAL_FAILURE)
 				{
+					bool isSocketFailed = false;
+
 					console_printf("%s; dwpal_hostap_event_get ERROR; VAPName= '%s', msgLen= %zu\n",
 					       __FUNCTION__, dwpalService[i]->VAPName, msgLen);
 
-					/* Trigger the recovery of iface immediately if needed */
-					if (write(g_monitorThreadInfo.pipeFDs[1], "R", 1) < 0)
-						console_printf("%s; write to g_monitorThreadInfo->pipeFDs[1] FAILED (errno= %d)\n", __FUNCTION__, errno);
+					if ( (dwpal_hostap_event_socket_failed_get(context[i], &isSocketFailed) == DWPAL_SUCCESS) && isSocketFailed )
+					{
+						/* hostapd is gone (e.g. ECONNREFUSED); stop polling the socket and
+						   trigger the recovery of iface immediately */
+						dwpalService[i]->isEventSocketFailed = true;
+						if (write(g_monitorThreadInfo.pipeFDs[1], "R", 1) < 0)
+							console_printf("%s; write to g_monitorThreadInfo->pipeFDs[1] FAILED (errno= %d)\n", __FUNCTION__, errno);
+					}
 				}
 				else
 				// ThreadShouldStop may be changed during select() call. Don't call event handler if thread is cancelling
@@ -742,6 +1133,12 @@ static void *listenerThreadStart(void *temp)
 				}
 			}
 		}
+
+#if defined EVENT_CALLBACK_THREAD
+		/* write the events of this round at once */
+		if (eventBatchFlush() == DWPAL_FAILURE)
+			console_printf("%s; eventBatchFlush failed ==> cont...\n", __FUNCTION__);
+#endif
 	}
 
 	console_printf("%s; exit\n", __FUNCTION__);
@@ -752,18 +1149,30 @@ static void *listenerThreadStart(void *temp)
 
 static void *monitorThreadStart(void *temp)
 {
-	int    highestValFD, ret;
-	bool   isInterfacesPingCheck = false;
-	fd_set rfds;
+	int       highestValFD, ret, inotifyFd, pingCheckTime;
+	int       ctrlDirWd[ARRAY_SIZE(hostapCtrlDirs)] = { [0 ... (ARRAY_SIZE(hostapCtrlDirs) - 1) ] = -1 };
+	bool      isCtrlDirWatched = false;
+	fd_set    rfds;
 	struct timeval tv;
-	long last_ping_check, last_recovery_time, current_time;
+	long      last_ping_check, current_time;
+	long long nextRecoveryTimeMs, waitMs;
+#if defined EVENT_CALLBACK_THREAD
+	fd_set    wfds;
+	int       eventChannelFd;
+#endif
 
 	(void)temp;
 
 	console_printf("%s Entry\n", __FUNCTION__);
 
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+		console_printf("%s; inotify_init1() failed; errno= %d ('%s') ==> use PING\n", __FUNCTION__, errno, strerror(errno));
+	else
+		isCtrlDirWatched = ctrlDirsWatch(inotifyFd, ctrlDirWd);
+
 	last_ping_check = dwpal_get_uptime();
-	last_recovery_time = last_ping_check;
+	nextRecoveryTimeMs = timeMsGet();
 
 	while (!g_monitorThreadInfo.threadShouldStop)
 	{
@@ -772,15 +1181,50 @@ static void *monitorThreadStart(void *temp)
 		FD_SET(g_monitorThreadInfo.pipeFDs[0], &rfds);
 		highestValFD = g_monitorThreadInfo.pipeFDs[0];
 
-		tv.tv_sec = 1;
-		tv.tv_usec = 0;
+		if (inotifyFd >= 0)
+		{
+			FD_SET(inotifyFd, &rfds);
+			highestValFD = (inotifyFd > highestValFD) ? inotifyFd : highestValFD;
+		}
+
+#if defined EVENT_CALLBACK_THREAD
+		/* the rest of the event batch is written as soon as the channel has
+		   room, even if the listener thread doesn't get any event */
+		FD_ZERO(&wfds);
+		eventChannelFd = eventBatchTailFdGet();
+		if (eventChannelFd != (-1))
+		{
+			FD_SET(eventChannelFd, &wfds);
+			highestValFD = (eventChannelFd > highestValFD) ? eventChannelFd : highestValFD;
+		}
+#endif
 
+		/* wake up for the next reconnect attempt */
+		waitMs = nextRecoveryTimeMs - timeMsGet();
+		if (waitMs > RECOVERY_RETRY_TIME_MS)
+			waitMs = RECOVERY_RETRY_TIME_MS;
+		else if (waitMs < 0)
+			waitMs = 0;
+
+		tv.tv_sec = waitMs / 1000;
+		tv.tv_usec = (waitMs % 1000) * 1000;
+
+#if defined EVENT_CALLBACK_THREAD
+		ret = select(highestValFD + 1, &rfds, &wfds, NULL, &tv);
+#else
 		ret = select(highestValFD + 1, &rfds, NULL, NULL, &tv);
+#endif
 		if (ret < 0) {
 			console_printf("%s; select() return value= %d ==> cont...; errno= %d ('%s')\n", __FUNCTION__, ret, errno, strerror(errno));
 			continue;
 		}
 
+#if defined EVENT_CALLBACK_THREAD
+		if ( (eventChannelFd != (-1)) && FD_ISSET(eventChannelFd, &wfds) &&
+		     (eventBatchFlush() == DWPAL_FAILURE) )
+			console_printf("%s; eventBatchFlush failed ==> cont...\n", __FUNCTION__);
+#endif
+
 		if (FD_ISSET(g_monitorThreadInfo.pipeFDs[0], &rfds)) {
 			char pipedMsg[16] = {0};
 
@@ -790,24 +1234,36 @@ static void *monitorThreadStart(void *temp)
 				break;
 			}
 
-			if ('R' == pipedMsg[0])
-				isInterfacesPingCheck = true;
-			else
+			/* 'R' - an event socket failed; 'F' - the rest of the event
+			   batch waits for room in the event channel, handled above */
+			if (memchr(pipedMsg, 'R', ret))
+				interfacesEventSocketCheck();
+			else if (!memchr(pipedMsg, 'F', ret))
 				break; /* Stop the thread */
 		}
 
+		if ((inotifyFd >= 0) && FD_ISSET(inotifyFd, &rfds)) {
+			ctrlDirEventsHandle(inotifyFd, ctrlDirWd);
+			isCtrlDirWatched = ctrlDirsWatch(inotifyFd, ctrlDirWd);
+		}
+
 		current_time = dwpal_get_uptime();
-		if (isInterfacesPingCheck || ((current_time - last_ping_check) >= PING_CHECK_TIME)) {
+		pingCheckTime = isCtrlDirWatched ? PING_FALLBACK_CHECK_TIME : PING_CHECK_TIME;
+		if (pingCheckTime && ((current_time - last_ping_check) >= pingCheckTime)) {
 			last_ping_check = current_time;
 			interfacesPingCheck();
-		}
 
-		if ((current_time - last_recovery_time) >= RECOVERY_RETRY_TIME) {
-			last_recovery_time = current_time;
-			interfacesRecoverIfNeeded();
+			/* a control directory may be created after the thread has started */
+			if (inotifyFd >= 0)
+				isCtrlDirWatched = ctrlDirsWatch(inotifyFd, ctrlDirWd);
 		}
+
+		nextRecoveryTimeMs = interfacesRecoverIfNeeded(timeMsGet());
 	}
 
+	if ((inotifyFd >= 0) && (close(inotifyFd) != 0))
+		console_printf("%s; close() of inotifyFd FAILED (errno= %d)\n", __FUNCTION__, errno);
+
 	console_printf("%s; exit\n", __FUNCTION__);
 	return NULL;
 }
@@ -957,257 +1413,156 @@ static DWPAL_Ret threadSet(threadData_t *threadInfo, DwpalThreadOperation thread
 }
 
 
-#if defined EVENT_CALLBACK_THREAD
-static int fdDaemonSet(char *socketName, int *fd /* output param */)
+/* A driver 'get' command. The commands of all the threads are pipelined on the
+   'get' socket, and each reply is delivered to its own request by the netlink
+   sequence number (see dwpal_nl80211_cmd_submit()) */
+typedef struct
 {
-	struct sockaddr_un un;
-	size_t len;
-
-	if ((*fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
-	{
-		console_printf("%s; create socket fail; socketName= '%s'; errno= %d ('%s')\n", __FUNCTION__, socketName, errno, strerror(errno));
-		return DWPAL_FAILURE;
-    }
+	DWPAL_nl80211Request req;
+	unsigned char        *outData;  /* caller's buffer of outSize bytes; NULL to allocate the reply */
+	size_t               outSize;
+	size_t               outLen;
+	bool                 received;
+	bool                 tooLong;
+} nlGetRequest;
+
+/* Max time to wait for the 'get' socket before checking again if another
+   thread has already received the reply */
+#define NL_GET_POLL_MS 20
+
+static int nlGetReplyCallback(struct nl_msg *msg, void *arg)
+{
+	nlGetRequest      *getReq = (nlGetRequest *)arg;
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr     *attr;
+	size_t            len;
 
-	console_printf("%s; fd_daemon (socketName='%s') = %d\n", __FUNCTION__, socketName, *fd);
+	attr = nla_find(genlmsg_attrdata(gnlh, 0), genlmsg_attrlen(gnlh, 0), NL80211_ATTR_VENDOR_DATA);
+	if ( (attr == NULL) || getReq->received )
+		return NL_SKIP;
 
-	unlink(socketName);   /* in case it already exists */
+	len = (size_t)nla_len(attr);
+	console_printf("%s; seq= %u, len= %zu\n", __FUNCTION__, getReq->req.seq, len);
 
-    /* fill in socket address structure */
-	memset(&un, 0, sizeof(un));
-	un.sun_family = AF_UNIX;
-	strcpy_s(un.sun_path, sizeof(un.sun_path), socketName);
-	len = offsetof(struct sockaddr_un, sun_path) + strnlen_s(socketName, SOCKET_NAME_LENGTH);
+	if (len == 0)
+		return NL_SKIP;
 
-    /* bind the name to the descriptor */
-	if (bind(*fd, (struct sockaddr *)&un, len) < 0)  // check if can use connect() instead...
+	if (getReq->outData == NULL)
 	{
-		console_printf("%s; bind() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
-
-		if (close(*fd) == (-1))
+		getReq->outData = (unsigned char *)malloc(len);
+		if (getReq->outData == NULL)
 		{
-			console_printf("%s; close() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
+			console_printf("%s; malloc failed ==> Abort!\n", __FUNCTION__);
+			return NL_SKIP;
 		}
-
-		return DWPAL_FAILURE;
-    }
-
-	if (chmod(socketName, 0600) < 0)
-	{
-		console_printf("%s; FAIL to chmod '%s' to 0666\n", __FUNCTION__, socketName);
-
-		if (close(*fd) == (-1))
-		{
-			console_printf("%s; close() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
-		}
-
-		return DWPAL_FAILURE;
-    }
-
-	if (listen(*fd, 10 /*Q Length*/) < 0)
-	{ /* tell kernel we're a server */
-		console_printf("%s; listen fail\n", __FUNCTION__);
-
-		if (close(*fd) == (-1))
-		{
-			console_printf("%s; close() fail; errno= %d ('%s')\n", __FUNCTION__, errno, strerror(errno));
-		}
-
-		return DWPAL_FAILURE;
+		getReq->outSize = len;
 	}
-
-	return DWPAL_SUCCESS;
-}
-
-
-static DWPAL_Ret dwpal_socket_create(int *fd, char *socketPrefixName)
-{
-	pid_t pid = getpid();
-	char  socketName[SOCKET_NAME_LENGTH] = "\0";
-	int status;
-
-	status = sprintf_s(socketName, sizeof(socketName), "%s_%d", socketPrefixName, pid);
-	if (status <= 0)
-		console_printf("%s; sprintf_s failed!\n", __FUNCTION__);
-
-	if (*fd > 0)
+	else if (len > getReq->outSize)
 	{
-		console_printf("%s; *fd (%d) ==> cont...\n", __FUNCTION__, *fd);
-		return DWPAL_SUCCESS;
+		console_printf("%s; len (%zu) > (%zu) ==> Abort!\n", __FUNCTION__, len, getReq->outSize);
+		getReq->tooLong = true;
+		return NL_SKIP;
 	}
 
-	if (fdDaemonSet(socketName, fd /*output*/) == DWPAL_FAILURE)
-	{
-		console_printf("%s; ERROR; *fd= %d\n", __FUNCTION__, *fd);
-		return DWPAL_FAILURE;
-	}
+	memcpy_s(getReq->outData, getReq->outSize, nla_data(attr), len);
+	getReq->outLen = len;
+	getReq->received = true;
 
-	return DWPAL_SUCCESS;
+	return NL_SKIP;
 }
-#endif
-
 
-static DWPAL_Ret nlCmdGetCallback(char *ifname, int event, int subevent, size_t len, unsigned char *data)
+static bool nlFdWait(int fd, int timeoutMs)
 {
-	console_printf("%s Entry; ifname= '%s', event= %d, subevent= %d (len= %zu)\n", __FUNCTION__, ifname, event, subevent, len);
-
-	(void)ifname;
-	(void)event;
-	(void)subevent;
-
-	if ( (len == 0) || (data == NULL) )
-	{
-		console_printf("%s; len=0 and/or data is NULL ==> Abort!\n", __FUNCTION__);
-		return DWPAL_FAILURE;
-	}
-
-	{
-		int i;
-		size_t lenToPrint = (len <= 10)? len : 10;
-
-		console_printf("%s; Output data from the 'get' function:\n", __FUNCTION__);
-		for (i=0; i < (int)lenToPrint; i++)
-		{
-			console_printf(" 0x%x", data[i]);
-		}
-		console_printf("\n");
-	}
-
-	if (nl_response_save_data == true)
-	{
-		if (nl_response_data == NULL || nl_response_len == NULL)
-		{
-			console_printf("%s; nl_response_data or nl_response_len is NULL ==> Abort!\n", __FUNCTION__);
-			return DWPAL_FAILURE;
-		}
-
-		if (len > DRIVER_NL_TO_DWPAL_MSG_LENGTH)
-		{
-			console_printf("%s; len (%zu) > (%zu) ==> Abort!\n", __FUNCTION__, len, (size_t)DRIVER_NL_TO_DWPAL_MSG_LENGTH);
-			return DWPAL_FAILURE;
-		}
+	struct timeval tv;
+	fd_set         rfds;
 
-		memcpy_s(nl_response_data, DRIVER_NL_TO_DWPAL_MSG_LENGTH, data, len);
-		*nl_response_len = len;
-		nl_response_received = true;
-	}
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	FD_ZERO(&rfds);
+	FD_SET(fd, &rfds);
 
-	return DWPAL_SUCCESS;
+	return (select(fd + 1, &rfds, NULL, NULL, &tv) > 0);
 }
 
-
-static DWPAL_Ret nl_cmd_socket_clean_if_needed(int idx)
+/* Sends the command and waits for its reply. nl_cmd_mutex is held only to
+   submit and to deliver the replies already received, never while waiting,
+   so the commands of other threads are sent meanwhile; whichever thread
+   receives delivers the replies of all of them. A command without a reply by
+   its deadline is cancelled alone, the others stay in flight */
+static DWPAL_Ret nl_cmd_get(int idx, char *ifname, CmdIdType cmdIdType, unsigned int subCommand,
+                            unsigned char *vendorData, size_t vendorDataSize, nlGetRequest *getReq)
 {
-	struct  timeval tv;
-	fd_set  rfds;
-	int     ret;
-	int select_failure_count = 0;
+	int       fd, fdCmdGet;
+	size_t    numInFlight;
+	long long deadline;
+	bool      done = false;
 
-	if (dwpal_driver_nl_fd_get(context[idx], &dwpalService[idx]->fd, &dwpalService[idx]->fdCmdGet) == DWPAL_FAILURE)
+	if (dwpal_driver_nl_fd_get(context[idx], &fd, &fdCmdGet) == DWPAL_FAILURE || fdCmdGet <= 0)
 	{
 		console_printf("%s; dwpal_driver_nl_fd_get returned error ==> Abort.\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
-	if (dwpalService[idx]->fdCmdGet <= 0)
+	getReq->req.msg = dwpal_driver_nl_vendor_msg_alloc(context[idx], ifname, cmdIdType, subCommand, vendorData, vendorDataSize);
+	if (getReq->req.msg == NULL)
 	{
-		console_printf("%s; fdCmdGet value is invalid (%d) ==> Abort!\n", __FUNCTION__, dwpalService[idx]->fdCmdGet);
+		console_printf("%s; dwpal_driver_nl_vendor_msg_alloc returned NULL ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
+	getReq->req.nlCallback = nlGetReplyCallback;
+	getReq->req.cb_arg = getReq;
 
-	do {
-		FD_ZERO(&rfds);
-		FD_SET(dwpalService[idx]->fdCmdGet, &rfds);
+	deadline = timeMsGet() + DWPAL_NL_CMD_TIMEOUT_MS;
 
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-
-		ret = select(dwpalService[idx]->fdCmdGet + 1, &rfds, NULL, NULL, &tv);
-		if (ret < 0)
+	/* dwpal_nl80211_cmd_submit() would wait for a free slot with the mutex held */
+	while (true)
+	{
+		MUTEX_LOCK(&nl_cmd_mutex);
+		if ( (dwpal_nl80211_cmd_in_flight_get(context[idx], &numInFlight) == DWPAL_SUCCESS) &&
+		     (numInFlight < DWPAL_NL_MAX_IN_FLIGHT) )
 		{
-			console_printf("%s; select() return value= %d ==> cont...; errno= %d ('%s')\n", __FUNCTION__, ret, errno, strerror(errno));
-			select_failure_count++;
-
-			if (select_failure_count >= 3)
-			{
-				console_printf("%s; select() returned error %d times in a row ==> Abort.\n", __FUNCTION__, select_failure_count);
-				return DWPAL_FAILURE;
-			}
-
-			usleep(1000);
-			continue;
+			break;
 		}
+		dwpal_nl80211_cmd_poll(context[idx]);
+		MUTEX_UNLOCK(&nl_cmd_mutex);
 
-		if (FD_ISSET(dwpalService[idx]->fdCmdGet, &rfds))
+		if (timeMsGet() >= deadline)
 		{
-			console_printf("%s; nl command socket not empty ==> receive one message\n", __FUNCTION__);
-
-			nl_response_save_data = false;
-			if (dwpal_driver_nl_msg_get(context[idx], DWPAL_NL_SOLICITED_EVENT, dwpalService[idx]->nlCmdGetCallback, NULL) == DWPAL_FAILURE)
-			{
-				console_printf("%s; dwpal_driver_nl_msg_get ERROR\n", __FUNCTION__);
-				return DWPAL_FAILURE;
-			}
+			console_printf("%s; too many commands in flight ==> Abort!\n", __FUNCTION__);
+			nlmsg_free(getReq->req.msg);
+			getReq->req.msg = NULL;
+			return DWPAL_FAILURE;
 		}
 
-	} while(ret);
-
-	return DWPAL_SUCCESS;
-}
-
-
-static DWPAL_Ret nl_cmd_socket_receive_response(int idx, size_t *outLen, unsigned char *outData)
-{
-	struct  timeval tv;
-	fd_set  rfds;
-	int     ret;
-
-	if (dwpal_driver_nl_fd_get(context[idx], &dwpalService[idx]->fd, &dwpalService[idx]->fdCmdGet) == DWPAL_FAILURE)
-	{
-		console_printf("%s; dwpal_driver_nl_fd_get returned error ==> Abort.\n", __FUNCTION__);
-		return DWPAL_FAILURE;
+		nlFdWait(fdCmdGet, NL_GET_POLL_MS);
 	}
 
-	if (dwpalService[idx]->fdCmdGet <= 0)
+	if (dwpal_nl80211_cmd_submit(context[idx], &getReq->req) == DWPAL_FAILURE)
 	{
-		console_printf("%s; fdCmdGet value is invalid (%d) ==> Abort!\n", __FUNCTION__, dwpalService[idx]->fdCmdGet);
+		MUTEX_UNLOCK(&nl_cmd_mutex);
+		console_printf("%s; dwpal_nl80211_cmd_submit returned ERROR ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
+	MUTEX_UNLOCK(&nl_cmd_mutex);
 
-recv:
-	FD_ZERO(&rfds);
-	FD_SET(dwpalService[idx]->fdCmdGet, &rfds);
-
-	tv.tv_sec = 2;
-	tv.tv_usec = 0;
-
-	ret = select(dwpalService[idx]->fdCmdGet + 1, &rfds, NULL, NULL, &tv);
-	if (ret < 0)
+	while (!done)
 	{
-		console_printf("%s; select() return value= %d ==> cont...; errno= %d ('%s') ==> expected behavior when 'Interrupted system call'\n", __FUNCTION__, ret, errno, strerror(errno));
-		usleep(1000);
-		goto recv;
+		MUTEX_LOCK(&nl_cmd_mutex);
+		if (getReq->req.cmd_res > 0)
+			dwpal_nl80211_cmd_poll(context[idx]);
+		if ( (getReq->req.cmd_res > 0) && (timeMsGet() >= deadline) )
+			dwpal_nl80211_cmd_cancel(context[idx], &getReq->req, -ETIMEDOUT);
+		done = (getReq->req.cmd_res <= 0);
+		MUTEX_UNLOCK(&nl_cmd_mutex);
+
+		if (!done)
+			nlFdWait(fdCmdGet, NL_GET_POLL_MS);
 	}
 
-	if (FD_ISSET(dwpalService[idx]->fdCmdGet, &rfds))
+	if (getReq->req.cmd_res < 0 || !getReq->received || getReq->tooLong)
 	{
-		console_printf("%s; nl command socket not empty ==> receive one message\n", __FUNCTION__);
-
-		nl_response_save_data = true;
-		nl_response_data = outData;
-		nl_response_len = outLen;
-		nl_response_received = false;
-		if (dwpal_driver_nl_msg_get(context[idx], DWPAL_NL_SOLICITED_EVENT, dwpalService[idx]->nlCmdGetCallback, NULL) == DWPAL_FAILURE)
-		{
-			console_printf("%s; dwpal_driver_nl_msg_get ERROR\n", __FUNCTION__);
-			return DWPAL_FAILURE;
-		}
-
-		if (nl_response_received == false)
-		{
-			console_printf("%s; nlCmdGetCallback did not fill outData with a response\n", __FUNCTION__);
-			return DWPAL_FAILURE;
-		}
+		console_printf("%s; no reply (subCommand= 0x%x, cmd_res= %d) ==> Abort!\n", __FUNCTION__, subCommand, getReq->req.cmd_res);
+		return DWPAL_FAILURE;
 	}
 
 	return DWPAL_SUCCESS;
@@ -1221,17 +1576,25 @@ static DWPAL_Ret nl_cmd_handle(char *ifname,
 							   unsigned char *vendorData,
 							   size_t vendorDataSize,
 							   size_t *outLen,
-							   unsigned char *outData)
+							   unsigned char **outData,
+							   size_t outSize)
 {
-	int    i, idx;
+	int    idx;
+	nlGetRequest getReq;
 
 	console_printf("%s; ifname= '%s', nl80211Command= 0x%x, cmdIdType= %d, subCommand= %u, vendorDataSize= %zu, outLen= %p, outData= %p\n",
 	            __FUNCTION__, ifname, nl80211Command, cmdIdType, subCommand, vendorDataSize, (void *)outLen, (void *)outData);
 
-	for (i=0; i < (int)vendorDataSize; i++)
+#if defined DWPAL_NL_VENDOR_DATA_DUMP
 	{
-		console_printf("%s; vendorData[%d]= 0x%02x\n", __FUNCTION__, i, ((const char*)vendorData)[i]);
+		size_t i;
+
+		for (i = 0; i < vendorDataSize; i++)
+		{
+			console_printf("%s; vendorData[%zu]= 0x%02x\n", __FUNCTION__, i, vendorData[i]);
+		}
 	}
+#endif
 
 	if (dwpal_ext_interfaceIndexGet(DWPAL_CONN_TYPE_DRIVER, "ALL", &idx) == DWPAL_INTERFACE_IS_DOWN)
 	{
@@ -1243,44 +1606,32 @@ static DWPAL_Ret nl_cmd_handle(char *ifname,
 
 	if ( (outLen != NULL) && (outData != NULL) )
 	{
-		MUTEX_LOCK(&nl_cmd_mutex);
-
-		if (nl_cmd_socket_clean_if_needed(idx) == DWPAL_FAILURE)
+		if (nl80211Command != NL80211_CMD_VENDOR /*0x67*/)
 		{
-			console_printf("%s; nl_cmd_socket_clean_if_needed returned ERROR ==> Abort!\n", __FUNCTION__);
-			goto cmd_err;
+			console_printf("%s; non supported command (0x%x); currently we support ONLY NL80211_CMD_VENDOR (0x67) ==> Abort!\n", __FUNCTION__, nl80211Command);
+			*outLen = 0;
+			return DWPAL_FAILURE;
 		}
 
 		/* Handle a command which invokes an event with the output data */
-		if (dwpal_driver_nl_cmd_send(context[idx],
-									 DWPAL_NL_SOLICITED_EVENT,
-									 ifname,
-									 nl80211Command,
-									 cmdIdType,
-									 subCommand,
-									 vendorData,
-									 vendorDataSize) == DWPAL_FAILURE)
-		{
-			console_printf("%s; dwpal_driver_nl_cmd_send returned ERROR ==> Abort!\n", __FUNCTION__);
-			goto cmd_err;
-		}
+		memset(&getReq, 0, sizeof(getReq));
+		getReq.outData = *outData;
+		getReq.outSize = outSize;
 
-		if (nl_cmd_socket_receive_response(idx, outLen, outData) == DWPAL_FAILURE)
+		if (nl_cmd_get(idx, ifname, cmdIdType, subCommand, vendorData, vendorDataSize, &getReq) == DWPAL_FAILURE)
 		{
-			console_printf("%s; nl_cmd_socket_receive_response ERROR (subCommand= 0x%x) ==> Abort!\n", __FUNCTION__, subCommand);
-			goto cmd_err;
+			console_printf("%s; nl_cmd_get ERROR (subCommand= 0x%x) ==> Abort!\n", __FUNCTION__, subCommand);
+			if (*outData == NULL)
+				free(getReq.outData);
+			*outLen = 0;
+			return DWPAL_FAILURE;
 		}
 
+		*outData = getReq.outData;
+		*outLen = getReq.outLen;
 		console_printf("%s; 'get command' (subCommand= 0x%x, outLen= %zu) was received\n", __FUNCTION__, subCommand, *outLen);
-		MUTEX_UNLOCK(&nl_cmd_mutex);
 
 		return DWPAL_SUCCESS;
-
-cmd_err:
-		*outLen = 0;
-		MUTEX_UNLOCK(&nl_cmd_mutex);
-		return DWPAL_FAILURE;
-
 	}
 	else
 	{
@@ -1316,9 +1667,9 @@ DWPAL_Ret dwpal_ext_interfaceIndexGet(DwpalConnectionType connectionType, const
 {
 	DWPAL_Ret ret;
 
-	// pthread_mutex_lock(&attach_mutex);
+	MUTEX_LOCK(&services_mutex);
 	ret = interfaceIndexGet(connectionType, VAPName, idx);
-	// pthread_mutex_unlock(&attach_mutex);
+	MUTEX_UNLOCK(&services_mutex);
 
 	return ret;
 }
@@ -1369,14 +1720,44 @@ DWPAL_Ret dwpal_ext_driver_nl_scan_trigger(char *ifname, ScanParams *scanParams)
  *  \param[in] unsigned char *vendorData - the vendor's data (can be NULL)
  *  \param[in] size_t vendorDataSize - the vendor's data length (if the vendor data is NULL, it should be '0')
  *  \param[out] size_t *outLen - The length of the returned data
- *  \param[out] unsigned char *outData - Pointer the returned data itself
+ *  \param[out] unsigned char *outData - Pointer the returned data itself, DRIVER_NL_TO_DWPAL_MSG_LENGTH bytes
  *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ *  \note may be called by several threads at once, their commands are sent together
  ***************************************************************************/
 DWPAL_Ret dwpal_ext_driver_nl_get(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize, size_t *outLen, unsigned char *outData)
 {
 	console_printf("%s; ifname= '%s', nl80211Command= 0x%x, cmdIdType= %d, subCommand= 0x%x\n", __FUNCTION__, ifname, nl80211Command, cmdIdType, subCommand);
 
-	return nl_cmd_handle(ifname, nl80211Command, cmdIdType, subCommand, vendorData, vendorDataSize, outLen, outData);
+	if (outData == NULL)
+	{
+		console_printf("%s; outData is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	return nl_cmd_handle(ifname, nl80211Command, cmdIdType, subCommand, vendorData, vendorDataSize, outLen, &outData, DRIVER_NL_TO_DWPAL_MSG_LENGTH);
+}
+
+
+/**************************************************************************/
+/*! \fn DWPAL_Ret dwpal_ext_driver_nl_get_alloc(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize, size_t *outLen, unsigned char **outData)
+ **************************************************************************
+ *  \brief driver-NL get command, same as dwpal_ext_driver_nl_get() for a reply of any size
+ *  \param[out] size_t *outLen - The length of the returned data
+ *  \param[out] unsigned char **outData - The returned data, allocated with the size of the reply; should be freed by the caller
+ *  \return DWPAL_Ret (DWPAL_SUCCESS for success, other for failure)
+ ***************************************************************************/
+DWPAL_Ret dwpal_ext_driver_nl_get_alloc(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize, size_t *outLen, unsigned char **outData)
+{
+	console_printf("%s; ifname= '%s', nl80211Command= 0x%x, cmdIdType= %d, subCommand= 0x%x\n", __FUNCTION__, ifname, nl80211Command, cmdIdType, subCommand);
+
+	if ( (outData == NULL) || (outLen == NULL) )
+	{
+		console_printf("%s; outData or outLen is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	*outData = NULL;
+	return nl_cmd_handle(ifname, nl80211Command, cmdIdType, subCommand, vendorData, vendorDataSize, outLen, outData, 0);
 }
 
 
@@ -1402,7 +1783,7 @@ DWPAL_Ret dwpal_ext_driver_nl_cmd_send(char *ifname, unsigned int nl80211Command
 
 	console_printf("%s; ifname= '%s', nl80211Command= 0x%x, cmdIdType= %d, subCommand= 0x%x, vendorDataSize= %zu\n", __FUNCTION__, ifname, nl80211Command, cmdIdType, subCommand, vendorDataSize);
 
-	return nl_cmd_handle(ifname, nl80211Command, cmdIdType, subCommand, vendorData, vendorDataSize, NULL, NULL);
+	return nl_cmd_handle(ifname, nl80211Command, cmdIdType, subCommand, vendorData, vendorDataSize, NULL, NULL, 0);
 }
 
 /* New API */
@@ -1462,6 +1843,52 @@ DWPAL_Ret dwpal_ext_nl80211_cmd_send(struct nl_msg *msg, int *cmd_res /*OUT*/, D
 }
 
 
+struct nl_msg *dwpal_ext_driver_nl_vendor_msg_alloc(char *ifname, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize)
+{
+	int idx;
+
+	if (dwpal_ext_interfaceIndexGet(DWPAL_CONN_TYPE_DRIVER, "ALL", &idx) == DWPAL_INTERFACE_IS_DOWN)
+	{
+		console_printf("%s; dwpal_ext_interfaceIndexGet returned ERROR ==> Abort!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	return dwpal_driver_nl_vendor_msg_alloc(context[idx], ifname, cmdIdType, (enum ltq_nl80211_vendor_subcmds)subCommand, vendorData, vendorDataSize);
+}
+
+
+DWPAL_Ret dwpal_ext_nl80211_cmd_send_batch(DWPAL_nl80211Request *reqs[], size_t numOfReqs, bool lock_cmd)
+{
+	int idx;
+	size_t i;
+	DWPAL_Ret ret;
+
+	if (reqs == NULL)
+	{
+		console_printf("%s; reqs is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (dwpal_ext_interfaceIndexGet(DWPAL_CONN_TYPE_DRIVER, "ALL", &idx) == DWPAL_INTERFACE_IS_DOWN)
+	{
+		console_printf("%s; dwpal_ext_interfaceIndexGet returned ERROR ==> Abort!\n", __FUNCTION__);
+		for (i = 0; i < numOfReqs; i++)
+		{
+			nlmsg_free(reqs[i]->msg);
+			reqs[i]->msg = NULL;
+		}
+		return DWPAL_INTERFACE_IS_DOWN;
+	}
+
+	/* Note: the messages are freed once sent, so there is no NL recovery here */
+	if (lock_cmd) MUTEX_LOCK(&nl_cmd_mutex);
+	ret = dwpal_nl80211_cmd_send_batch(context[idx], reqs, numOfReqs);
+	if (lock_cmd) MUTEX_UNLOCK(&nl_cmd_mutex);
+
+	return ret;
+}
+
+
 DWPAL_Ret dwpal_ext_driver_nl_scan_dump_sync(char *ifname, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg, bool lock_cmd)
 {
 	int idx;
@@ -1528,6 +1955,26 @@ DWPAL_Ret dwpal_ext_nl80211_id_get(int *nl80211_id /*OUT*/)
 }
 
 
+DWPAL_Ret dwpal_ext_driver_nl_ifindex_get(char *ifname, unsigned *ifindex /*OUT*/)
+{
+	int idx;
+
+	if ( (ifname == NULL) || (ifindex == NULL) )
+	{
+		console_printf("%s; ifname and/or ifindex is NULL ==> Abort!\n", __FUNCTION__);
+		return DWPAL_FAILURE;
+	}
+
+	if (dwpal_ext_interfaceIndexGet(DWPAL_CONN_TYPE_DRIVER, "ALL", &idx) == DWPAL_INTERFACE_IS_DOWN)
+	{
+		console_printf("%s; dwpal_ext_interfaceIndexGet returned ERROR ==> Abort!\n", __FUNCTION__);
+		return DWPAL_INTERFACE_IS_DOWN;
+	}
+
+	return dwpal_driver_nl_ifindex_get(context[idx], ifname, ifindex);
+}
+
+
 /**************************************************************************/
 /*! \fn DWPAL_Ret dwpal_ext_driver_nl_detach(void)
  **************************************************************************
@@ -1538,9 +1985,6 @@ DWPAL_Ret dwpal_ext_driver_nl_detach(void)
 {
 	int idx;
 	DWPAL_Ret ret;
-#if defined EVENT_CALLBACK_THREAD
-	int status;
-#endif
 
 	console_printf("%s Entry\n", __FUNCTION__);
 
@@ -1563,16 +2007,12 @@ DWPAL_Ret dwpal_ext_driver_nl_detach(void)
 
 	/* Cancel the listener thread, if it does exist */
 #if defined EVENT_CALLBACK_THREAD
-	threadSet(&eventHandlerThreadId, THREAD_CANCEL, NULL);
+	threadSet(&g_eventHandlerThreadInfo, THREAD_CANCEL, NULL);
 #endif
 	threadSet(&g_listenerThreadInfo, THREAD_CANCEL, NULL);
 
 	/* dealocate the interface (after canceling the listener thread) */
-	if (dwpalService[idx] != NULL)
-	{
-		free(dwpalService[idx]);
-		dwpalService[idx] = NULL;
-	}
+	serviceFree(idx);
 
 	if (dwpal_driver_nl_detach(&context[idx]) == DWPAL_FAILURE)
 	{
@@ -1587,27 +2027,14 @@ end:
 	{ /* There are still active interfaces */
 		/* Create the listener thread, if it does NOT exist yet */
 #if defined EVENT_CALLBACK_THREAD
-		threadSet(&eventHandlerThreadId, THREAD_CREATE, eventHandlerThreadStart);
+		threadSet(&g_eventHandlerThreadInfo, THREAD_CREATE, eventHandlerThreadStart);
 #endif
 		threadSet(&g_listenerThreadInfo, THREAD_CREATE, listenerThreadStart);
 	}
 #if defined EVENT_CALLBACK_THREAD
-	else if (dwpal_event_handler != (-1))
+	else
 	{
-		pid_t pid = getpid();
-		char  socketName[SOCKET_NAME_LENGTH] = "\0";
-
-		status = sprintf_s(socketName, sizeof(socketName), "%s_%d", EVENT_HANDLER_SOCKET, pid);
-		if (status <= 0)
-			console_printf("%s; sprintf_s failed!\n", __FUNCTION__);
-
-		if (close(dwpal_event_handler) == (-1))
-		{
-			console_printf("%s; close() fail; dwpal_event_handler= %d; errno= %d ('%s')\n", __FUNCTION__, dwpal_event_handler, errno, strerror(errno));
-		}
-
-		unlink(socketName);
-		dwpal_event_handler = (-1);
+		eventChannelClose();
 	}
 #endif
 
@@ -1648,7 +2075,7 @@ DWPAL_Ret dwpal_ext_driver_nl_attach(DwpalExtNlEventCallback nlEventCallback, Dw
 
 	/* Cancel the listener thread, if it does exist */
 #if defined EVENT_CALLBACK_THREAD
-	threadSet(&eventHandlerThreadId, THREAD_CANCEL, NULL);
+	threadSet(&g_eventHandlerThreadInfo, THREAD_CANCEL, NULL);
 #endif
 	threadSet(&g_listenerThreadInfo, THREAD_CANCEL, NULL);
 
@@ -1677,9 +2104,6 @@ DWPAL_Ret dwpal_ext_driver_nl_attach(DwpalExtNlEventCallback nlEventCallback, Dw
 	/* nlEventCallback can be NULL */
 	dwpalService[idx]->nlEventCallback = nlEventCallback;
 
-	/* Register here the internal static callback function of the 'get command' event */
-	dwpalService[idx]->nlCmdGetCallback = nlCmdGetCallback;
-
 	/* Register here the internal static callback function of the 'non-Vendor' event */
 	dwpalService[idx]->nlNonVendorEventCallback = nlNonVendorEventCallback;
 
@@ -1688,15 +2112,14 @@ DWPAL_Ret dwpal_ext_driver_nl_attach(DwpalExtNlEventCallback nlEventCallback, Dw
 end:
 	if (ret == DWPAL_FAILURE && dwpalService[idx] != NULL)
 	{
-		free(dwpalService[idx]);
-		dwpalService[idx] = NULL;
+		serviceFree(idx);
 	}
 
 	/* Create the listener thread, if it does NOT exist yet */
 	if (isAnyInterfaceActive())
 	{
 #if defined EVENT_CALLBACK_THREAD
-		threadSet(&eventHandlerThreadId, THREAD_CREATE, eventHandlerThreadStart);
+		threadSet(&g_eventHandlerThreadInfo, THREAD_CREATE, eventHandlerThreadStart);
 #endif
 		threadSet(&g_listenerThreadInfo, THREAD_CREATE, listenerThreadStart);
 	}
@@ -1748,10 +2171,21 @@ DWPAL_Ret dwpal_ext_hostap_cmd_send(const char *VAPName, const char *cmdHeader,
 
 	console_printf("%s; interfaceIndexGet returned idx= %d\n", __FUNCTION__, idx);
 
-	MUTEX_LOCK(&context_mutex);
+	MUTEX_LOCK(&serviceLock[idx]);
+	/* the interface may have been detached before the lock was taken */
+	if ( (dwpalService[idx] == NULL) ||
+	     (dwpalService[idx]->connectionType != DWPAL_CONN_TYPE_HOSTAP) ||
+	     strncmp(VAPName, dwpalService[idx]->VAPName, DWPAL_VAP_NAME_STRING_LENGTH) )
+	{
+		MUTEX_UNLOCK(&serviceLock[idx]);
+		console_printf("%s; VAPName= '%s' was detached ==> Abort!\n", __FUNCTION__, VAPName);
+		*replyLen = 0;
+		return DWPAL_INTERFACE_IS_DOWN;
+	}
+
 	if (dwpalService[idx]->isConnectionEstablishNeeded == true)
 	{
-		MUTEX_UNLOCK(&context_mutex);
+		MUTEX_UNLOCK(&serviceLock[idx]);
 		console_printf("%s; interface is being reconnected, but still NOT ready ==> Abort!\n", __FUNCTION__);
 		*replyLen = 0;
 		return DWPAL_INTERFACE_IS_DOWN;
@@ -1759,7 +2193,7 @@ DWPAL_Ret dwpal_ext_hostap_cmd_send(const char *VAPName, const char *cmdHeader,
 
 	if (context[idx] == NULL)
 	{
-		MUTEX_UNLOCK(&context_mutex);
+		MUTEX_UNLOCK(&serviceLock[idx]);
 		console_printf("%s; context[%d] is NULL ==> Abort!\n", __FUNCTION__, idx);
 		*replyLen = 0;
 		return DWPAL_FAILURE;
@@ -1772,7 +2206,7 @@ DWPAL_Ret dwpal_ext_hostap_cmd_send(const char *VAPName, const char *cmdHeader,
 		*replyLen = 0;
 
 		console_printf("%s; VAPName= '%s' interface needs to be recovered\n", __FUNCTION__, dwpalService[idx]->VAPName);
-		dwpalService[idx]->isConnectionEstablishNeeded = true;
+		interfaceDownMark(idx);
 
 		if (DWPAL_SOCKET_FAILURE == dwpal_ret) {
 			if (dwpal_hostap_socket_close(&context[idx] /*OUT*/) != DWPAL_SUCCESS)
@@ -1787,12 +2221,12 @@ DWPAL_Ret dwpal_ext_hostap_cmd_send(const char *VAPName, const char *cmdHeader,
 			}
 		}
 
-		MUTEX_UNLOCK(&context_mutex);
+		MUTEX_UNLOCK(&serviceLock[idx]);
 		interfaceDisconnectedSend(idx);
 		return DWPAL_FAILURE;
 	}
 
-	MUTEX_UNLOCK(&context_mutex);
+	MUTEX_UNLOCK(&serviceLock[idx]);
 
 	if (strncmp(cmdHeader, "PING", sizeof("PING")))
 	{
@@ -1816,7 +2250,7 @@ DWPAL_Ret dwpal_ext_hostap_cmd_send(const char *VAPName, const char *cmdHeader,
 bool dwpal_ext_is_events_thread_context(void)
 {
 #ifdef EVENT_CALLBACK_THREAD
-	return (pthread_self() == eventHandlerThreadId);
+	return (pthread_self() == g_eventHandlerThreadInfo.threadID);
 #else
 	return (pthread_self() == g_listenerThreadInfo.threadID);
 #endif
@@ -1861,58 +2295,40 @@ DWPAL_Ret dwpal_ext_hostap_interface_detach(const char *VAPName)
 	console_printf("%s; interfaceIndexGet returned idx= %d\n", __FUNCTION__, idx);
 
 #if defined EVENT_CALLBACK_THREAD
-	threadSet(&eventHandlerThreadId, THREAD_CANCEL, NULL);
+	threadSet(&g_eventHandlerThreadInfo, THREAD_CANCEL, NULL);
 #endif
 	/* Cancel the listener thread, if it does exist */
 	threadSet(&g_listenerThreadInfo, THREAD_CANCEL, NULL);
 	threadSet(&g_monitorThreadInfo, THREAD_CANCEL, NULL);
 
 	/* dealocate the interface (after canceling the listener thread) */
-	if (dwpalService[idx] != NULL)
-	{
-		free((void *)dwpalService[idx]);
-		dwpalService[idx] = NULL;
-	}
+	serviceFree(idx);
 
-	MUTEX_LOCK(&context_mutex);
+	MUTEX_LOCK(&serviceLock[idx]);
 	if (context[idx] != NULL && dwpal_hostap_interface_detach(&context[idx]) == DWPAL_FAILURE)
 	{
-		MUTEX_UNLOCK(&context_mutex);
+		MUTEX_UNLOCK(&serviceLock[idx]);
 		console_printf("%s; dwpal_hostap_interface_detach (VAPName= '%s') returned ERROR ==> Abort!\n", __FUNCTION__, VAPName);
 		ret = DWPAL_FAILURE;
 		goto end;
 	}
-	MUTEX_UNLOCK(&context_mutex);
+	MUTEX_UNLOCK(&serviceLock[idx]);
 	ret = DWPAL_SUCCESS;
 
 end:
 	if (isAnyInterfaceActive())
 	{ /* There are still active interfaces */
 #if defined EVENT_CALLBACK_THREAD
-		threadSet(&eventHandlerThreadId, THREAD_CREATE, eventHandlerThreadStart);
+		threadSet(&g_eventHandlerThreadInfo, THREAD_CREATE, eventHandlerThreadStart);
 #endif
 		/* Create the listener thread, if it does exist */
 		threadSet(&g_listenerThreadInfo, THREAD_CREATE, listenerThreadStart);
 		threadSet(&g_monitorThreadInfo, THREAD_CREATE, monitorThreadStart);
 	}
 #if defined EVENT_CALLBACK_THREAD
-	else if (dwpal_event_handler != (-1))
+	else
 	{
-		pid_t pid = getpid();
-		char  socketName[SOCKET_NAME_LENGTH] = "\0";
-		int status;
-
-		status = sprintf_s(socketName, sizeof(socketName), "%s_%d", EVENT_HANDLER_SOCKET, pid);
-		if (status <= 0)
-			console_printf("%s; sprintf_s failed!\n", __FUNCTION__);
-
-		if (close(dwpal_event_handler) == (-1))
-		{
-			console_printf("%s; close() fail; dwpal_event_handler= %d; errno= %d ('%s')\n", __FUNCTION__, dwpal_event_handler, errno, strerror(errno));
-		}
-
-		unlink(socketName);
-		dwpal_event_handler = (-1);
+		eventChannelClose();
 	}
 #endif
 
@@ -1964,20 +2380,17 @@ DWPAL_Ret dwpal_ext_hostap_interface_attach(const char *VAPName, DwpalExtHostapE
 	}
 
 #if defined EVENT_CALLBACK_THREAD
-	if (dwpal_event_handler == -1)
+	if (eventChannelOpen() == DWPAL_FAILURE)
 	{
-		if (dwpal_socket_create(&dwpal_event_handler /*output*/, EVENT_HANDLER_SOCKET) == DWPAL_FAILURE)
-		{
-			console_printf("%s; dwpal_socket_create returned ERROR ==> Abort!\n", __FUNCTION__);
-			MUTEX_UNLOCK(&attach_mutex);
-			return DWPAL_FAILURE;
-		}
+		console_printf("%s; eventChannelOpen returned ERROR ==> Abort!\n", __FUNCTION__);
+		MUTEX_UNLOCK(&attach_mutex);
+		return DWPAL_FAILURE;
 	}
 #endif
 
 	/* Cancel the listener thread, if it does exist */
 #if defined EVENT_CALLBACK_THREAD
-	threadSet(&eventHandlerThreadId, THREAD_CANCEL, NULL);
+	threadSet(&g_eventHandlerThreadInfo, THREAD_CANCEL, NULL);
 #endif
 	threadSet(&g_listenerThreadInfo, THREAD_CANCEL, NULL);
 	threadSet(&g_monitorThreadInfo, THREAD_CANCEL, NULL);
@@ -1999,7 +2412,7 @@ DWPAL_Ret dwpal_ext_hostap_interface_attach(const char *VAPName, DwpalExtHostapE
 
 	ret = DWPAL_SUCCESS;
 
-	MUTEX_LOCK(&context_mutex);
+	MUTEX_LOCK(&serviceLock[idx]);
 	dwpalService[idx]->isConnectionEstablishNeeded = false;
 
 	if ((context[idx] == NULL) && (dwpal_hostap_interface_attach(&context[idx] /*OUT*/, VAPName, NULL /*use one-way interface*/) != DWPAL_SUCCESS))
@@ -2007,10 +2420,10 @@ DWPAL_Ret dwpal_ext_hostap_interface_attach(const char *VAPName, DwpalExtHostapE
 		console_printf("%s; dwpal_hostap_interface_attach (VAPName= '%s') returned ERROR ==> try later on...\n", __FUNCTION__, VAPName);
 
 		/* in this case, continue and try to establish the connection later on */
-		dwpalService[idx]->isConnectionEstablishNeeded = true;
+		interfaceDownMark(idx);
 		ret = DWPAL_INTERFACE_IS_DOWN;
 	}
-	MUTEX_UNLOCK(&context_mutex);
+	MUTEX_UNLOCK(&serviceLock[idx]);
 
 	/* Set the callback whether attach succeeded or not */
 	dwpalService[idx]->hostapEventCallback = hostapEventCallback;
@@ -2027,7 +2440,7 @@ end:
 	if (isAnyInterfaceActive())
 	{
 #if defined EVENT_CALLBACK_THREAD
-		threadSet(&eventHandlerThreadId, THREAD_CREATE, eventHandlerThreadStart);
+		threadSet(&g_eventHandlerThreadInfo, THREAD_CREATE, eventHandlerThreadStart);
 #endif
 		threadSet(&g_listenerThreadInfo, THREAD_CREATE, listenerThreadStart);
 		threadSet(&g_monitorThreadInfo, THREAD_CREATE, monitorThreadStart);
@@ -52,6 +52,9 @@ typedef int8_t s8;
 #define DWPAL_GENERAL_STRING_LENGTH            64
 #define DWPAL_OPCODE_STRING_LENGTH             64
 #define DRIVER_NL_TO_DWPAL_MSG_LENGTH          8192
+#define DWPAL_NL_MAX_IN_FLIGHT                 16    /* max pipelined nl80211 commands per context */
+#define DWPAL_NL_CMD_TIMEOUT_MS                2000
+#define DWPAL_NL_IFINDEX_CACHE_SIZE            32    /* interfaces whose ifindex is cached per context */
 #define DWPAL_FIELD_NAME_LENGTH                128
 #define HOSTAPD_TO_DWPAL_VALUE_STRING_LENGTH   4096
 #define SOCKET_NAME_LENGTH                     100
@@ -64,6 +67,9 @@ typedef int8_t s8;
 
 #define CTL_SCAN_STATS
 
+/* Print every byte of the vendor data of the driver commands */
+//#define DWPAL_NL_VENDOR_DATA_DUMP
+
 #ifndef MUST_BE_ARRAY
 #define MUST_BE_ARRAY(__arg) ( \
 		sizeof(struct { \
@@ -101,6 +107,23 @@ typedef DWPAL_Ret (*DWPAL_nlVendorEventCallback)(char *ifname, int event, int su
 typedef DWPAL_Ret (*DWPAL_nlNonVendorEventCallback)(struct nl_msg *msg);  /* callback function for Driver (via nl) non-Vendor events */
 typedef int (*DWPAL_nl80211Callback)(struct nl_msg *msg, void *arg); /* callback function for nl80211 responses */
 
+typedef struct _DWPAL_nl80211Request DWPAL_nl80211Request;
+typedef void (*DWPAL_nl80211DoneCallback)(DWPAL_nl80211Request *req); /* called once the request is completed; must not submit new requests */
+
+/* A pipelined nl80211 command, see dwpal_nl80211_cmd_submit() */
+struct _DWPAL_nl80211Request
+{
+	struct nl_msg             *msg;           /* the nl command to send; freed once submitted */
+	DWPAL_nl80211Callback     nlCallback;     /* called for each reply message; can be NULL */
+	DWPAL_nl80211DoneCallback doneCallback;   /* can be NULL */
+	void                      *cb_arg;
+	int                       cmd_res;        /*OUT*/  /* 1 while in flight, then 0 or negative errno */
+
+	/* internal */
+	unsigned int              seq;
+	bool                      isDump, isDumpIntr;
+};
+
 typedef enum
 {
 	DWPAL_STR_PARAM = 0,
@@ -178,12 +201,25 @@ DWPAL_Ret dwpal_driver_nl_cmd_send(void *context,
 								   enum ltq_nl80211_vendor_subcmds subCommand,
 								   unsigned char *vendorData,
 								   size_t vendorDataSize);
+struct nl_msg *dwpal_driver_nl_vendor_msg_alloc(void *context,
+						char *ifname,
+						CmdIdType cmdIdType,
+						enum ltq_nl80211_vendor_subcmds subCommand,
+						unsigned char *vendorData,
+						size_t vendorDataSize);
 DWPAL_Ret dwpal_driver_nl_msg_get(void *context, DWPAL_NlEventType nlEventType, DWPAL_nlVendorEventCallback nlEventCallback, DWPAL_nlNonVendorEventCallback nlNonVendorEventCallback);
 DWPAL_Ret dwpal_driver_nl_fd_get(void *context, int *fd /*OUT*/, int *fdCmdGet /*OUT*/);
 DWPAL_Ret dwpal_nl80211_cmd_send(void *context, struct nl_msg *msg, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg);
+DWPAL_Ret dwpal_nl80211_cmd_submit(void *context, DWPAL_nl80211Request *req);
+DWPAL_Ret dwpal_nl80211_cmd_complete(void *context);
+DWPAL_Ret dwpal_nl80211_cmd_poll(void *context);
+DWPAL_Ret dwpal_nl80211_cmd_cancel(void *context, DWPAL_nl80211Request *req, int cmd_res);
+DWPAL_Ret dwpal_nl80211_cmd_in_flight_get(void *context, size_t *numInFlight /*OUT*/);
+DWPAL_Ret dwpal_nl80211_cmd_send_batch(void *context, DWPAL_nl80211Request *reqs[], size_t numOfReqs);
 DWPAL_Ret dwpal_driver_nl_scan_dump_sync(void *context, char *ifname, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg);
 DWPAL_Ret dwpal_driver_nl_scan_trigger_sync(void *context, char *ifname, int *cmd_res /*OUT*/, ScanParams *scanParams);
 DWPAL_Ret dwpal_nl80211_id_get(void *context, int *nl80211_id /*OUT*/);
+DWPAL_Ret dwpal_driver_nl_ifindex_get(void *context, const char *ifname, unsigned *ifindex /*OUT*/);
 DWPAL_Ret dwpal_driver_nl_detach(void **context /*IN/OUT*/);
 DWPAL_Ret dwpal_driver_nl_attach(void **context /*OUT*/);
 
@@ -192,6 +228,7 @@ DWPAL_Ret dwpal_string_to_struct_parse(char *msg, size_t msgLen, FieldsToParse f
 DWPAL_Ret dwpal_hostap_cmd_send(void *context, const char *cmdHeader, FieldsToCmdParse *fieldsToCmdParse, char *reply /*OUT*/, size_t *replyLen /*IN/OUT*/);
 DWPAL_Ret dwpal_hostap_event_get(void *context, char *msg /*OUT*/, size_t *msgLen /*IN/OUT*/, char *opCode /*OUT*/);
 DWPAL_Ret dwpal_hostap_event_fd_get(void *context, int *fd /*OUT*/);
+DWPAL_Ret dwpal_hostap_event_socket_failed_get(void *context, bool *isFailed /*OUT*/);
 DWPAL_Ret dwpal_hostap_socket_close(void **context);
 DWPAL_Ret dwpal_hostap_is_socket_alive(void *context, bool *isExist /*OUT*/);
 DWPAL_Ret dwpal_hostap_interface_detach(void **context /*IN/OUT*/);
@@ -49,11 +49,15 @@ typedef DWPAL_nlNonVendorEventCallback DwpalExtNlNonVendorEventCallback;
 DWPAL_Ret dwpal_ext_driver_nl_scan_dump(char *ifname, DWPAL_nlNonVendorEventCallback nlEventCallback); /* deprecated */
 DWPAL_Ret dwpal_ext_driver_nl_scan_trigger(char *ifname, ScanParams *scanParams); /* deprecated */
 DWPAL_Ret dwpal_ext_driver_nl_get(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize, size_t *outLen, unsigned char *outData);
+DWPAL_Ret dwpal_ext_driver_nl_get_alloc(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize, size_t *outLen, unsigned char **outData);
 DWPAL_Ret dwpal_ext_driver_nl_cmd_send(char *ifname, unsigned int nl80211Command, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize);
 DWPAL_Ret dwpal_ext_nl80211_cmd_send(struct nl_msg *msg, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg, bool lock_cmd);
+struct nl_msg *dwpal_ext_driver_nl_vendor_msg_alloc(char *ifname, CmdIdType cmdIdType, unsigned int subCommand, unsigned char *vendorData, size_t vendorDataSize);
+DWPAL_Ret dwpal_ext_nl80211_cmd_send_batch(DWPAL_nl80211Request *reqs[], size_t numOfReqs, bool lock_cmd);
 DWPAL_Ret dwpal_ext_driver_nl_scan_dump_sync(char *ifname, int *cmd_res /*OUT*/, DWPAL_nl80211Callback nlCallback, void *cb_arg, bool lock_cmd);
 DWPAL_Ret dwpal_ext_driver_nl_scan_trigger_sync(char *ifname, int *cmd_res /*OUT*/, ScanParams *scanParams, bool lock_cmd);
 DWPAL_Ret dwpal_ext_nl80211_id_get(int *nl80211_id /*OUT*/);
+DWPAL_Ret dwpal_ext_driver_nl_ifindex_get(char *ifname, unsigned *ifindex /*OUT*/);
 DWPAL_Ret dwpal_ext_driver_nl_detach(void);
 DWPAL_Ret dwpal_ext_driver_nl_attach(DwpalExtNlEventCallback nlEventCallback, DwpalExtNlNonVendorEventCallback nlNonVendorEventCallback);
 
@@ -1619,20 +1619,63 @@ void dump_total_su_mu_ru_ofdma_stats(unsigned char *total_ofdma_stats, stat_id i
 	}
 }
 
+/* One request of the link adaptation stats batch, per STA and one for the radio total */
+typedef struct
+{
+	DWPAL_nl80211Request req;
+	IEEE_ADDR            addr;
+	unsigned char        *outData;  /* MAX_NL_REPLY bytes, allocated once the reply is received */
+	size_t               outLen;
+} link_adapt_stats_entry;
+
+static int link_adapt_stats_reply_get(struct nl_msg *msg, void *arg)
+{
+	link_adapt_stats_entry *entry = (link_adapt_stats_entry *)arg;
+	struct genlmsghdr      *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr          *attr;
+
+	attr = nla_find(genlmsg_attrdata(gnlh, 0), genlmsg_attrlen(gnlh, 0), NL80211_ATTR_VENDOR_DATA);
+	if ((attr == NULL) || (entry->outData != NULL))
+		return NL_SKIP;
+
+	/* the dump functions read the whole stats structure, as with the MAX_NL_REPLY buffer of dwpal_ext_driver_nl_get() */
+	entry->outData = (unsigned char *)calloc(1, MAX_NL_REPLY);
+	if (entry->outData == NULL)
+		return NL_SKIP;
+
+	entry->outLen = (nla_len(attr) < MAX_NL_REPLY) ? (size_t)nla_len(attr) : MAX_NL_REPLY;
+	if (entry->outLen)
+		memcpy_s(entry->outData, MAX_NL_REPLY, nla_data(attr), entry->outLen);
+
+	return NL_SKIP;
+}
+
+static void link_adapt_stats_entry_init(link_adapt_stats_entry *entry, char *ifname, unsigned int subcommand, uint8_t category)
+{
+	unsigned char Vendordata[sizeof(uint8_t) + IEEE_ADDR_LEN];
+
+	/* vendordata = |category|MAC_ADDR| */
+	Vendordata[0] = category;
+	memcpy_s(Vendordata + sizeof(uint8_t), IEEE_ADDR_LEN, &entry->addr, IEEE_ADDR_LEN);
+
+	entry->req.msg = dwpal_ext_driver_nl_vendor_msg_alloc(ifname, DWPAL_NETDEV_ID, subcommand, Vendordata, sizeof(Vendordata));
+	entry->req.nlCallback = link_adapt_stats_reply_get;
+	entry->req.cb_arg = entry;
+}
+
 /* The function gets the su mu ru OFDMA stats */
 int get_link_adapt_su_mu_ru_ofdma_stats(char *cmd[], stat_id id)
 {
 	unsigned char outData[MAX_NL_REPLY] = { '\0' };
 	unsigned int i;
-	size_t outLen;
+	size_t outLen = 0;
 	unsigned int param, sta_number = 0;
 	unsigned char Vendordata[128] = {'\0'};
 	int VendorDataLen = 0;
-	size_t *pOutLen = &outLen;
-	unsigned char *pOutData = outData;
 	peer_list_t *sta = NULL;
-	IEEE_ADDR *mac_buff_addr = NULL, *tmp_buff = NULL;
-	uint8_t res = DWPAL_SUCCESS,category = 0;
+	link_adapt_stats_entry *entries = NULL, *total;
+	DWPAL_nl80211Request **reqs = NULL;
+	uint8_t res = DWPAL_SUCCESS,category = 0, total_category = 0;
 	unsigned int subcommand1, subcommand2 = LTQ_NL80211_VENDOR_SUBCMD_UNSPEC;
 
 	switch(id) {
@@ -1661,98 +1704,88 @@ int get_link_adapt_su_mu_ru_ofdma_stats(char *cmd[], stat_id id)
 			return -1;
 	}
 
+	if (category == GET_UL_OFDMA_CATEGORY)
+		total_category = GET_UL_RADIO_OFDMA_CATEGORY;
+	else if (category == GET_DL_OFDMA_CATEGORY)
+		total_category = GET_DL_RADIO_OFDMA_CATEGORY;
+
 	if (dwpal_ext_driver_nl_attach(NlEventCallback, NULL) == DWPAL_FAILURE)
 	{
 		console_printf_err("%s; dwpal_driver_nl_attach returned ERROR ==> Abort!\n", __FUNCTION__);
 		return DWPAL_FAILURE;
 	}
 
+	/*If there are no stations present, print only total_stats */
 	if (dwpal_ext_driver_nl_get(cmd[0], NL80211_CMD_VENDOR, DWPAL_NETDEV_ID, subcommand1,\
-				Vendordata, VendorDataLen, pOutLen, pOutData) != DWPAL_SUCCESS)
+				Vendordata, VendorDataLen, &outLen, outData) != DWPAL_SUCCESS)
 	{
-		/*If there are no stations present, print only total_stats */
-		goto total_stats;
+		outLen = 0;
 	}
-	if ( !outLen)
+	else if (!outLen)
 	{
 		console_printf_err("%s; Invalid response length, printing total_stats \n", __FUNCTION__);
-		goto total_stats;
 	}
 
 	sta_number = outLen / sizeof(peer_list_t);
 	sta = (peer_list_t *)outData;
 
-	if (sta_number == 0)
+	/* The per-STA requests and the radio total are sent as one batch, the replies are
+	   collected into entries[] and printed once all of them are received */
+	entries = (link_adapt_stats_entry *)calloc(sta_number + 1, sizeof(link_adapt_stats_entry));
+	reqs = (DWPAL_nl80211Request **)calloc(sta_number + 1, sizeof(DWPAL_nl80211Request *));
+	if ((entries == NULL) || (reqs == NULL))
 	{
-		console_printf_err("%s; No STA present, printing total_stats \n", __FUNCTION__);
-		goto total_stats;
+		console_printf_err("%s; Unable to allocate the stats table ==> Abort!\n", __FUNCTION__);
+		res = DWPAL_FAILURE;
+		goto detach;
 	}
 
-	mac_buff_addr = (IEEE_ADDR *)malloc(sta_number * sizeof(IEEE_ADDR));
-	if (mac_buff_addr == NULL) {
-		console_printf_err("%s; Unable to print STA stats, printing total_stats\n",__FUNCTION__);
-		goto total_stats;
+	for (i = 0; i < sta_number; i++)
+	{
+		memcpy_s(&entries[i].addr, IEEE_ADDR_LEN, &sta[i].addr, IEEE_ADDR_LEN);
+		link_adapt_stats_entry_init(&entries[i], cmd[0], subcommand2, category);
+		reqs[i] = &entries[i].req;
 	}
 
-	tmp_buff = mac_buff_addr;
+	/* In total stats calculation , update mac address with 0 */
+	total = &entries[sta_number];
+	link_adapt_stats_entry_init(total, cmd[0], subcommand2, total_category);
+	reqs[sta_number] = &total->req;
 
-	for (i = 0 ; i < sta_number; i ++)
+	if (dwpal_ext_nl80211_cmd_send_batch(reqs, sta_number + 1, true) != DWPAL_SUCCESS)
 	{
-		memcpy_s(tmp_buff, IEEE_ADDR_LEN, &sta->addr, IEEE_ADDR_LEN);
-		tmp_buff ++;
-		sta ++;
+		console_printf_err("%s; some of the stats requests were not sent\n", __FUNCTION__);
 	}
 
-	tmp_buff = mac_buff_addr;
-
-	Vendordata[0] = category;
-
-	while (sta_number > 0)
+	for (i = 0; i < sta_number; i++)
 	{
-		memcpy_s(Vendordata + sizeof(uint8_t), IEEE_ADDR_LEN, tmp_buff, IEEE_ADDR_LEN);
-		/* vendordata = |category|MAC_ADDR| */
-		VendorDataLen = sizeof(uint8_t) + IEEE_ADDR_LEN;
-		tmp_buff ++;
-		sta_number --;
-
-		if (dwpal_ext_driver_nl_get(cmd[0], NL80211_CMD_VENDOR, DWPAL_NETDEV_ID, subcommand2,\
-					Vendordata, VendorDataLen, pOutLen, pOutData) != DWPAL_SUCCESS)
+		if ((entries[i].req.cmd_res != 0) || (entries[i].outData == NULL))
 		{
-
-			console_printf_err("STA Disconnected => " MAC_PRINTF_FMT "\n", MAC_PRINTF_ARG(Vendordata + sizeof(uint8_t)));
+			console_printf_err("STA Disconnected => " MAC_PRINTF_FMT "\n", MAC_PRINTF_ARG(&entries[i].addr));
 			continue;
 		}
 
-		if (!outLen)
+		if (!entries[i].outLen)
 		{
 			console_printf_err("%s; Invalid response length of STA  ==> Abort!\n", __FUNCTION__);
 			continue;
 		}
 		if (id == LINK_ADAPT_SU_MU_RU_OFDMA_STATS)
 			/* Print STA's SuMuRu OFDMA statistics */
-			dump_sta_su_mu_ru_ofdma_stats(outData, id, category);
+			dump_sta_su_mu_ru_ofdma_stats(entries[i].outData, id, category);
 		else if (id == LINK_ADAPT_MIMO_OFDMA_STATS)
 			/* Print STA's SuMuRu OFDMA statistics */
-			dump_sta_mimo_stats(outData, id, category);
+			dump_sta_mimo_stats(entries[i].outData, id, category);
 	}
-total_stats:
-	if (category == GET_UL_OFDMA_CATEGORY)
-		Vendordata[0] = GET_UL_RADIO_OFDMA_CATEGORY;
-	else if (category == GET_DL_OFDMA_CATEGORY)
-		Vendordata[0] = GET_DL_RADIO_OFDMA_CATEGORY;
 
-	/* In total stats calculation , update mac address with 0 */
-	memset((Vendordata + sizeof(uint8_t)), 0, IEEE_ADDR_LEN);
-	VendorDataLen = sizeof(uint8_t) + IEEE_ADDR_LEN;
-	if (dwpal_ext_driver_nl_get(cmd[0], NL80211_CMD_VENDOR, DWPAL_NETDEV_ID, subcommand2,\
-				Vendordata, VendorDataLen, pOutLen, pOutData) != DWPAL_SUCCESS)
+	if ((total->req.cmd_res != 0) || (total->outData == NULL))
 	{
 		console_printf_err("%s; Could'nt calculate the total stats \n", __FUNCTION__);
 		res = DWPAL_FAILURE;
 		goto detach;
 	}
 
-	if (!outLen)
+	if (!total->outLen)
 	{
 		console_printf_err("%s; Invalid response length for total stats  ==> Abort!\n", __FUNCTION__);
 		res = DWPAL_FAILURE;
@@ -1761,15 +1794,21 @@ total_stats:
 
 	if (id == LINK_ADAPT_SU_MU_RU_OFDMA_STATS)
 		/* Print Total/Radio SuMuRu OFDMA statitics */
-		dump_total_su_mu_ru_ofdma_stats(outData, id, category);
+		dump_total_su_mu_ru_ofdma_stats(total->outData, id, category);
 	else if (id == LINK_ADAPT_MIMO_OFDMA_STATS)
 		/* Print Total/Radio mimo OFDMA statitics */
-		dump_radio_mimo_stats(outData, id, category);
+		dump_radio_mimo_stats(total->outData, id, category);
 
 detach:
 	dwpal_ext_driver_nl_detach();
-	if (mac_buff_addr)
-		free(mac_buff_addr);
+	if (entries)
+	{
+		for (i = 0; i <= sta_number; i++)
+			free(entries[i].outData);
+		free(entries);
+	}
+	if (reqs)
+		free(reqs);
 	return res;
 }
 
@@ -0,0 +1,786 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+/* Micro benchmarks of the wv_ipc stack.
+ *
+ * Every benchmark prints one JSON object per line on stdout:
+ *   {"bench":"ipc_rtt","clients":4,"payload":64,"ops":40000,"ops_per_sec":...,
+ *    "p50_ns":...,"p99_ns":...,"p999_ns":...,"allocs_per_op":...}
+ * Latencies of obj_pool and list are per operation, averaged over batches of
+ * BENCH_BATCH operations (a single operation is too short for the clock).
+ * allocs_per_op is -1 where malloc() can't be counted (non glibc builds).
+ */
+
+#include "obj_pool.h"
+#include "linked_list.h"
+#include "work_serializer.h"
+#include "wave_ipc_client.h"
+#include "wave_ipc_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_SERVER_NAME	"bench_wv_ipc_server"
+#define BENCH_BATCH		(64)
+#define BENCH_EVENTS_WINDOW	(32)
+#define BENCH_MAX_CLIENTS	(64)
+#define BENCH_MAX_PAYLOAD	(WAVE_IPC_BUFF_SIZE - 256)
+
+#define BENCH_ERR(fmt, ...) fprintf(stderr, "bench_wv_ipc: " fmt "\n", ##__VA_ARGS__)
+
+static unsigned long long num_allocs;
+
+#ifdef __GLIBC__
+/* Count the allocations of the whole process, the libraries included */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+#define ALLOCS_COUNTED	1
+#else
+#define ALLOCS_COUNTED	0
+#endif
+
+static unsigned long long allocs_get(void)
+{
+	return __atomic_load_n(&num_allocs, __ATOMIC_RELAXED);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef struct {
+	unsigned clients;
+	size_t payload;
+	size_t ops;		/* operations of the micro benchmarks */
+	size_t msgs;		/* messages per client of the IPC benchmarks */
+} bench_cfg;
+
+typedef struct {
+	const char *name;
+	unsigned clients;
+	size_t payload;
+	uint64_t ops;
+	uint64_t elapsed_ns;
+	unsigned long long allocs;
+	uint64_t *samples;	/* latencies, ns */
+	size_t num_samples;
+} bench_result;
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t percentile(bench_result *res, unsigned permille)
+{
+	size_t idx;
+
+	if (!res->num_samples)
+		return 0;
+
+	idx = (res->num_samples * permille) / 1000;
+	if (idx >= res->num_samples)
+		idx = res->num_samples - 1;
+
+	return res->samples[idx];
+}
+
+static void result_print(bench_result *res)
+{
+	double secs = res->elapsed_ns / 1e9;
+
+	qsort(res->samples, res->num_samples, sizeof(uint64_t), cmp_u64);
+
+	printf("{\"bench\":\"%s\",\"clients\":%u,\"payload\":%zu,\"ops\":%llu,"
+	       "\"ops_per_sec\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+	       "\"allocs_per_op\":%.3f}\n",
+	       res->name, res->clients, res->payload, (unsigned long long)res->ops,
+	       secs > 0 ? res->ops / secs : 0.0,
+	       (unsigned long long)percentile(res, 500),
+	       (unsigned long long)percentile(res, 990),
+	       (unsigned long long)percentile(res, 999),
+	       (ALLOCS_COUNTED && res->ops) ? (double)res->allocs / res->ops : -1.0);
+	fflush(stdout);
+}
+
+static int result_init(bench_result *res, const char *name, size_t num_samples)
+{
+	memset(res, 0, sizeof(*res));
+	res->name = name;
+	res->samples = (uint64_t*)calloc(num_samples ? num_samples : 1, sizeof(uint64_t));
+	if (!res->samples) {
+		BENCH_ERR("%s: can't allocate %zu samples", name, num_samples);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* obj_pool: alloc and put of one object */
+static int bench_obj_pool(bench_cfg *cfg)
+{
+	bench_result res;
+	obj_pool *pool;
+	void *objs[BENCH_BATCH];
+	size_t batch, i, num_batches = cfg->ops / BENCH_BATCH;
+	unsigned long long allocs;
+	uint64_t start, t;
+
+	if (result_init(&res, "obj_pool", num_batches))
+		return 1;
+
+	pool = obj_pool_init("bench pool", cfg->payload, BENCH_BATCH, 0, 1);
+	if (!pool) {
+		BENCH_ERR("obj_pool_init failed");
+		free(res.samples);
+		return 1;
+	}
+
+	/* warm up, the pool grows to its working set */
+	for (i = 0; i < BENCH_BATCH; i++)
+		objs[i] = obj_pool_alloc_object(pool);
+	for (i = 0; i < BENCH_BATCH; i++)
+		obj_pool_put_object(pool, objs[i]);
+
+	allocs = allocs_get();
+	start = now_ns();
+	for (batch = 0; batch < num_batches; batch++) {
+		t = now_ns();
+		for (i = 0; i < BENCH_BATCH; i++)
+			objs[i] = obj_pool_alloc_object(pool);
+		for (i = 0; i < BENCH_BATCH; i++)
+			obj_pool_put_object(pool, objs[i]);
+		res.samples[res.num_samples++] = (now_ns() - t) / BENCH_BATCH;
+	}
+	res.elapsed_ns = now_ns() - start;
+	res.allocs = allocs_get() - allocs;
+	res.ops = (uint64_t)num_batches * BENCH_BATCH;
+	res.payload = cfg->payload;
+
+	result_print(&res);
+	obj_pool_destroy(pool);
+	free(res.samples);
+	return 0;
+}
+
+/* list: push_back, find and pop_front of one entry on a list of BENCH_BATCH entries */
+static int match_ptr(void *obj, void *arg)
+{
+	return obj == arg;
+}
+
+static int bench_list(bench_cfg *cfg)
+{
+	bench_result res;
+	l_list *lst;
+	size_t batch, i, num_batches = cfg->ops / BENCH_BATCH;
+	unsigned long long allocs;
+	uint64_t start, t;
+	int err = 0;
+
+	if (result_init(&res, "list", num_batches))
+		return 1;
+
+	lst = list_init();
+	if (!lst) {
+		BENCH_ERR("list_init failed");
+		free(res.samples);
+		return 1;
+	}
+
+	allocs = allocs_get();
+	start = now_ns();
+	for (batch = 0; batch < num_batches && !err; batch++) {
+		t = now_ns();
+		for (i = 0; i < BENCH_BATCH; i++)
+			err |= list_push_back(lst, (void*)(i + 1));
+		for (i = 0; i < BENCH_BATCH; i += 8)
+			err |= (list_find_first(lst, match_ptr, (void*)(i + 1)) == NULL);
+		for (i = 0; i < BENCH_BATCH; i++)
+			list_pop_front(lst);
+		res.samples[res.num_samples++] = (now_ns() - t) / BENCH_BATCH;
+	}
+	res.elapsed_ns = now_ns() - start;
+	res.allocs = allocs_get() - allocs;
+	res.ops = (uint64_t)res.num_samples * BENCH_BATCH;
+
+	if (err)
+		BENCH_ERR("list operation failed");
+	else
+		result_print(&res);
+
+	list_free(lst);
+	free(res.samples);
+	return err;
+}
+
+/* work_serializer: latency from serializer_exec_work_async() to the execution of the work */
+typedef struct {
+	bench_result *res;
+	size_t expected;
+	size_t done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} serializer_bench;
+
+static int serializer_bench_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	serializer_bench *sb = (serializer_bench*)ctx;
+	uintptr_t sent = (uintptr_t)work_obj;
+
+	(void)s;
+	sb->res->samples[sb->res->num_samples++] = (uintptr_t)now_ns() - sent;
+
+	pthread_mutex_lock(&sb->lock);
+	if (++sb->done == sb->expected)
+		pthread_cond_signal(&sb->cond);
+	pthread_mutex_unlock(&sb->lock);
+
+	return 0;
+}
+
+static int bench_serializer(bench_cfg *cfg)
+{
+	bench_result res;
+	serializer_bench sb;
+	work_ops_t ops[] = { { serializer_bench_work, NULL, NULL } };
+	work_serializer *s;
+	unsigned long long allocs;
+	uint64_t start;
+	size_t i;
+	int err = 0;
+
+	if (result_init(&res, "serializer", cfg->ops))
+		return 1;
+
+	memset(&sb, 0, sizeof(sb));
+	sb.res = &res;
+	sb.expected = cfg->ops;
+	pthread_mutex_init(&sb.lock, NULL);
+	pthread_cond_init(&sb.cond, NULL);
+
+	s = serializer_create(ops, 1, 1);
+	if (!s) {
+		BENCH_ERR("serializer_create failed");
+		err = 1;
+		goto out;
+	}
+
+	allocs = allocs_get();
+	start = now_ns();
+	for (i = 0; i < cfg->ops; i++) {
+		/* the send time is passed as the work object; on 32 bit targets it is
+		   truncated, which is fine for latencies of less than 4 secs */
+		if (serializer_exec_work_async(s, 0, (void*)(uintptr_t)now_ns(), &sb)) {
+			BENCH_ERR("serializer_exec_work_async failed, i=%zu", i);
+			err = 1;
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&sb.lock);
+	sb.expected = i;
+	while (sb.done < sb.expected)
+		pthread_cond_wait(&sb.cond, &sb.lock);
+	pthread_mutex_unlock(&sb.lock);
+
+	res.elapsed_ns = now_ns() - start;
+	res.allocs = allocs_get() - allocs;
+	res.ops = sb.done;
+
+	if (!err)
+		result_print(&res);
+
+	serializer_destroy(s);
+out:
+	pthread_cond_destroy(&sb.cond);
+	pthread_mutex_destroy(&sb.lock);
+	free(res.samples);
+	return err;
+}
+
+/* IPC: a server thread and N client threads over the wv_ipc Unix sockets */
+typedef struct {
+	wv_ipserver *server;
+	volatile int stop;
+	unsigned num_connected;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} ipc_bench_server;
+
+static ipc_bench_server bench_server;
+
+static int bench_server_cmd(wv_ipserver *ipserv, wv_ipstation *ipsta,
+			    uint32_t seq_num, wv_ipc_msg *cmd)
+{
+	/* echo the command */
+	wave_ipcs_send_response_to(ipserv, ipsta, seq_num, cmd, 0);
+	wave_ipc_msg_put(cmd);
+	return 0;
+}
+
+static int bench_server_stop_cond(wv_ipserver *ipserv)
+{
+	(void)ipserv;
+	return bench_server.stop;
+}
+
+static int bench_server_adding_client(wv_ipserver *ipserv, wv_ipstation *ipsta)
+{
+	(void)ipserv;
+	(void)ipsta;
+	pthread_mutex_lock(&bench_server.lock);
+	bench_server.num_connected++;
+	pthread_cond_broadcast(&bench_server.cond);
+	pthread_mutex_unlock(&bench_server.lock);
+	return 0;
+}
+
+static int bench_server_removing_client(wv_ipserver *ipserv, wv_ipstation *ipsta)
+{
+	(void)ipserv;
+	(void)ipsta;
+	pthread_mutex_lock(&bench_server.lock);
+	bench_server.num_connected--;
+	pthread_cond_broadcast(&bench_server.cond);
+	pthread_mutex_unlock(&bench_server.lock);
+	return 0;
+}
+
+static void* bench_server_thread(void *arg)
+{
+	wv_ipserver_callbacks clbs;
+
+	(void)arg;
+	memset(&clbs, 0, sizeof(clbs));
+	clbs.cmd_async = bench_server_cmd;
+	clbs.stop_cond = bench_server_stop_cond;
+	clbs.adding_client = bench_server_adding_client;
+	clbs.removing_client = bench_server_removing_client;
+
+	if (wave_ipcs_run(bench_server.server, &clbs) == WAVE_IPC_ERROR)
+		BENCH_ERR("wave_ipcs_run returned error");
+
+	return NULL;
+}
+
+static int bench_server_start(pthread_t *tid)
+{
+	memset(&bench_server, 0, sizeof(bench_server));
+	pthread_mutex_init(&bench_server.lock, NULL);
+	pthread_cond_init(&bench_server.cond, NULL);
+
+	if (wave_ipcs_create(&bench_server.server, BENCH_SERVER_NAME) != WAVE_IPC_SUCCESS) {
+		BENCH_ERR("wave_ipcs_create failed");
+		return 1;
+	}
+
+	if (pthread_create(tid, NULL, bench_server_thread, NULL)) {
+		BENCH_ERR("pthread_create failed");
+		wave_ipcs_delete(&bench_server.server);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void bench_server_wait_clients(unsigned num)
+{
+	pthread_mutex_lock(&bench_server.lock);
+	while (bench_server.num_connected != num)
+		pthread_cond_wait(&bench_server.cond, &bench_server.lock);
+	pthread_mutex_unlock(&bench_server.lock);
+}
+
+static void bench_server_stop(pthread_t tid)
+{
+	/* wave_ipcs_run() checks the stop condition on its housekeeping timer */
+	bench_server.stop = 1;
+	pthread_join(tid, NULL);
+	wave_ipcs_delete(&bench_server.server);
+	pthread_cond_destroy(&bench_server.cond);
+	pthread_mutex_destroy(&bench_server.lock);
+}
+
+typedef struct {
+	bench_cfg *cfg;
+	unsigned idx;
+	wv_ipclient *client;
+	uint64_t *samples;
+	size_t num_samples;
+	size_t num_events;
+	pthread_mutex_t *lock;
+	pthread_cond_t *cond;
+	int err;
+} ipc_bench_client;
+
+static void* bench_rtt_client_thread(void *arg)
+{
+	ipc_bench_client *c = (ipc_bench_client*)arg;
+	char *payload;
+	size_t i;
+
+	payload = (char*)calloc(1, c->cfg->payload);
+	if (!payload) {
+		c->err = 1;
+		return NULL;
+	}
+
+	for (i = 0; i < c->cfg->msgs; i++) {
+		wv_ipc_msg *cmd = wave_ipc_msg_alloc_size(c->cfg->payload), *reply = NULL;
+		uint64_t t;
+
+		if (!cmd || wave_ipc_msg_fill_data(cmd, payload, c->cfg->payload) != WAVE_IPC_SUCCESS) {
+			if (cmd) wave_ipc_msg_put(cmd);
+			c->err = 1;
+			break;
+		}
+
+		t = now_ns();
+		if (wave_ipcc_send_cmd(c->client, cmd, &reply) != WAVE_IPC_SUCCESS) {
+			wave_ipc_msg_put(cmd);
+			c->err = 1;
+			break;
+		}
+		c->samples[c->num_samples++] = now_ns() - t;
+
+		wave_ipc_msg_put(cmd);
+		wave_ipc_msg_put(reply);
+	}
+
+	free(payload);
+	return NULL;
+}
+
+static int bench_event_cb(void *arg, wv_ipc_msg *event)
+{
+	ipc_bench_client *c = (ipc_bench_client*)arg;
+	uint64_t sent;
+
+	if (wave_ipc_msg_get_size(event) >= sizeof(sent)) {
+		memcpy(&sent, wave_ipc_msg_get_data(event), sizeof(sent));
+		c->samples[c->num_samples++] = now_ns() - sent;
+	}
+
+	pthread_mutex_lock(c->lock);
+	c->num_events++;
+	pthread_cond_broadcast(c->cond);
+	pthread_mutex_unlock(c->lock);
+
+	return WAVE_IPC_EVENT_SUCCESS;
+}
+
+static int bench_clients_connect(ipc_bench_client *clients, bench_cfg *cfg,
+				 size_t samples_per_client)
+{
+	char name[32];
+	unsigned i;
+
+	for (i = 0; i < cfg->clients; i++) {
+		clients[i].cfg = cfg;
+		clients[i].idx = i;
+		clients[i].samples = (uint64_t*)calloc(samples_per_client, sizeof(uint64_t));
+		if (!clients[i].samples)
+			return 1;
+
+		snprintf(name, sizeof(name), "bench_client_%u", i);
+		if (wave_ipcc_connect(&clients[i].client, name, BENCH_SERVER_NAME) != WAVE_IPC_SUCCESS) {
+			BENCH_ERR("wave_ipcc_connect failed, client %u", i);
+			return 1;
+		}
+	}
+
+	bench_server_wait_clients(cfg->clients);
+	return 0;
+}
+
+static void bench_clients_disconnect(ipc_bench_client *clients, bench_cfg *cfg)
+{
+	unsigned i;
+
+	for (i = 0; i < cfg->clients; i++) {
+		if (clients[i].client) {
+			wave_ipcc_stop_listener(clients[i].client);
+			wave_ipcc_disconnect(&clients[i].client);
+		}
+		free(clients[i].samples);
+	}
+
+	bench_server_wait_clients(0);
+}
+
+/* Merge the samples of all the clients into the result */
+static int bench_clients_collect(ipc_bench_client *clients, bench_cfg *cfg,
+				 bench_result *res)
+{
+	unsigned i;
+	size_t total = 0;
+
+	for (i = 0; i < cfg->clients; i++)
+		total += clients[i].num_samples;
+
+	if (result_init(res, res->name, total))
+		return 1;
+
+	for (i = 0; i < cfg->clients; i++) {
+		memcpy(res->samples + res->num_samples, clients[i].samples,
+		       clients[i].num_samples * sizeof(uint64_t));
+		res->num_samples += clients[i].num_samples;
+	}
+
+	res->clients = cfg->clients;
+	res->payload = cfg->payload;
+	return 0;
+}
+
+/* wave_ipcc_send_cmd() round trip, all the clients send in parallel */
+static int bench_ipc_rtt(bench_cfg *cfg)
+{
+	ipc_bench_client clients[BENCH_MAX_CLIENTS];
+	pthread_t server_tid, tids[BENCH_MAX_CLIENTS];
+	bench_result res;
+	unsigned long long allocs;
+	uint64_t start, elapsed;
+	unsigned i, started = 0;
+	int err = 1;
+
+	memset(clients, 0, sizeof(clients));
+	if (bench_server_start(&server_tid))
+		return 1;
+
+	if (bench_clients_connect(clients, cfg, cfg->msgs))
+		goto out;
+
+	allocs = allocs_get();
+	start = now_ns();
+	for (started = 0; started < cfg->clients; started++) {
+		if (pthread_create(&tids[started], NULL, bench_rtt_client_thread, &clients[started]))
+			break;
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+	elapsed = now_ns() - start;
+	allocs = allocs_get() - allocs;
+
+	for (i = 0; i < cfg->clients; i++) {
+		if (clients[i].err || i >= started) {
+			BENCH_ERR("ipc_rtt: client %u failed", i);
+			goto out;
+		}
+	}
+
+	res.name = "ipc_rtt";
+	if (bench_clients_collect(clients, cfg, &res))
+		goto out;
+	res.ops = res.num_samples;
+	res.elapsed_ns = elapsed;
+	res.allocs = allocs;
+	result_print(&res);
+	free(res.samples);
+	err = 0;
+
+out:
+	bench_clients_disconnect(clients, cfg);
+	bench_server_stop(server_tid);
+	return err;
+}
+
+/* wave_ipcs_send_event_all() to all the clients; latency is from the send to
+   the event callback of each client, an operation is one event of one client */
+static int bench_event_fanout(bench_cfg *cfg)
+{
+	ipc_bench_client clients[BENCH_MAX_CLIENTS];
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+	pthread_t server_tid;
+	bench_result res;
+	unsigned long long allocs;
+	uint64_t start, elapsed;
+	char *payload = NULL;
+	size_t sent;
+	unsigned i;
+	int err = 1;
+
+	memset(clients, 0, sizeof(clients));
+	if (bench_server_start(&server_tid))
+		return 1;
+
+	payload = (char*)calloc(1, cfg->payload);
+	if (!payload || bench_clients_connect(clients, cfg, cfg->msgs))
+		goto out;
+
+	for (i = 0; i < cfg->clients; i++) {
+		clients[i].lock = &lock;
+		clients[i].cond = &cond;
+		if (wave_ipcc_start_listener(clients[i].client, bench_event_cb, NULL,
+					     NULL, NULL, &clients[i], 0) != WAVE_IPC_SUCCESS) {
+			BENCH_ERR("wave_ipcc_start_listener failed, client %u", i);
+			goto out;
+		}
+	}
+
+	allocs = allocs_get();
+	start = now_ns();
+	for (sent = 0; sent < cfg->msgs; ) {
+		size_t window_end = sent + BENCH_EVENTS_WINDOW;
+
+		if (window_end > cfg->msgs)
+			window_end = cfg->msgs;
+
+		/* a window of events, then wait for all the clients to get it,
+		   so the server doesn't queue more than its pending messages limit */
+		for (; sent < window_end; sent++) {
+			wv_ipc_msg *event = wave_ipc_msg_alloc_size(cfg->payload);
+			uint64_t t = now_ns();
+
+			memcpy(payload, &t, sizeof(t));
+			if (!event || wave_ipc_msg_fill_data(event, payload, cfg->payload) != WAVE_IPC_SUCCESS ||
+			    wave_ipcs_send_event_all(bench_server.server, event) != WAVE_IPC_SUCCESS) {
+				BENCH_ERR("event_fanout: sending event %zu failed", sent);
+				if (event) wave_ipc_msg_put(event);
+				goto out;
+			}
+			wave_ipc_msg_put(event);
+		}
+
+		pthread_mutex_lock(&lock);
+		for (i = 0; i < cfg->clients; i++) {
+			while (clients[i].num_events < sent)
+				pthread_cond_wait(&cond, &lock);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	elapsed = now_ns() - start;
+	allocs = allocs_get() - allocs;
+
+	res.name = "event_fanout";
+	if (bench_clients_collect(clients, cfg, &res))
+		goto out;
+	res.ops = res.num_samples;
+	res.elapsed_ns = elapsed;
+	res.allocs = allocs;
+	result_print(&res);
+	free(res.samples);
+	err = 0;
+
+out:
+	bench_clients_disconnect(clients, cfg);
+	bench_server_stop(server_tid);
+	free(payload);
+	return err;
+}
+
+typedef struct {
+	const char *name;
+	int (*run)(bench_cfg *cfg);
+} bench_def;
+
+static bench_def benches[] = {
+	{ "obj_pool",     bench_obj_pool },
+	{ "list",         bench_list },
+	{ "serializer",   bench_serializer },
+	{ "ipc_rtt",      bench_ipc_rtt },
+	{ "event_fanout", bench_event_fanout },
+};
+
+static void usage(const char *prog)
+{
+	size_t i;
+
+	fprintf(stderr, "usage: %s [-c clients] [-s payload bytes] [-n ops] [-m msgs per client] [bench ...]\n"
+		"  -c  number of IPC clients (1..%d, default 4)\n"
+		"  -s  payload size in bytes (%zu..%d, default 64)\n"
+		"  -n  operations of the obj_pool, list and serializer benchmarks (default 100000)\n"
+		"  -m  messages per client of the ipc_rtt and event_fanout benchmarks (default 10000)\n"
+		"  benchmarks (default all):", prog, BENCH_MAX_CLIENTS, sizeof(uint64_t), BENCH_MAX_PAYLOAD);
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+		fprintf(stderr, " %s", benches[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	bench_cfg cfg = { 4, 64, 100000, 10000 };
+	size_t i;
+	int opt, failed = 0, ran = 0;
+
+	while ((opt = getopt(argc, argv, "c:s:n:m:h")) != -1) {
+		switch (opt) {
+		case 'c': cfg.clients = strtoul(optarg, NULL, 0); break;
+		case 's': cfg.payload = strtoul(optarg, NULL, 0); break;
+		case 'n': cfg.ops = strtoul(optarg, NULL, 0); break;
+		case 'm': cfg.msgs = strtoul(optarg, NULL, 0); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.clients < 1 || cfg.clients > BENCH_MAX_CLIENTS ||
+	    cfg.payload < sizeof(uint64_t) || cfg.payload > BENCH_MAX_PAYLOAD ||
+	    cfg.ops < BENCH_BATCH || cfg.msgs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		int selected = (optind == argc);
+		int j;
+
+		for (j = optind; j < argc; j++)
+			selected |= !strcmp(argv[j], benches[i].name);
+
+		if (!selected)
+			continue;
+
+		ran++;
+		if (benches[i].run(&cfg)) {
+			BENCH_ERR("%s failed", benches[i].name);
+			failed++;
+		}
+	}
+
+	if (!ran) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return failed;
+}
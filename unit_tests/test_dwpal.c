@@ -14,6 +14,8 @@
 
 int unit_test_module_dwpal_ext(char *tests);
 int unit_test_module_dwpal_daemon(char *tests);
+int unit_test_module_hostap_parse(char *tests);
+int unit_test_module_iface_manager(char *tests);
 
 int main(int argc, char *argv[])
 {
@@ -26,10 +28,16 @@ int main(int argc, char *argv[])
 		if (!strcmp(argv[i], "all")) {
 			res += unit_test_module_dwpal_ext(NULL);
 			res += unit_test_module_dwpal_daemon(NULL);
+			res += unit_test_module_hostap_parse(NULL);
+			res += unit_test_module_iface_manager(NULL);
 		} else if (!strncmp(argv[i], "dwpal_ext", sizeof("dwpal_ext") - 1)) {
 			res += unit_test_module_dwpal_ext(argv[i]);
 		} else if (!strncmp(argv[i], "daemon", sizeof("daemon") - 1)) {
 			res += unit_test_module_dwpal_daemon(argv[i]);
+		} else if (!strncmp(argv[i], "hostap_parse", sizeof("hostap_parse") - 1)) {
+			res += unit_test_module_hostap_parse(argv[i]);
+		} else if (!strncmp(argv[i], "iface_manager", sizeof("iface_manager") - 1)) {
+			res += unit_test_module_iface_manager(argv[i]);
 		} else {
 			ELOG("unknown unit test: %s", argv[i]);
 		}
@@ -11,6 +11,12 @@
 #include "unitest_helper.h"
 #include "dwpal_ext.h"
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+
 static int empty_dwpal_ext_hostap_event_callback(char *VAPName, char *opCode, char *msg, size_t msgStringLen)
 {
 	(void)VAPName;
@@ -134,9 +140,187 @@ UNIT_TEST_CLEANUP_ON_ERRR
 	dwpal_ext_driver_nl_detach();
 UNIT_TEST_DEFINITION_DONE
 
+#define VAP_CMD_SENDERS	4
+
+static volatile int vap_cmd_stop;
+
+typedef struct {
+	int sent;
+	int replied;
+	int bad;  /* failed with a reply, or a wrong reply */
+} vap_cmd_sender_stats;
+
+static void* vap_cmd_sender(void *obj)
+{
+	vap_cmd_sender_stats *stats = (vap_cmd_sender_stats*)obj;
+	char reply[64];
+	size_t replyLen;
+	DWPAL_Ret ret;
+
+	while (!vap_cmd_stop) {
+		replyLen = sizeof(reply) - 1;
+		ret = dwpal_ext_hostap_cmd_send("wlan0", "PING", NULL, reply, &replyLen);
+		stats->sent++;
+
+		if (ret == DWPAL_SUCCESS) {
+			reply[replyLen] = '\0';
+			if (strncmp(reply, "PONG", sizeof("PONG") - 1))
+				stats->bad++;
+			else
+				stats->replied++;
+		} else if (replyLen != 0) {
+			stats->bad++;
+		}
+	}
+
+	return NULL;
+}
+
+UNIT_TEST_DEFINE(5, commands while the VAP is detached and attached)
+	vap_cmd_sender_stats stats[VAP_CMD_SENDERS];
+	pthread_t threads[VAP_CMD_SENDERS];
+	int num_threads = 0, replied = 0;
+	char reply[64];
+	size_t replyLen;
+	DWPAL_Ret ret;
+	int i;
+
+	memset(stats, 0, sizeof(stats));
+	vap_cmd_stop = 0;
+
+	ret = dwpal_ext_hostap_interface_attach("wlan0", empty_dwpal_ext_hostap_event_callback);
+	if (ret != DWPAL_SUCCESS)
+		UNIT_TEST_FAILED("iface_attach returned err (%d)", ret);
+
+	for (num_threads = 0; num_threads < VAP_CMD_SENDERS; num_threads++) {
+		if (pthread_create(&threads[num_threads], NULL, vap_cmd_sender, &stats[num_threads]))
+			UNIT_TEST_FAILED("pthread_create failed");
+	}
+
+	/* wlan2 may take the entry wlan0 left, a command to wlan0 which found
+	 * the entry before the detach must not be sent on wlan2 */
+	for (i = 0; i < 50; i++) {
+		ret = dwpal_ext_hostap_interface_detach("wlan0");
+		if (ret != DWPAL_SUCCESS)
+			UNIT_TEST_FAILED("iface_detach returned err (%d) i=%d", ret, i);
+
+		ret = dwpal_ext_hostap_interface_attach("wlan2", empty_dwpal_ext_hostap_event_callback);
+		if (ret != DWPAL_SUCCESS)
+			UNIT_TEST_FAILED("iface_attach returned err (%d) i=%d", ret, i);
+
+		ret = dwpal_ext_hostap_interface_attach("wlan0", empty_dwpal_ext_hostap_event_callback);
+		if (ret != DWPAL_SUCCESS)
+			UNIT_TEST_FAILED("iface_attach returned err (%d) i=%d", ret, i);
+
+		ret = dwpal_ext_hostap_interface_detach("wlan2");
+		if (ret != DWPAL_SUCCESS)
+			UNIT_TEST_FAILED("iface_detach returned err (%d) i=%d", ret, i);
+
+		usleep(10 * 1000);
+	}
+
+	vap_cmd_stop = 1;
+	while (num_threads)
+		pthread_join(threads[--num_threads], NULL);
+
+	for (i = 0; i < VAP_CMD_SENDERS; i++) {
+		if (stats[i].bad)
+			UNIT_TEST_FAILED("sender %d: %d bad replies of %d commands", i, stats[i].bad, stats[i].sent);
+		replied += stats[i].replied;
+	}
+
+	if (replied == 0)
+		UNIT_TEST_FAILED("no command was replied");
+
+	/* once detached, the commands fail until the next attach */
+	ret = dwpal_ext_hostap_interface_detach("wlan0");
+	if (ret != DWPAL_SUCCESS)
+		UNIT_TEST_FAILED("iface_detach returned err (%d)", ret);
+
+	replyLen = sizeof(reply);
+	ret = dwpal_ext_hostap_cmd_send("wlan0", "PING", NULL, reply, &replyLen);
+	if (ret != DWPAL_INTERFACE_IS_DOWN || replyLen != 0)
+		UNIT_TEST_FAILED("command to a detached VAP returned %d, replyLen=%zu", ret, replyLen);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	vap_cmd_stop = 1;
+	while (num_threads)
+		pthread_join(threads[--num_threads], NULL);
+	dwpal_ext_hostap_interface_detach("wlan0");
+	dwpal_ext_hostap_interface_detach("wlan2");
+UNIT_TEST_DEFINITION_DONE
+
+/* dummy links, created and removed by the test */
+#define IFINDEX_TEST_IFNAME	"dwpaltst0"
+#define IFINDEX_TEST_IFNAME2	"dwpaltst1"
+
+UNIT_TEST_DEFINE(6, ifindex cache follows link removal and rename)
+	DWPAL_Ret ret;
+	unsigned ifindex, old_ifindex;
+	int attached = 0;
+
+	if (system("ip link del " IFINDEX_TEST_IFNAME " 2>/dev/null; ip link del " IFINDEX_TEST_IFNAME2 " 2>/dev/null; "
+		   "ip link add " IFINDEX_TEST_IFNAME " type dummy"))
+		UNIT_TEST_FAILED("failed to create " IFINDEX_TEST_IFNAME);
+
+	ret = dwpal_ext_driver_nl_attach(empty_DWPAL_nlVendorEventCallback, empty_DWPAL_nlNonVendorEventCallback);
+	if (ret != DWPAL_SUCCESS)
+		UNIT_TEST_FAILED("nl_attach returned err (%d)", ret);
+	attached = 1;
+
+	/* cached by the first lookup */
+	ret = dwpal_ext_driver_nl_ifindex_get(IFINDEX_TEST_IFNAME, &ifindex);
+	if (ret != DWPAL_SUCCESS || ifindex != if_nametoindex(IFINDEX_TEST_IFNAME))
+		UNIT_TEST_FAILED("ifindex_get returned %d, ifindex=%u", ret, ifindex);
+	old_ifindex = ifindex;
+
+	/* RTM_DELLINK, the link is created again with another ifindex */
+	if (system("ip link del " IFINDEX_TEST_IFNAME " && ip link add " IFINDEX_TEST_IFNAME " type dummy"))
+		UNIT_TEST_FAILED("failed to create " IFINDEX_TEST_IFNAME " again");
+	if (if_nametoindex(IFINDEX_TEST_IFNAME) == old_ifindex)
+		UNIT_TEST_FAILED("ifindex %u was reused", old_ifindex);
+
+	ret = dwpal_ext_driver_nl_ifindex_get(IFINDEX_TEST_IFNAME, &ifindex);
+	if (ret != DWPAL_SUCCESS || ifindex != if_nametoindex(IFINDEX_TEST_IFNAME))
+		UNIT_TEST_FAILED("stale ifindex after DELLINK: ret=%d, ifindex=%u (was %u)", ret, ifindex, old_ifindex);
+
+	/* rename, the old name must not resolve to the link anymore */
+	if (system("ip link set " IFINDEX_TEST_IFNAME " name " IFINDEX_TEST_IFNAME2))
+		UNIT_TEST_FAILED("failed to rename " IFINDEX_TEST_IFNAME);
+
+	ret = dwpal_ext_driver_nl_ifindex_get(IFINDEX_TEST_IFNAME, &ifindex);
+	if (ret != DWPAL_FAILURE)
+		UNIT_TEST_FAILED("renamed link still found by its old name, ifindex=%u", ifindex);
+
+	ret = dwpal_ext_driver_nl_ifindex_get(IFINDEX_TEST_IFNAME2, &ifindex);
+	if (ret != DWPAL_SUCCESS || ifindex != if_nametoindex(IFINDEX_TEST_IFNAME2))
+		UNIT_TEST_FAILED("ifindex_get of the new name returned %d, ifindex=%u", ret, ifindex);
+
+	/* removed */
+	if (system("ip link del " IFINDEX_TEST_IFNAME2))
+		UNIT_TEST_FAILED("failed to delete " IFINDEX_TEST_IFNAME2);
+
+	ret = dwpal_ext_driver_nl_ifindex_get(IFINDEX_TEST_IFNAME2, &ifindex);
+	if (ret != DWPAL_FAILURE)
+		UNIT_TEST_FAILED("deleted link still found, ifindex=%u", ifindex);
+
+	ret = dwpal_ext_driver_nl_detach();
+	attached = 0;
+	if (ret != DWPAL_SUCCESS)
+		UNIT_TEST_FAILED("nl_detach returned err (%d)", ret);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (attached)
+		dwpal_ext_driver_nl_detach();
+	if (system("ip link del " IFINDEX_TEST_IFNAME " 2>/dev/null; ip link del " IFINDEX_TEST_IFNAME2 " 2>/dev/null; true"))
+		printf("failed to remove the test links\n");
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(dwpal_ext)
 	ADD_TEST(1)
 	ADD_TEST(2)
 	ADD_TEST(3)
 	ADD_TEST(4)
+	ADD_TEST(5)
+	ADD_TEST(6)
 UNIT_TEST_MODULE_DEFINITION_DONE
@@ -0,0 +1,130 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "hash_table.h"
+#include "unitest_helper.h"
+
+#include <stdio.h>
+
+#define NUM_KEYS (5000)
+
+typedef struct {
+	uint32_t id;
+	char name[16];
+} test_obj;
+
+static test_obj objs[NUM_KEYS];
+
+UNIT_TEST_DEFINE(1, insert find remove)
+	hash_table *ht;
+	size_t i, size;
+
+	ht = hash_table_init(0, hash_u32, hash_u32_cmp);
+	if (!ht)
+		UNIT_TEST_FAILED("hash_table_init retuned NULL");
+
+	for (i = 0; i < NUM_KEYS; i++) {
+		objs[i].id = i * 3;
+		if (hash_table_insert(ht, &objs[i].id, &objs[i]))
+			UNIT_TEST_FAILED("hash_table_insert retuned err, i=%zu", i);
+	}
+
+	if (!hash_table_insert(ht, &objs[7].id, &objs[7]))
+		UNIT_TEST_FAILED("hash_table_insert accepted an existing key");
+
+	size = hash_table_get_size(ht);
+	if (size != NUM_KEYS)
+		UNIT_TEST_FAILED("hash_table_get_size retuned %zu", size);
+
+	for (i = 0; i < NUM_KEYS * 3; i++) {
+		uint32_t key = i;
+		test_obj *obj = (test_obj*)hash_table_find(ht, &key);
+
+		if ((i % 3) && obj)
+			UNIT_TEST_FAILED("hash_table_find found missing key %zu", i);
+		if (!(i % 3) && (!obj || obj->id != key))
+			UNIT_TEST_FAILED("hash_table_find failed for key %zu", i);
+	}
+
+	for (i = 0; i < NUM_KEYS; i += 2) {
+		uint32_t key = objs[i].id;
+
+		if (hash_table_remove(ht, &key) != &objs[i])
+			UNIT_TEST_FAILED("hash_table_remove retuned wrong object, i=%zu", i);
+		if (hash_table_find(ht, &key))
+			UNIT_TEST_FAILED("found removed key, i=%zu", i);
+	}
+
+	size = hash_table_get_size(ht);
+	if (size != NUM_KEYS / 2)
+		UNIT_TEST_FAILED("hash_table_get_size retuned %zu after remove", size);
+
+	for (i = 1; i < NUM_KEYS; i += 2) {
+		if (hash_table_find(ht, &objs[i].id) != &objs[i])
+			UNIT_TEST_FAILED("lost key after remove, i=%zu", i);
+	}
+
+	hash_table_free(ht);
+UNIT_TEST_CLEANUP_ON_ERRR
+	hash_table_free(ht);
+UNIT_TEST_DEFINITION_DONE
+
+static int remove_odd_ids(void *obj, void *arg)
+{
+	size_t *count = (size_t*)arg;
+
+	(*count)++;
+	return ((test_obj*)obj)->id & 1;
+}
+
+UNIT_TEST_DEFINE(2, string keys and walk)
+	hash_table *ht;
+	size_t i, count = 0, removed;
+
+	ht = hash_table_init(4, hash_str, hash_str_cmp);
+	if (!ht)
+		UNIT_TEST_FAILED("hash_table_init retuned NULL");
+
+	for (i = 0; i < NUM_KEYS; i++) {
+		objs[i].id = i;
+		snprintf(objs[i].name, sizeof(objs[i].name), "EVENT-%zu", i);
+		if (hash_table_insert(ht, objs[i].name, &objs[i]))
+			UNIT_TEST_FAILED("hash_table_insert retuned err, i=%zu", i);
+	}
+
+	if (hash_table_find(ht, "EVENT-100") != &objs[100])
+		UNIT_TEST_FAILED("hash_table_find failed for string key");
+	if (hash_table_find(ht, "EVENT-") != NULL)
+		UNIT_TEST_FAILED("hash_table_find found a prefix");
+
+	removed = hash_table_walk(ht, remove_odd_ids, &count);
+	if (count != NUM_KEYS || removed != NUM_KEYS / 2)
+		UNIT_TEST_FAILED("walk visited %zu, removed %zu", count, removed);
+
+	for (i = 0; i < NUM_KEYS; i++) {
+		test_obj *obj = (test_obj*)hash_table_find(ht, objs[i].name);
+
+		if ((i & 1) ? obj != NULL : obj != &objs[i])
+			UNIT_TEST_FAILED("wrong lookup result after walk, i=%zu", i);
+	}
+
+	removed = hash_table_walk(ht, NULL, NULL);
+	if (removed != NUM_KEYS / 2 || hash_table_get_size(ht))
+		UNIT_TEST_FAILED("walk without callback removed %zu", removed);
+
+	hash_table_free(ht);
+UNIT_TEST_CLEANUP_ON_ERRR
+	hash_table_free(ht);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_MODULE_DEFINE(hash_table)
+	ADD_TEST(1)
+	ADD_TEST(2)
+UNIT_TEST_MODULE_DEFINITION_DONE
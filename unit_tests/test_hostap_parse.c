@@ -0,0 +1,156 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "unitest_helper.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined YOCTO
+#include <slibc/string.h>
+#include <slibc/stdio.h>
+#else
+#include <stddef.h>
+#include "libsafec/safe_str_lib.h"
+#include "libsafec/safe_mem_lib.h"
+#endif
+
+#include "dwpald_hostap_parse.h"
+
+#define PARSE_TEST_MAX_LINES	2
+
+typedef struct {
+	int  id;
+	char name[16];
+	int  key_int;
+	char key_str[16];
+	int  int_array[4];
+	dwpald_string str_array[2];
+} parse_test_data;
+
+enum {
+	PARSE_TEST_ID,
+	PARSE_TEST_NAME,
+	PARSE_TEST_KEY_INT,
+	PARSE_TEST_KEY_STR,
+	PARSE_TEST_INT_ARRAY,
+	PARSE_TEST_STR_ARRAY,
+
+	/* keep last */
+	PARSE_TEST_NUM_FIELDS,
+};
+
+typedef struct {
+	const char *desc;
+	const char *msg;
+	size_t lines;		/* lines the user buffer has room for */
+	bool ret;
+	/* expected on success; id and key_int of every line, the others of line 0 */
+	size_t num_valid[PARSE_TEST_NUM_FIELDS];
+	int id[PARSE_TEST_MAX_LINES];
+	const char *name;
+	int key_int[PARSE_TEST_MAX_LINES];
+	const char *key_str;
+	int int_array[4];
+	const char *str_array[2];
+} parse_test_case;
+
+/* "str_array=" followed by a value longer than dwpald_string */
+static char long_str_array_msg[sizeof("7 wlan0 str_array=") + sizeof(dwpald_string)];
+
+static const parse_test_case parse_test_cases[] = {
+	{ "line of fields", "7 wlan0 key_int=5 key_str=abc int_array=1 2 3 str_array=s1 s2", 1, true,
+	  { 1, 1, 1, 1, 3, 2 }, { 7 }, "wlan0", { 5 }, "abc", { 1, 2, 3 }, { "s1", "s2" } },
+	{ "column of fields", "7\nwlan0\nkey_int=5\nkey_str=abc\nint_array=1 2\n", 1, true,
+	  { 1, 1, 1, 1, 2, 0 }, { 7 }, "wlan0", { 5 }, "abc", { 1, 2 }, { "" } },
+	{ "repeated array keys", "7 wlan0 int_array=1 2 key_int=5 int_array=3 str_array=a str_array=b", 1, true,
+	  { 1, 1, 1, 0, 3, 2 }, { 7 }, "wlan0", { 5 }, "", { 1, 2, 3 }, { "a", "b" } },
+	{ "unknown tokens", "7 wlan0 foo=1 key_int=5 bar int_array=1 2 baz=3 4 key_str=abc", 1, true,
+	  { 1, 1, 1, 1, 2, 0 }, { 7 }, "wlan0", { 5 }, "abc", { 1, 2 }, { "" } },
+	{ "lines of fields", "1 wlan0 key_int=5 key_str=a\n2 wlan1 key_int=6 key_str=b\n", 2, true,
+	  { 2, 2, 2, 2, 0, 0 }, { 1, 2 }, "wlan0", { 5, 6 }, "a", { 0 }, { "" } },
+	{ "more lines than buffer", "1 wlan0 key_int=5 key_str=a\n2 wlan1 key_int=6 key_str=b\n", 1, false },
+	{ "missing mandatory field", "7", 1, false },
+	{ "failure reply", "FAIL", 1, false },
+	{ "string value too long", "7 wlan0 key_str=0123456789abcdef", 1, false },
+	{ "mandatory string too long", "7 wlan0123456789abcdef", 1, false },
+	{ "too many array values", "7 wlan0 int_array=1 2 3 4 5", 1, false },
+	{ "array string too long", long_str_array_msg, 1, false },
+};
+
+UNIT_TEST_DEFINE(1, hostap reply parser cases)
+	static parse_test_data data[PARSE_TEST_MAX_LINES];
+	static char msg[HOSTAPD_TO_DWPAL_MSG_LENGTH];
+	size_t num_valid[PARSE_TEST_NUM_FIELDS];
+	dwpald_fields_to_parse fields[] = {
+		DWPALD_PARSE_INT(data[0].id, &num_valid[PARSE_TEST_ID], NULL),
+		DWPALD_PARSE_STR(data[0].name, &num_valid[PARSE_TEST_NAME], NULL),
+		DWPALD_PARSE_INT(data[0].key_int, &num_valid[PARSE_TEST_KEY_INT], "key_int="),
+		DWPALD_PARSE_STR(data[0].key_str, &num_valid[PARSE_TEST_KEY_STR], "key_str="),
+		DWPALD_PARSE_INT_ARRAY(data[0].int_array, &num_valid[PARSE_TEST_INT_ARRAY], "int_array="),
+		DWPALD_PARSE_STR_ARRAY(data[0].str_array, &num_valid[PARSE_TEST_STR_ARRAY], "str_array="),
+		DWPALD_PARSE_END
+	};
+	size_t i, j;
+
+	memset(long_str_array_msg, 'x', sizeof(long_str_array_msg) - 1);
+	memcpy_s(long_str_array_msg, sizeof(long_str_array_msg),
+		 "7 wlan0 str_array=", sizeof("7 wlan0 str_array=") - 1);
+	long_str_array_msg[sizeof(long_str_array_msg) - 1] = '\0';
+
+	for (i = 0; i < sizeof(parse_test_cases) / sizeof(parse_test_cases[0]); i++) {
+		const parse_test_case *tc = &parse_test_cases[i];
+		bool ret;
+
+		strncpy_s(msg, sizeof(msg), tc->msg, sizeof(msg) - 1);
+		ret = dwpald_hostap_response_parse(msg, strnlen_s(msg, sizeof(msg)), fields,
+						   tc->lines * sizeof(parse_test_data));
+		if (ret != tc->ret)
+			UNIT_TEST_FAILED("'%s': parse returned %d", tc->desc, ret);
+		if (!ret)
+			continue;
+
+		for (j = 0; j < PARSE_TEST_NUM_FIELDS; j++) {
+			if (num_valid[j] != tc->num_valid[j])
+				UNIT_TEST_FAILED("'%s': field %zu has %zu valid args, expected %zu",
+						 tc->desc, j, num_valid[j], tc->num_valid[j]);
+		}
+
+		for (j = 0; j < tc->lines; j++) {
+			if (data[j].id != tc->id[j] || data[j].key_int != tc->key_int[j])
+				UNIT_TEST_FAILED("'%s': line %zu id=%d key_int=%d", tc->desc, j,
+						 data[j].id, data[j].key_int);
+		}
+
+		if (strncmp(data[0].name, tc->name, sizeof(data[0].name)) ||
+		    strncmp(data[0].key_str, tc->key_str, sizeof(data[0].key_str)))
+			UNIT_TEST_FAILED("'%s': name='%s' key_str='%s'", tc->desc,
+					 data[0].name, data[0].key_str);
+
+		for (j = 0; j < 4; j++) {
+			if (data[0].int_array[j] != tc->int_array[j])
+				UNIT_TEST_FAILED("'%s': int_array[%zu]=%d", tc->desc, j,
+						 data[0].int_array[j]);
+		}
+
+		for (j = 0; j < 2; j++) {
+			const char *expected = tc->str_array[j] ? tc->str_array[j] : "";
+
+			if (strncmp(data[0].str_array[j], expected, sizeof(dwpald_string)))
+				UNIT_TEST_FAILED("'%s': str_array[%zu]='%s'", tc->desc, j,
+						 data[0].str_array[j]);
+		}
+	}
+
+UNIT_TEST_CLEANUP_ON_ERRR
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_MODULE_DEFINE(hostap_parse)
+	ADD_TEST(1)
+UNIT_TEST_MODULE_DEFINITION_DONE
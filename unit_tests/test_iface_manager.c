@@ -0,0 +1,627 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "iface_manager.h"
+#include "dwpal_daemon.h"
+#include "wave_ipc_client.h"
+
+/* the daemon logs are replaced by the ones of the unit tests */
+#undef ELOG
+#undef DLOG
+#include "unitest_helper.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <net/if.h>
+
+#if defined YOCTO
+#include <slibc/string.h>
+#include <slibc/stdio.h>
+#else
+#include <stddef.h>
+#include "libsafec/safe_str_lib.h"
+#include "libsafec/safe_mem_lib.h"
+#endif
+
+#define TEST_SERVER_NAME	"unitest_iface_man"
+#define TEST_IFNAME		"test0"
+
+/* IFACE_MAN_QUEUE_MAX_SIZE of iface_manager.c */
+#define TEST_QUEUE_MAX_SIZE	(500)
+
+/* info of the events sent by the tests */
+#define TEST_EVENT_GATE		(1)
+#define TEST_EVENT_FILL		(2)
+#define TEST_EVENT_LAST		(3)
+
+static wv_ipserver *__ipserver = NULL;
+static iface_manager *__manager = NULL;
+static wv_ipstation * volatile __ipsta = NULL;
+static volatile int __stop_server = 0;
+static volatile int __disconnected = 0;
+
+/* send_event() and execute_command() block on the gate while it is closed */
+static volatile int __gate_entered = 0;
+static volatile int __gate_open = 1;
+
+static volatile int __events_handled = 0;
+static volatile int __last_event_regs = -1;
+
+/* commands in the order they were executed, the one of __gate_seq blocks */
+#define TEST_MAX_CMDS		(16)
+static uint32_t __cmds[TEST_MAX_CMDS];
+static volatile int __num_cmds = 0;
+static uint32_t __gate_seq = 0;
+
+/* events registration of a station, keyed by its address */
+typedef struct {
+	char key[2 * sizeof(void*) + 3];
+	wv_ipstation *ipsta;
+} test_reg;
+
+static void test_reg_key(wv_ipstation *ipsta, char *key, size_t size)
+{
+	snprintf(key, size, "%p", (void*)ipsta);
+}
+
+static void test_gate_wait(void)
+{
+	__gate_entered = 1;
+	while (!__gate_open)
+		usleep(1000);
+}
+
+static int test_execute_command(wv_ipserver *ipserv, wv_ipc_msg *cmd,
+				wv_ipstation *ipsta, uint32_t seq_num)
+{
+	(void)ipserv;
+	(void)cmd;
+	(void)ipsta;
+
+	if (seq_num == __gate_seq)
+		test_gate_wait();
+
+	if (__num_cmds < TEST_MAX_CMDS)
+		__cmds[__num_cmds] = seq_num;
+	__num_cmds++;
+	return 0;
+}
+
+static int test_iface_attach(iface_manager *manager, char *ifname, uint8_t *state)
+{
+	(void)manager;
+	(void)ifname;
+
+	*state = INTERFACE_DWPAL_STATE_CONNECTED;
+	return 0;
+}
+
+static int test_iface_detach(char *ifname)
+{
+	(void)ifname;
+	return 0;
+}
+
+static int test_register_sta_to_events(hash_table *events, wv_ipstation *ipsta,
+				       const char *reg_str, size_t len)
+{
+	test_reg *reg = (test_reg*)calloc(1, sizeof(test_reg));
+
+	(void)reg_str;
+	(void)len;
+
+	if (!reg)
+		return 1;
+
+	reg->ipsta = ipsta;
+	test_reg_key(ipsta, reg->key, sizeof(reg->key));
+	if (hash_table_insert(events, reg->key, reg)) {
+		free(reg);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int test_unregister_sta_from_events(hash_table *events, wv_ipstation *ipsta)
+{
+	char key[sizeof(((test_reg*)0)->key)];
+
+	test_reg_key(ipsta, key, sizeof(key));
+	free(hash_table_remove(events, key));
+	return 0;
+}
+
+/* the stations aren't used, a disconnected one may be gone already */
+static int test_man_send_event(wv_ipserver *ipserv, char *ifname, wv_ipc_msg *event,
+			       void *info, hash_table *events, uint8_t *state)
+{
+	int id = *(int*)info;
+
+	(void)ipserv;
+	(void)ifname;
+	(void)event;
+	(void)state;
+
+	if (id == TEST_EVENT_GATE)
+		test_gate_wait();
+	else if (id == TEST_EVENT_LAST)
+		__last_event_regs = (int)hash_table_get_size(events);
+
+	__events_handled++;
+	return 0;
+}
+
+static manager_apis test_man_apis = {
+	.events_hash = hash_str,
+	.events_cmp = hash_str_cmp,
+	.execute_command = test_execute_command,
+	.iface_attach = test_iface_attach,
+	.iface_detach = test_iface_detach,
+	.register_sta_to_events = test_register_sta_to_events,
+	.unregister_sta_from_events = test_unregister_sta_from_events,
+	.send_event = test_man_send_event,
+};
+
+static int test_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta,
+			  uint32_t seq_num, wv_ipc_msg *cmd)
+{
+	(void)ipserv;
+	(void)ipsta;
+	(void)seq_num;
+
+	wave_ipc_msg_put(cmd);
+	return 0;
+}
+
+static int test_stop_cond(wv_ipserver *ipserv)
+{
+	(void)ipserv;
+	return __stop_server;
+}
+
+static int test_adding_client(wv_ipserver *ipserv, wv_ipstation *ipsta)
+{
+	(void)ipserv;
+	__ipsta = ipsta;
+	return 0;
+}
+
+/* as the daemon does, the server drops its reference once this returns */
+static int test_removing_client(wv_ipserver *ipserv, wv_ipstation *ipsta)
+{
+	(void)ipserv;
+
+	if (__manager)
+		iface_manager_sta_disconnected(__manager, ipsta);
+	__ipsta = NULL;
+	__disconnected = 1;
+	return 0;
+}
+
+static void* test_server_thread(void *obj)
+{
+	wv_ipserver_callbacks clbs;
+
+	(void)obj;
+
+	memset(&clbs, 0, sizeof(clbs));
+	clbs.cmd_async = test_cmd_async;
+	clbs.stop_cond = test_stop_cond;
+	clbs.adding_client = test_adding_client;
+	clbs.removing_client = test_removing_client;
+
+	if (wave_ipcs_run(__ipserver, &clbs) != WAVE_IPC_SUCCESS)
+		return (void*)-1;
+	return NULL;
+}
+
+static int test_wait_for(volatile int *cond, const char *what)
+{
+	int sleep_count = 0;
+
+	while (!*cond) {
+		usleep(1000);
+		if (++sleep_count > 6000) {
+			ELOG("timeout waiting for %s", what);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void test_teardown(pthread_t *server_thread, wv_ipclient **client)
+{
+	__gate_open = 1;
+
+	if (*client)
+		wave_ipcc_disconnect(client);
+
+	__stop_server = 1;
+	pthread_join(*server_thread, NULL);
+
+	if (__ipserver)
+		wave_ipcs_delete(&__ipserver);
+	if (__manager)
+		iface_manager_deinit(__manager);
+	__manager = NULL;
+}
+
+/* Starts the server and a manager, connects a client to it. Everything is
+ * cleaned up on failure */
+static int test_setup(bool sharded, unsigned int detach_time,
+		      pthread_t *server_thread, wv_ipclient **client)
+{
+	int sleep_count = 0;
+
+	__ipsta = NULL;
+	__stop_server = 0;
+	__disconnected = 0;
+	__gate_entered = 0;
+	__gate_open = 1;
+	__events_handled = 0;
+	__last_event_regs = -1;
+	__num_cmds = 0;
+	__gate_seq = 0;
+
+	if (wave_ipcs_create(&__ipserver, TEST_SERVER_NAME) != WAVE_IPC_SUCCESS) {
+		ELOG("wave_ipcs_create returned error");
+		return 1;
+	}
+
+	__manager = iface_manager_init(__ipserver, &test_man_apis, NULL,
+				       DWPALD_IF_TYPE_HOSTAP, detach_time, sharded);
+	if (!__manager) {
+		ELOG("iface_manager_init returned NULL");
+		wave_ipcs_delete(&__ipserver);
+		return 1;
+	}
+
+	if (pthread_create(server_thread, NULL, test_server_thread, NULL)) {
+		ELOG("failed to start the server thread");
+		iface_manager_deinit(__manager);
+		__manager = NULL;
+		wave_ipcs_delete(&__ipserver);
+		return 1;
+	}
+
+	if (wave_ipcc_connect(client, "unitest_iface_man_client", TEST_SERVER_NAME) !=
+	    WAVE_IPC_SUCCESS) {
+		ELOG("wave_ipcc_connect returned error");
+		goto err;
+	}
+
+	while (!__ipsta) {
+		usleep(1000);
+		if (++sleep_count > 6000) {
+			ELOG("timeout waiting for the client");
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	test_teardown(server_thread, client);
+	return 1;
+}
+
+static int test_send_attach(uint32_t seq_num, const char *ifname)
+{
+	dwpald_header hdr = { 0 };
+	char data[IFNAMSIZ + 1 + sizeof("EVENTS")] = { 0 };
+	wv_ipc_msg *cmd = wave_ipc_msg_alloc();
+
+	if (!cmd)
+		return 1;
+
+	strncpy_s(data, IFNAMSIZ + 1, ifname, IFNAMSIZ);
+	memcpy_s(data + IFNAMSIZ + 1, sizeof("EVENTS"), "EVENTS", sizeof("EVENTS"));
+	wave_ipc_msg_fill_data(cmd, data, sizeof(data));
+
+	hdr.header[0] = DWPALD_ATTACH_REQ;
+	hdr.header[1] = DWPALD_IF_TYPE_HOSTAP;
+	if (dwpald_header_push(cmd, &hdr)) {
+		wave_ipc_msg_put(cmd);
+		return 1;
+	}
+
+	return iface_manager_sta_cmd_async(__manager, __ipsta, seq_num, cmd);
+}
+
+static int test_send_detach(uint32_t seq_num, const char *ifname)
+{
+	dwpald_header hdr = { 0 };
+	char data[IFNAMSIZ + 1] = { 0 };
+	wv_ipc_msg *cmd = wave_ipc_msg_alloc();
+
+	if (!cmd)
+		return 1;
+
+	strncpy_s(data, sizeof(data), ifname, IFNAMSIZ);
+	wave_ipc_msg_fill_data(cmd, data, sizeof(data));
+
+	hdr.header[0] = DWPALD_DETACH_REQ;
+	hdr.header[1] = DWPALD_IF_TYPE_HOSTAP;
+	if (dwpald_header_push(cmd, &hdr)) {
+		wave_ipc_msg_put(cmd);
+		return 1;
+	}
+
+	return iface_manager_sta_cmd_async(__manager, __ipsta, seq_num, cmd);
+}
+
+/* [DWPALD_CMD] [iftype] [ifname_len], the data starts with the ifname */
+static int test_send_cmd(uint32_t seq_num, const char *ifname)
+{
+	dwpald_header hdr = { 0 };
+	char data[IFNAMSIZ + sizeof("PING")] = { 0 };
+	size_t ifname_len = strnlen_s(ifname, IFNAMSIZ);
+	wv_ipc_msg *cmd = wave_ipc_msg_alloc();
+
+	if (!cmd)
+		return 1;
+
+	memcpy_s(data, sizeof(data), ifname, ifname_len);
+	memcpy_s(data + ifname_len, sizeof(data) - ifname_len, "PING", sizeof("PING"));
+	wave_ipc_msg_fill_data(cmd, data, ifname_len + sizeof("PING"));
+
+	hdr.header[0] = DWPALD_CMD;
+	hdr.header[1] = DWPALD_IF_TYPE_HOSTAP;
+	hdr.header[2] = (uint8_t)ifname_len;
+	if (dwpald_header_push(cmd, &hdr)) {
+		wave_ipc_msg_put(cmd);
+		return 1;
+	}
+
+	return iface_manager_sta_cmd_async(__manager, __ipsta, seq_num, cmd);
+}
+
+static int test_wait_for_cmds(int num_cmds)
+{
+	int sleep_count = 0;
+
+	while (__num_cmds < num_cmds) {
+		usleep(1000);
+		if (++sleep_count > 6000) {
+			ELOG("timeout, %d of %d commands executed", __num_cmds, num_cmds);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int test_check_cmds_order(const uint32_t *expected, int num_cmds)
+{
+	int i;
+
+	if (__num_cmds != num_cmds) {
+		ELOG("%d commands executed, expected %d", __num_cmds, num_cmds);
+		return 1;
+	}
+
+	for (i = 0; i < num_cmds; i++) {
+		if (__cmds[i] != expected[i]) {
+			ELOG("command %d is %u, expected %u", i, __cmds[i], expected[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+typedef struct {
+	const char *ifname;
+	int found;
+	uint64_t executed;
+} test_iface_stats;
+
+static void test_iface_stats_cb(const char *ifname, serializer_stats *stats, void *arg)
+{
+	test_iface_stats *iface_stats = (test_iface_stats*)arg;
+
+	if (!ifname || strncmp(ifname, iface_stats->ifname, IFNAMSIZ))
+		return;
+
+	iface_stats->found = 1;
+	iface_stats->executed = stats->executed;
+}
+
+static int test_queue_event(const char *ifname, int id)
+{
+	wv_ipc_msg *event = wave_ipc_msg_alloc();
+	int *info = (int*)malloc(sizeof(int));
+
+	if (!event || !info) {
+		if (event)
+			wave_ipc_msg_put(event);
+		free(info);
+		return 1;
+	}
+
+	*info = id;
+	return iface_manager_event_received(__manager, event, ifname,
+					    strnlen_s(ifname, IFNAMSIZ) + 1, info);
+}
+
+UNIT_TEST_DEFINE(1, disconnect a client while the queue is full)
+	pthread_t server_thread;
+	wv_ipclient *client = NULL;
+	int started = 0, i;
+
+	if (test_setup(false, 60, &server_thread, &client))
+		UNIT_TEST_FAILED("setup failed");
+	started = 1;
+
+	if (test_send_attach(1, TEST_IFNAME))
+		UNIT_TEST_FAILED("attach returned err");
+
+	/* the serializer blocks on the gate after the attach */
+	__gate_open = 0;
+	if (test_queue_event(TEST_IFNAME, TEST_EVENT_GATE))
+		UNIT_TEST_FAILED("gate event returned err");
+	if (test_wait_for(&__gate_entered, "the gate"))
+		UNIT_TEST_FAILED("serializer didn't reach the gate");
+
+	for (i = 0; i < TEST_QUEUE_MAX_SIZE; i++) {
+		if (test_queue_event(TEST_IFNAME, TEST_EVENT_FILL))
+			UNIT_TEST_FAILED("fill event %d returned err", i);
+	}
+
+	/* the disconnection is queued behind the full queue */
+	if (wave_ipcc_disconnect(&client) != WAVE_IPC_SUCCESS)
+		UNIT_TEST_FAILED("wave_ipcc_disconnect returned err");
+	client = NULL;
+	if (test_wait_for(&__disconnected, "the disconnection"))
+		UNIT_TEST_FAILED("server didn't remove the client");
+
+	__gate_open = 1;
+
+	if (test_queue_event(TEST_IFNAME, TEST_EVENT_LAST))
+		UNIT_TEST_FAILED("last event returned err");
+
+	i = 0;
+	while (__events_handled != TEST_QUEUE_MAX_SIZE + 2) {
+		usleep(1000);
+		if (++i > 6000)
+			UNIT_TEST_FAILED("timeout, %d events handled", __events_handled);
+	}
+
+	if (__last_event_regs != 0)
+		UNIT_TEST_FAILED("event sent to %d stations after the disconnection",
+				 __last_event_regs);
+
+	started = 0;
+	test_teardown(&server_thread, &client);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (started)
+		test_teardown(&server_thread, &client);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(2, sharded commands keep their order across the attach)
+	static const uint32_t expected[] = { 1, 2, 3, 4 };
+	test_iface_stats iface_stats = { TEST_IFNAME, 0, 0 };
+	pthread_t server_thread;
+	wv_ipclient *client = NULL;
+	int started = 0;
+
+	if (test_setup(true, 60, &server_thread, &client))
+		UNIT_TEST_FAILED("setup failed");
+	started = 1;
+
+	/* not attached yet, queued to the manager's serializer */
+	__gate_open = 0;
+	__gate_seq = 1;
+	if (test_send_cmd(1, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 1 returned err");
+	if (test_wait_for(&__gate_entered, "the gate"))
+		UNIT_TEST_FAILED("cmd 1 didn't reach the gate");
+	if (test_send_cmd(2, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 2 returned err");
+
+	/* attached once cmd 2 is done, cmd 3 must not overtake them */
+	if (test_send_attach(100, TEST_IFNAME))
+		UNIT_TEST_FAILED("attach returned err");
+	if (test_send_cmd(3, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 3 returned err");
+
+	__gate_open = 1;
+	if (test_wait_for_cmds(3))
+		UNIT_TEST_FAILED("fallback commands weren't executed");
+
+	/* the fallback commands are freed right after they ran */
+	usleep(100 * 1000);
+	if (test_send_cmd(4, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 4 returned err");
+	if (test_wait_for_cmds(4))
+		UNIT_TEST_FAILED("cmd 4 wasn't executed");
+
+	if (test_check_cmds_order(expected, 4))
+		UNIT_TEST_FAILED("commands executed out of order");
+
+	iface_manager_serializers_stats(__manager, test_iface_stats_cb, &iface_stats);
+	if (!iface_stats.found || iface_stats.executed != 1)
+		UNIT_TEST_FAILED("interface serializer found=%d executed=%llu",
+				 iface_stats.found, (unsigned long long)iface_stats.executed);
+
+	started = 0;
+	test_teardown(&server_thread, &client);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (started)
+		test_teardown(&server_thread, &client);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(3, sharded commands queued to a removed interface still run)
+	static const uint32_t expected[] = { 1, 2, 3 };
+	test_iface_stats iface_stats = { TEST_IFNAME, 1, 0 };
+	pthread_t server_thread;
+	wv_ipclient *client = NULL;
+	int started = 0, sleep_count = 0;
+
+	/* the interface is removed as soon as its last client detaches */
+	if (test_setup(true, 0, &server_thread, &client))
+		UNIT_TEST_FAILED("setup failed");
+	started = 1;
+
+	if (test_send_attach(100, TEST_IFNAME))
+		UNIT_TEST_FAILED("attach returned err");
+	do {
+		usleep(1000);
+		iface_stats.found = 0;
+		iface_manager_serializers_stats(__manager, test_iface_stats_cb, &iface_stats);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, interface wasn't attached");
+	} while (!iface_stats.found);
+
+	/* the interface serializer blocks on cmd 1, 2 and 3 are queued to it */
+	__gate_open = 0;
+	__gate_seq = 1;
+	if (test_send_cmd(1, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 1 returned err");
+	if (test_wait_for(&__gate_entered, "the gate"))
+		UNIT_TEST_FAILED("cmd 1 didn't reach the gate");
+	if (test_send_cmd(2, TEST_IFNAME) || test_send_cmd(3, TEST_IFNAME))
+		UNIT_TEST_FAILED("cmd 2/3 returned err");
+
+	if (test_send_detach(101, TEST_IFNAME))
+		UNIT_TEST_FAILED("detach returned err");
+	sleep_count = 0;
+	do {
+		usleep(1000);
+		iface_stats.found = 0;
+		iface_manager_serializers_stats(__manager, test_iface_stats_cb, &iface_stats);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, interface wasn't removed");
+	} while (iface_stats.found);
+
+	__gate_open = 1;
+	if (test_wait_for_cmds(3))
+		UNIT_TEST_FAILED("queued commands were dropped");
+	if (test_check_cmds_order(expected, 3))
+		UNIT_TEST_FAILED("commands executed out of order");
+
+	started = 0;
+	test_teardown(&server_thread, &client);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (started)
+		test_teardown(&server_thread, &client);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_MODULE_DEFINE(iface_manager)
+	ADD_TEST(1)
+	ADD_TEST(2)
+	ADD_TEST(3)
+UNIT_TEST_MODULE_DEFINITION_DONE
@@ -167,7 +167,7 @@ fail:
 static int __die_after_n_commands = TEST1_NUM_ITER;
 static int __die_after_n_events = TEST1_NUM_ITER;
 
-static int cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta, uint8_t seq_num,
+static int cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta, uint32_t seq_num,
 		     wv_ipc_msg *cmd)
 {
 	char *data;
@@ -1742,7 +1742,7 @@ static int blocked_commands_term(void *arg)
 	return 0;
 }
 
-static int client_cmd(void *arg, uint8_t seq_num, wv_ipc_msg *cmd)
+static int client_cmd(void *arg, uint32_t seq_num, wv_ipc_msg *cmd)
 {
 	char *data;
 	size_t size;
@@ -2062,6 +2062,169 @@ UNIT_TEST_CLEANUP_ON_ERRR
 	}
 UNIT_TEST_DEFINITION_DONE
 
+static char deadline_cmd[] = "do you know my deadline?";
+static char ignored_cmd[] = "don't answer this one";
+
+static int deadline_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta, uint32_t seq_num,
+			      wv_ipc_msg *cmd)
+{
+	char *data = wave_ipc_msg_get_data(cmd);
+	size_t size = wave_ipc_msg_get_size(cmd);
+	static int num_cmds = 0;
+
+	if (size == sizeof(deadline_cmd) && data && !strncmp(data, deadline_cmd, sizeof(deadline_cmd))) {
+		wv_ipc_msg *reply = wave_ipc_msg_alloc();
+		const char *answer;
+
+		if (reply == NULL)
+			goto err;
+		answer = (wave_ipc_msg_get_deadline(cmd) != WAVE_IPC_NO_DEADLINE &&
+			  !wave_ipc_msg_deadline_passed(cmd)) ? "yes" : "no";
+		wave_ipc_msg_fill_data(reply, answer, strlen(answer) + 1);
+		wave_ipcs_send_response_to(ipserv, ipsta, seq_num, reply, 0);
+		wave_ipc_msg_put(reply);
+	} else if (size != sizeof(ignored_cmd) || !data || strncmp(data, ignored_cmd, sizeof(ignored_cmd))) {
+		goto err;
+	}
+	wave_ipc_msg_put(cmd);
+
+	if (++num_cmds == __die_after_n_commands) {
+		TLOG("answered %d cmds", num_cmds);
+		__die_after_n_commands = 0;
+	}
+	return 0;
+
+err:
+	wave_ipc_msg_put(cmd);
+	__stop_cond = 1;
+	__err_detected = 1;
+	return 1;
+}
+
+static int run_deadline_server(int die_after_n_commands)
+{
+	wv_ipc_ret ret;
+	wv_ipserver *handle = NULL;
+
+	wv_ipserver_callbacks clbs;
+	memset(&clbs, 0, sizeof(wv_ipserver_callbacks));
+	clbs.cmd_async = deadline_cmd_async;
+	clbs.stop_cond = stop_cond;
+
+	ret = wave_ipcs_create(&handle, "server_t2");
+	if (ret == WAVE_IPC_ERROR)
+		return 1;
+
+	__die_after_n_events = 0;
+	__die_after_n_commands = die_after_n_commands;
+	__stop_cond = 0;
+
+	ret = wave_ipcs_run(handle, &clbs);
+	if (ret == WAVE_IPC_ERROR)
+		return 1;
+
+	ret = wave_ipcs_delete(&handle);
+	if (ret == WAVE_IPC_ERROR)
+		return 1;
+
+	return 0;
+}
+
+/* Returns the time the command took in msec, or -1 if the result is not the expected one */
+static int send_deadline_cmd(wv_ipclient *handle, const char *data, size_t len,
+			     const struct timespec *deadline, const char *e_reply)
+{
+	wv_ipc_msg *cmd = wave_ipc_msg_alloc();
+	wv_ipc_msg *reply = NULL;
+	uint64_t start = wave_ipc_now_ms();
+	wv_ipc_ret ret;
+	int res = -1;
+
+	if (cmd == NULL)
+		return -1;
+
+	wave_ipc_msg_fill_data(cmd, data, len);
+	ret = wave_ipcc_send_cmd_deadline(handle, cmd, &reply, deadline);
+	wave_ipc_msg_put(cmd);
+
+	if (e_reply == NULL) {
+		if (ret != WAVE_IPC_SUCCESS && reply == NULL)
+			res = (int)(wave_ipc_now_ms() - start);
+		else
+			ELOG("command was expected to time out (ret=%d)", ret);
+	} else if (ret != WAVE_IPC_SUCCESS || wave_ipc_msg_get_data(reply) == NULL ||
+		   strcmp(wave_ipc_msg_get_data(reply), e_reply)) {
+		ELOG("unexpected reply to the command (ret=%d)", ret);
+	} else {
+		res = (int)(wave_ipc_now_ms() - start);
+	}
+
+	if (reply)
+		wave_ipc_msg_put(reply);
+	return res;
+}
+
+UNIT_TEST_DEFINE(26, commands with deadlines with and without listener)
+
+	wv_ipc_ret ret;
+	wv_ipclient *handle = NULL;
+	struct timespec deadline;
+	int with_listener, took;
+
+	UNIT_TEST_FORK
+	UNIT_TEST_FORKED_CHILD
+		exit(run_deadline_server(6));
+	UNIT_TEST_FORKED_PARENET
+
+		usleep(100000);
+
+		ret = wave_ipcc_connect(&handle, "clinet_t2", "server_t2");
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcc_connect returned error");
+
+		for (with_listener = 0; with_listener < 2; with_listener++) {
+			if (with_listener) {
+				ret = wave_ipcc_start_listener(handle, null_event_handler, NULL, NULL, NULL, NULL, 0);
+				if (ret == WAVE_IPC_ERROR)
+					UNIT_TEST_FAILED("wave_ipcc_start_listener returned error");
+			}
+
+			/* the server gets the deadline with the command */
+			wave_ipc_deadline_after_ms(&deadline, 500);
+			if (send_deadline_cmd(handle, deadline_cmd, sizeof(deadline_cmd), &deadline, "yes") < 0)
+				UNIT_TEST_FAILED("command with deadline failed, listener=%d", with_listener);
+
+			if (send_deadline_cmd(handle, deadline_cmd, sizeof(deadline_cmd), NULL, "yes") < 0)
+				UNIT_TEST_FAILED("command with default deadline failed, listener=%d", with_listener);
+
+			/* no reply: gives up at the deadline, not after the default timeout */
+			wave_ipc_deadline_after_ms(&deadline, 150);
+			took = send_deadline_cmd(handle, ignored_cmd, sizeof(ignored_cmd), &deadline, NULL);
+			if (took < 140 || took > 1000)
+				UNIT_TEST_FAILED("command timed out after %d msec, listener=%d", took, with_listener);
+
+			/* passed deadline: not sent at all */
+			wave_ipc_ms_to_timespec(wave_ipc_now_ms() - 1, &deadline);
+			took = send_deadline_cmd(handle, deadline_cmd, sizeof(deadline_cmd), &deadline, NULL);
+			if (took < 0 || took > 50)
+				UNIT_TEST_FAILED("command with passed deadline took %d msec, listener=%d", took, with_listener);
+		}
+
+		ret = wave_ipcc_stop_listener(handle);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcc_stop_listener returned error");
+
+		ret = wave_ipcc_disconnect(&handle);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcc_disconnect returned error");
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (handle) {
+		wave_ipcc_stop_listener(handle);
+		wave_ipcc_disconnect(&handle);
+	}
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(ipc_client)
 	ADD_TEST(1)
 	ADD_TEST(2)
@@ -2088,4 +2251,5 @@ UNIT_TEST_MODULE_DEFINE(ipc_client)
 	ADD_TEST(23)
 	ADD_TEST(24)
 	ADD_TEST(25)
+	ADD_TEST(26)
 UNIT_TEST_MODULE_DEFINITION_DONE
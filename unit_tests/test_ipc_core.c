@@ -18,6 +18,9 @@
 #include <sys/un.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 
 #if defined YOCTO
 #include <slibc/string.h>
@@ -512,6 +515,432 @@ UNIT_TEST_CLEANUP_ON_ERRR
 	if (client != -1) close(client);
 UNIT_TEST_DEFINITION_DONE
 
+UNIT_TEST_DEFINE(7, grow data across size classes)
+
+	wv_ipc_msg *a = NULL, *b = NULL, *c = NULL;
+	wv_ipc_ret ret;
+	char *m1;
+	size_t s1, i, num_appends = 0;
+	uint8_t headr1[] = "abc";
+	int sockets[2] = { -1, -1 };
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets))
+		UNIT_TEST_FAILED("socketpair");
+
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+
+	/* grow the message from the inline buffer up to the biggest class */
+	while (wave_ipc_msg_get_size(a) + sizeof(msg1) <= WAVE_IPC_BUFF_SIZE) {
+		if (WAVE_IPC_SUCCESS != wave_ipc_msg_append_data(a, msg1, sizeof(msg1)))
+			UNIT_TEST_FAILED("wave_ipc_msg_append_data retuned Failure, i=%zu", num_appends);
+		num_appends++;
+	}
+
+	if (WAVE_IPC_SUCCESS == wave_ipc_msg_append_data(a, msg1, sizeof(msg1)))
+		UNIT_TEST_FAILED("wave_ipc_msg_append_data beyond WAVE_IPC_BUFF_SIZE succeeded");
+
+	m1 = wave_ipc_msg_get_data(a);
+	s1 = wave_ipc_msg_get_size(a);
+	if (NULL == m1 || s1 != num_appends * sizeof(msg1))
+		UNIT_TEST_FAILED("wrong data after grow, s1=%zu", s1);
+
+	for (i = 0; i < num_appends; i++) {
+		if (memcmp(m1 + i * sizeof(msg1), msg1, sizeof(msg1)))
+			UNIT_TEST_FAILED("data mismatch in chunk %zu", i);
+	}
+
+	/* dup keeps the data, headers and deadline */
+	push_hdr(a, headr1)
+	wave_ipc_msg_set_deadline(a, wave_ipc_now_ms() + 60000);
+	b = wave_ipc_msg_dup(a);
+	if (!b)
+		UNIT_TEST_FAILED("wave_ipc_msg_dup retuned NULL");
+
+	if (wave_ipc_msg_get_deadline(b) != wave_ipc_msg_get_deadline(a))
+		UNIT_TEST_FAILED("dup deadline %llu != %llu",
+				 (unsigned long long)wave_ipc_msg_get_deadline(b),
+				 (unsigned long long)wave_ipc_msg_get_deadline(a));
+
+	if (WAVE_IPC_SUCCESS != wave_ipc_send_msg(sockets[0], b, 0))
+		UNIT_TEST_FAILED("wave_ipc_send_msg retuned Failure");
+
+	if ((ret = wave_ipc_recv_msg(sockets[1], &c)))
+		UNIT_TEST_FAILED("wave_ipc_recv_msg retuned err (%d)", ret);
+
+	pop_hdr(c, headr1)
+	if (wave_ipc_msg_get_size(c) != s1 ||
+	    memcmp(wave_ipc_msg_get_data(c), m1, s1))
+		UNIT_TEST_FAILED("received data mismatch");
+
+	wave_ipc_msg_put(a);
+	wave_ipc_msg_put(b);
+	wave_ipc_msg_put(c);
+	close(sockets[0]);
+	close(sockets[1]);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (a) wave_ipc_msg_put(a);
+	if (b) wave_ipc_msg_put(b);
+	if (c) wave_ipc_msg_put(c);
+	if (sockets[0] != -1) close(sockets[0]);
+	if (sockets[1] != -1) close(sockets[1]);
+UNIT_TEST_DEFINITION_DONE
+
+/* Reads whatever is available on the socket without blocking */
+static void drain_socket(int socket, char *buf, size_t size, size_t *len)
+{
+	ssize_t res;
+
+	while (*len < size) {
+		res = recv(socket, buf + *len, size - *len, MSG_DONTWAIT);
+		if (res <= 0)
+			break;
+		*len += res;
+	}
+}
+
+UNIT_TEST_DEFINE(8, shared msg and partial send)
+
+	wv_ipc_msg *a = NULL;
+	wv_ipc_ret ret;
+	uint8_t headr1[] = "abc";
+	char *wire = NULL, *expected = NULL;
+	size_t wire_len = 0, expected_len = 0, offset = 0, buf_size = 2 * WAVE_IPC_BUFF_SIZE;
+	int sockets[2] = { -1, -1 }, ref_sockets[2] = { -1, -1 };
+	int sndbuf = 4096, i, num_partial = 0;
+
+	wire = malloc(buf_size);
+	expected = malloc(buf_size);
+	if (!wire || !expected)
+		UNIT_TEST_FAILED("malloc");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) ||
+	    socketpair(AF_UNIX, SOCK_STREAM, 0, ref_sockets))
+		UNIT_TEST_FAILED("socketpair");
+
+	if (setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)))
+		UNIT_TEST_FAILED("setsockopt");
+
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+
+	while (wave_ipc_msg_get_size(a) + sizeof(msg1) <= WAVE_IPC_BUFF_SIZE) {
+		if (WAVE_IPC_SUCCESS != wave_ipc_msg_append_data(a, msg1, sizeof(msg1)))
+			UNIT_TEST_FAILED("wave_ipc_msg_append_data retuned Failure");
+	}
+	push_hdr(a, headr1)
+
+	/* a shared msg is immutable */
+	if (wave_ipc_msg_get(a) != a || !wave_ipc_msg_is_shared(a))
+		UNIT_TEST_FAILED("wave_ipc_msg_get didn't share the msg");
+
+	if (WAVE_IPC_SUCCESS == wave_ipc_msg_push_hdr(a, headr1, sizeof(headr1)) ||
+	    WAVE_IPC_SUCCESS == wave_ipc_msg_shrink_data(a, 0))
+		UNIT_TEST_FAILED("shared msg was modified");
+
+	wave_ipc_msg_put(a);
+	if (wave_ipc_msg_is_shared(a))
+		UNIT_TEST_FAILED("msg is still shared");
+
+	/* the stream of a msg sent at once */
+	if (WAVE_IPC_SUCCESS != wave_ipc_send_msg(ref_sockets[0], a, 0))
+		UNIT_TEST_FAILED("wave_ipc_send_msg retuned Failure");
+	drain_socket(ref_sockets[1], expected, buf_size, &expected_len);
+
+	/* send it again through a small socket buffer, resuming from the offset */
+	for (i = 0; i < 10000; i++) {
+		ret = wave_ipc_send_msg_from(sockets[0], a, MSG_DONTWAIT, &offset);
+		if (ret == WAVE_IPC_SUCCESS)
+			break;
+		if (ret != WAVE_IPC_CMD_WOULD_BLOCK)
+			UNIT_TEST_FAILED("wave_ipc_send_msg_from retuned err (%d)", ret);
+		if (offset)
+			num_partial++;
+		drain_socket(sockets[1], wire, buf_size, &wire_len);
+	}
+	drain_socket(sockets[1], wire, buf_size, &wire_len);
+
+	if (ret != WAVE_IPC_SUCCESS || offset != expected_len)
+		UNIT_TEST_FAILED("msg wasn't sent, offset=%zu", offset);
+
+	if (!num_partial)
+		UNIT_TEST_FAILED("msg was never sent partially");
+
+	if (wire_len != expected_len || memcmp(wire, expected, wire_len))
+		UNIT_TEST_FAILED("resumed stream differs, len=%zu expected=%zu",
+				 wire_len, expected_len);
+
+	wave_ipc_msg_put(a);
+	close(sockets[0]);
+	close(sockets[1]);
+	close(ref_sockets[0]);
+	close(ref_sockets[1]);
+	free(wire);
+	free(expected);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (a) wave_ipc_msg_put(a);
+	if (sockets[0] != -1) close(sockets[0]);
+	if (sockets[1] != -1) close(sockets[1]);
+	if (ref_sockets[0] != -1) close(ref_sockets[0]);
+	if (ref_sockets[1] != -1) close(ref_sockets[1]);
+	free(wire);
+	free(expected);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(9, framed receive of coalesced and split messages)
+
+	wv_ipc_msg *a = NULL, *b = NULL;
+	wv_ipc_rx *rx = NULL;
+	wv_ipc_ret ret;
+	uint8_t headr1[] = "abc";
+	char *wire = NULL;
+	size_t wire_len = 0, sent = 0, chunk = 1000, i;
+	int sockets[2] = { -1, -1 }, ref_sockets[2] = { -1, -1 };
+
+	wire = malloc(2 * WAVE_IPC_BUFF_SIZE);
+	if (!wire)
+		UNIT_TEST_FAILED("malloc");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) ||
+	    socketpair(AF_UNIX, SOCK_STREAM, 0, ref_sockets))
+		UNIT_TEST_FAILED("socketpair");
+
+	rx = wave_ipc_rx_create();
+	if (!rx)
+		UNIT_TEST_FAILED("wave_ipc_rx_create retuned NULL");
+
+	/* back-to-back small messages come out of one read */
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+	if (WAVE_IPC_SUCCESS != wave_ipc_msg_fill_data(a, msg1, sizeof(msg1)))
+		UNIT_TEST_FAILED("wave_ipc_msg_fill_data retuned Failure");
+	push_hdr(a, headr1)
+	for (i = 0; i < 3; i++) {
+		if (WAVE_IPC_SUCCESS != wave_ipc_send_msg(sockets[0], a, 0))
+			UNIT_TEST_FAILED("wave_ipc_send_msg retuned Failure");
+	}
+
+	for (i = 0; i < 3; i++) {
+		if ((ret = wave_ipc_rx_recv(rx, sockets[1], MSG_DONTWAIT, &b)))
+			UNIT_TEST_FAILED("wave_ipc_rx_recv retuned err (%d), i=%zu", ret, i);
+		pop_hdr(b, headr1)
+		if (wave_ipc_msg_get_size(b) != sizeof(msg1) ||
+		    memcmp(wave_ipc_msg_get_data(b), msg1, sizeof(msg1)))
+			UNIT_TEST_FAILED("received data mismatch, i=%zu", i);
+		wave_ipc_msg_put(b);
+		b = NULL;
+
+		if (i < 2 && !wave_ipc_rx_has_msg(rx))
+			UNIT_TEST_FAILED("next msg isn't buffered, i=%zu", i);
+	}
+
+	if (WAVE_IPC_CMD_WOULD_BLOCK != wave_ipc_rx_recv(rx, sockets[1], MSG_DONTWAIT, &b))
+		UNIT_TEST_FAILED("wave_ipc_rx_recv on an empty socket didn't block");
+
+	/* a big msg delivered in pieces */
+	wave_ipc_msg_put(a);
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+	while (wave_ipc_msg_get_size(a) + sizeof(msg2) <= WAVE_IPC_BUFF_SIZE) {
+		if (WAVE_IPC_SUCCESS != wave_ipc_msg_append_data(a, msg2, sizeof(msg2)))
+			UNIT_TEST_FAILED("wave_ipc_msg_append_data retuned Failure");
+	}
+	push_hdr(a, headr1)
+
+	if (WAVE_IPC_SUCCESS != wave_ipc_send_msg(ref_sockets[0], a, 0))
+		UNIT_TEST_FAILED("wave_ipc_send_msg retuned Failure");
+	drain_socket(ref_sockets[1], wire, 2 * WAVE_IPC_BUFF_SIZE, &wire_len);
+
+	while (sent < wire_len) {
+		size_t len = (wire_len - sent < chunk) ? wire_len - sent : chunk;
+
+		if (send(sockets[0], wire + sent, len, 0) != (ssize_t)len)
+			UNIT_TEST_FAILED("send");
+		sent += len;
+
+		ret = wave_ipc_rx_recv(rx, sockets[1], MSG_DONTWAIT, &b);
+		if (sent < wire_len && ret != WAVE_IPC_CMD_WOULD_BLOCK)
+			UNIT_TEST_FAILED("incomplete msg returned %d, sent=%zu", ret, sent);
+	}
+
+	if (ret != WAVE_IPC_SUCCESS)
+		UNIT_TEST_FAILED("wave_ipc_rx_recv retuned err (%d)", ret);
+
+	pop_hdr(b, headr1)
+	if (wave_ipc_msg_get_size(b) != wave_ipc_msg_get_size(a) ||
+	    memcmp(wave_ipc_msg_get_data(b), wave_ipc_msg_get_data(a), wave_ipc_msg_get_size(a)))
+		UNIT_TEST_FAILED("received data mismatch");
+
+	/* EOF */
+	close(sockets[0]);
+	sockets[0] = -1;
+	wave_ipc_msg_put(b);
+	b = NULL;
+	if (WAVE_IPC_DISCONNECTED != wave_ipc_rx_recv(rx, sockets[1], MSG_DONTWAIT, &b))
+		UNIT_TEST_FAILED("disconnect wasn't reported");
+
+	wave_ipc_msg_put(a);
+	wave_ipc_rx_destroy(rx);
+	close(sockets[1]);
+	close(ref_sockets[0]);
+	close(ref_sockets[1]);
+	free(wire);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (a) wave_ipc_msg_put(a);
+	if (b) wave_ipc_msg_put(b);
+	wave_ipc_rx_destroy(rx);
+	if (sockets[0] != -1) close(sockets[0]);
+	if (sockets[1] != -1) close(sockets[1]);
+	if (ref_sockets[0] != -1) close(ref_sockets[0]);
+	if (ref_sockets[1] != -1) close(ref_sockets[1]);
+	free(wire);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(10, 32 bit seq num in ipc header)
+
+	wv_ipc_msg *a = NULL;
+	ipc_header hdr = { 0 }, out;
+	uint32_t seq_nums[] = { 0, 255, 256, 65536, 0x12345678, 0xFFFFFFFF };
+	size_t i;
+
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+
+	for (i = 0; i < ARRAY_SIZE(seq_nums); i++) {
+		hdr.header[0] = (uint8_t)i;
+		ipc_header_set_seq_num(&hdr, seq_nums[i]);
+		if (ipc_header_push(a, &hdr))
+			UNIT_TEST_FAILED("ipc_header_push failed, i=%zu", i);
+
+		if (ipc_header_pop(a, &out))
+			UNIT_TEST_FAILED("ipc_header_pop failed, i=%zu", i);
+
+		if (out.header[0] != (uint8_t)i ||
+		    ipc_header_get_seq_num(&out) != seq_nums[i])
+			UNIT_TEST_FAILED("seq num %u came back as %u",
+					 seq_nums[i], ipc_header_get_seq_num(&out));
+	}
+
+	wave_ipc_msg_put(a);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (a) wave_ipc_msg_put(a);
+UNIT_TEST_DEFINITION_DONE
+
+typedef struct {
+	int socket;
+	size_t len;
+	unsigned int delay_ms;
+	size_t received;
+} slow_reader_arg;
+
+static void* slow_reader(void *arg)
+{
+	slow_reader_arg *reader = (slow_reader_arg*)arg;
+	char buf[1024];
+	ssize_t res;
+
+	usleep(reader->delay_ms * 1000);
+	while (reader->received < reader->len) {
+		res = read(reader->socket, buf, sizeof(buf));
+		if (res <= 0)
+			break;
+		reader->received += res;
+	}
+
+	return NULL;
+}
+
+static uint64_t thread_cpu_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+UNIT_TEST_DEFINE(11, blocking send on a non-blocking socket)
+
+	wv_ipc_msg *a = NULL;
+	wv_ipc_ret ret;
+	slow_reader_arg reader = { 0 };
+	pthread_t reader_thread;
+	int reader_started = 0;
+	int sockets[2] = { -1, -1 };
+	int sndbuf = 4096;
+	uint64_t start_ms, cpu_ms;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets))
+		UNIT_TEST_FAILED("socketpair");
+
+	if (setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) ||
+	    fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK))
+		UNIT_TEST_FAILED("socket options");
+
+	a = wave_ipc_msg_alloc();
+	if (!a)
+		UNIT_TEST_FAILED("wave_ipc_msg_alloc retuned NULL");
+
+	while (wave_ipc_msg_get_size(a) + sizeof(msg1) <= WAVE_IPC_BUFF_SIZE) {
+		if (WAVE_IPC_SUCCESS != wave_ipc_msg_append_data(a, msg1, sizeof(msg1)))
+			UNIT_TEST_FAILED("wave_ipc_msg_append_data retuned Failure");
+	}
+
+	/* the msg doesn't fit the socket, the sender waits for the reader */
+	reader.socket = sockets[1];
+	reader.len = wave_ipc_msg_get_size(a);	/* at least, the header comes on top */
+	reader.delay_ms = 300;
+	if (pthread_create(&reader_thread, NULL, slow_reader, &reader))
+		UNIT_TEST_FAILED("pthread_create");
+	reader_started = 1;
+
+	cpu_ms = thread_cpu_ms();
+	ret = wave_ipc_send_msg(sockets[0], a, 0);
+	cpu_ms = thread_cpu_ms() - cpu_ms;
+	if (ret != WAVE_IPC_SUCCESS)
+		UNIT_TEST_FAILED("wave_ipc_send_msg retuned err (%d)", ret);
+
+	pthread_join(reader_thread, NULL);
+	reader_started = 0;
+	if (reader.received < reader.len)
+		UNIT_TEST_FAILED("received %zu of %zu bytes", reader.received, reader.len);
+
+	/* a spinning sender would burn the whole delay of the reader */
+	if (cpu_ms > reader.delay_ms / 3)
+		UNIT_TEST_FAILED("sender used %llu msec of cpu", (unsigned long long)cpu_ms);
+
+	/* nobody reads: the send gives up at the deadline of the msg */
+	wave_ipc_msg_set_deadline(a, wave_ipc_now_ms() + 200);
+	start_ms = wave_ipc_now_ms();
+	ret = wave_ipc_send_msg(sockets[0], a, 0);
+	if (ret != WAVE_IPC_ERROR)
+		UNIT_TEST_FAILED("wave_ipc_send_msg to a full socket retuned %d", ret);
+	if (wave_ipc_now_ms() - start_ms > 1000)
+		UNIT_TEST_FAILED("send didn't stop at the deadline");
+
+	wave_ipc_msg_put(a);
+	close(sockets[0]);
+	close(sockets[1]);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (reader_started) {
+		close(sockets[1]);
+		sockets[1] = -1;
+		pthread_join(reader_thread, NULL);
+	}
+	if (a) wave_ipc_msg_put(a);
+	if (sockets[0] != -1) close(sockets[0]);
+	if (sockets[1] != -1) close(sockets[1]);
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(ipc_core)
 	ADD_TEST(1)
 	ADD_TEST(2)
@@ -519,4 +948,9 @@ UNIT_TEST_MODULE_DEFINE(ipc_core)
 	ADD_TEST(4)
 	ADD_TEST(5)
 	ADD_TEST(6)
+	ADD_TEST(7)
+	ADD_TEST(8)
+	ADD_TEST(9)
+	ADD_TEST(10)
+	ADD_TEST(11)
 UNIT_TEST_MODULE_DEFINITION_DONE
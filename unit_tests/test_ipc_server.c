@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/socket.h>
 
 static char cmd1[] = "DID YOU HEAR ABOUT UPDOG?";
 static char resp1[] = "NO, WHAT'S UP DOG?";
@@ -30,7 +31,7 @@ static char resp2[] = "OMG! Who's there ??????";
 
 static int __stop_cond = 0;
 
-static int cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta, uint8_t seq_num,
+static int cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta, uint32_t seq_num,
 		     wv_ipc_msg *cmd)
 {
 	char *data;
@@ -203,7 +204,371 @@ UNIT_TEST_CLEANUP_ON_ERRR
 	if (handle) wave_ipcs_delete(&handle);
 UNIT_TEST_DEFINITION_DONE
 
+#define NUM_FLOOD_EVENTS (1000)
+#define FLOOD_EVENT_SIZE (1024)
+
+static wv_ipstation * volatile __flood_sta = NULL;
+static volatile int __flood_sender_ret = 0;
+static volatile int __flood_num_events = 0;
+static volatile int __flood_out_of_order = 0;
+
+static int flood_adding_client(wv_ipserver *ipserv, wv_ipstation *sta)
+{
+	(void)ipserv;
+	wave_ipcs_sta_incref(sta);
+	__flood_sta = sta;
+	return 0;
+}
+
+static void* flood_sender_thread(void *arg)
+{
+	wv_ipserver *handle = (wv_ipserver*)arg;
+	char data[FLOOD_EVENT_SIZE];
+	int i, retries = 100;
+
+	while (__flood_sta == NULL && retries--)
+		usleep(10000);
+
+	if (__flood_sta == NULL) {
+		__flood_sender_ret = 1;
+		__stop_cond = 1;
+		return NULL;
+	}
+
+	/* the client doesn't read yet, so most events become pending */
+	for (i = 0; i < NUM_FLOOD_EVENTS; i++) {
+		wv_ipc_msg *event = wave_ipc_msg_alloc();
+
+		if (event == NULL) {
+			__flood_sender_ret = 1;
+			break;
+		}
+
+		memset(data, 0, sizeof(data));
+		memcpy(data, &i, sizeof(i));
+		wave_ipc_msg_fill_data(event, data, sizeof(data));
+		if (wave_ipcs_send_event_to(handle, event, __flood_sta) != WAVE_IPC_SUCCESS) {
+			ELOG("wave_ipcs_send_event_to failed i=%d", i);
+			__flood_sender_ret = 1;
+		}
+		wave_ipc_msg_put(event);
+	}
+
+	wave_ipcs_sta_decref(__flood_sta);
+	return NULL;
+}
+
+static int flood_event_clb(void *arg, wv_ipc_msg *event)
+{
+	int idx;
+
+	(void)arg;
+	memcpy(&idx, wave_ipc_msg_get_data(event), sizeof(idx));
+	if (idx != __flood_num_events)
+		__flood_out_of_order = 1;
+	__flood_num_events++;
+
+	return WAVE_IPC_EVENT_SUCCESS;
+}
+
+static int run_slow_event_client(void)
+{
+	wv_ipclient *handle = NULL;
+	int retries;
+
+	usleep(100000);
+
+	if (wave_ipcc_connect(&handle, "unitest_client", "unitest_server") != WAVE_IPC_SUCCESS) {
+		ELOG("wave_ipcc_connect returned error");
+		return 1;
+	}
+
+	/* let the server fill the socket and queue pending events */
+	usleep(500000);
+
+	if (wave_ipcc_start_listener(handle, flood_event_clb, NULL, NULL, NULL, NULL, 0)) {
+		ELOG("wave_ipcc_start_listener returned error");
+		wave_ipcc_disconnect(&handle);
+		return 1;
+	}
+
+	/* pending events are flushed as soon as the socket is writable, not
+	 * on a once a second resend */
+	retries = 150;
+	while (__flood_num_events < NUM_FLOOD_EVENTS && retries--)
+		usleep(10000);
+
+	wave_ipcc_stop_listener(handle);
+	wave_ipcc_disconnect(&handle);
+
+	if (__flood_num_events != NUM_FLOOD_EVENTS || __flood_out_of_order) {
+		ELOG("received %d events, out of order=%d",
+		     __flood_num_events, __flood_out_of_order);
+		return 1;
+	}
+
+	SLOG("succesfully received %d events from the server", NUM_FLOOD_EVENTS)
+	return 0;
+}
+
+UNIT_TEST_DEFINE(3, flush pending events to a slow client)
+
+	wv_ipc_ret ret;
+	wv_ipserver *handle = NULL;
+	wv_ipserver_callbacks clbs;
+	pthread_t sender;
+	int sender_started = 0;
+
+	UNIT_TEST_FORK
+	UNIT_TEST_FORKED_CHILD
+		exit(run_slow_event_client());
+	UNIT_TEST_FORKED_PARENET
+		memset(&clbs, 0, sizeof(wv_ipserver_callbacks));
+		clbs.cmd_async = cmd_async;
+		clbs.stop_cond = stop_cond;
+		clbs.adding_client = flood_adding_client;
+		clbs.removing_client = removing_client;
+
+		ret = wave_ipcs_create(&handle, "unitest_server");
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_create returned error");
+
+		__stop_cond = 0;
+		__flood_sta = NULL;
+		__flood_sender_ret = 0;
+		if (pthread_create(&sender, NULL, flood_sender_thread, handle))
+			UNIT_TEST_FAILED("pthread_create failed");
+		sender_started = 1;
+
+		ret = wave_ipcs_run(handle, &clbs);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_run returned error");
+
+		pthread_join(sender, NULL);
+		sender_started = 0;
+		if (__flood_sender_ret)
+			UNIT_TEST_FAILED("sender thread failed");
+
+		ret = wave_ipcs_delete(&handle);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_destroy returned error");
+		handle = NULL;
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (sender_started) pthread_join(sender, NULL);
+	if (handle) wave_ipcs_delete(&handle);
+UNIT_TEST_DEFINITION_DONE
+
+#define NUM_MULTI_SENDERS (4)
+#define NUM_MULTI_EVENTS (200)	/* per sender */
+#define MULTI_EVENT_SIZE (16001)	/* odd size, most writes to a full socket are partial */
+
+typedef struct {
+	wv_ipserver *handle;
+	int id;
+} multi_sender_arg;
+
+static int __multi_next_seq[NUM_MULTI_SENDERS];
+static volatile int __multi_num_events = 0;
+static volatile int __multi_corrupted = 0;
+
+static void* multi_sender_thread(void *arg)
+{
+	multi_sender_arg *sender = (multi_sender_arg*)arg;
+	char data[MULTI_EVENT_SIZE];
+	int i;
+
+	for (i = 0; i < NUM_MULTI_EVENTS; i++) {
+		wv_ipc_msg *event = wave_ipc_msg_alloc();
+
+		if (event == NULL) {
+			__flood_sender_ret = 1;
+			break;
+		}
+
+		memset(data, (sender->id * 31 + i) & 0xff, sizeof(data));
+		memcpy(data, &sender->id, sizeof(int));
+		memcpy(data + sizeof(int), &i, sizeof(int));
+		wave_ipc_msg_fill_data(event, data, sizeof(data));
+		if (wave_ipcs_send_event_to(sender->handle, event, __flood_sta) != WAVE_IPC_SUCCESS) {
+			ELOG("wave_ipcs_send_event_to failed sender=%d i=%d", sender->id, i);
+			__flood_sender_ret = 1;
+		}
+		wave_ipc_msg_put(event);
+	}
+
+	return NULL;
+}
+
+/* A small send buffer makes the kernel write the events in several chunks,
+ * so that sends to a full socket are partial */
+static int multi_adding_client(wv_ipserver *ipserv, wv_ipstation *sta)
+{
+	int fd, type, sndbuf = 4096;
+	socklen_t len;
+
+	for (fd = 3; fd < 256; fd++) {
+		len = sizeof(type);
+		if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 && type == SOCK_STREAM)
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	}
+
+	return flood_adding_client(ipserv, sta);
+}
+
+/* sends from several threads at once to the same station */
+static void* multi_senders_start(void *arg)
+{
+	pthread_t senders[NUM_MULTI_SENDERS];
+	multi_sender_arg args[NUM_MULTI_SENDERS];
+	int i, num_started = 0, retries = 100;
+
+	while (__flood_sta == NULL && retries--)
+		usleep(10000);
+
+	if (__flood_sta == NULL) {
+		__flood_sender_ret = 1;
+		__stop_cond = 1;
+		return NULL;
+	}
+
+	for (i = 0; i < NUM_MULTI_SENDERS; i++) {
+		args[i].handle = (wv_ipserver*)arg;
+		args[i].id = i;
+		if (pthread_create(&senders[i], NULL, multi_sender_thread, &args[i])) {
+			__flood_sender_ret = 1;
+			break;
+		}
+		num_started++;
+	}
+
+	for (i = 0; i < num_started; i++)
+		pthread_join(senders[i], NULL);
+
+	wave_ipcs_sta_decref(__flood_sta);
+	return NULL;
+}
+
+static int multi_event_clb(void *arg, wv_ipc_msg *event)
+{
+	unsigned char *data = (unsigned char*)wave_ipc_msg_get_data(event);
+	int id, seq;
+	size_t i;
+
+	(void)arg;
+	if (!data || wave_ipc_msg_get_size(event) != MULTI_EVENT_SIZE) {
+		__multi_corrupted = 1;
+		goto out;
+	}
+
+	memcpy(&id, data, sizeof(int));
+	memcpy(&seq, data + sizeof(int), sizeof(int));
+	if (id < 0 || id >= NUM_MULTI_SENDERS || seq != __multi_next_seq[id]) {
+		__multi_corrupted = 1;
+		goto out;
+	}
+	__multi_next_seq[id]++;
+
+	for (i = 2 * sizeof(int); i < MULTI_EVENT_SIZE; i++) {
+		if (data[i] != ((id * 31 + seq) & 0xff)) {
+			__multi_corrupted = 1;
+			break;
+		}
+	}
+
+out:
+	/* a slow reader keeps the station going in and out of blocking */
+	if (++__multi_num_events % 16 == 0)
+		usleep(1000);
+	return WAVE_IPC_EVENT_SUCCESS;
+}
+
+static int run_slow_multi_event_client(void)
+{
+	wv_ipclient *handle = NULL;
+	int retries;
+
+	usleep(100000);
+
+	if (wave_ipcc_connect(&handle, "unitest_client", "unitest_server") != WAVE_IPC_SUCCESS) {
+		ELOG("wave_ipcc_connect returned error");
+		return 1;
+	}
+
+	if (wave_ipcc_start_listener(handle, multi_event_clb, NULL, NULL, NULL, NULL, 0)) {
+		ELOG("wave_ipcc_start_listener returned error");
+		wave_ipcc_disconnect(&handle);
+		return 1;
+	}
+
+	retries = 300;
+	while (__multi_num_events < NUM_MULTI_SENDERS * NUM_MULTI_EVENTS &&
+	       !__multi_corrupted && retries--)
+		usleep(10000);
+
+	wave_ipcc_stop_listener(handle);
+	wave_ipcc_disconnect(&handle);
+
+	if (__multi_num_events != NUM_MULTI_SENDERS * NUM_MULTI_EVENTS || __multi_corrupted) {
+		ELOG("received %d events, corrupted=%d",
+		     __multi_num_events, __multi_corrupted);
+		return 1;
+	}
+
+	SLOG("succesfully received %d events from %d senders",
+	     NUM_MULTI_SENDERS * NUM_MULTI_EVENTS, NUM_MULTI_SENDERS)
+	return 0;
+}
+
+UNIT_TEST_DEFINE(4, events of several threads to a slow client)
+
+	wv_ipc_ret ret;
+	wv_ipserver *handle = NULL;
+	wv_ipserver_callbacks clbs;
+	pthread_t sender;
+	int sender_started = 0;
+
+	UNIT_TEST_FORK
+	UNIT_TEST_FORKED_CHILD
+		exit(run_slow_multi_event_client());
+	UNIT_TEST_FORKED_PARENET
+		memset(&clbs, 0, sizeof(wv_ipserver_callbacks));
+		clbs.cmd_async = cmd_async;
+		clbs.stop_cond = stop_cond;
+		clbs.adding_client = multi_adding_client;
+		clbs.removing_client = removing_client;
+
+		ret = wave_ipcs_create(&handle, "unitest_server");
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_create returned error");
+
+		__stop_cond = 0;
+		__flood_sta = NULL;
+		__flood_sender_ret = 0;
+		if (pthread_create(&sender, NULL, multi_senders_start, handle))
+			UNIT_TEST_FAILED("pthread_create failed");
+		sender_started = 1;
+
+		ret = wave_ipcs_run(handle, &clbs);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_run returned error");
+
+		pthread_join(sender, NULL);
+		sender_started = 0;
+		if (__flood_sender_ret)
+			UNIT_TEST_FAILED("sender threads failed");
+
+		ret = wave_ipcs_delete(&handle);
+		if (ret == WAVE_IPC_ERROR)
+			UNIT_TEST_FAILED("wave_ipcs_destroy returned error");
+		handle = NULL;
+UNIT_TEST_CLEANUP_ON_ERRR
+	if (sender_started) pthread_join(sender, NULL);
+	if (handle) wave_ipcs_delete(&handle);
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(ipc_server)
 	ADD_TEST(1)
 	ADD_TEST(2)
+	ADD_TEST(3)
+	ADD_TEST(4)
 UNIT_TEST_MODULE_DEFINITION_DONE
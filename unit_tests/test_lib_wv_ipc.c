@@ -13,6 +13,7 @@
 #include <string.h>
 
 int unit_test_module_linked_list(char *tests);
+int unit_test_module_hash_table(char *tests);
 int unit_test_module_obj_pool(char *tests);
 int unit_test_module_work_serializer(char *tests);
 int unit_test_module_ipc_core(char *tests);
@@ -29,6 +30,7 @@ int main(int argc, char *argv[])
 		ILOG( "starting test: %s", argv[i]);
 		if (!strcmp(argv[i], "all")) {
 			res += unit_test_module_linked_list(NULL);
+			res += unit_test_module_hash_table(NULL);
 			res += unit_test_module_obj_pool(NULL);
 			res += unit_test_module_work_serializer(NULL);
 			res += unit_test_module_ipc_core(NULL);
@@ -36,6 +38,8 @@ int main(int argc, char *argv[])
 			res += unit_test_module_ipc_server(NULL);
 		} else if (!strncmp(argv[i], "list", sizeof("list") - 1)) {
 			res += unit_test_module_linked_list(argv[i]);
+		} else if (!strncmp(argv[i], "hash", sizeof("hash") - 1)) {
+			res += unit_test_module_hash_table(argv[i]);
 		} else if (!strncmp(argv[i], "obj_pool", sizeof("obj_pool") - 1)) {
 			res += unit_test_module_obj_pool(argv[i]);
 		} else if (!strncmp(argv[i], "serializer", sizeof("serializer") - 1)) {
@@ -277,10 +277,74 @@ UNIT_TEST_CLEANUP_ON_ERRR
 		list_free(lst);
 UNIT_TEST_DEFINITION_DONE
 
+typedef struct _dl_test_obj {
+	int val;
+	dl_node link;
+} dl_test_obj;
+
+UNIT_TEST_DEFINE(6, intrusive list)
+	dl_list lst;
+	static dl_test_obj a[20000];
+	dl_node *n;
+	size_t i, size;
+	int expected;
+
+	dl_list_init(&lst);
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		a[i].val = i;
+		dl_node_init(&a[i].link);
+		dl_list_push_back(&lst, &a[i].link);
+	}
+
+	size = dl_list_get_size(&lst);
+	if (size != ARRAY_SIZE(a))
+		UNIT_TEST_FAILED("dl_list_get_size retuned %zu", size);
+
+	/* remove the odd values by their node */
+	for (i = 1; i < ARRAY_SIZE(a); i += 2) {
+		dl_list_remove(&lst, &a[i].link);
+		if (dl_node_is_linked(&a[i].link))
+			UNIT_TEST_FAILED("removed node is still linked, i=%zu", i);
+	}
+
+	size = dl_list_get_size(&lst);
+	if (size != ARRAY_SIZE(a) / 2)
+		UNIT_TEST_FAILED("dl_list_get_size retuned %zu", size);
+
+	expected = 0;
+	dl_list_foreach_start(&lst, obj, dl_test_obj, link)
+		if (obj->val != expected)
+			UNIT_TEST_FAILED("wrong value %d, expected %d", obj->val, expected);
+		expected += 2;
+		/* remove every 4th value while iterating */
+		if (obj->val % 4 == 0)
+			dl_list_foreach_remove_current_entry();
+	dl_list_foreach_end
+
+	size = dl_list_get_size(&lst);
+	if (size != ARRAY_SIZE(a) / 4)
+		UNIT_TEST_FAILED("dl_list_get_size retuned %zu", size);
+
+	dl_list_push_front(&lst, &a[0].link);
+	expected = 0;
+	while ((n = dl_list_pop_front(&lst)) != NULL) {
+		dl_test_obj *obj = dl_list_entry(n, dl_test_obj, link);
+
+		if (obj->val != expected)
+			UNIT_TEST_FAILED("dl_list_pop_front retuned %d, expected %d", obj->val, expected);
+		expected = expected ? expected + 4 : 2;
+	}
+
+	if (dl_list_get_size(&lst) != 0 || dl_list_peek_front(&lst))
+		UNIT_TEST_FAILED("list is not empty");
+UNIT_TEST_CLEANUP_ON_ERRR
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(linked_list)
 	ADD_TEST(1)
 	ADD_TEST(2)
 	ADD_TEST(3)
 	ADD_TEST(4)
 	ADD_TEST(5)
+	ADD_TEST(6)
 UNIT_TEST_MODULE_DEFINITION_DONE
@@ -11,6 +11,11 @@
 #include "obj_pool.h"
 #include "unitest_helper.h"
 
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+
 typedef struct _dummy_struct {
 	int a;
 	int b;
@@ -89,7 +94,312 @@ UNIT_TEST_CLEANUP_ON_ERRR
 		obj_pool_destroy(pool);
 UNIT_TEST_DEFINITION_DONE
 
+#define CACHE_TEST_NUM_THREADS (4)
+#define CACHE_TEST_NUM_OBJS (100)
+#define CACHE_TEST_NUM_ROUNDS (1000)
+
+typedef struct _cache_test_ctx {
+	obj_pool *pool;
+	dummy_struct *objs[CACHE_TEST_NUM_OBJS];
+	int failed;
+} cache_test_ctx;
+
+static void* cache_test_thread(void *arg)
+{
+	cache_test_ctx *ctx = (cache_test_ctx*)arg;
+	size_t i, j;
+
+	for (i = 0; i < CACHE_TEST_NUM_ROUNDS; i++) {
+		for (j = 0; j < CACHE_TEST_NUM_OBJS; j++) {
+			ctx->objs[j] = obj_pool_alloc_object(ctx->pool);
+			if (!ctx->objs[j]) {
+				ctx->failed = 1;
+				return NULL;
+			}
+			ctx->objs[j]->a = (int)j;
+		}
+
+		for (j = 0; j < CACHE_TEST_NUM_OBJS; j++) {
+			if (ctx->objs[j]->a != (int)j)
+				ctx->failed = 1;
+			obj_pool_put_object(ctx->pool, ctx->objs[j]);
+		}
+	}
+
+	/* leave objects to be released by another thread */
+	for (j = 0; j < CACHE_TEST_NUM_OBJS; j++) {
+		ctx->objs[j] = obj_pool_alloc_object(ctx->pool);
+		if (!ctx->objs[j])
+			ctx->failed = 1;
+	}
+
+	return NULL;
+}
+
+UNIT_TEST_DEFINE(3, per thread cache)
+
+	cache_test_ctx ctx[CACHE_TEST_NUM_THREADS];
+	pthread_t threads[CACHE_TEST_NUM_THREADS];
+	size_t i, j, num_started = 0;
+	obj_pool *pool;
+
+	memset(ctx, 0, sizeof(ctx));
+	pool = obj_pool_init("objpool 3", sizeof(dummy_struct), 1, 0, 1);
+	if (!pool)
+		UNIT_TEST_FAILED("obj_pool_init retuned NULL");
+
+	if (obj_pool_set_thread_cache(pool, 16))
+		UNIT_TEST_FAILED("obj_pool_set_thread_cache failed");
+
+	for (i = 0; i < CACHE_TEST_NUM_THREADS; i++) {
+		ctx[i].pool = pool;
+		if (pthread_create(&threads[i], NULL, cache_test_thread, &ctx[i]))
+			UNIT_TEST_FAILED("pthread_create failed, i=%zu", i);
+		num_started++;
+	}
+
+	for (i = 0; i < num_started; i++)
+		pthread_join(threads[i], NULL);
+	num_started = 0;
+
+	for (i = 0; i < CACHE_TEST_NUM_THREADS; i++) {
+		if (ctx[i].failed)
+			UNIT_TEST_FAILED("thread %zu failed", i);
+		for (j = 0; j < CACHE_TEST_NUM_OBJS; j++)
+			obj_pool_put_object(pool, ctx[i].objs[j]);
+	}
+
+	if (obj_pool_walk(pool, NULL))
+		UNIT_TEST_FAILED("pool has allocated objects");
+
+	if (obj_pool_destroy(pool))
+		UNIT_TEST_FAILED("obj_pool_destroy found unreturned objects");
+	pool = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	for (i = 0; i < num_started; i++)
+		pthread_join(threads[i], NULL);
+	if (pool)
+		obj_pool_destroy(pool);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(4, occupancy stats)
+	dummy_struct *a[10];
+	obj_pool_stats stats;
+	size_t i, num_allocated = 0;
+	obj_pool *pool;
+
+	pool = obj_pool_init("objpool 4", sizeof(dummy_struct), 4, 0, 1);
+	if (!pool)
+		UNIT_TEST_FAILED("obj_pool_init retuned NULL");
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size != 4 || stats.in_use != 0)
+		UNIT_TEST_FAILED("size=%zu in_use=%zu", stats.size, stats.in_use);
+
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		a[i] = obj_pool_alloc_object(pool);
+		if (!a[i])
+			UNIT_TEST_FAILED("obj_pool_alloc_object retuned NULL, i=%zu", i);
+		num_allocated++;
+	}
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size < ARRAY_SIZE(a) || stats.in_use != ARRAY_SIZE(a))
+		UNIT_TEST_FAILED("size=%zu in_use=%zu", stats.size, stats.in_use);
+
+	for (i = 0; i < ARRAY_SIZE(a); i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 0;
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.in_use != 0)
+		UNIT_TEST_FAILED("in_use=%zu", stats.in_use);
+
+	obj_pool_destroy(pool);
+	pool = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	for (i = 0; i < num_allocated; i++)
+		obj_pool_put_object(pool, a[i]);
+	if (pool)
+		obj_pool_destroy(pool);
+UNIT_TEST_DEFINITION_DONE
+
+static size_t __walked_objs = 0;
+
+static void count_walked_obj(obj_pool *pool, const OBJ object)
+{
+	(void)pool;
+	(void)object;
+	__walked_objs++;
+}
+
+#define TRIM_TEST_NUM_OBJS (100)
+
+UNIT_TEST_DEFINE(5, trim and statistics)
+	dummy_struct *a[TRIM_TEST_NUM_OBJS];
+	obj_pool_stats stats;
+	size_t i, size, trimmed, num_allocated = 0;
+	obj_pool *pool;
+
+	pool = obj_pool_init("objpool 5", sizeof(dummy_struct), 4, 0, 0);
+	if (!pool)
+		UNIT_TEST_FAILED("obj_pool_init retuned NULL");
+
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		a[i] = obj_pool_alloc_object(pool);
+		if (!a[i])
+			UNIT_TEST_FAILED("obj_pool_alloc_object retuned NULL, i=%zu", i);
+		num_allocated++;
+	}
+
+	/* the walk visits every allocated object once */
+	__walked_objs = 0;
+	if (obj_pool_walk(pool, count_walked_obj) != ARRAY_SIZE(a) ||
+	    __walked_objs != ARRAY_SIZE(a))
+		UNIT_TEST_FAILED("walked %zu objects", __walked_objs);
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.in_use != ARRAY_SIZE(a) || stats.peak_in_use != ARRAY_SIZE(a) ||
+	    stats.total_allocs != ARRAY_SIZE(a) || stats.grows == 0 || stats.trimmed)
+		UNIT_TEST_FAILED("in_use=%zu peak_in_use=%zu total_allocs=%llu grows=%llu",
+				 stats.in_use, stats.peak_in_use,
+				 (unsigned long long)stats.total_allocs,
+				 (unsigned long long)stats.grows);
+	size = stats.size;
+
+	/* only slabs of available objects are trimmed */
+	for (i = 10; i < ARRAY_SIZE(a); i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 10;
+
+	trimmed = obj_pool_trim(pool, 0);
+	if (trimmed == 0)
+		UNIT_TEST_FAILED("obj_pool_trim didn't free objects");
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size != size - trimmed || stats.size < 10 || stats.in_use != 10 ||
+	    stats.peak_in_use != ARRAY_SIZE(a) || stats.trimmed != trimmed)
+		UNIT_TEST_FAILED("size=%zu in_use=%zu trimmed=%llu", stats.size, stats.in_use,
+				 (unsigned long long)stats.trimmed);
+
+	for (i = 0; i < 10; i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 0;
+
+	/* a burst keeps the pool from being trimmed for one period */
+	if (obj_pool_set_auto_trim(pool, 8, 50))
+		UNIT_TEST_FAILED("obj_pool_set_auto_trim failed");
+
+	for (i = 0; i < 50; i++) {
+		a[i] = obj_pool_alloc_object(pool);
+		if (!a[i])
+			UNIT_TEST_FAILED("obj_pool_alloc_object retuned NULL, i=%zu", i);
+		num_allocated++;
+	}
+	for (i = 0; i < 50; i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 0;
+
+	usleep(80 * 1000);
+	obj_pool_put_object(pool, obj_pool_alloc_object(pool));
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size < 50)
+		UNIT_TEST_FAILED("pool was trimmed below its recent use, size=%zu", stats.size);
+
+	/* a period of low use trims it down to the floor */
+	usleep(80 * 1000);
+	obj_pool_put_object(pool, obj_pool_alloc_object(pool));
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size < 8 || stats.size >= 50)
+		UNIT_TEST_FAILED("pool wasn't trimmed to the floor, size=%zu", stats.size);
+
+	if (obj_pool_destroy(pool))
+		UNIT_TEST_FAILED("obj_pool_destroy found unreturned objects");
+	pool = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	for (i = 0; i < num_allocated; i++)
+		obj_pool_put_object(pool, a[i]);
+	if (pool)
+		obj_pool_destroy(pool);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(6, cache and page aligned slabs)
+	dummy_struct *a[100];
+	obj_pool_stats stats;
+	size_t i, num_allocated = 0;
+	obj_pool *pool;
+
+	pool = obj_pool_init_ex("objpool 6", sizeof(dummy_struct), 4, 0, 1,
+				OBJ_POOL_CACHE_ALIGNED);
+	if (!pool)
+		UNIT_TEST_FAILED("obj_pool_init_ex retuned NULL");
+
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		a[i] = obj_pool_alloc_object(pool);
+		if (!a[i])
+			UNIT_TEST_FAILED("obj_pool_alloc_object retuned NULL, i=%zu", i);
+		num_allocated++;
+		if ((uintptr_t)a[i] % 64)
+			UNIT_TEST_FAILED("object %zu isn't cache line aligned", i);
+		memset(a[i], 0xff, sizeof(dummy_struct));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(a); i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 0;
+
+	if (obj_pool_destroy(pool))
+		UNIT_TEST_FAILED("obj_pool_destroy found unreturned objects");
+
+	/* a page aligned slab fills its page with objects */
+	pool = obj_pool_init_ex("objpool 6 page", sizeof(dummy_struct), 4, 0, 1,
+				OBJ_POOL_PAGE_ALIGNED);
+	if (!pool)
+		UNIT_TEST_FAILED("obj_pool_init_ex retuned NULL");
+
+	if (obj_pool_get_stats(pool, &stats))
+		UNIT_TEST_FAILED("obj_pool_get_stats failed");
+	if (stats.size <= 4)
+		UNIT_TEST_FAILED("size=%zu", stats.size);
+
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		a[i] = obj_pool_alloc_object(pool);
+		if (!a[i])
+			UNIT_TEST_FAILED("obj_pool_alloc_object retuned NULL, i=%zu", i);
+		num_allocated++;
+		memset(a[i], 0xff, sizeof(dummy_struct));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(a); i++)
+		obj_pool_put_object(pool, a[i]);
+	num_allocated = 0;
+
+	if (obj_pool_destroy(pool))
+		UNIT_TEST_FAILED("obj_pool_destroy found unreturned objects");
+	pool = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	for (i = 0; i < num_allocated; i++)
+		obj_pool_put_object(pool, a[i]);
+	if (pool)
+		obj_pool_destroy(pool);
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(obj_pool)
 	ADD_TEST(1)
 	ADD_TEST(2)
+	ADD_TEST(3)
+	ADD_TEST(4)
+	ADD_TEST(5)
+	ADD_TEST(6)
 UNIT_TEST_MODULE_DEFINITION_DONE
@@ -15,6 +15,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 
 static int __sum1 = 0;
 static int __sum2 = 0;
@@ -60,6 +62,56 @@ static int do_work2(work_serializer *s, void *work_obj, void *ctx)
 	return 0;
 }
 
+static volatile int __block_started = 0;
+static volatile int __block_release = 0;
+
+static int do_block_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	(void)work_obj;
+	(void)ctx;
+	(void)s;
+
+	__block_started = 1;
+	while (!__block_release)
+		usleep(1000);
+
+	return 0;
+}
+
+/* A timer expires somewhere in [lo_us, hi_us], the times before and after
+ * adding it */
+typedef struct _timer_obj {
+	uint64_t lo_us;
+	uint64_t hi_us;
+} timer_obj;
+
+static volatile int __timers_fired = 0;
+static int __timers_misordered = 0;
+static uint64_t __last_timer_lo_us = 0;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int do_timer_work(work_serializer *s, void *work_obj, void *ctx)
+{
+	timer_obj *timer = (timer_obj*)work_obj;
+	(void)ctx;
+	(void)s;
+
+	/* fired too early, or surely after a timer which expires later */
+	if (now_us() < timer->lo_us || __last_timer_lo_us > timer->hi_us)
+		__timers_misordered++;
+
+	__last_timer_lo_us = timer->lo_us;
+	__timers_fired++;
+	return 0;
+}
+
 static int clean_work_obj(void *work_obj, void *ctx)
 {
 	integer_obj *work = (integer_obj*)work_obj;
@@ -68,17 +120,28 @@ static int clean_work_obj(void *work_obj, void *ctx)
 	return 0;
 }
 
+static int integer_obj_cmp(void *work_obj, void *key)
+{
+	return ((integer_obj*)work_obj)->num != *(int*)key;
+}
+
 enum {
 	TEST_WORK_1,
 	TEST_WORK_2,
+	TEST_WORK_BLOCK,
+	TEST_WORK_TIMER,
+	TEST_WORK_UNLIMITED,
 
 	/* keep last */
 	NUM_CMD_WORK_TYPES,
 };
 
 static work_ops_t cmd_work_ops[] = {
-	[TEST_WORK_1] = { do_work1, clean_work_obj, NULL },
+	[TEST_WORK_1] = { do_work1, clean_work_obj, integer_obj_cmp },
 	[TEST_WORK_2] = { do_work2, clean_work_obj, NULL },
+	[TEST_WORK_BLOCK] = { do_block_work, clean_work_obj, NULL },
+	[TEST_WORK_TIMER] = { do_timer_work, clean_work_obj, NULL },
+	[TEST_WORK_UNLIMITED] = { do_work1, clean_work_obj, NULL, 1 },
 };
 
 static int __num_work = 100000;
@@ -305,9 +368,456 @@ UNIT_TEST_DEFINE(4, from k threads: do work * N times)
 UNIT_TEST_CLEANUP_ON_ERRR
 UNIT_TEST_DEFINITION_DONE
 
+UNIT_TEST_DEFINE(5, queue statistics)
+	work_serializer *serializer = NULL;
+	serializer_stats stats;
+	integer_obj *integer;
+	int i, sleep_count = 0;
+
+	__sum1 = 0;
+	__block_started = 0;
+	__block_release = 0;
+
+	serializer = serializer_create(cmd_work_ops, NUM_CMD_WORK_TYPES, 1);
+	if (!serializer)
+		UNIT_TEST_FAILED("serializer start failed")
+
+	integer = (integer_obj*)malloc(sizeof(integer_obj));
+	if (!integer)
+		UNIT_TEST_FAILED("malloc");
+	if (serializer_exec_work_async(serializer, TEST_WORK_BLOCK, integer, NULL))
+		UNIT_TEST_FAILED("push block work returned err");
+
+	while (!__block_started) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	/* the serializer is blocked, the works stay queued */
+	for (i = 0; i < 10; i++) {
+		integer = (integer_obj*)malloc(sizeof(integer_obj));
+		if (!integer)
+			UNIT_TEST_FAILED("malloc");
+
+		integer->num = 1;
+		if (serializer_exec_work_async(serializer, TEST_WORK_1, integer, NULL))
+			UNIT_TEST_FAILED("push work returned err i=%d", i);
+	}
+
+	if (serializer_get_stats(serializer, &stats))
+		UNIT_TEST_FAILED("serializer_get_stats returned err");
+	if (stats.queued != 10 || stats.max_queued != 10 || stats.executed != 1)
+		UNIT_TEST_FAILED("queued=%zu max_queued=%zu executed=%llu", stats.queued,
+				 stats.max_queued, (unsigned long long)stats.executed);
+
+	__block_release = 1;
+	sleep_count = 0;
+	while (__sum1 != 10) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	if (serializer_get_stats(serializer, &stats))
+		UNIT_TEST_FAILED("serializer_get_stats returned err");
+	if (stats.queued != 0 || stats.max_queued != 10 || stats.executed != 11 ||
+	    stats.wait_max_us > stats.wait_total_us)
+		UNIT_TEST_FAILED("queued=%zu max_queued=%zu executed=%llu", stats.queued,
+				 stats.max_queued, (unsigned long long)stats.executed);
+
+	if (serializer_destroy(serializer))
+		UNIT_TEST_FAILED("serializer stop returned err")
+	serializer = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	__block_release = 1;
+	if (serializer)
+		serializer_destroy(serializer);
+UNIT_TEST_DEFINITION_DONE
+
+#define TEST_NUM_TIMERS	(2000)
+
+UNIT_TEST_DEFINE(6, many delayed works cancelled by handle)
+	static serializer_timer handles[TEST_NUM_TIMERS];
+	work_serializer *serializer = NULL;
+	serializer_stats stats;
+	integer_obj *integer;
+	timer_obj *timer;
+	unsigned delay_ms;
+	int i, sleep_count = 0;
+
+	__block_started = 0;
+	__block_release = 0;
+	__timers_fired = 0;
+	__timers_misordered = 0;
+	__last_timer_lo_us = 0;
+
+	serializer = serializer_create(cmd_work_ops, NUM_CMD_WORK_TYPES, 1);
+	if (!serializer)
+		UNIT_TEST_FAILED("serializer start failed")
+
+	integer = (integer_obj*)malloc(sizeof(integer_obj));
+	if (!integer)
+		UNIT_TEST_FAILED("malloc");
+	if (serializer_exec_work_async(serializer, TEST_WORK_BLOCK, integer, NULL))
+		UNIT_TEST_FAILED("push block work returned err");
+
+	while (!__block_started) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	/* much more timers than the old limit of the delayed list */
+	for (i = 0; i < TEST_NUM_TIMERS; i++) {
+		timer = (timer_obj*)malloc(sizeof(timer_obj));
+		if (!timer)
+			UNIT_TEST_FAILED("malloc");
+
+		delay_ms = (i * 7919) % 200;
+		timer->lo_us = now_us() + delay_ms * 1000;
+		if (serializer_add_delayed_work_ex(serializer, TEST_WORK_TIMER, timer, NULL,
+						   0, delay_ms, &handles[i]))
+			UNIT_TEST_FAILED("add delayed work returned err i=%d", i);
+		timer->hi_us = now_us() + delay_ms * 1000;
+	}
+
+	for (i = 1; i < TEST_NUM_TIMERS; i += 2) {
+		if (serializer_cancel_timer(serializer, handles[i]))
+			UNIT_TEST_FAILED("cancel timer returned err i=%d", i);
+		if (!serializer_cancel_timer(serializer, handles[i]))
+			UNIT_TEST_FAILED("timer i=%d was cancelled twice", i);
+	}
+
+	if (serializer_get_stats(serializer, &stats))
+		UNIT_TEST_FAILED("serializer_get_stats returned err");
+	if (stats.delayed != TEST_NUM_TIMERS / 2)
+		UNIT_TEST_FAILED("delayed=%zu", stats.delayed);
+
+	/* let the rest expire while the serializer is blocked, then they run in
+	 * the order of their expiry */
+	usleep(300 * 1000);
+	__block_release = 1;
+
+	sleep_count = 0;
+	while (__timers_fired != TEST_NUM_TIMERS / 2) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, fired=%d", __timers_fired);
+	}
+
+	if (__timers_misordered)
+		UNIT_TEST_FAILED("%d timers fired out of order", __timers_misordered);
+
+	if (!serializer_cancel_timer(serializer, handles[0]))
+		UNIT_TEST_FAILED("fired timer was cancelled");
+
+	if (serializer_destroy(serializer))
+		UNIT_TEST_FAILED("serializer stop returned err")
+	serializer = NULL;
+
+	if (__timers_fired != TEST_NUM_TIMERS / 2)
+		UNIT_TEST_FAILED("fired=%d", __timers_fired);
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	__block_release = 1;
+	if (serializer)
+		serializer_destroy(serializer);
+UNIT_TEST_DEFINITION_DONE
+
+static integer_obj * new_integer(int num)
+{
+	integer_obj *integer = (integer_obj*)malloc(sizeof(integer_obj));
+
+	if (integer)
+		integer->num = num;
+	return integer;
+}
+
+static void* blocked_pusher(void *obj)
+{
+	work_serializer *serializer = (work_serializer*)obj;
+	integer_obj *integer = new_integer(7);
+
+	if (integer == NULL)
+		return (void*)-1;
+
+	if (serializer_exec_work_async(serializer, TEST_WORK_1, integer, NULL)) {
+		free(integer);
+		return (void*)-1;
+	}
+
+	return NULL;
+}
+
+UNIT_TEST_DEFINE(7, overflow policies)
+	work_serializer *serializer = NULL;
+	serializer_stats stats;
+	integer_obj *integer = NULL;
+	struct timespec start, end;
+	pthread_t thread;
+	void *result;
+	int i, key, sleep_count = 0;
+
+	__sum1 = 0;
+	__block_started = 0;
+	__block_release = 0;
+
+	serializer = serializer_create(cmd_work_ops, NUM_CMD_WORK_TYPES, 1);
+	if (!serializer)
+		UNIT_TEST_FAILED("serializer start failed")
+
+	if (serializer_exec_work_async(serializer, TEST_WORK_BLOCK, new_integer(0), NULL))
+		UNIT_TEST_FAILED("push block work returned err");
+
+	while (!__block_started) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	/* the serializer is blocked, fill the queue: 1, 2, 3, 4 */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_DROP_NEWEST, 4, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+
+	for (i = 1; i <= 4; i++) {
+		if (serializer_exec_work_async(serializer, TEST_WORK_1, new_integer(i), NULL))
+			UNIT_TEST_FAILED("push work returned err i=%d", i);
+	}
+
+	integer = new_integer(1000);
+	if (!serializer_exec_work_async(serializer, TEST_WORK_1, integer, NULL))
+		UNIT_TEST_FAILED("newest work wasn't dropped");
+	free(integer);
+	integer = NULL;
+
+	/* 1 is dropped: 2, 3, 4, 5 */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_DROP_OLDEST, 4, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	if (serializer_exec_work_async(serializer, TEST_WORK_1, new_integer(5), NULL))
+		UNIT_TEST_FAILED("push work returned err");
+
+	/* 3 is replaced: 2, 20, 4, 5 */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_COALESCE, 4, 100))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	key = 3;
+	if (serializer_exec_work_async_key(serializer, TEST_WORK_1, new_integer(20), NULL, &key))
+		UNIT_TEST_FAILED("push coalesced work returned err");
+
+	/* nothing to coalesce with, blocks until the timeout */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	integer = new_integer(1000);
+	if (!serializer_exec_work_async_key(serializer, TEST_WORK_1, integer, NULL, &key))
+		UNIT_TEST_FAILED("work was queued to a full serializer");
+	free(integer);
+	integer = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if ((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 < 90)
+		UNIT_TEST_FAILED("producer didn't wait for the block timeout");
+
+	/* blocks until the serializer takes a work */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_BLOCK, 4, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	pthread_create(&thread, NULL, blocked_pusher, serializer);
+	usleep(50 * 1000);
+	__block_release = 1;
+
+	pthread_join(thread, &result);
+	if (result != NULL)
+		UNIT_TEST_FAILED("blocked pusher returned error");
+
+	sleep_count = 0;
+	while (__sum1 != 2 + 20 + 4 + 5 + 7) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, sum=%d", __sum1);
+	}
+
+	if (serializer_get_stats(serializer, &stats))
+		UNIT_TEST_FAILED("serializer_get_stats returned err");
+	if (stats.overflow_blocked != 2 || stats.overflow_dropped != 3 ||
+	    stats.overflow_coalesced != 1)
+		UNIT_TEST_FAILED("blocked=%llu dropped=%llu coalesced=%llu",
+				 (unsigned long long)stats.overflow_blocked,
+				 (unsigned long long)stats.overflow_dropped,
+				 (unsigned long long)stats.overflow_coalesced);
+
+	if (serializer_destroy(serializer))
+		UNIT_TEST_FAILED("serializer stop returned err")
+	serializer = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	__block_release = 1;
+	if (integer)
+		free(integer);
+	if (serializer)
+		serializer_destroy(serializer);
+UNIT_TEST_DEFINITION_DONE
+
+static void* serializer_destroyer(void *obj)
+{
+	return (void*)(intptr_t)serializer_destroy((work_serializer*)obj);
+}
+
+UNIT_TEST_DEFINE(8, destroy with a blocked producer)
+	work_serializer *serializer = NULL;
+	serializer_stats stats;
+	pthread_t pusher, destroyer;
+	int pusher_started = 0, destroyer_started = 0;
+	void *result;
+	int sleep_count = 0;
+
+	__block_started = 0;
+	__block_release = 0;
+
+	serializer = serializer_create(cmd_work_ops, NUM_CMD_WORK_TYPES, 1);
+	if (!serializer)
+		UNIT_TEST_FAILED("serializer start failed")
+
+	if (serializer_exec_work_async(serializer, TEST_WORK_BLOCK, new_integer(0), NULL))
+		UNIT_TEST_FAILED("push block work returned err");
+
+	while (!__block_started) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	/* the queue is full, the pusher blocks without a timeout */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_BLOCK, 1, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	if (serializer_exec_work_async(serializer, TEST_WORK_1, new_integer(1), NULL))
+		UNIT_TEST_FAILED("push work returned err");
+
+	pthread_create(&pusher, NULL, blocked_pusher, serializer);
+	pusher_started = 1;
+
+	sleep_count = 0;
+	do {
+		usleep(1000);
+		if (serializer_get_stats(serializer, &stats))
+			UNIT_TEST_FAILED("serializer_get_stats returned err");
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, pusher didn't block");
+	} while (stats.overflow_blocked != 1);
+
+	/* destroy waits for the running work, the pusher fails meanwhile */
+	pthread_create(&destroyer, NULL, serializer_destroyer, serializer);
+	destroyer_started = 1;
+
+	pthread_join(pusher, &result);
+	pusher_started = 0;
+	if (result == NULL)
+		UNIT_TEST_FAILED("blocked pusher queued to a destroyed serializer");
+
+	__block_release = 1;
+	pthread_join(destroyer, &result);
+	destroyer_started = 0;
+	serializer = NULL;
+	if (result != NULL)
+		UNIT_TEST_FAILED("serializer stop returned err");
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	__block_release = 1;
+	if (destroyer_started)
+		pthread_join(destroyer, NULL);
+	else if (serializer)
+		serializer_destroy(serializer);
+	if (pusher_started)
+		pthread_join(pusher, NULL);
+UNIT_TEST_DEFINITION_DONE
+
+UNIT_TEST_DEFINE(9, unlimited works on a full queue)
+	work_serializer *serializer = NULL;
+	serializer_stats stats;
+	integer_obj *integer = NULL;
+	struct timespec start, end;
+	int sleep_count = 0;
+
+	__sum1 = 0;
+	__block_started = 0;
+	__block_release = 0;
+
+	serializer = serializer_create(cmd_work_ops, NUM_CMD_WORK_TYPES, 1);
+	if (!serializer)
+		UNIT_TEST_FAILED("serializer start failed")
+
+	if (serializer_exec_work_async(serializer, TEST_WORK_BLOCK, new_integer(0), NULL))
+		UNIT_TEST_FAILED("push block work returned err");
+
+	while (!__block_started) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout");
+	}
+
+	/* full: 1 */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_BLOCK, 1, 100))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	if (serializer_exec_work_async(serializer, TEST_WORK_1, new_integer(1), NULL))
+		UNIT_TEST_FAILED("push work returned err");
+
+	/* queued at once: 1, 10, 20 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (serializer_exec_work_async(serializer, TEST_WORK_UNLIMITED, new_integer(10), NULL) ||
+	    serializer_exec_work_async(serializer, TEST_WORK_UNLIMITED, new_integer(20), NULL))
+		UNIT_TEST_FAILED("unlimited work wasn't queued to a full serializer");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if ((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 >= 90)
+		UNIT_TEST_FAILED("unlimited work waited for room");
+
+	/* only limited works are evicted: 10, 20, 2 */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_DROP_OLDEST, 1, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	if (serializer_exec_work_async(serializer, TEST_WORK_1, new_integer(2), NULL))
+		UNIT_TEST_FAILED("push work returned err");
+
+	/* still full for limited works */
+	if (serializer_set_overflow_policy(serializer, SERIALIZER_OVERFLOW_DROP_NEWEST, 1, 0))
+		UNIT_TEST_FAILED("set overflow policy returned err");
+	integer = new_integer(1000);
+	if (!serializer_exec_work_async(serializer, TEST_WORK_1, integer, NULL))
+		UNIT_TEST_FAILED("work was queued to a full serializer");
+	free(integer);
+	integer = NULL;
+
+	__block_release = 1;
+
+	sleep_count = 0;
+	while (__sum1 != 10 + 20 + 2) {
+		usleep(1000);
+		if (++sleep_count > 6000)
+			UNIT_TEST_FAILED("timeout, sum=%d", __sum1);
+	}
+
+	if (serializer_get_stats(serializer, &stats))
+		UNIT_TEST_FAILED("serializer_get_stats returned err");
+	if (stats.overflow_blocked != 0 || stats.overflow_dropped != 2)
+		UNIT_TEST_FAILED("blocked=%llu dropped=%llu",
+				 (unsigned long long)stats.overflow_blocked,
+				 (unsigned long long)stats.overflow_dropped);
+
+	if (serializer_destroy(serializer))
+		UNIT_TEST_FAILED("serializer stop returned err")
+	serializer = NULL;
+
+UNIT_TEST_CLEANUP_ON_ERRR
+	__block_release = 1;
+	if (integer)
+		free(integer);
+	if (serializer)
+		serializer_destroy(serializer);
+UNIT_TEST_DEFINITION_DONE
+
 UNIT_TEST_MODULE_DEFINE(work_serializer)
 	ADD_TEST(1)
 	ADD_TEST(2)
 	ADD_TEST(3)
 	ADD_TEST(4)
+	ADD_TEST(5)
+	ADD_TEST(6)
+	ADD_TEST(7)
+	ADD_TEST(8)
+	ADD_TEST(9)
 UNIT_TEST_MODULE_DEFINITION_DONE
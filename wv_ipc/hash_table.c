@@ -0,0 +1,254 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#include "hash_table.h"
+#include "logs.h"
+#include "obj_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_TABLE_MIN_BUCKETS	(8)
+
+static hash_entry ** hash_table_alloc_buckets(size_t num_buckets)
+{
+	return (hash_entry**)calloc(num_buckets, sizeof(hash_entry*));
+}
+
+hash_table * hash_table_init(size_t num_buckets, hash_func hash, hash_key_cmp cmp)
+{
+	hash_table *ht;
+	size_t n = HASH_TABLE_MIN_BUCKETS;
+
+	if (hash == NULL || cmp == NULL)
+		return NULL;
+
+	/* keep the number of buckets a power of 2 */
+	while (n < num_buckets)
+		n <<= 1;
+
+	if ((ht = malloc(sizeof(hash_table))) == NULL)
+		return NULL;
+
+	memset(ht, 0, sizeof(hash_table));
+	ht->hash = hash;
+	ht->cmp = cmp;
+	ht->num_buckets = n;
+
+	ht->buckets = hash_table_alloc_buckets(n);
+	if (ht->buckets == NULL)
+		goto err;
+
+	ht->entry_pool = obj_pool_init("hash entry", sizeof(hash_entry), 4, 0, 0);
+	if (ht->entry_pool == NULL)
+		goto err;
+
+	return ht;
+
+err:
+	free(ht->buckets);
+	free(ht);
+	return NULL;
+}
+
+void hash_table_free(hash_table *ht)
+{
+	if (ht == NULL) return;
+
+	hash_table_walk(ht, NULL, NULL);
+	obj_pool_destroy(ht->entry_pool);
+	free(ht->buckets);
+	free(ht);
+}
+
+/* Doubling the table keeps chains short, failure just leaves them longer */
+static void hash_table_grow(hash_table *ht)
+{
+	size_t i, new_num_buckets = ht->num_buckets << 1;
+	hash_entry **new_buckets;
+
+	new_buckets = hash_table_alloc_buckets(new_num_buckets);
+	if (new_buckets == NULL)
+		return;
+
+	for (i = 0; i < ht->num_buckets; i++) {
+		hash_entry *e = ht->buckets[i];
+
+		while (e) {
+			hash_entry *next = e->next;
+			size_t idx = e->hash & (new_num_buckets - 1);
+
+			e->next = new_buckets[idx];
+			new_buckets[idx] = e;
+			e = next;
+		}
+	}
+
+	free(ht->buckets);
+	ht->buckets = new_buckets;
+	ht->num_buckets = new_num_buckets;
+}
+
+static hash_entry ** hash_table_lookup(hash_table *ht, const void *key, size_t hash)
+{
+	hash_entry **pe = &ht->buckets[hash & (ht->num_buckets - 1)];
+
+	while (*pe) {
+		if ((*pe)->hash == hash && !ht->cmp((*pe)->key, key))
+			break;
+		pe = &(*pe)->next;
+	}
+
+	return pe;
+}
+
+int hash_table_insert(hash_table *ht, const void *key, void *obj)
+{
+	hash_entry *e, **pe;
+	size_t hash;
+
+	if (ht == NULL || key == NULL || obj == NULL) return 1;
+
+	hash = ht->hash(key);
+	pe = hash_table_lookup(ht, key, hash);
+	if (*pe) {
+		BUG("key already exists in hash table");
+		return 1;
+	}
+
+	e = (hash_entry*)obj_pool_alloc_object(ht->entry_pool);
+	if (e == NULL) return 1;
+
+	e->key = key;
+	e->obj = obj;
+	e->hash = hash;
+	e->next = NULL;
+	*pe = e;
+	ht->size++;
+
+	if (ht->size > ht->num_buckets)
+		hash_table_grow(ht);
+
+	return 0;
+}
+
+void* hash_table_find(hash_table *ht, const void *key)
+{
+	hash_entry *e;
+
+	if (ht == NULL || key == NULL) return NULL;
+
+	e = *hash_table_lookup(ht, key, ht->hash(key));
+	return e ? e->obj : NULL;
+}
+
+void* hash_table_remove(hash_table *ht, const void *key)
+{
+	hash_entry *e, **pe;
+	void *obj;
+
+	if (ht == NULL || key == NULL) return NULL;
+
+	pe = hash_table_lookup(ht, key, ht->hash(key));
+	if ((e = *pe) == NULL)
+		return NULL;
+
+	*pe = e->next;
+	obj = e->obj;
+	obj_pool_put_object(ht->entry_pool, e);
+	ht->size--;
+
+	return obj;
+}
+
+size_t hash_table_get_size(hash_table *ht)
+{
+	return ht ? ht->size : 0;
+}
+
+size_t hash_table_walk(hash_table *ht, hash_walk_cb cb, void *arg)
+{
+	size_t i, removed = 0;
+
+	if (ht == NULL) return 0;
+
+	for (i = 0; i < ht->num_buckets; i++) {
+		hash_entry **pe = &ht->buckets[i];
+
+		while (*pe) {
+			hash_entry *e = *pe;
+
+			/* no callback: remove all */
+			if (cb && !cb(e->obj, arg)) {
+				pe = &e->next;
+				continue;
+			}
+
+			*pe = e->next;
+			obj_pool_put_object(ht->entry_pool, e);
+			ht->size--;
+			removed++;
+		}
+	}
+
+	return removed;
+}
+
+/* FNV-1a */
+size_t hash_str(const void *key)
+{
+	const unsigned char *s = (const unsigned char*)key;
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= *s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+int hash_str_cmp(const void *key1, const void *key2)
+{
+	return strcmp((const char*)key1, (const char*)key2);
+}
+
+size_t hash_u32(const void *key)
+{
+	uint32_t h = *(const uint32_t*)key;
+
+	/* mix the bits, the ids are often small and sequential */
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+
+	return h;
+}
+
+int hash_u32_cmp(const void *key1, const void *key2)
+{
+	return (*(const uint32_t*)key1 != *(const uint32_t*)key2);
+}
+
+size_t hash_u64(const void *key)
+{
+	uint64_t h = *(const uint64_t*)key;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+
+	return (size_t)h;
+}
+
+int hash_u64_cmp(const void *key1, const void *key2)
+{
+	return (*(const uint64_t*)key1 != *(const uint64_t*)key2);
+}
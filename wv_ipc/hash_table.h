@@ -0,0 +1,72 @@
+/******************************************************************************
+
+         Copyright (c) 2020, MaxLinear, Inc.
+         Copyright 2016 - 2020 Intel Corporation
+
+  For licensing information, see the file 'LICENSE' in the root folder of
+  this software module.
+
+*******************************************************************************/
+
+#ifndef __WAVE_HASH_TABLE__H__
+#define __WAVE_HASH_TABLE__H__
+
+#include "obj_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Chained hash table mapping a key to an object. The table doesn't copy keys,
+ * a key must stay valid as long as its entry exists (usually it is a field of
+ * the stored object). The table grows when it becomes loaded, it is not thread
+ * safe */
+
+typedef size_t (*hash_func)(const void *key);
+/* returns 0 if the keys are equal */
+typedef int (*hash_key_cmp)(const void *key1, const void *key2);
+/* returns non zero to remove the current entry from the table */
+typedef int (*hash_walk_cb)(void *obj, void *arg);
+
+typedef struct _hash_entry {
+	const void *key;
+	void *obj;
+	size_t hash;
+	struct _hash_entry *next;
+} hash_entry;
+
+typedef struct _hash_table {
+	obj_pool *entry_pool;
+	hash_entry **buckets;
+	size_t num_buckets;
+	size_t size;
+	hash_func hash;
+	hash_key_cmp cmp;
+} hash_table;
+
+hash_table * hash_table_init(size_t num_buckets, hash_func hash, hash_key_cmp cmp);
+
+void hash_table_free(hash_table *ht);
+
+/* Fails if the key already exists */
+int hash_table_insert(hash_table *ht, const void *key, void *obj);
+
+void* hash_table_find(hash_table *ht, const void *key);
+
+/* Returns the removed object or NULL if the key doesn't exist */
+void* hash_table_remove(hash_table *ht, const void *key);
+
+size_t hash_table_get_size(hash_table *ht);
+
+/* Calls 'cb' for every object, entries for which 'cb' returns non zero are
+ * removed. Returns the number of removed entries */
+size_t hash_table_walk(hash_table *ht, hash_walk_cb cb, void *arg);
+
+/* Helpers for the common key types */
+size_t hash_str(const void *key);
+int hash_str_cmp(const void *key1, const void *key2);
+size_t hash_u32(const void *key);
+int hash_u32_cmp(const void *key1, const void *key2);
+size_t hash_u64(const void *key);
+int hash_u64_cmp(const void *key1, const void *key2);
+
+#endif /* __WAVE_HASH_TABLE__H__ */
@@ -102,4 +102,104 @@ void* list_find_first(l_list *lst, int(*cmp)(void *obj, void *arg), void *arg);
 		_free_cb(__curr);						\
 } while(0)
 
+/* Intrusive doubly linked list. The links (dl_node) are embedded in the listed
+ * object, so no node is allocated and a known entry is unlinked in O(1).
+ * An object is on at most one list per embedded dl_node */
+typedef struct _dl_node {
+	struct _dl_node *prev;
+	struct _dl_node *next;
+} dl_node;
+
+typedef struct _dl_list {
+	dl_node head;
+	size_t size;
+} dl_list;
+
+#define dl_list_entry(_node, _type, _member) \
+	((_type*)((char*)(_node) - offsetof(_type, _member)))
+
+static inline void dl_list_init(dl_list *lst)
+{
+	lst->head.prev = &lst->head;
+	lst->head.next = &lst->head;
+	lst->size = 0;
+}
+
+/* A node which isn't on a list */
+static inline void dl_node_init(dl_node *n)
+{
+	n->prev = NULL;
+	n->next = NULL;
+}
+
+static inline int dl_node_is_linked(const dl_node *n)
+{
+	return n->next != NULL;
+}
+
+static inline size_t dl_list_get_size(const dl_list *lst)
+{
+	return lst->size;
+}
+
+static inline void dl_list_insert_after(dl_list *lst, dl_node *pos, dl_node *n)
+{
+	n->prev = pos;
+	n->next = pos->next;
+	pos->next->prev = n;
+	pos->next = n;
+	lst->size++;
+}
+
+static inline void dl_list_push_front(dl_list *lst, dl_node *n)
+{
+	dl_list_insert_after(lst, &lst->head, n);
+}
+
+static inline void dl_list_push_back(dl_list *lst, dl_node *n)
+{
+	dl_list_insert_after(lst, lst->head.prev, n);
+}
+
+/* 'n' must be on 'lst' */
+static inline void dl_list_remove(dl_list *lst, dl_node *n)
+{
+	n->prev->next = n->next;
+	n->next->prev = n->prev;
+	dl_node_init(n);
+	lst->size--;
+}
+
+static inline dl_node* dl_list_peek_front(dl_list *lst)
+{
+	return (lst->head.next != &lst->head) ? lst->head.next : NULL;
+}
+
+static inline dl_node* dl_list_pop_front(dl_list *lst)
+{
+	dl_node *n = dl_list_peek_front(lst);
+
+	if (n)
+		dl_list_remove(lst, n);
+	return n;
+}
+
+/* Same as list_foreach_start(), for the objects of type '_type' linked by
+ * their '_member' node. Only the current entry may be removed while iterating */
+#define dl_list_foreach_start(_list, _obj, _type, _member) {		\
+	dl_list *__dl_list = _list;					\
+	dl_node *__dl_curr, *__dl_next;					\
+	_type * _obj;							\
+	for (__dl_curr = __dl_list->head.next;				\
+	     __dl_curr != &__dl_list->head; __dl_curr = __dl_next) {	\
+		__dl_next = __dl_curr->next;				\
+		_obj = dl_list_entry(__dl_curr, _type, _member);
+
+#define dl_list_foreach_remove_current_entry()			\
+	dl_list_remove(__dl_list, __dl_curr)
+
+#define dl_list_foreach_end					\
+	}							\
+}
+
 #endif /* __WAVE_LIST__H__ */
@@ -14,6 +14,8 @@
 #include <stdbool.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #include "logs.h"
 
 #if defined(__GNUC__) && !defined(likely)
@@ -36,32 +38,118 @@
 	const typeof(((type *)0)->member) * __mptr = (ptr);	\
 	(type *)((char *)__mptr - offsetof(type, member)); })
 
-typedef struct __attribute__((__packed__)) _pooled_obj {
+#define ROUND_UP(x, align) (((x) + (align) - 1) / (align) * (align))
+
+#define OBJ_CACHE_LINE_SIZE (64)
+
+/* data is aligned like malloc() memory: objects may hold atomics, mutexes
+ * and condition variables */
+typedef struct _pooled_obj {
 	struct _pooled_obj *next;
-	struct _pooled_obj *all_next;
-	struct _obj_pool *pool;
-	uint8_t allocated;
-	uint8_t data[];
+	struct _obj_slab *slab;
+	uint8_t allocated;               /* OBJ_* */
+	uint8_t data[] __attribute__((aligned(__BIGGEST_ALIGNMENT__)));
 } pooled_obj;
 
+#define OBJ_AVAILABLE	(0)
+#define OBJ_ALLOCATED	(1)
+
+/* Objects are carved out of slabs, one slab per growth of the pool. A slab is
+ * freed only by a trim, once all of its objects are available */
+typedef struct _obj_slab {
+	struct _obj_slab *next;         /* List of all slabs of the pool */
+	struct _obj_pool *pool;
+	size_t num_objects;
+	size_t num_available;           /* counted by trims */
+	uint8_t objects[] __attribute__((aligned(__BIGGEST_ALIGNMENT__)));
+} obj_slab;
+
+/* Per-thread cache (magazine) of available objects */
+typedef struct _obj_cache {
+	struct _obj_cache *next;        /* List of all caches of the pool */
+	struct _obj_pool *pool;
+	pooled_obj *objects;
+	size_t num_objects;
+} obj_cache;
+
 struct _obj_pool {
 	pooled_obj *available_objects;  /* List of available objects */
-	pooled_obj *all_objects;        /* List of all objects (for debugging) */
+	obj_slab *slabs;                /* List of all slabs, newest first */
 	const char* name;
 	volatile bool destroy_started;
 	object_cb  callback;
 
 	size_t object_byte_size;
+	size_t obj_stride;              /* distance between objects of a slab */
+	size_t obj_offset;              /* of the header in its stride, aligns data */
+	size_t slab_align;              /* alignment of slabs and objects */
+	size_t slab_hdr_size;           /* offset of the first object of a slab */
+	unsigned int flags;
 	size_t min_size;
 	size_t max_size;
 	size_t curr_size;
 
 	size_t num_traveling_objects;
 
+	/* statistics, the counters of allocations are updated outside of
+	 * alloc_lock with per-thread caches */
+	size_t peak_in_use;
+	uint64_t total_allocs;
+	uint64_t grows;
+	uint64_t trimmed;
+
+	/* auto trim, 0 trim_idle_ms if disabled. window_peak is the max number
+	 * of objects in use since trim_window_start */
+	size_t trim_floor;
+	unsigned int trim_idle_ms;
+	uint64_t trim_window_start;
+	size_t window_peak;
+
 	int thread_safety_needed;
 	pthread_mutex_t alloc_lock;
+
+	size_t cache_size;              /* 0 if per-thread caches are disabled */
+	pthread_key_t cache_key;
+	obj_cache *caches;              /* List of all thread caches */
 };
 
+/* With per-thread caches enabled the counter is updated outside of alloc_lock */
+#define SLAB_OBJ(__p, __slab, __i) \
+	((pooled_obj*)((uint8_t*)(__slab) + (__p)->slab_hdr_size + \
+		       (__i) * (__p)->obj_stride + (__p)->obj_offset))
+
+#define TRAVELING_OBJECTS_INC(__p) \
+	__atomic_add_fetch(&(__p)->num_traveling_objects, 1, __ATOMIC_RELAXED)
+#define TRAVELING_OBJECTS_DEC(__p) \
+	__atomic_sub_fetch(&(__p)->num_traveling_objects, 1, __ATOMIC_RELAXED)
+
+static inline void obj_pool_update_max(size_t *max, size_t val)
+{
+	size_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur &&
+	       !__atomic_compare_exchange_n(max, &cur, val, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void obj_pool_account_alloc(obj_pool *pool)
+{
+	size_t in_use = TRAVELING_OBJECTS_INC(pool);
+
+	__atomic_add_fetch(&pool->total_allocs, 1, __ATOMIC_RELAXED);
+	obj_pool_update_max(&pool->peak_in_use, in_use);
+	if (pool->trim_idle_ms)
+		obj_pool_update_max(&pool->window_peak, in_use);
+}
+
+static uint64_t obj_pool_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 void obj_pool_set_callback(obj_pool *pool, object_cb cb)
 {
 	if (pool == NULL) return;
@@ -75,40 +163,51 @@ const char* obj_pool_get_name(obj_pool *pool)
 
 size_t obj_pool_destroy(obj_pool *pool)
 {
-	struct _pooled_obj *obj;
-	size_t ret;
+	obj_slab *slab;
+	size_t i, ret;
 
 	if (pool == NULL) return 0;
 	pool->destroy_started = true;
 
-#ifdef OBJPOOL_DEBUG
-	int counter = 1;
-#endif
 	DEBUG("[pool:%s] destroy pool", pool->name);
 
-	while ((obj = pool->available_objects)) {
-		DEBUG("%i: pool:%s, pool->available_objects=%p, obj->next=%p",
-		      counter++, pool->name, pool->available_objects, obj->next);
-		pool->available_objects = obj->next;
-		free(obj);
+	/* cached objects are freed with their slabs */
+	if (pool->cache_size) {
+		obj_cache *cache;
+
+		pthread_key_delete(pool->cache_key);
+		while ((cache = pool->caches)) {
+			pool->caches = cache->next;
+			free(cache);
+		}
 	}
 
 	if (pool->thread_safety_needed)
 		pthread_mutex_destroy(&pool->alloc_lock);
 
 	ret = pool->num_traveling_objects;
-	if (ret) {
+	if (ret)
 		BUG("%s: obj pool '%s' has %zu unreturned objects",
 			__FUNCTION__, pool->name, ret);
 
-		/* Traverse all unreleased objects and call callback fucntions */
-		if (pool->callback) {
-			obj = pool->all_objects;
-			while (obj) {
+	/* slabs with unreleased objects are left allocated, callback is called
+	 * for each of these objects */
+	while ((slab = pool->slabs)) {
+		bool leaked = false;
+
+		pool->slabs = slab->next;
+		for (i = 0; ret && i < slab->num_objects; i++) {
+			pooled_obj *obj = SLAB_OBJ(pool, slab, i);
+
+			if (obj->allocated != OBJ_ALLOCATED)
+				continue;
+			leaked = true;
+			if (pool->callback)
 				pool->callback(pool, &obj->data);
-				obj = obj->next;
-			}
 		}
+
+		if (!leaked)
+			free(slab);
 	}
 	free(pool);
 
@@ -117,10 +216,9 @@ size_t obj_pool_destroy(obj_pool *pool)
 
 static int obj_pool_increase_size_to(obj_pool *pool, size_t new_size)
 {
-	size_t i, old_size = pool->curr_size;
-#ifdef OBJPOOL_DEBUG
-	int counter = 1;
-#endif
+	size_t i, slab_bytes, num, old_size = pool->curr_size;
+	obj_slab *slab;
+	void *mem;
 
 	if (new_size <= old_size) return 1;
 	if (pool->max_size)
@@ -130,22 +228,41 @@ static int obj_pool_increase_size_to(obj_pool *pool, size_t new_size)
 			new_size = pool->max_size;
 		}
 
-	DEBUG("[pool:%s] old_size:%u, new_size:%u", pool->name, old_size, new_size);
-	for (i = old_size; i < new_size; i++) {
-		pooled_obj *obj = malloc(sizeof(pooled_obj) +
-					 pool->object_byte_size);
-		if (obj == NULL) return 1;
+	num = new_size - old_size;
+	slab_bytes = pool->slab_hdr_size + num * pool->obj_stride;
 
-		obj->allocated = 0;
-		obj->pool = pool;
+	/* page aligned slabs take whole pages, the tail is filled with objects */
+	if (pool->flags & OBJ_POOL_PAGE_ALIGNED) {
+		slab_bytes = ROUND_UP(slab_bytes, pool->slab_align);
+		num = (slab_bytes - pool->slab_hdr_size) / pool->obj_stride;
+		if (pool->max_size && old_size + num > pool->max_size)
+			num = pool->max_size - old_size;
+	}
+
+	DEBUG("[pool:%s] old_size:%zu, new_size:%zu", pool->name, old_size, old_size + num);
+	if (pool->slab_align > __BIGGEST_ALIGNMENT__) {
+		if (posix_memalign(&mem, pool->slab_align, slab_bytes))
+			return 1;
+	} else if ((mem = malloc(slab_bytes)) == NULL)
+		return 1;
+
+	slab = (obj_slab*)mem;
+	slab->pool = pool;
+	slab->num_objects = num;
+	slab->num_available = 0;
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	/* pushed backwards, objects are handed out in the order of addresses */
+	for (i = num; i > 0; i--) {
+		pooled_obj *obj = SLAB_OBJ(pool, slab, i - 1);
+
+		obj->allocated = OBJ_AVAILABLE;
+		obj->slab = slab;
 		obj->next = pool->available_objects;
 		pool->available_objects = obj;
-		obj->all_next = pool->all_objects;
-		pool->all_objects = obj;
-		pool->curr_size++;
-		DEBUG("%i: pool->available_objects:%p, obj->next:%p",
-		      counter++, pool->available_objects, obj->next);
 	}
+	pool->curr_size += num;
 
 	return 0;
 }
@@ -153,6 +270,14 @@ static int obj_pool_increase_size_to(obj_pool *pool, size_t new_size)
 obj_pool* obj_pool_init(const char *pool_name, size_t object_byte_size,
 			size_t min_size, size_t max_size,
 			int thread_safety_needed)
+{
+	return obj_pool_init_ex(pool_name, object_byte_size, min_size, max_size,
+				thread_safety_needed, 0);
+}
+
+obj_pool* obj_pool_init_ex(const char *pool_name, size_t object_byte_size,
+			   size_t min_size, size_t max_size,
+			   int thread_safety_needed, unsigned int flags)
 {
 	obj_pool *pool = NULL;
 
@@ -165,6 +290,20 @@ obj_pool* obj_pool_init(const char *pool_name, size_t object_byte_size,
 
 	pool->name = pool_name;
 	pool->object_byte_size = object_byte_size;
+	pool->flags = flags;
+	pool->slab_align = __BIGGEST_ALIGNMENT__;
+	if (flags & OBJ_POOL_CACHE_ALIGNED)
+		pool->slab_align = OBJ_CACHE_LINE_SIZE;
+	pool->obj_offset = ROUND_UP(offsetof(pooled_obj, data), pool->slab_align) -
+			   offsetof(pooled_obj, data);
+	pool->obj_stride = ROUND_UP(pool->obj_offset + offsetof(pooled_obj, data) +
+				    object_byte_size, pool->slab_align);
+	pool->slab_hdr_size = ROUND_UP(sizeof(obj_slab), pool->slab_align);
+	if (flags & OBJ_POOL_PAGE_ALIGNED) {
+		long page_size = sysconf(_SC_PAGESIZE);
+
+		pool->slab_align = (page_size > 0) ? (size_t)page_size : 4096;
+	}
 	pool->available_objects = NULL;
 	pool->min_size = min_size;
 	pool->max_size = max_size;
@@ -192,9 +331,237 @@ if (thread_safety_needed) \
 if (thread_safety_needed) \
 	{ pthread_mutex_unlock(&__p->alloc_lock); }
 
+/* Must be called with alloc_lock held. Frees available objects of the shared
+ * list (not of thread caches) while the pool is bigger than 'target' */
+static size_t obj_pool_trim_locked(obj_pool *pool, size_t target)
+{
+	pooled_obj *obj, **pp;
+	obj_slab *slab, **sp;
+	size_t num = 0;
+
+	if (target < pool->min_size)
+		target = pool->min_size;
+
+	if (pool->curr_size <= target || pool->available_objects == NULL)
+		return 0;
+
+	/* only slabs with all objects in the shared list can be freed. Such
+	 * slabs are marked by num_available > num_objects */
+	for (slab = pool->slabs; slab; slab = slab->next)
+		slab->num_available = 0;
+	for (obj = pool->available_objects; obj; obj = obj->next)
+		obj->slab->num_available++;
+
+	for (slab = pool->slabs; slab; slab = slab->next) {
+		if (slab->num_available != slab->num_objects ||
+		    pool->curr_size - num - slab->num_objects < target)
+			continue;
+		slab->num_available++;
+		num += slab->num_objects;
+	}
+
+	if (num == 0)
+		return 0;
+
+	pp = &pool->available_objects;
+	while ((obj = *pp)) {
+		if (obj->slab->num_available > obj->slab->num_objects)
+			*pp = obj->next;
+		else
+			pp = &obj->next;
+	}
+
+	sp = &pool->slabs;
+	while ((slab = *sp)) {
+		if (slab->num_available > slab->num_objects) {
+			*sp = slab->next;
+			free(slab);
+		} else
+			sp = &slab->next;
+	}
+
+	pool->curr_size -= num;
+	pool->trimmed += num;
+	DEBUG("[pool:%s] trimmed %zu objects", pool->name, num);
+
+	return num;
+}
+
+/* Must be called with alloc_lock held. Once in trim_idle_ms trims the pool to
+ * the max number of objects used in the last period (but not below the floor) */
+static void obj_pool_auto_trim(obj_pool *pool)
+{
+	uint64_t now;
+	size_t peak;
+
+	if (!pool->trim_idle_ms)
+		return;
+
+	now = obj_pool_now_ms();
+	if (now - pool->trim_window_start < pool->trim_idle_ms)
+		return;
+
+	pool->trim_window_start = now;
+	peak = __atomic_exchange_n(&pool->window_peak,
+				   __atomic_load_n(&pool->num_traveling_objects, __ATOMIC_RELAXED),
+				   __ATOMIC_RELAXED);
+	if (peak < pool->trim_floor)
+		peak = pool->trim_floor;
+
+	if (pool->curr_size > peak)
+		obj_pool_trim_locked(pool, peak);
+}
+
+size_t obj_pool_trim(obj_pool *pool, size_t target)
+{
+	int thread_safety_needed;
+	size_t num;
+
+	if (pool == NULL) return 0;
+
+	thread_safety_needed = pool->thread_safety_needed;
+	LOCK_ALLOCATION(pool, thread_safety_needed);
+	num = obj_pool_trim_locked(pool, target);
+	UNLOCK_ALLOCATION(pool, thread_safety_needed);
+
+	return num;
+}
+
+int obj_pool_set_auto_trim(obj_pool *pool, size_t floor, unsigned int idle_ms)
+{
+	int thread_safety_needed;
+
+	if (pool == NULL) return 1;
+
+	thread_safety_needed = pool->thread_safety_needed;
+	LOCK_ALLOCATION(pool, thread_safety_needed);
+	pool->trim_floor = floor;
+	pool->trim_idle_ms = idle_ms;
+	pool->trim_window_start = obj_pool_now_ms();
+	__atomic_store_n(&pool->window_peak,
+			 __atomic_load_n(&pool->num_traveling_objects, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+	UNLOCK_ALLOCATION(pool, thread_safety_needed);
+
+	return 0;
+}
+
+/* Must be called with alloc_lock held */
+static int obj_pool_grow(obj_pool *pool)
+{
+	pool->grows++;
+	if (obj_pool_increase_size_to(pool, (int)((pool->curr_size * 3)/2) + 1))
+		return 1;
+
+	return (pool->available_objects == NULL);
+}
+
+/* Number of objects moved between a thread cache and the shared list at once */
+#define OBJ_CACHE_BATCH(__p) (((__p)->cache_size + 1) / 2)
+
+/* Must be called with alloc_lock held */
+static void obj_pool_cache_refill(obj_pool *pool, obj_cache *cache)
+{
+	size_t batch = OBJ_CACHE_BATCH(pool);
+	pooled_obj *obj;
+
+	while (cache->num_objects < batch) {
+		if (pool->available_objects == NULL && obj_pool_grow(pool))
+			break;
+
+		obj = pool->available_objects;
+		pool->available_objects = obj->next;
+		obj->next = cache->objects;
+		cache->objects = obj;
+		cache->num_objects++;
+	}
+}
+
+/* Must be called with alloc_lock held */
+static void obj_pool_cache_flush(obj_pool *pool, obj_cache *cache, size_t num)
+{
+	pooled_obj *obj;
+
+	while (num-- && (obj = cache->objects)) {
+		cache->objects = obj->next;
+		cache->num_objects--;
+		obj->next = pool->available_objects;
+		pool->available_objects = obj;
+	}
+
+	obj_pool_auto_trim(pool);
+}
+
+/* Called on thread exit: return the cached objects to the shared list */
+static void obj_pool_cache_release(void *arg)
+{
+	obj_cache *cache = (obj_cache*)arg, **pp;
+	obj_pool *pool = cache->pool;
+
+	pthread_mutex_lock(&pool->alloc_lock);
+	obj_pool_cache_flush(pool, cache, cache->num_objects);
+	for (pp = &pool->caches; *pp; pp = &(*pp)->next) {
+		if (*pp == cache) {
+			*pp = cache->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->alloc_lock);
+	free(cache);
+}
+
+static obj_cache* obj_pool_get_cache(obj_pool *pool)
+{
+	obj_cache *cache = (obj_cache*)pthread_getspecific(pool->cache_key);
+
+	if (likely(cache != NULL))
+		return cache;
+
+	cache = (obj_cache*)malloc(sizeof(obj_cache));
+	if (cache == NULL)
+		return NULL;
+	memset(cache, 0, sizeof(obj_cache));
+	cache->pool = pool;
+
+	if (pthread_setspecific(pool->cache_key, cache)) {
+		free(cache);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->alloc_lock);
+	cache->next = pool->caches;
+	pool->caches = cache;
+	pthread_mutex_unlock(&pool->alloc_lock);
+
+	return cache;
+}
+
+int obj_pool_set_thread_cache(obj_pool *pool, size_t cache_size)
+{
+	if (pool == NULL || cache_size == 0)
+		return 1;
+
+	if (!pool->thread_safety_needed) {
+		BUG("Object pool '%s': thread cache requires a thread safe pool", pool->name);
+		return 1;
+	}
+
+	if (pool->cache_size)
+		return 1;
+
+	if (pthread_key_create(&pool->cache_key, obj_pool_cache_release)) {
+		ELOG("Object pool '%s': pthread_key_create failed", pool->name);
+		return 1;
+	}
+
+	pool->cache_size = cache_size;
+	return 0;
+}
+
 OBJ obj_pool_alloc_object(obj_pool *pool)
 {
 	OBJ ret = NULL;
+	pooled_obj *p_obj;
 	int thread_safety_needed;
 
 	if (pool == NULL) return NULL;
@@ -205,12 +572,31 @@ OBJ obj_pool_alloc_object(obj_pool *pool)
 
 	thread_safety_needed = pool->thread_safety_needed;
 
+	if (pool->cache_size) {
+		obj_cache *cache = obj_pool_get_cache(pool);
+
+		if (likely(cache != NULL)) {
+			if (cache->objects == NULL) {
+				LOCK_ALLOCATION(pool, thread_safety_needed);
+				obj_pool_cache_refill(pool, cache);
+				UNLOCK_ALLOCATION(pool, thread_safety_needed);
+				if (cache->objects == NULL)
+					return NULL;
+			}
+
+			p_obj = cache->objects;
+			cache->objects = p_obj->next;
+			cache->num_objects--;
+			p_obj->allocated = OBJ_ALLOCATED;
+			obj_pool_account_alloc(pool);
+			return p_obj->data;
+		}
+		/* no cache for this thread, fall back to the shared list */
+	}
+
 	LOCK_ALLOCATION(pool, thread_safety_needed);
 	if (pool->available_objects == NULL) {
-		if (obj_pool_increase_size_to(pool, (int)((pool->curr_size * 3)/2) + 1))
-			goto err;
-
-		if (pool->available_objects == NULL)
+		if (obj_pool_grow(pool))
 			goto err;
 	}
 
@@ -218,9 +604,9 @@ OBJ obj_pool_alloc_object(obj_pool *pool)
 	DEBUG_VAR("%p", pool->available_objects->next);
 
 	ret = pool->available_objects->data;
-	pool->available_objects->allocated = 1;
+	pool->available_objects->allocated = OBJ_ALLOCATED;
 	pool->available_objects = pool->available_objects->next;
-	pool->num_traveling_objects++;
+	obj_pool_account_alloc(pool);
 	DEBUG("[pool:%s] object allocated", pool->name);
 
 err:
@@ -242,9 +628,40 @@ void obj_pool_put_object(obj_pool *pool, OBJ object)
 	}
 
 	thread_safety_needed = pool->thread_safety_needed;
+	p_obj = container_of(object, pooled_obj, data);
+
+	if (pool->cache_size) {
+		obj_cache *cache;
+
+		if (unlikely(p_obj->slab->pool != pool)) {
+			BUG("This object doesn't belong to the pool '%s'", pool->name);
+			return;
+		}
+
+		if (unlikely(p_obj->allocated != OBJ_ALLOCATED)) {
+			BUG("This object wasn't allocated yet");
+			return;
+		}
+
+		cache = obj_pool_get_cache(pool);
+		if (likely(cache != NULL)) {
+			p_obj->allocated = OBJ_AVAILABLE;
+			p_obj->next = cache->objects;
+			cache->objects = p_obj;
+			cache->num_objects++;
+			TRAVELING_OBJECTS_DEC(pool);
+
+			if (cache->num_objects > pool->cache_size) {
+				LOCK_ALLOCATION(pool, thread_safety_needed);
+				obj_pool_cache_flush(pool, cache, OBJ_CACHE_BATCH(pool));
+				UNLOCK_ALLOCATION(pool, thread_safety_needed);
+			}
+			return;
+		}
+		/* no cache for this thread, fall back to the shared list */
+	}
 
 	LOCK_ALLOCATION(pool, thread_safety_needed);
-	p_obj = container_of(object, pooled_obj, data);
 
 	DEBUG("[pool:%s] put object", pool->name);
 	DEBUG_VAR("%p", p_obj);
@@ -252,32 +669,52 @@ void obj_pool_put_object(obj_pool *pool, OBJ object)
 	DEBUG_VAR("%p", pool->available_objects);
 	DEBUG_VAR("%d", p_obj->allocated);
 
-	if (unlikely(p_obj->pool != pool)) {
+	if (unlikely(p_obj->slab->pool != pool)) {
 		BUG("This object doesn't belong to the pool '%s'", pool->name);
 		goto failure;
 	}
 
-	if (unlikely(!p_obj->allocated)) {
+	if (unlikely(p_obj->allocated != OBJ_ALLOCATED)) {
 		BUG("This object wasn't allocated yet");
 		goto failure;
 	}
 
-	p_obj->allocated = 0;
+	p_obj->allocated = OBJ_AVAILABLE;
 	p_obj->next = pool->available_objects;
 	pool->available_objects = p_obj;
 
 	DEBUG_VAR("%p", p_obj->next);
 	DEBUG_VAR("%p", pool->available_objects);
 
-	pool->num_traveling_objects--;
+	TRAVELING_OBJECTS_DEC(pool);
+	obj_pool_auto_trim(pool);
 failure:
 	UNLOCK_ALLOCATION(pool, thread_safety_needed);
 }
 
+int obj_pool_get_stats(obj_pool *pool, obj_pool_stats *stats)
+{
+	int thread_safety_needed;
+
+	if (pool == NULL || stats == NULL) return 1;
+
+	thread_safety_needed = pool->thread_safety_needed;
+	LOCK_ALLOCATION(pool, thread_safety_needed);
+	stats->size = pool->curr_size;
+	stats->grows = pool->grows;
+	stats->trimmed = pool->trimmed;
+	UNLOCK_ALLOCATION(pool, thread_safety_needed);
+	stats->in_use = __atomic_load_n(&pool->num_traveling_objects, __ATOMIC_RELAXED);
+	stats->peak_in_use = __atomic_load_n(&pool->peak_in_use, __ATOMIC_RELAXED);
+	stats->total_allocs = __atomic_load_n(&pool->total_allocs, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
 size_t obj_pool_walk(obj_pool *pool, object_cb cb)
 {
-	struct _pooled_obj *obj;
-	size_t obj_num = 0;
+	obj_slab *slab;
+	size_t i, obj_num = 0;
 	size_t num_traveling_objects;
 	int thread_safety_needed;
 
@@ -287,13 +724,15 @@ size_t obj_pool_walk(obj_pool *pool, object_cb cb)
 	thread_safety_needed = pool->thread_safety_needed;
 	if (num_traveling_objects > 0) {
 		LOCK_ALLOCATION(pool, thread_safety_needed);
-		obj = pool->all_objects;
-		while (obj) {
-			if (obj->allocated) {
-				++obj_num;
-				if (cb) cb(pool, &obj->data);
+		for (slab = pool->slabs; slab; slab = slab->next) {
+			for (i = 0; i < slab->num_objects; i++) {
+				pooled_obj *obj = SLAB_OBJ(pool, slab, i);
+
+				if (obj->allocated == OBJ_ALLOCATED) {
+					++obj_num;
+					if (cb) cb(pool, &obj->data);
+				}
 			}
-			obj = obj->next;
 		}
 		UNLOCK_ALLOCATION(pool, thread_safety_needed);
 		BUG("num_traveling_objects:%zu, obj_num:%zu", num_traveling_objects, obj_num);
@@ -23,12 +23,33 @@ typedef struct _obj_pool obj_pool;
 
 typedef void (*object_cb)(obj_pool* pool, const OBJ object);
 
+typedef struct _obj_pool_stats {
+	size_t size;    /* number of objects owned by the pool */
+	size_t in_use;  /* objects currently handed out */
+	size_t peak_in_use;     /* max of in_use since the pool was created */
+	uint64_t total_allocs;  /* objects handed out since the pool was created */
+	uint64_t grows;         /* times the pool grew */
+	uint64_t trimmed;       /* objects freed by trims */
+} obj_pool_stats;
+
 size_t obj_pool_destroy(obj_pool *pool);
 
 obj_pool* obj_pool_init(const char *pool_name, size_t object_byte_size,
 			size_t min_size, size_t max_size,
 			int thread_safety_needed);
 
+/* Objects are allocated in slabs, one contiguous allocation per growth of
+   the pool. Flags of obj_pool_init_ex(): */
+/* Objects start at cache lines and don't share them, for objects used by
+   different threads at the same time */
+#define OBJ_POOL_CACHE_ALIGNED	(1 << 0)
+/* Slabs are page aligned and take whole pages */
+#define OBJ_POOL_PAGE_ALIGNED	(1 << 1)
+
+obj_pool* obj_pool_init_ex(const char *pool_name, size_t object_byte_size,
+			   size_t min_size, size_t max_size,
+			   int thread_safety_needed, unsigned int flags);
+
 OBJ obj_pool_alloc_object(obj_pool *pool);
 
 void obj_pool_put_object(obj_pool *pool, OBJ object);
@@ -47,4 +68,28 @@ void obj_pool_set_callback(obj_pool *pool, object_cb cb);
    The function returns the number of allocated objects */
 size_t obj_pool_walk(obj_pool *pool, object_cb cb);
 
+/* Snapshot of the pool occupancy. Objects held in thread caches are counted
+   as owned but not in use. Returns 0 on success */
+int obj_pool_get_stats(obj_pool *pool, obj_pool_stats *stats);
+
+/* Free slabs of available objects while the pool keeps at least 'target'
+   objects (never less than its min_size). A slab with objects in use or held
+   in thread caches is not freed. Returns the number of freed objects */
+size_t obj_pool_trim(obj_pool *pool, size_t target);
+
+/* Trim the pool automatically: once in idle_ms (checked when objects are put
+   back) the pool is trimmed to the max number of objects in use during the
+   last idle_ms, but not below 'floor'. 0 idle_ms disables it.
+   Returns 0 on success */
+int obj_pool_set_auto_trim(obj_pool *pool, size_t floor, unsigned int idle_ms);
+
+/* Enable per-thread caches of up to cache_size objects for a thread safe pool.
+   Allocations and releases are served from a thread-local free list and move
+   batches of objects to/from the shared list only when the cache runs empty or
+   overflows, so the pool lock is not taken on the common path. Objects held in
+   one thread's cache are not available to other threads (relevant for pools
+   with max_size). Must be called before the pool is shared between threads.
+   Returns 0 on success */
+int obj_pool_set_thread_cache(obj_pool *pool, size_t cache_size);
+
 #endif /* __OBJ_POOL__H__ */
@@ -11,6 +11,7 @@
 #include "wave_ipc_client.h"
 #include "work_serializer.h"
 #include "linked_list.h"
+#include "hash_table.h"
 #include "logs.h"
 
 #include <unistd.h>
@@ -45,12 +46,18 @@ typedef enum _cmd_response_status {
 	RESP_FAILURE,
 } cmd_response_status;
 
+/* A command waiting for its response, in resp_table by seq_num. The fields
+ * are protected by resp_lock */
 typedef struct _cmd_response {
-	uint8_t seq_num;
-	volatile cmd_response_status status;
+	uint32_t seq_num;
+	cmd_response_status status;
 	wv_ipc_msg *response;
+	/* signaled once the response is complete */
+	pthread_cond_t cond;
 } cmd_response;
 
+#define RESP_TABLE_INIT_BUCKETS	(16)
+
 typedef struct _listener_thread_data {
 	pthread_t thread_id;
 	int terminate;
@@ -62,20 +69,19 @@ typedef struct _listener_thread_data {
 
 	work_serializer *events_serializer;
 
-	l_list *resp_list;
-	pthread_cond_t resp_cond;
-	pthread_mutex_t resp_cond_lock;
-	pthread_mutex_t resp_list_lock;
+	hash_table *resp_table;
+	pthread_mutex_t resp_lock;
 } listener_thread_data;
 
 struct _wv_ipclient {
 	int socket;
+	wv_ipc_rx *rx;
 	int is_connected;
 	int is_after_reconnect;
 	/* Internal pipe to send "interrupt" to function select() */
 	int pipe_fds[2];
 
-	uint8_t cmd_seq_num;
+	uint32_t cmd_seq_num;
 	struct sockaddr_un server_sockaddr;
 	struct sockaddr_un our_sockaddr;
 
@@ -133,6 +139,9 @@ static wv_ipc_ret wave_ipcc_socket_init(wv_ipclient *ipclient)
 	if (ret != WAVE_IPC_SUCCESS)
 		return WAVE_IPC_ERROR;
 
+	/* whatever was read from the old socket is useless now */
+	wave_ipc_rx_reset(ipclient->rx);
+
 	// - Create internal "self-pipe"
 	if (-1 == pipe(ipclient->pipe_fds)) {
 		ELOG("error creating pipe, errno = %d", errno);
@@ -218,6 +227,9 @@ wv_ipc_ret wave_ipcc_connect(wv_ipclient **handle_p,
 	if ((ipclient->queued_msgs = list_init()) == NULL)
 		goto free;
 
+	if ((ipclient->rx = wave_ipc_rx_create()) == NULL)
+		goto free;
+
 	ipclient->our_sockaddr.sun_family = AF_UNIX;
 	ipclient->our_sockaddr.sun_path[0] = '\0';
 	sprintf_s(ipclient->our_sockaddr.sun_path + 1,
@@ -254,6 +266,7 @@ free:
 		obj_pool_destroy(ipclient->cmd_resp_pool);
 	if (ipclient->queued_msgs)
 		list_free(ipclient->queued_msgs);
+	wave_ipc_rx_destroy(ipclient->rx);
 	free(ipclient);
 	return WAVE_IPC_ERROR;
 }
@@ -274,6 +287,7 @@ wv_ipc_ret wave_ipcc_disconnect(wv_ipclient **handle_p)
 		list_foreach_remove_current_entry();
 	list_foreach_end
 	list_free(ipclient->queued_msgs);
+	wave_ipc_rx_destroy(ipclient->rx);
 	obj_pool_destroy(ipclient->cmd_resp_pool);
 	free(ipclient);
 	*handle_p = NULL;
@@ -318,15 +332,26 @@ static wv_ipc_ret ipcc_wait_for_message(wv_ipclient *ipclient,
 		tv.tv_sec = 1;
 		tv.tv_usec = 0;
 
-		res = select(MAX(ipclient->socket, ipclient->pipe_fds[0]) + 1, &rfds, NULL, NULL, &tv);
+		if (wave_ipc_rx_has_msg(ipclient->rx)) {
+			/* read ahead of a previous msg, don't wait for the socket */
+			FD_CLR(ipclient->pipe_fds[0], &rfds);
+			res = 1;
+		} else {
+			res = select(MAX(ipclient->socket, ipclient->pipe_fds[0]) + 1,
+				     &rfds, NULL, NULL, &tv);
+		}
+
 		if (res == -1 && errno == EINTR) {
 			usleep(1000);
 		} else if (res == -1) {
 			BUG("select() returned error, errno = %d", errno);
 			break;
 		} else if (res && FD_ISSET(ipclient->socket, &rfds)) {
-			ret = wave_ipc_recv_msg(ipclient->socket, msg);
-			if (ret != WAVE_IPC_SUCCESS) {
+			ret = wave_ipc_rx_recv(ipclient->rx, ipclient->socket, MSG_DONTWAIT, msg);
+			if (ret == WAVE_IPC_CMD_WOULD_BLOCK) {
+				/* the rest of the msg didn't arrive yet */
+				continue;
+			} else if (ret != WAVE_IPC_SUCCESS) {
 				if (ret == WAVE_IPC_DISCONNECTED) {
 					LOG(1, "server reset ==> try to reconnect");
 				} else {
@@ -365,23 +390,16 @@ static void ipcc_handle_response_from_listener_ctx(wv_ipclient *ipclient,
 						   wv_ipc_msg *resp,
 						   ipc_header *resp_hdr)
 {
-	cmd_response *cs = NULL;
-	uint8_t response_seq_num = resp_hdr->header[1];
+	cmd_response *cs;
+	uint32_t response_seq_num = ipc_header_get_seq_num(resp_hdr);
 	listener_thread_data *listener = ipclient->listener;
 	int notify = 1;
 
-	pthread_mutex_lock(&listener->resp_cond_lock);
-	pthread_mutex_lock(&listener->resp_list_lock);
-	list_foreach_start(listener->resp_list, tmp, cmd_response)
-		if (tmp->seq_num == response_seq_num) {
-			cs = tmp;
-			break;
-		}
-	list_foreach_end
+	pthread_mutex_lock(&listener->resp_lock);
+	cs = (cmd_response*)hash_table_find(listener->resp_table, &response_seq_num);
 	if (!cs) {
-		pthread_mutex_unlock(&listener->resp_list_lock);
-		pthread_mutex_unlock(&listener->resp_cond_lock);
-		ELOG("response to seq num %d was thrown", response_seq_num);
+		pthread_mutex_unlock(&listener->resp_lock);
+		ELOG("response to seq num %u was thrown", response_seq_num);
 		wave_ipc_msg_put(resp);
 		return;
 	}
@@ -415,10 +433,10 @@ static void ipcc_handle_response_from_listener_ctx(wv_ipclient *ipclient,
 		cs->response = resp;
 	}
 
-	pthread_mutex_unlock(&listener->resp_list_lock);
+	/* wake only the caller waiting for this response */
 	if (notify)
-		pthread_cond_broadcast(&listener->resp_cond);
-	pthread_mutex_unlock(&listener->resp_cond_lock);
+		pthread_cond_signal(&cs->cond);
+	pthread_mutex_unlock(&listener->resp_lock);
 }
 
 static void* ipcc_listener(void *data)
@@ -482,11 +500,13 @@ queued_msg:
 				break;
 			}
 
-			ret = listener->cmd_clb(listener->clb_arg, hdr.header[1], msg);
+			wave_ipc_msg_set_deadline(msg, ipc_header_get_deadline(&hdr));
+			ret = listener->cmd_clb(listener->clb_arg,
+						ipc_header_get_seq_num(&hdr), msg);
 			if (ret == WAVE_IPC_EVENT_TAKE_OWNERSHIP)
 				break;
 			else if (ret)
-				wave_ipcc_send_req_failed(ipclient, hdr.header[1]);
+				wave_ipcc_send_req_failed(ipclient, ipc_header_get_seq_num(&hdr));
 
 			wave_ipc_msg_put(msg);
 			break;
@@ -595,6 +615,7 @@ wv_ipc_ret wave_ipcc_start_listener(wv_ipclient *handle,
 		work_op.work_func = _serialized_event_work;
 		work_op.free_func = _serialized_event_work_free;
 		work_op.cmp_func = NULL;
+		work_op.unlimited = 0;
 
 		listener->events_serializer = serializer_create(&work_op, 1, 1);
 		if (!listener->events_serializer) {
@@ -603,7 +624,8 @@ wv_ipc_ret wave_ipcc_start_listener(wv_ipclient *handle,
 		}
 	}
 
-	if ((listener->resp_list = list_init()) == NULL) {
+	listener->resp_table = hash_table_init(RESP_TABLE_INIT_BUCKETS, hash_u32, hash_u32_cmp);
+	if (listener->resp_table == NULL) {
 		if (listener->events_serializer)
 			serializer_destroy(listener->events_serializer);
 		free(listener);
@@ -614,9 +636,7 @@ wv_ipc_ret wave_ipcc_start_listener(wv_ipclient *handle,
 	listener->cmd_clb = command_clb;
 	listener->reconnect_clb = reconnect_clb;
 	listener->clb_arg = clb_arg;
-	pthread_mutex_init(&listener->resp_cond_lock, NULL);
-	pthread_mutex_init(&listener->resp_list_lock, NULL);
-	pthread_cond_init(&listener->resp_cond, NULL);
+	pthread_mutex_init(&listener->resp_lock, NULL);
 
 	handle->listener = listener;
 	handle->disconnect_clb = disconnect_clb;
@@ -624,10 +644,8 @@ wv_ipc_ret wave_ipcc_start_listener(wv_ipclient *handle,
 	if (pthread_create(&listener->thread_id, NULL, ipcc_listener, handle)) {
 		ELOG("thread create failed");
 
-		pthread_cond_destroy(&listener->resp_cond);
-		pthread_mutex_destroy(&listener->resp_list_lock);
-		pthread_mutex_destroy(&listener->resp_cond_lock);
-		list_free(listener->resp_list);
+		pthread_mutex_destroy(&listener->resp_lock);
+		hash_table_free(listener->resp_table);
 		if (listener->events_serializer)
 			serializer_destroy(listener->events_serializer);
 		free(listener);
@@ -659,10 +677,8 @@ wv_ipc_ret wave_ipcc_stop_listener(wv_ipclient *handle)
 		return WAVE_IPC_ERROR;
 	}
 
-	pthread_cond_destroy(&handle->listener->resp_cond);
-	pthread_mutex_destroy(&handle->listener->resp_list_lock);
-	pthread_mutex_destroy(&handle->listener->resp_cond_lock);
-	list_free(handle->listener->resp_list);
+	pthread_mutex_destroy(&handle->listener->resp_lock);
+	hash_table_free(handle->listener->resp_table);
 	if (handle->listener->events_serializer)
 		serializer_destroy(handle->listener->events_serializer);
 	free(handle->listener);
@@ -671,8 +687,9 @@ wv_ipc_ret wave_ipcc_stop_listener(wv_ipclient *handle)
 	return WAVE_IPC_SUCCESS;
 }
 
-static wv_ipc_ret wave_ipcc_send_cmd_listener(wv_ipclient *ipclient, uint8_t seq_num,
-					      wv_ipc_msg *cmd, wv_ipc_msg **reply, int timeout)
+static wv_ipc_ret wave_ipcc_send_cmd_listener(wv_ipclient *ipclient, uint32_t seq_num,
+					      wv_ipc_msg *cmd, wv_ipc_msg **reply,
+					      uint64_t deadline_ms)
 {
 	wv_ipc_ret ret;
 	int cw_res = 0;
@@ -682,7 +699,7 @@ static wv_ipc_ret wave_ipcc_send_cmd_listener(wv_ipclient *ipclient, uint8_t seq
 	listener_thread_data *listener = ipclient->listener;
 	int reconnect_attempts = 0;
 
-	while (reconnect_attempts++ < 15) {
+	while (reconnect_attempts++ < 15 && wave_ipc_now_ms() < deadline_ms) {
 		socket = ipclient->socket;
 		if (ipclient->is_connected && ipclient->is_after_reconnect && socket != -1)
 			break;
@@ -700,33 +717,35 @@ static wv_ipc_ret wave_ipcc_send_cmd_listener(wv_ipclient *ipclient, uint8_t seq
 	resp_handle->response = NULL;
 	resp_handle->status = RESP_NONE;
 	resp_handle->seq_num = seq_num;
+	if (wave_ipc_cond_init_monotonic(&resp_handle->cond)) {
+		obj_pool_put_object(ipclient->cmd_resp_pool, resp_handle);
+		return WAVE_IPC_ERROR;
+	}
 
-	pthread_mutex_lock(&listener->resp_list_lock);
-	list_push_front(listener->resp_list, resp_handle);
-	pthread_mutex_unlock(&listener->resp_list_lock);
+	pthread_mutex_lock(&listener->resp_lock);
+	if (hash_table_insert(listener->resp_table, &resp_handle->seq_num, resp_handle)) {
+		pthread_mutex_unlock(&listener->resp_lock);
+		ELOG("seq num %u is already waiting for a response", seq_num);
+		ret = WAVE_IPC_ERROR;
+		goto free;
+	}
+	pthread_mutex_unlock(&listener->resp_lock);
 
 	ret = wave_ipc_send_msg(socket, cmd, 0);
-	if (ret != WAVE_IPC_SUCCESS) {
+	if (ret != WAVE_IPC_SUCCESS)
 		ELOG("failed to send command to the server");
-		goto response;
-	}
 
-	pthread_mutex_lock(&listener->resp_cond_lock);
-	clock_gettime(CLOCK_REALTIME, &ts);
-	/* TODO: add a couple of miliseconds */
-	ts.tv_sec += (timeout < 0) ? WAVE_IPC_CMD_TIMEOUT_SECS : (unsigned)timeout;
-	while (resp_handle->status == RESP_NONE) {
-		cw_res = pthread_cond_timedwait(&listener->resp_cond,
-						&listener->resp_cond_lock, &ts);
-		if (cw_res != 0) break;
+	pthread_mutex_lock(&listener->resp_lock);
+	if (ret == WAVE_IPC_SUCCESS) {
+		wave_ipc_ms_to_timespec(deadline_ms, &ts);
+		while (resp_handle->status == RESP_NONE) {
+			cw_res = pthread_cond_timedwait(&resp_handle->cond,
+							&listener->resp_lock, &ts);
+			if (cw_res != 0) break;
+		}
 	}
-
-	pthread_mutex_unlock(&listener->resp_cond_lock);
-
-response:
-	pthread_mutex_lock(&listener->resp_list_lock);
-	list_remove(listener->resp_list, resp_handle);
-	pthread_mutex_unlock(&listener->resp_list_lock);
+	hash_table_remove(listener->resp_table, &resp_handle->seq_num);
+	pthread_mutex_unlock(&listener->resp_lock);
 
 	if (ret != WAVE_IPC_SUCCESS)
 		goto free;
@@ -743,13 +762,19 @@ response:
 	}
 
 	*reply = resp_handle->response;
+	resp_handle->response = NULL;
 free:
+	/* a partial response of a failed or timed out command */
+	if (resp_handle->response)
+		wave_ipc_msg_put(resp_handle->response);
+	pthread_cond_destroy(&resp_handle->cond);
 	obj_pool_put_object(ipclient->cmd_resp_pool, resp_handle);
 	return ret;
 }
 
-static wv_ipc_ret wave_ipcc_send_cmd_no_listener(wv_ipclient *ipclient, uint8_t seq_num,
-						 wv_ipc_msg *cmd, wv_ipc_msg **reply, int timeout)
+static wv_ipc_ret wave_ipcc_send_cmd_no_listener(wv_ipclient *ipclient, uint32_t seq_num,
+						 wv_ipc_msg *cmd, wv_ipc_msg **reply,
+						 uint64_t deadline_ms)
 {
 	int res;
 	fd_set rfds;
@@ -757,6 +782,7 @@ static wv_ipc_ret wave_ipcc_send_cmd_no_listener(wv_ipclient *ipclient, uint8_t
 	wv_ipc_msg *out, *multi_out = NULL;
 	ipc_header hdr;
 	struct timeval tv;
+	uint64_t now;
 	int socket = ipclient->socket;
 
 	if (socket == -1)
@@ -778,10 +804,15 @@ again:
 	out = NULL;
 	FD_ZERO(&rfds);
 	FD_SET(socket, &rfds);
-	tv.tv_sec = (timeout < 0) ? WAVE_IPC_CMD_TIMEOUT_SECS : (unsigned)timeout;
-	tv.tv_usec = 0;
+	now = wave_ipc_now_ms();
+	now = (now < deadline_ms) ? deadline_ms - now : 0;
+	tv.tv_sec = now / 1000;
+	tv.tv_usec = (now % 1000) * 1000;
 
-	res = select(socket + 1, &rfds, NULL, NULL, &tv);
+	if (wave_ipc_rx_has_msg(ipclient->rx))
+		res = 1;
+	else
+		res = select(socket + 1, &rfds, NULL, NULL, &tv);
 	if (res == -1 && errno == EINTR) {
 		usleep(1000);
 		goto again;
@@ -793,7 +824,9 @@ again:
 		goto timeout;
 	}
 
-	ret = wave_ipc_recv_msg(socket, &out);
+	ret = wave_ipc_rx_recv(ipclient->rx, socket, MSG_DONTWAIT, &out);
+	if (ret == WAVE_IPC_CMD_WOULD_BLOCK)
+		goto again;
 	if (ret != WAVE_IPC_SUCCESS) {
 		ELOG("ipc_recv_msg returned %d ==> disconnect", ret);
 		goto disconnect;
@@ -807,7 +840,7 @@ again:
 
 	if (hdr.header[0] == WAVE_IPC_MSG_RESP ||
 	    hdr.header[0] == WAVE_IPC_MSG_REQ_FAIL) {
-		if (hdr.header[1] == seq_num) {
+		if (ipc_header_get_seq_num(&hdr) == seq_num) {
 			if (hdr.header[0] == WAVE_IPC_MSG_REQ_FAIL) {
 				if (multi_out)
 					wave_ipc_msg_put(multi_out);
@@ -856,14 +889,16 @@ disconnect:
 		ipclient->disconnect_clb(ipclient->clb_arg);
 	return WAVE_IPC_DISCONNECTED;
 timeout:
+	if (multi_out)
+		wave_ipc_msg_put(multi_out);
 	return WAVE_IPC_ERROR;
 }
 
-wv_ipc_ret wave_ipcc_send_cmd_ex(wv_ipclient *handle,
-			      wv_ipc_msg *cmd, wv_ipc_msg **reply, int timeout)
+static wv_ipc_ret ipcc_send_cmd(wv_ipclient *handle, wv_ipc_msg *cmd,
+				wv_ipc_msg **reply, uint64_t deadline_ms)
 {
 	ipc_header cmd_hdr = { 0 };
-	uint8_t seq_num;
+	uint32_t seq_num;
 	wv_ipc_ret ret = WAVE_IPC_ERROR;
 
 	if (reply == NULL) {
@@ -881,7 +916,12 @@ wv_ipc_ret wave_ipcc_send_cmd_ex(wv_ipclient *handle,
 	seq_num = __atomic_add_fetch(&handle->cmd_seq_num, 1, __ATOMIC_SEQ_CST);
 
 	cmd_hdr.header[0] = WAVE_IPC_MSG_CMD;
-	cmd_hdr.header[1] = seq_num;
+	ipc_header_set_seq_num(&cmd_hdr, seq_num);
+	if (ipc_header_set_deadline(&cmd_hdr, deadline_ms)) {
+		ELOG("deadline of the command has already passed");
+		ret = WAVE_IPC_ERROR;
+		goto err;
+	}
 	if (ipc_header_push(cmd, &cmd_hdr)) {
 		ELOG("failed to push ipc command header");
 		ret = WAVE_IPC_ERROR;
@@ -889,14 +929,39 @@ wv_ipc_ret wave_ipcc_send_cmd_ex(wv_ipclient *handle,
 	}
 
 	if (handle->listener && pthread_self() != handle->listener->thread_id)
-		ret = wave_ipcc_send_cmd_listener(handle, seq_num, cmd, reply, timeout);
+		ret = wave_ipcc_send_cmd_listener(handle, seq_num, cmd, reply, deadline_ms);
 	else
-		ret = wave_ipcc_send_cmd_no_listener(handle, seq_num, cmd, reply, timeout);
+		ret = wave_ipcc_send_cmd_no_listener(handle, seq_num, cmd, reply, deadline_ms);
 
 err:
 	return ret;
 }
 
+wv_ipc_ret wave_ipcc_send_cmd_ex(wv_ipclient *handle,
+			      wv_ipc_msg *cmd, wv_ipc_msg **reply, int timeout)
+{
+	unsigned int secs = (timeout < 0) ? WAVE_IPC_CMD_TIMEOUT_SECS : (unsigned)timeout;
+
+	return ipcc_send_cmd(handle, cmd, reply, wave_ipc_now_ms() + secs * 1000ULL);
+}
+
+wv_ipc_ret wave_ipcc_send_cmd_ms(wv_ipclient *handle,
+				 wv_ipc_msg *cmd, wv_ipc_msg **reply,
+				 unsigned int timeout_ms)
+{
+	return ipcc_send_cmd(handle, cmd, reply, wave_ipc_now_ms() + timeout_ms);
+}
+
+wv_ipc_ret wave_ipcc_send_cmd_deadline(wv_ipclient *handle,
+				       wv_ipc_msg *cmd, wv_ipc_msg **reply,
+				       const struct timespec *deadline)
+{
+	if (deadline == NULL)
+		return wave_ipcc_send_cmd_ex(handle, cmd, reply, -1);
+
+	return ipcc_send_cmd(handle, cmd, reply, wave_ipc_timespec_to_ms(deadline));
+}
+
 wv_ipc_ret wave_ipcc_send_cmd(wv_ipclient *handle,
 			      wv_ipc_msg *cmd, wv_ipc_msg **reply)
 {
@@ -904,7 +969,7 @@ wv_ipc_ret wave_ipcc_send_cmd(wv_ipclient *handle,
 }
 
 
-wv_ipc_ret wave_ipcc_send_response(wv_ipclient *handle, uint8_t seq_num,
+wv_ipc_ret wave_ipcc_send_response(wv_ipclient *handle, uint32_t seq_num,
 				   wv_ipc_msg *reply, uint8_t has_more)
 {
 	ipc_header resp_hdr = { 0 };
@@ -918,8 +983,8 @@ wv_ipc_ret wave_ipcc_send_response(wv_ipclient *handle, uint8_t seq_num,
 		goto err;
 
 	resp_hdr.header[0] = WAVE_IPC_MSG_RESP;
-	resp_hdr.header[1] = seq_num;
 	resp_hdr.header[2] = has_more;
+	ipc_header_set_seq_num(&resp_hdr, seq_num);
 	if (ipc_header_push(reply, &resp_hdr))
 		goto err;
 
@@ -929,7 +994,7 @@ err:
 	return WAVE_IPC_ERROR;
 }
 
-wv_ipc_ret wave_ipcc_send_req_failed(wv_ipclient *ipclient, uint8_t seq_num)
+wv_ipc_ret wave_ipcc_send_req_failed(wv_ipclient *ipclient, uint32_t seq_num)
 {
 	wv_ipc_msg *reply = NULL;
 	ipc_header resp_hdr = { 0 };
@@ -947,7 +1012,7 @@ wv_ipc_ret wave_ipcc_send_req_failed(wv_ipclient *ipclient, uint8_t seq_num)
 		goto err;
 
 	resp_hdr.header[0] = WAVE_IPC_MSG_REQ_FAIL;
-	resp_hdr.header[1] = seq_num;
+	ipc_header_set_seq_num(&resp_hdr, seq_num);
 	if (ipc_header_push(reply, &resp_hdr))
 		goto err;
 
@@ -1011,11 +1076,12 @@ queued_msg:
 				break;
 			}
 
-			ret = command_clb(clb_arg, hdr.header[1], msg);
+			wave_ipc_msg_set_deadline(msg, ipc_header_get_deadline(&hdr));
+			ret = command_clb(clb_arg, ipc_header_get_seq_num(&hdr), msg);
 			if (ret == WAVE_IPC_EVENT_TAKE_OWNERSHIP)
 				break;
 			else if (ret)
-				wave_ipcc_send_req_failed(handle, hdr.header[1]);
+				wave_ipcc_send_req_failed(handle, ipc_header_get_seq_num(&hdr));
 
 			wave_ipc_msg_put(msg);
 			break;
@@ -36,7 +36,7 @@ typedef enum {
  * Otherwise function may return WAVE_IPC_EVENT_SUCCESS (0) or WAVE_IPC_EVENT_ERROR (1)
  */
 typedef int (*wv_ipc_event)(void *arg, wv_ipc_msg *event);
-typedef int (*wv_ipc_cmd)(void *arg, uint8_t seq_num, wv_ipc_msg *cmd);
+typedef int (*wv_ipc_cmd)(void *arg, uint32_t seq_num, wv_ipc_msg *cmd);
 typedef int (*wv_ipc_disconnect)(void *arg);
 typedef int (*wv_ipc_reconnect)(void *arg);
 typedef int (*wv_ipc_terminate_cond)(void *arg);
@@ -58,13 +58,26 @@ wv_ipc_ret wave_ipcc_stop_listener(wv_ipclient *handle);
 wv_ipc_ret wave_ipcc_send_cmd(wv_ipclient *handle,
 					wv_ipc_msg *cmd, wv_ipc_msg **reply);
 
+/* 'timeout' in seconds, WAVE_IPC_CMD_TIMEOUT_SECS if negative */
 wv_ipc_ret wave_ipcc_send_cmd_ex(wv_ipclient *handle,
 					wv_ipc_msg *cmd, wv_ipc_msg **reply, int timeout);
 
-wv_ipc_ret wave_ipcc_send_response(wv_ipclient *handle, uint8_t seq_num,
+/* Give up after 'timeout_ms' msec */
+wv_ipc_ret wave_ipcc_send_cmd_ms(wv_ipclient *handle,
+					wv_ipc_msg *cmd, wv_ipc_msg **reply,
+					unsigned int timeout_ms);
+
+/* Give up at 'deadline', an absolute CLOCK_MONOTONIC time (see
+ * wave_ipc_deadline_after_ms()). The server gets the deadline with the command
+ * and may drop it once passed. NULL means the default timeout */
+wv_ipc_ret wave_ipcc_send_cmd_deadline(wv_ipclient *handle,
+					wv_ipc_msg *cmd, wv_ipc_msg **reply,
+					const struct timespec *deadline);
+
+wv_ipc_ret wave_ipcc_send_response(wv_ipclient *handle, uint32_t seq_num,
 					wv_ipc_msg *reply, uint8_t has_more);
 
-wv_ipc_ret wave_ipcc_send_req_failed(wv_ipclient *ipclient, uint8_t seq_num);
+wv_ipc_ret wave_ipcc_send_req_failed(wv_ipclient *ipclient, uint32_t seq_num);
 
 wv_ipc_ret wave_ipcc_blocked_event_listener(wv_ipclient *handle,
 					wv_ipc_event event_clb,
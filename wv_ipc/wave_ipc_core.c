@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <poll.h>
 
 #if defined YOCTO
 #include <slibc/string.h>
@@ -30,32 +31,73 @@
 
 #define IPC_MSG_HDR_SIZE	32
 
+/* Payloads up to this size are kept inside the message object itself */
+#define IPC_MSG_INLINE_DATA_SIZE	(256)
+#define IPC_MSG_DATA_CLASS_INLINE	(-1)
+
 typedef struct __attribute__((__packed__)) {
 	uint16_t data_len;
 	uint8_t hdr[IPC_MSG_HDR_SIZE];
 } wv_ipc_msg_info;
 
-typedef struct __attribute__((__packed__)) {
-	wv_ipc_msg_info info;
-	char data[WAVE_IPC_BUFF_SIZE];
-} wv_ipc_msg_transmitted_data;
+/* Size classes of the out-of-line data buffers, smallest first.
+ * The last class must be able to hold WAVE_IPC_BUFF_SIZE bytes */
+static const size_t ipc_msg_data_class_size[] = {
+	2 * 1024,
+	WAVE_IPC_BUFF_SIZE,
+};
+
+static const char *ipc_msg_data_class_name[] = {
+	"ipc msg data 2K",
+	"ipc msg data 20K",
+};
+
+static const size_t ipc_msg_data_class_min_objs[] = {
+	4,
+	1,
+};
+
+#define IPC_MSG_NUM_DATA_CLASSES \
+	(sizeof(ipc_msg_data_class_size) / sizeof(ipc_msg_data_class_size[0]))
 
 struct _wv_ipc_msg {
 	/* for multi msg response support */
 	wv_ipc_msg *prev, *next;
 	uint8_t is_head;
 
+	/* references held on the message, see wave_ipc_msg_get() */
+	int refcnt;
+
+	/* of a received command, not sent over socket */
+	uint64_t deadline_ms;
+
+	/* data buffer: either inline_data or a buffer of the data_class pool */
+	int data_class;
+	size_t data_capacity;
+	char *data;
+
 #ifdef WAVE_IPC_CORE_DEBUG
 	/* debug data */
 	const char* func;
 	unsigned lineno;
 	pthread_t thread_id;
 #endif
-	/* actual data sent over socket */
-	wv_ipc_msg_transmitted_data packet;
+	/* sent over socket, followed by info.data_len bytes of data */
+	wv_ipc_msg_info info;
+	char inline_data[IPC_MSG_INLINE_DATA_SIZE];
 };
 
+/* Number of objects each thread keeps cached per pool */
+#define IPC_MSG_THREAD_CACHE_SIZE (32)
+
+/* Objects left unused for this long after a burst are freed, down to the min
+ * number of objects of the pool */
+#define IPC_MSG_POOL_TRIM_MS (10000)
+
+/* The pools are thread safe and use per-thread caches, ipc_msg_pool_lock only
+ * serializes their (lazy) creation and destruction */
 static obj_pool *ipc_msg_pool = NULL;
+static obj_pool *ipc_msg_data_pool[IPC_MSG_NUM_DATA_CLASSES] = { NULL };
 static pthread_mutex_t ipc_msg_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 #define LOCK_IPC_MSG_POOL() pthread_mutex_lock(&ipc_msg_pool_lock);
 #define UNLOCK_IPC_MSG_POOL() pthread_mutex_unlock(&ipc_msg_pool_lock);
@@ -69,55 +111,204 @@ static void ipc_msg_dump(obj_pool* pool, const OBJ object)
 }
 #endif
 
-/* This function will be called automatically on library unload */
-static void __attribute__((destructor)) ipc_msg_pool_cleanup(void)
+static void ipc_msg_pools_destroy(void)
 {
+	size_t i;
+
 	if (ipc_msg_pool) {
 		obj_pool_destroy(ipc_msg_pool);
-		// DLOG("ipc_msg_pool_cleanup");
+		__atomic_store_n(&ipc_msg_pool, NULL, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < IPC_MSG_NUM_DATA_CLASSES; i++) {
+		if (ipc_msg_data_pool[i]) {
+			obj_pool_destroy(ipc_msg_data_pool[i]);
+			ipc_msg_data_pool[i] = NULL;
+		}
 	}
 }
 
-#ifdef WAVE_IPC_CORE_DEBUG
-wv_ipc_msg* _wave_ipc_msg_alloc_debug(const char *func, unsigned lineno)
-#else
-wv_ipc_msg* wave_ipc_msg_alloc(void)
-#endif
+static int ipc_msg_pools_init(void)
 {
-	wv_ipc_msg *msg = NULL;
+	obj_pool *pool;
+	size_t i;
+
+	if (__atomic_load_n(&ipc_msg_pool, __ATOMIC_ACQUIRE) != NULL)
+		return 0;
 
 	LOCK_IPC_MSG_POOL()
-	if (ipc_msg_pool == NULL) {
-		ipc_msg_pool = obj_pool_init("ipc msg", sizeof(wv_ipc_msg), 8, 0, 0);
-		if (ipc_msg_pool == NULL) {
-			UNLOCK_IPC_MSG_POOL()
-			BUG("Failed to initialize obj pool");
-			return NULL;
-		}
+	if (ipc_msg_pool) {
+		UNLOCK_IPC_MSG_POOL()
+		return 0;
+	}
+
+	for (i = 0; i < IPC_MSG_NUM_DATA_CLASSES; i++) {
+		ipc_msg_data_pool[i] = obj_pool_init_ex(ipc_msg_data_class_name[i],
+							ipc_msg_data_class_size[i],
+							ipc_msg_data_class_min_objs[i], 0, 1,
+							OBJ_POOL_CACHE_ALIGNED);
+		if (ipc_msg_data_pool[i] == NULL)
+			goto err;
+		obj_pool_set_thread_cache(ipc_msg_data_pool[i], IPC_MSG_THREAD_CACHE_SIZE);
+		obj_pool_set_auto_trim(ipc_msg_data_pool[i], 0, IPC_MSG_POOL_TRIM_MS);
+	}
+
+	/* messages are passed between threads, don't let them share cache lines */
+	pool = obj_pool_init_ex("ipc msg", sizeof(wv_ipc_msg), 8, 0, 1, OBJ_POOL_CACHE_ALIGNED);
+	if (pool == NULL)
+		goto err;
+	obj_pool_set_thread_cache(pool, IPC_MSG_THREAD_CACHE_SIZE);
+	obj_pool_set_auto_trim(pool, 0, IPC_MSG_POOL_TRIM_MS);
 #ifdef WAVE_IPC_CORE_DEBUG
-		obj_pool_set_callback(ipc_msg_pool, ipc_msg_dump);
+	obj_pool_set_callback(pool, ipc_msg_dump);
 #endif
+
+	/* publish after the data pools are ready */
+	__atomic_store_n(&ipc_msg_pool, pool, __ATOMIC_RELEASE);
+	UNLOCK_IPC_MSG_POOL()
+	return 0;
+
+err:
+	ipc_msg_pools_destroy();
+	UNLOCK_IPC_MSG_POOL()
+	return 1;
+}
+
+/* This function will be called automatically on library unload */
+static void __attribute__((destructor)) ipc_msg_pool_cleanup(void)
+{
+	LOCK_IPC_MSG_POOL()
+	ipc_msg_pools_destroy();
+	UNLOCK_IPC_MSG_POOL()
+}
+
+void wave_ipc_msg_pools_walk(void (*cb)(obj_pool *pool, void *arg), void *arg)
+{
+	size_t i;
+
+	if (cb == NULL)
+		return;
+
+	LOCK_IPC_MSG_POOL()
+	if (ipc_msg_pool) {
+		cb(ipc_msg_pool, arg);
+		for (i = 0; i < IPC_MSG_NUM_DATA_CLASSES; i++)
+			cb(ipc_msg_data_pool[i], arg);
+	}
+	UNLOCK_IPC_MSG_POOL()
+}
+
+static void ipc_msg_data_release(wv_ipc_msg *msg)
+{
+	if (msg->data_class != IPC_MSG_DATA_CLASS_INLINE)
+		obj_pool_put_object(ipc_msg_data_pool[msg->data_class], msg->data);
+
+	msg->data_class = IPC_MSG_DATA_CLASS_INLINE;
+	msg->data_capacity = sizeof(msg->inline_data);
+	msg->data = msg->inline_data;
+}
+
+/* Make sure that msg is able to hold len bytes of data. If the current buffer
+ * is too small, the data is moved to a buffer of the smallest fitting class */
+static wv_ipc_ret ipc_msg_data_grow(wv_ipc_msg *msg, size_t len)
+{
+	char *buff;
+	size_t i;
+
+	if (len <= msg->data_capacity)
+		return WAVE_IPC_SUCCESS;
+
+	if (len > WAVE_IPC_BUFF_SIZE)
+		return WAVE_IPC_ERROR;
+
+	for (i = 0; i < IPC_MSG_NUM_DATA_CLASSES; i++) {
+		if (len <= ipc_msg_data_class_size[i])
+			break;
+	}
+
+	if (i == IPC_MSG_NUM_DATA_CLASSES) {
+		BUG("no size class for %zu bytes", len);
+		return WAVE_IPC_ERROR;
+	}
+
+	buff = (char*)obj_pool_alloc_object(ipc_msg_data_pool[i]);
+
+	if (buff == NULL) {
+		ELOG("failed to allocate %zu bytes of msg data", ipc_msg_data_class_size[i]);
+		return WAVE_IPC_ERROR;
+	}
+
+	if (msg->info.data_len)
+		memcpy_s(buff, ipc_msg_data_class_size[i], msg->data, msg->info.data_len);
+
+	if (msg->data_class != IPC_MSG_DATA_CLASS_INLINE)
+		ipc_msg_data_release(msg);
+
+	msg->data_class = (int)i;
+	msg->data_capacity = ipc_msg_data_class_size[i];
+	msg->data = buff;
+	return WAVE_IPC_SUCCESS;
+}
+
+static wv_ipc_msg* ipc_msg_alloc(size_t size)
+{
+	wv_ipc_msg *msg = NULL;
+
+	if (ipc_msg_pools_init()) {
+		BUG("Failed to initialize obj pool");
+		return NULL;
 	}
 
 	msg = (wv_ipc_msg*)obj_pool_alloc_object(ipc_msg_pool);
-	UNLOCK_IPC_MSG_POOL()
 
-	if (msg) {
-		msg->prev = NULL;
-		msg->next = NULL;
-		msg->is_head = 0;
-		msg->packet.info.data_len = 0;
-		memset(msg->packet.info.hdr, 0, sizeof(msg->packet.info.hdr));
+	if (msg == NULL) {
+		BUG("alloc object returned NULL");
+		return NULL;
+	}
+
+	msg->prev = NULL;
+	msg->next = NULL;
+	msg->is_head = 0;
+	msg->refcnt = 1;
+	msg->deadline_ms = WAVE_IPC_NO_DEADLINE;
+	msg->data_class = IPC_MSG_DATA_CLASS_INLINE;
+	msg->data_capacity = sizeof(msg->inline_data);
+	msg->data = msg->inline_data;
+	msg->info.data_len = 0;
+	memset(msg->info.hdr, 0, sizeof(msg->info.hdr));
+
+	if (ipc_msg_data_grow(msg, size) != WAVE_IPC_SUCCESS) {
+		obj_pool_put_object(ipc_msg_pool, (void*)msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
 #ifdef WAVE_IPC_CORE_DEBUG
+wv_ipc_msg* _wave_ipc_msg_alloc_debug(size_t size, const char *func, unsigned lineno)
+{
+	wv_ipc_msg *msg = ipc_msg_alloc(size);
+
+	if (msg) {
 		msg->func = func;
 		msg->lineno = lineno;
 		msg->thread_id = pthread_self();
-#endif
-	} else
-		BUG("alloc object returned NULL");
+	}
 
 	return msg;
 }
+#else
+wv_ipc_msg* wave_ipc_msg_alloc(void)
+{
+	return ipc_msg_alloc(0);
+}
+
+wv_ipc_msg* wave_ipc_msg_alloc_size(size_t size)
+{
+	return ipc_msg_alloc(size);
+}
+#endif
 
 wv_ipc_ret wave_ipc_multi_msg_append(wv_ipc_msg *head, wv_ipc_msg *msg)
 {
@@ -179,18 +370,53 @@ wv_ipc_msg* wave_ipc_msg_dup(wv_ipc_msg *orig)
 		return NULL;
 	}
 
-	clone = wave_ipc_msg_alloc();
+	/* clone gets the smallest size class fitting the actual data */
+	clone = wave_ipc_msg_alloc_size(orig->info.data_len);
 	if (clone == NULL) {
 		ELOG("alloc object returned NULL");
 		return NULL;
 	}
 
-	memcpy_s(clone, sizeof(wv_ipc_msg), orig, sizeof(wv_ipc_msg));
+	memcpy_s(&clone->info, sizeof(clone->info), &orig->info, sizeof(orig->info));
+	clone->deadline_ms = orig->deadline_ms;
+	if (orig->info.data_len)
+		memcpy_s(clone->data, clone->data_capacity, orig->data, orig->info.data_len);
 	return clone;
 }
 
+wv_ipc_msg* wave_ipc_msg_get(wv_ipc_msg *msg)
+{
+	if (msg == NULL) {
+		BUG("msg is NULL!");
+		return NULL;
+	}
+
+	__atomic_add_fetch(&msg->refcnt, 1, __ATOMIC_RELAXED);
+	return msg;
+}
+
+int wave_ipc_msg_is_shared(wv_ipc_msg *msg)
+{
+	if (msg == NULL)
+		return 0;
+
+	return (__atomic_load_n(&msg->refcnt, __ATOMIC_ACQUIRE) > 1);
+}
+
+/* A shared message may be in the middle of being sent to another station */
+static inline int ipc_msg_check_writable(wv_ipc_msg *msg)
+{
+	if (wave_ipc_msg_is_shared(msg)) {
+		BUG("modifying a shared msg");
+		return 1;
+	}
+	return 0;
+}
+
 void wave_ipc_msg_put(wv_ipc_msg *msg)
 {
+	int refcnt;
+
 	if (msg == NULL) {
 		BUG("msg is NULL!");
 		return;
@@ -201,17 +427,26 @@ void wave_ipc_msg_put(wv_ipc_msg *msg)
 		return;
 	}
 
-	LOCK_IPC_MSG_POOL()
+	refcnt = __atomic_sub_fetch(&msg->refcnt, 1, __ATOMIC_ACQ_REL);
+	if (refcnt > 0)
+		return;
+
+	if (refcnt < 0) {
+		BUG("msg was already released");
+		return;
+	}
+
 	if (wave_ipc_msg_is_multi_msg(msg)) {
 		wv_ipc_msg *next = msg->next;
 		while (next != msg && next != NULL) {
 			wv_ipc_msg *next_next = next->next;
+			ipc_msg_data_release(next);
 			obj_pool_put_object(ipc_msg_pool, (void*)next);
 			next = next_next;
 		}
 	}
+	ipc_msg_data_release(msg);
 	obj_pool_put_object(ipc_msg_pool, (void*)msg);
-	UNLOCK_IPC_MSG_POOL()
 }
 
 wv_ipc_ret wave_ipc_msg_fill_data(wv_ipc_msg *msg, const char *data, size_t len)
@@ -219,19 +454,25 @@ wv_ipc_ret wave_ipc_msg_fill_data(wv_ipc_msg *msg, const char *data, size_t len)
 	if (msg == NULL || (data == NULL && len != 0))
 		return WAVE_IPC_ERROR;
 
+	if (ipc_msg_check_writable(msg))
+		return WAVE_IPC_ERROR;
+
 	if (len > WAVE_IPC_BUFF_SIZE)
 		return WAVE_IPC_ERROR;
 
 	if (data == NULL) {
-		msg->packet.info.data_len = 0;
+		msg->info.data_len = 0;
 		return WAVE_IPC_SUCCESS;
 	}
 
-	if (msg->packet.info.data_len)
+	if (msg->info.data_len)
 		return WAVE_IPC_ERROR;
 
-	memcpy_s(msg->packet.data, sizeof(msg->packet.data), data, len);
-	msg->packet.info.data_len = len;
+	if (ipc_msg_data_grow(msg, len) != WAVE_IPC_SUCCESS)
+		return WAVE_IPC_ERROR;
+
+	memcpy_s(msg->data, msg->data_capacity, data, len);
+	msg->info.data_len = len;
 	return WAVE_IPC_SUCCESS;
 }
 
@@ -240,12 +481,18 @@ wv_ipc_ret wave_ipc_msg_append_data(wv_ipc_msg *msg, const char *data, size_t le
 	if (msg == NULL || data == NULL || len == 0)
 		return WAVE_IPC_ERROR;
 
-	if (len + msg->packet.info.data_len > WAVE_IPC_BUFF_SIZE)
+	if (ipc_msg_check_writable(msg))
+		return WAVE_IPC_ERROR;
+
+	if (len + msg->info.data_len > WAVE_IPC_BUFF_SIZE)
+		return WAVE_IPC_ERROR;
+
+	if (ipc_msg_data_grow(msg, len + msg->info.data_len) != WAVE_IPC_SUCCESS)
 		return WAVE_IPC_ERROR;
 
-	memcpy_s(msg->packet.data + msg->packet.info.data_len,
-		 sizeof(msg->packet.data) - msg->packet.info.data_len, data, len);
-	msg->packet.info.data_len += len;
+	memcpy_s(msg->data + msg->info.data_len,
+		 msg->data_capacity - msg->info.data_len, data, len);
+	msg->info.data_len += len;
 	return WAVE_IPC_SUCCESS;
 }
 
@@ -254,13 +501,19 @@ wv_ipc_ret wave_ipc_msg_reserve_data(wv_ipc_msg *msg, size_t len)
 	if (msg == NULL || len == 0)
 		return WAVE_IPC_ERROR;
 
+	if (ipc_msg_check_writable(msg))
+		return WAVE_IPC_ERROR;
+
 	if (len > WAVE_IPC_BUFF_SIZE)
 		return WAVE_IPC_ERROR;
 
-	if (msg->packet.info.data_len)
+	if (msg->info.data_len)
 		return WAVE_IPC_ERROR;
 
-	msg->packet.info.data_len = len;
+	if (ipc_msg_data_grow(msg, len) != WAVE_IPC_SUCCESS)
+		return WAVE_IPC_ERROR;
+
+	msg->info.data_len = len;
 	return WAVE_IPC_SUCCESS;
 }
 
@@ -269,29 +522,93 @@ wv_ipc_ret wave_ipc_msg_shrink_data(wv_ipc_msg *msg, size_t len)
 	if (msg == NULL)
 		return WAVE_IPC_ERROR;
 
-	if (msg->packet.info.data_len < len)
+	if (ipc_msg_check_writable(msg))
 		return WAVE_IPC_ERROR;
 
-	msg->packet.info.data_len = len;
+	if (msg->info.data_len < len)
+		return WAVE_IPC_ERROR;
+
+	msg->info.data_len = len;
 	return WAVE_IPC_SUCCESS;
 }
 
 char* wave_ipc_msg_get_data(wv_ipc_msg *msg)
 {
 	if (msg == NULL ||
-	    msg->packet.info.data_len == 0 ||
-	    msg->packet.info.data_len > sizeof(msg->packet.data))
+	    msg->info.data_len == 0 ||
+	    msg->info.data_len > msg->data_capacity)
 		return NULL;
 
-	return msg->packet.data;
+	return msg->data;
 }
 
 size_t wave_ipc_msg_get_size(wv_ipc_msg *msg)
 {
-	if (msg == NULL || msg->packet.info.data_len > sizeof(msg->packet.data))
+	if (msg == NULL || msg->info.data_len > msg->data_capacity)
 		return 0;
 
-	return msg->packet.info.data_len;
+	return msg->info.data_len;
+}
+
+uint64_t wave_ipc_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return wave_ipc_timespec_to_ms(&ts);
+}
+
+uint64_t wave_ipc_timespec_to_ms(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+void wave_ipc_ms_to_timespec(uint64_t ms, struct timespec *ts)
+{
+	ts->tv_sec = ms / 1000;
+	ts->tv_nsec = (ms % 1000) * 1000000;
+}
+
+void wave_ipc_deadline_after_ms(struct timespec *deadline, unsigned int ms)
+{
+	if (deadline == NULL)
+		return;
+
+	wave_ipc_ms_to_timespec(wave_ipc_now_ms() + ms, deadline);
+}
+
+int wave_ipc_cond_init_monotonic(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	int res;
+
+	if (pthread_condattr_init(&attr))
+		return 1;
+
+	res = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) ||
+	      pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return res;
+}
+
+void wave_ipc_msg_set_deadline(wv_ipc_msg *msg, uint64_t deadline_ms)
+{
+	if (msg)
+		msg->deadline_ms = deadline_ms;
+}
+
+uint64_t wave_ipc_msg_get_deadline(wv_ipc_msg *msg)
+{
+	return msg ? msg->deadline_ms : WAVE_IPC_NO_DEADLINE;
+}
+
+bool wave_ipc_msg_deadline_passed(wv_ipc_msg *msg)
+{
+	if (msg == NULL || msg->deadline_ms == WAVE_IPC_NO_DEADLINE)
+		return false;
+
+	return (wave_ipc_now_ms() >= msg->deadline_ms);
 }
 
 wv_ipc_ret wave_ipc_msg_push_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t len)
@@ -301,35 +618,41 @@ wv_ipc_ret wave_ipc_msg_push_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t len)
 	if (msg == NULL || hdr == NULL || len == 0)
 		return WAVE_IPC_ERROR;
 
-	while (i < sizeof(msg->packet.info.hdr)) {
-		if (msg->packet.info.hdr[i])
-			i += msg->packet.info.hdr[i] + 1;
+	if (ipc_msg_check_writable(msg))
+		return WAVE_IPC_ERROR;
+
+	while (i < sizeof(msg->info.hdr)) {
+		if (msg->info.hdr[i])
+			i += msg->info.hdr[i] + 1;
 		else
 			break;
 	}
 
-	if (i >= sizeof(msg->packet.info.hdr))
+	if (i >= sizeof(msg->info.hdr))
 		return WAVE_IPC_ERROR;
 
-	if (i + len + 1 > sizeof(msg->packet.info.hdr))
+	if (i + len + 1 > sizeof(msg->info.hdr))
 		return WAVE_IPC_ERROR;
 
-	msg->packet.info.hdr[i++] = len;
-	memcpy_s(&msg->packet.info.hdr[i], sizeof(msg->packet.info.hdr) - i, hdr, len);
+	msg->info.hdr[i++] = len;
+	memcpy_s(&msg->info.hdr[i], sizeof(msg->info.hdr) - i, hdr, len);
 	return WAVE_IPC_SUCCESS;
 }
 
 wv_ipc_ret wave_ipc_msg_pop_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t *len)
 {
-	uint8_t i = 0, j = sizeof(msg->packet.info.hdr);
+	uint8_t i = 0, j = sizeof(msg->info.hdr);
 
 	if (msg == NULL || hdr == NULL || len == NULL || *len == 0)
 		return WAVE_IPC_ERROR;
 
-	while (i < sizeof(msg->packet.info.hdr)) {
-		if (msg->packet.info.hdr[i]) {
+	if (ipc_msg_check_writable(msg))
+		return WAVE_IPC_ERROR;
+
+	while (i < sizeof(msg->info.hdr)) {
+		if (msg->info.hdr[i]) {
 			j = i;
-			i += msg->packet.info.hdr[i] + 1;
+			i += msg->info.hdr[i] + 1;
 		} else
 			break;
 	}
@@ -337,40 +660,67 @@ wv_ipc_ret wave_ipc_msg_pop_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t *len)
 	if (i == 0)
 		return WAVE_IPC_ERROR;
 
-	if (j >= sizeof(msg->packet.info.hdr) ||
-	    j + msg->packet.info.hdr[j] >= sizeof(msg->packet.info.hdr)) {
-		BUG("j=%d, i=%d msg->hdr[j]=%d", j, i, msg->packet.info.hdr[j]);
+	if (j >= sizeof(msg->info.hdr) ||
+	    j + msg->info.hdr[j] >= sizeof(msg->info.hdr)) {
+		BUG("j=%d, i=%d msg->hdr[j]=%d", j, i, msg->info.hdr[j]);
 		return WAVE_IPC_ERROR;
 	}
 
-	if (msg->packet.info.hdr[j] > *len) {
-		BUG("msg->hdr[j]=%d > *len=%d", msg->packet.info.hdr[j], *len);
+	if (msg->info.hdr[j] > *len) {
+		BUG("msg->hdr[j]=%d > *len=%d", msg->info.hdr[j], *len);
 		return WAVE_IPC_ERROR;
 	}
 
-	memcpy_s(hdr, *len, &msg->packet.info.hdr[j + 1], msg->packet.info.hdr[j]);
-	*len = msg->packet.info.hdr[j];
+	memcpy_s(hdr, *len, &msg->info.hdr[j + 1], msg->info.hdr[j]);
+	*len = msg->info.hdr[j];
 
-	memset(&msg->packet.info.hdr[j], 0, *len + 1);
+	memset(&msg->info.hdr[j], 0, *len + 1);
 	return WAVE_IPC_SUCCESS;
 }
 
-wv_ipc_ret wave_ipc_send_msg(int socket, wv_ipc_msg *msg, int flags)
+wv_ipc_ret wave_ipc_send_msg_from(int socket, wv_ipc_msg *msg, int flags,
+				  size_t *offset)
 {
+	struct iovec iov[2];
+	struct msghdr msghdr;
+	size_t skip, total;
 	ssize_t res;
 
-	if (msg == NULL)
+	if (msg == NULL || offset == NULL)
 		return WAVE_IPC_ERROR;
 
 	if (socket == -1)
 		goto err;
 
-	if (msg->packet.info.data_len > sizeof(msg->packet.data))
+	if (msg->info.data_len > msg->data_capacity)
+		goto err;
+
+	total = sizeof(msg->info) + msg->info.data_len;
+	if (*offset >= total)
 		goto err;
 
-	res = send(socket, &msg->packet,
-		   sizeof(msg->packet.info) + msg->packet.info.data_len,
-		   MSG_NOSIGNAL | flags);
+	/* info and data live in separate buffers, send only the used part of
+	 * data and skip what was already sent */
+	memset(&msghdr, 0, sizeof(msghdr));
+	msghdr.msg_iov = iov;
+	skip = *offset;
+	if (skip < sizeof(msg->info)) {
+		iov[0].iov_base = (char*)&msg->info + skip;
+		iov[0].iov_len = sizeof(msg->info) - skip;
+		iov[1].iov_base = msg->data;
+		iov[1].iov_len = msg->info.data_len;
+		msghdr.msg_iovlen = msg->info.data_len ? 2 : 1;
+	} else {
+		skip -= sizeof(msg->info);
+		iov[0].iov_base = msg->data + skip;
+		iov[0].iov_len = msg->info.data_len - skip;
+		msghdr.msg_iovlen = 1;
+	}
+
+	do {
+		res = sendmsg(socket, &msghdr, MSG_NOSIGNAL | flags);
+	} while (res == -1 && errno == EINTR);
+
 	if (res == -1) {
 		if (errno == EAGAIN || errno == EWOULDBLOCK)
 			return WAVE_IPC_CMD_WOULD_BLOCK;
@@ -379,16 +729,101 @@ wv_ipc_ret wave_ipc_send_msg(int socket, wv_ipc_msg *msg, int flags)
 		goto err;
 	}
 
+	*offset += res;
+	if (*offset < total)
+		return WAVE_IPC_CMD_WOULD_BLOCK;
+
 	return WAVE_IPC_SUCCESS;
 err:
 	return WAVE_IPC_ERROR;
 }
 
+/* Max time a blocking send of a msg without deadline waits for its socket to
+ * drain, once part of the msg is on the wire */
+#define WAVE_IPC_SEND_BLOCK_MS	(5000)
+
+/* Returns 0 once the socket is writable (or has an error to report), 1 if
+ * the deadline passed first */
+static int ipc_wait_writable(int socket, uint64_t deadline_ms)
+{
+	struct pollfd pfd = { .fd = socket, .events = POLLOUT };
+	uint64_t now_ms;
+	int res;
+
+	do {
+		now_ms = wave_ipc_now_ms();
+		if (now_ms >= deadline_ms)
+			return 1;
+
+		res = poll(&pfd, 1, (int)(deadline_ms - now_ms));
+	} while (res == -1 && errno == EINTR);
+
+	return res > 0 ? 0 : 1;
+}
+
+wv_ipc_ret wave_ipc_send_msg(int socket, wv_ipc_msg *msg, int flags)
+{
+	uint64_t deadline_ms = WAVE_IPC_NO_DEADLINE;
+	size_t offset = 0;
+	wv_ipc_ret ret;
+
+	while (1) {
+		ret = wave_ipc_send_msg_from(socket, msg, flags, &offset);
+		if (ret != WAVE_IPC_CMD_WOULD_BLOCK || !offset || (flags & MSG_DONTWAIT))
+			break;
+
+		/* The socket is non-blocking or the send was interrupted by a
+		 * signal; wait for room instead of spinning on EAGAIN */
+		if (deadline_ms == WAVE_IPC_NO_DEADLINE) {
+			deadline_ms = msg->deadline_ms;
+			if (deadline_ms == WAVE_IPC_NO_DEADLINE)
+				deadline_ms = wave_ipc_now_ms() + WAVE_IPC_SEND_BLOCK_MS;
+		}
+		if (ipc_wait_writable(socket, deadline_ms))
+			break;
+	}
+
+	if (ret == WAVE_IPC_CMD_WOULD_BLOCK && offset) {
+		/* the rest of the msg can't be sent later by the caller */
+		ELOG("partial send (%zu bytes)", offset);
+		return WAVE_IPC_ERROR;
+	}
+
+	return ret;
+}
+
+/* Reads exactly len bytes. Returns len, 0 if the peer disconnected before
+ * sending anything, or -1 */
+static ssize_t ipc_recv_all(int socket, void *buf, size_t len)
+{
+	size_t got = 0;
+	ssize_t res;
+
+	while (got < len) {
+		res = recv(socket, (char*)buf + got, len - got, 0);
+		if (res == -1 && errno == EINTR)
+			continue;
+		if (res == -1) {
+			ELOG("recv error, errno = %d", errno);
+			return -1;
+		}
+		if (res == 0) {
+			if (got)
+				ELOG("disconnected in the middle of a msg");
+			return got ? -1 : 0;
+		}
+		got += res;
+	}
+
+	return got;
+}
+
 wv_ipc_ret wave_ipc_recv_msg(int socket, wv_ipc_msg **out_msg)
 {
 	ssize_t recv_res;
 	wv_ipc_msg *msg;
 	wv_ipc_ret ret;
+	uint16_t data_len;
 
 	if (socket == -1)
 		return WAVE_IPC_DISCONNECTED;
@@ -400,31 +835,28 @@ wv_ipc_ret wave_ipc_recv_msg(int socket, wv_ipc_msg **out_msg)
 		return WAVE_IPC_ERROR;
 
 	ret = WAVE_IPC_ERROR;
-	recv_res = recv(socket, &msg->packet.info, sizeof(msg->packet.info), 0);
+	recv_res = ipc_recv_all(socket, &msg->info, sizeof(msg->info));
 	if (recv_res == -1) {
-		ELOG("recv error, errno = %d", errno);
 		goto err;
 	} else if (recv_res == 0) {
 		LOG(1, "disconnected gracefuly");
 		ret = WAVE_IPC_DISCONNECTED;
 		goto err;
-	} else if ((size_t)recv_res < sizeof(msg->packet.info)) {
-		ELOG("disconnecting client");
-		goto err;
-	} else if (msg->packet.info.data_len > sizeof(msg->packet.data)) {
-		BUG("data len (%d) > max data size", msg->packet.info.data_len);
+	} else if (msg->info.data_len > WAVE_IPC_BUFF_SIZE) {
+		BUG("data len (%d) > max data size", msg->info.data_len);
 		goto err;
 	}
 
-	if (msg->packet.info.data_len) {
-		recv_res = recv(socket, msg->packet.data, msg->packet.info.data_len, 0);
-		if (recv_res == -1) {
-			ELOG("recv error, errno = %d", errno);
-			goto err;
-		} else if (recv_res != msg->packet.info.data_len) {
-			BUG("disconnecting client");
-			goto err;
-		}
+	data_len = msg->info.data_len;
+	msg->info.data_len = 0;
+	if (ipc_msg_data_grow(msg, data_len) != WAVE_IPC_SUCCESS)
+		goto err;
+	msg->info.data_len = data_len;
+
+	if (msg->info.data_len &&
+	    ipc_recv_all(socket, msg->data, msg->info.data_len) != msg->info.data_len) {
+		BUG("disconnecting client");
+		goto err;
 	}
 
 	*out_msg = msg;
@@ -434,3 +866,210 @@ err:
 	wave_ipc_msg_put(msg);
 	return ret;
 }
+
+/* Bytes read ahead of the current msg, so that one read returns several
+ * small messages */
+#define IPC_RX_BUF_SIZE	(4096)
+
+struct _wv_ipc_rx {
+	wv_ipc_msg *msg;	/* msg being received, NULL between messages */
+	size_t got;		/* bytes of msg received so far */
+	uint16_t data_len;	/* data length of msg, valid once its info is in */
+	size_t head, tail;	/* bytes not parsed yet are buf[head..tail) */
+	char buf[IPC_RX_BUF_SIZE];
+};
+
+wv_ipc_rx* wave_ipc_rx_create(void)
+{
+	wv_ipc_rx *rx = (wv_ipc_rx*)malloc(sizeof(wv_ipc_rx));
+
+	if (rx == NULL) {
+		ELOG("failed to allocate rx state");
+		return NULL;
+	}
+
+	rx->msg = NULL;
+	rx->got = 0;
+	rx->data_len = 0;
+	rx->head = rx->tail = 0;
+	return rx;
+}
+
+void wave_ipc_rx_reset(wv_ipc_rx *rx)
+{
+	if (rx == NULL)
+		return;
+
+	if (rx->msg)
+		wave_ipc_msg_put(rx->msg);
+	rx->msg = NULL;
+	rx->got = 0;
+	rx->head = rx->tail = 0;
+}
+
+void wave_ipc_rx_destroy(wv_ipc_rx *rx)
+{
+	if (rx == NULL)
+		return;
+
+	wave_ipc_rx_reset(rx);
+	free(rx);
+}
+
+int wave_ipc_rx_has_msg(wv_ipc_rx *rx)
+{
+	size_t avail;
+	uint16_t data_len;
+
+	/* bytes are buffered only after a msg was completed (see ipc_rx_parse) */
+	if (rx == NULL || rx->msg)
+		return 0;
+
+	avail = rx->tail - rx->head;
+	if (avail < sizeof(wv_ipc_msg_info))
+		return 0;
+
+	memcpy_s(&data_len, sizeof(data_len), rx->buf + rx->head, sizeof(data_len));
+	return (avail >= sizeof(wv_ipc_msg_info) + data_len);
+}
+
+/* Moves the buffered bytes to the msg being received, until it's complete.
+ * Returns 1 if the msg is complete, 0 if more bytes are needed, -1 on error */
+static int ipc_rx_parse(wv_ipc_rx *rx)
+{
+	wv_ipc_msg *msg;
+	size_t avail, len, data_got;
+
+	if (rx->msg == NULL) {
+		if (rx->head == rx->tail)
+			return 0;
+
+		if ((rx->msg = wave_ipc_msg_alloc()) == NULL)
+			return -1;
+		rx->got = 0;
+	}
+
+	msg = rx->msg;
+	avail = rx->tail - rx->head;
+
+	if (rx->got < sizeof(msg->info)) {
+		len = sizeof(msg->info) - rx->got;
+		if (len > avail)
+			len = avail;
+		if (len)
+			memcpy_s((char*)&msg->info + rx->got, sizeof(msg->info) - rx->got,
+				 rx->buf + rx->head, len);
+		rx->got += len;
+		rx->head += len;
+		avail -= len;
+		if (rx->got < sizeof(msg->info))
+			goto out;
+
+		if (msg->info.data_len > WAVE_IPC_BUFF_SIZE) {
+			BUG("data len (%d) > max data size", msg->info.data_len);
+			return -1;
+		}
+
+		rx->data_len = msg->info.data_len;
+		msg->info.data_len = 0;
+		if (ipc_msg_data_grow(msg, rx->data_len) != WAVE_IPC_SUCCESS)
+			return -1;
+		msg->info.data_len = rx->data_len;
+	}
+
+	data_got = rx->got - sizeof(msg->info);
+	len = rx->data_len - data_got;
+	if (len > avail)
+		len = avail;
+	if (len) {
+		memcpy_s(msg->data + data_got, msg->data_capacity - data_got,
+			 rx->buf + rx->head, len);
+		rx->got += len;
+		rx->head += len;
+	}
+
+out:
+	if (rx->head == rx->tail)
+		rx->head = rx->tail = 0;
+
+	return (rx->got == sizeof(msg->info) + rx->data_len) ? 1 : 0;
+}
+
+/* The data of the msg being received is read in place and what follows it
+ * goes to buf, which is empty at this point */
+static ssize_t ipc_rx_read(wv_ipc_rx *rx, int socket, int flags)
+{
+	struct iovec iov[2];
+	struct msghdr msghdr;
+	size_t in_place = 0;
+	ssize_t res;
+
+	memset(&msghdr, 0, sizeof(msghdr));
+	msghdr.msg_iov = iov;
+
+	if (rx->msg && rx->got >= sizeof(rx->msg->info)) {
+		size_t data_got = rx->got - sizeof(rx->msg->info);
+
+		in_place = rx->data_len - data_got;
+		iov[msghdr.msg_iovlen].iov_base = rx->msg->data + data_got;
+		iov[msghdr.msg_iovlen].iov_len = in_place;
+		msghdr.msg_iovlen++;
+	}
+
+	iov[msghdr.msg_iovlen].iov_base = rx->buf;
+	iov[msghdr.msg_iovlen].iov_len = sizeof(rx->buf);
+	msghdr.msg_iovlen++;
+
+	res = recvmsg(socket, &msghdr, flags);
+	if (res <= 0)
+		return res;
+
+	if ((size_t)res <= in_place) {
+		rx->got += res;
+	} else {
+		rx->got += in_place;
+		rx->head = 0;
+		rx->tail = res - in_place;
+	}
+
+	return res;
+}
+
+wv_ipc_ret wave_ipc_rx_recv(wv_ipc_rx *rx, int socket, int flags,
+			    wv_ipc_msg **out_msg)
+{
+	ssize_t res;
+	int parsed;
+
+	if (socket == -1)
+		return WAVE_IPC_DISCONNECTED;
+
+	if (rx == NULL || out_msg == NULL)
+		return WAVE_IPC_ERROR;
+
+	while (1) {
+		parsed = ipc_rx_parse(rx);
+		if (parsed < 0)
+			return WAVE_IPC_ERROR;
+
+		if (parsed) {
+			*out_msg = rx->msg;
+			rx->msg = NULL;
+			return WAVE_IPC_SUCCESS;
+		}
+
+		res = ipc_rx_read(rx, socket, flags);
+		if (res == 0) {
+			LOG(1, "disconnected gracefuly");
+			return WAVE_IPC_DISCONNECTED;
+		} else if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return WAVE_IPC_CMD_WOULD_BLOCK;
+
+			ELOG("recv error, errno = %d", errno);
+			return WAVE_IPC_ERROR;
+		}
+	}
+}
@@ -12,26 +12,42 @@
 #define __WAVE_IPC_CORE__H__
 
 #include "wave_ipc.h"
+#include "obj_pool.h"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
 
 /* Define WAVE_IPC_CORE_DEBUG for extended debug printouts */
 /* #define WAVE_IPC_CORE_DEBUG */
 
 typedef struct _wv_ipc_msg wv_ipc_msg;
 
+/* Message data is kept in a buffer of the smallest fitting size class and moved
+ * to a bigger one when needed (up to WAVE_IPC_BUFF_SIZE). wave_ipc_msg_alloc_size()
+ * picks the class up front when the payload size is known in advance */
 #ifdef WAVE_IPC_CORE_DEBUG
-#define wave_ipc_msg_alloc() _wave_ipc_msg_alloc_debug(__FUNCTION__, __LINE__)
-wv_ipc_msg* _wave_ipc_msg_alloc_debug(const char *func, unsigned lineno);
+#define wave_ipc_msg_alloc() _wave_ipc_msg_alloc_debug(0, __FUNCTION__, __LINE__)
+#define wave_ipc_msg_alloc_size(size) _wave_ipc_msg_alloc_debug(size, __FUNCTION__, __LINE__)
+wv_ipc_msg* _wave_ipc_msg_alloc_debug(size_t size, const char *func, unsigned lineno);
 #else
 wv_ipc_msg* wave_ipc_msg_alloc(void);
+wv_ipc_msg* wave_ipc_msg_alloc_size(size_t size);
 #endif
 wv_ipc_ret wave_ipc_multi_msg_append(wv_ipc_msg *head, wv_ipc_msg *msg);
 int wave_ipc_msg_is_multi_msg(wv_ipc_msg *msg);
 wv_ipc_msg * wave_ipc_multi_msg_get_next(wv_ipc_msg *msg);
 wv_ipc_msg* wave_ipc_msg_dup(wv_ipc_msg *orig);
+
+/* Messages are reference counted: alloc returns a message holding one
+ * reference, wave_ipc_msg_get() takes another one and wave_ipc_msg_put()
+ * drops one, freeing the message with the last. A shared message (more than
+ * one reference) is immutable, data and header changes fail on it, so one
+ * message can be queued to many stations without copying it */
+wv_ipc_msg* wave_ipc_msg_get(wv_ipc_msg *msg);
+int wave_ipc_msg_is_shared(wv_ipc_msg *msg);
 void wave_ipc_msg_put(wv_ipc_msg *msg);
 
 wv_ipc_ret wave_ipc_msg_fill_data(wv_ipc_msg *msg, const char *data, size_t len);
@@ -44,12 +60,71 @@ size_t wave_ipc_msg_get_size(wv_ipc_msg *msg);
 wv_ipc_ret wave_ipc_msg_push_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t len);
 wv_ipc_ret wave_ipc_msg_pop_hdr(wv_ipc_msg *msg, uint8_t* hdr, uint8_t *len);
 
+/* Deadlines of commands are absolute CLOCK_MONOTONIC times, kept in msec
+ * internally. The time left is sent in the ipc header of the command and the
+ * receiver attaches the deadline to the msg, so the handler can drop a
+ * command its sender has already given up on */
+#define WAVE_IPC_NO_DEADLINE	(0)
+
+uint64_t wave_ipc_now_ms(void);
+uint64_t wave_ipc_timespec_to_ms(const struct timespec *ts);
+void wave_ipc_ms_to_timespec(uint64_t ms, struct timespec *ts);
+
+/* Fill 'deadline' with the CLOCK_MONOTONIC time 'ms' msec from now */
+void wave_ipc_deadline_after_ms(struct timespec *deadline, unsigned int ms);
+
+/* Condition variable waited on with CLOCK_MONOTONIC deadlines */
+int wave_ipc_cond_init_monotonic(pthread_cond_t *cond);
+
+void wave_ipc_msg_set_deadline(wv_ipc_msg *msg, uint64_t deadline_ms);
+/* WAVE_IPC_NO_DEADLINE unless the sender of the command has set one */
+uint64_t wave_ipc_msg_get_deadline(wv_ipc_msg *msg);
+bool wave_ipc_msg_deadline_passed(wv_ipc_msg *msg);
+
+/* Calls 'cb' for every pool backing ipc messages and their data buffers.
+ * Does nothing before the first message is allocated */
+void wave_ipc_msg_pools_walk(void (*cb)(obj_pool *pool, void *arg), void *arg);
+
+/* Sends the whole msg. With MSG_DONTWAIT a partial send is an error, use
+ * wave_ipc_send_msg_from() to be able to resume it. Otherwise, once part of
+ * the msg is sent to a non-blocking socket, waits for the socket to drain
+ * until the deadline of the msg (5 seconds if it has none) */
 wv_ipc_ret wave_ipc_send_msg(int socket, wv_ipc_msg *msg, int flags);
+
+/* Sends msg starting at byte '*offset' of its wire format and advances
+ * '*offset' by the bytes sent. Returns WAVE_IPC_CMD_WOULD_BLOCK if the msg
+ * was sent only partially (or not at all), the caller resumes from '*offset'
+ * once the socket is writable */
+wv_ipc_ret wave_ipc_send_msg_from(int socket, wv_ipc_msg *msg, int flags,
+				  size_t *offset);
+/* Receives exactly one msg, blocking until all of it arrived */
 wv_ipc_ret wave_ipc_recv_msg(int socket, wv_ipc_msg **out_msg);
 
+/* Receive state of a connection. A read takes whatever the socket has, the
+ * messages following the current one are buffered for the next calls and a
+ * msg that arrives in pieces is completed by the later reads, so it works on
+ * non-blocking sockets as well. Must be reset when the socket is replaced */
+typedef struct _wv_ipc_rx wv_ipc_rx;
+
+wv_ipc_rx* wave_ipc_rx_create(void);
+void wave_ipc_rx_destroy(wv_ipc_rx *rx);
+void wave_ipc_rx_reset(wv_ipc_rx *rx);
+
+/* Returns WAVE_IPC_CMD_WOULD_BLOCK once the socket has no complete msg */
+wv_ipc_ret wave_ipc_rx_recv(wv_ipc_rx *rx, int socket, int flags,
+			    wv_ipc_msg **out_msg);
+
+/* A complete msg is buffered: select()/epoll won't report it, so call
+ * wave_ipc_rx_recv() before waiting on the socket */
+int wave_ipc_rx_has_msg(wv_ipc_rx *rx);
+
 typedef struct __attribute__((__packed__)) {
 	uint8_t magic;
 	uint8_t header[4];
+	/* of the command and of its responses, see ipc_header_set_seq_num() */
+	uint8_t seq_num[4];
+	/* msec left to the deadline of a command, 0 if it has none */
+	uint8_t time_left[4];
 } ipc_header;
 
 #define IPC_HDR_MAGIC	(0xA1)
@@ -85,4 +160,58 @@ static inline uint16_t wv_aligned_16_bit_fetch(uint8_t *buff)
     return (uint16_t)*buff | ((uint16_t)*(buff + 1) << 8);
 }
 
+static inline void wv_aligned_32_bit_assign(uint8_t *buff, uint32_t num)
+{
+    wv_aligned_16_bit_assign(buff, num & (uint32_t)0xFFFF);
+    wv_aligned_16_bit_assign(buff + 2, (num >> 16) & (uint32_t)0xFFFF);
+}
+
+static inline uint32_t wv_aligned_32_bit_fetch(uint8_t *buff)
+{
+    return (uint32_t)wv_aligned_16_bit_fetch(buff) |
+	   ((uint32_t)wv_aligned_16_bit_fetch(buff + 2) << 16);
+}
+
+static inline void ipc_header_set_seq_num(ipc_header *hdr, uint32_t seq_num)
+{
+	wv_aligned_32_bit_assign(hdr->seq_num, seq_num);
+}
+
+static inline uint32_t ipc_header_get_seq_num(ipc_header *hdr)
+{
+	return wv_aligned_32_bit_fetch(hdr->seq_num);
+}
+
+/* The clocks of the peers may differ, the time left is sent instead of the
+ * deadline. Returns 1 if the deadline has already passed */
+static inline int ipc_header_set_deadline(ipc_header *hdr, uint64_t deadline_ms)
+{
+	uint64_t now;
+
+	if (deadline_ms == WAVE_IPC_NO_DEADLINE) {
+		wv_aligned_32_bit_assign(hdr->time_left, 0);
+		return 0;
+	}
+
+	now = wave_ipc_now_ms();
+	if (deadline_ms <= now)
+		return 1;
+
+	if (deadline_ms - now > UINT32_MAX)
+		wv_aligned_32_bit_assign(hdr->time_left, UINT32_MAX);
+	else
+		wv_aligned_32_bit_assign(hdr->time_left, (uint32_t)(deadline_ms - now));
+	return 0;
+}
+
+static inline uint64_t ipc_header_get_deadline(ipc_header *hdr)
+{
+	uint32_t time_left = wv_aligned_32_bit_fetch(hdr->time_left);
+
+	if (time_left == 0)
+		return WAVE_IPC_NO_DEADLINE;
+
+	return wave_ipc_now_ms() + time_left;
+}
+
 #endif /* __WAVE_IPC_CORE__H__ */
@@ -10,6 +10,7 @@
 
 #include "wave_ipc_server.h"
 #include "linked_list.h"
+#include "hash_table.h"
 #include "logs.h"
 
 #include <unistd.h>
@@ -19,7 +20,8 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <sys/time.h>
 #include <sys/un.h>
 
@@ -35,6 +37,13 @@
 #define IPC_CLIENT_ARR_SIZE	(36)
 #define IPC_CLIENT_NAME_SIZE	(48)
 #define SERV_SOCKET_LISTEN	(16)
+#define SERV_EPOLL_MAX_EVENTS	(16)
+
+/* Housekeeping period: stop condition check and stuck stations detection */
+#define SERV_HOUSEKEEPING_SEC	(1)
+/* Station is removed after this many housekeeping periods without progress
+ * in sending its pending messages */
+#define STA_MAX_RESEND_ATTEMPTS	(10)
 
 typedef enum _cmd_response_status {
 	RESP_NONE,
@@ -42,24 +51,40 @@ typedef enum _cmd_response_status {
 	RESP_FAILURE,
 } cmd_response_status;
 
+/* A command waiting for its response, in resp_table by seq_num. The fields
+ * are protected by resp_lock */
 typedef struct _cmd_response {
 	wv_ipstation *ipsta;
-	uint8_t seq_num;
-	volatile cmd_response_status status;
+	uint32_t seq_num;
+	cmd_response_status status;
 	wv_ipc_msg *response;
+	/* signaled once the response is complete */
+	pthread_cond_t cond;
 } cmd_response;
 
+#define RESP_TABLE_INIT_BUCKETS	(16)
+
 struct _wv_ipstation {
 	void *data;  /**< user-defined data; MUST be first (see _wv_ipstation_data)*/
 	int refcnt;
         int socket;
+	int index;      /* slot in ipserver->stations */
 	int is_connected;
 	char name[IPC_CLIENT_NAME_SIZE];
+	wv_ipc_rx *rx;
 
+	/* serializes the writes to the socket, protects the fields below */
+	pthread_mutex_t send_lock;
 	int has_pending_msgs;
 	int resend_attempts;
+	/* pending messages are references to the sent msg, not copies of it */
 	l_list *pending_msgs;
 	l_list *pending_replies;
+	/* msg partially written to the socket, sent before any other msg */
+	wv_ipc_msg *partial_msg;
+	size_t partial_offset;
+	/* messages that could neither be sent nor queued */
+	uint64_t dropped_msgs;
 };
 
 #define MAX_NUM_PENDING_IPC_MSGS		(1000)
@@ -67,32 +92,38 @@ struct _wv_ipstation {
 
 struct _wv_ipserver {
 	int listener_socket;
+	int epoll_fd;
+	int timer_fd;
 	char buf[WAVE_IPC_BUFF_SIZE];
 	struct sockaddr_un sockaddr;
 
 	wv_ipstation *stations[IPC_CLIENT_ARR_SIZE];
 	unsigned int num_stas;
+	/* protects num_blocking_stas, the set of stations with pending msgs */
 	pthread_mutex_t pending_lock;
+	unsigned int num_blocking_stas;
 
 	wv_ipserver_callbacks clbacks;
 
+	/* msgs pending on all the stations, updated atomically */
 	int station_has_pending_msgs;
 
 	/* Thread id of the server's wave_ipcs_run() */
 	pthread_t thread_id;
 
-	uint8_t cmd_seq_num;
-	l_list *resp_list;
-	pthread_mutex_t resp_list_lock;
-	pthread_mutex_t resp_cond_lock;
-	pthread_cond_t resp_cond;
+	uint32_t cmd_seq_num;
+	hash_table *resp_table;
+	pthread_mutex_t resp_lock;
 };
 
 #define PEND_MSGS_LOCK(srv) pthread_mutex_lock(&srv->pending_lock)
 #define PEND_MSGS_UNLOCK(srv) pthread_mutex_unlock(&srv->pending_lock)
 
+#define STA_SEND_LOCK(sta) pthread_mutex_lock(&sta->send_lock)
+#define STA_SEND_UNLOCK(sta) pthread_mutex_unlock(&sta->send_lock)
+
 static int wave_ipcs_cmd_async(wv_ipserver *ipserv, wv_ipstation *ipsta,
-				uint8_t seq_num, wv_ipc_msg *cmd)
+				uint32_t seq_num, wv_ipc_msg *cmd)
 {
 	if (ipserv->clbacks.cmd_async)
 		return ipserv->clbacks.cmd_async(ipserv, ipsta, seq_num, cmd);
@@ -125,6 +156,93 @@ static int wave_ipcs_removing_client(wv_ipserver *ipserv, wv_ipstation *ipsta)
 	return 1;
 }
 
+/* Must be called with the station's send_lock held. Links the station into
+ * or out of the set of blocking stations */
+static void wave_ipcs_sta_set_pending(wv_ipserver *ipserver, wv_ipstation *sta,
+				      int has_pending_msgs)
+{
+	if (sta->has_pending_msgs == has_pending_msgs)
+		return;
+
+	sta->has_pending_msgs = has_pending_msgs;
+
+	PEND_MSGS_LOCK(ipserver);
+	if (has_pending_msgs)
+		ipserver->num_blocking_stas++;
+	else
+		ipserver->num_blocking_stas--;
+	PEND_MSGS_UNLOCK(ipserver);
+}
+
+/* epoll data of the listener and timer fds; stations use their wv_ipstation */
+static int epoll_listener_tag;
+static int epoll_timer_tag;
+
+static int wave_ipcs_epoll_init(wv_ipserver *serv)
+{
+	struct epoll_event ev = { 0 };
+	struct itimerspec its = { { 0 } };
+
+	serv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (serv->epoll_fd == -1) {
+		ELOG("error creating epoll, errno = %d", errno);
+		return 1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &epoll_listener_tag;
+	if (epoll_ctl(serv->epoll_fd, EPOLL_CTL_ADD, serv->listener_socket, &ev)) {
+		ELOG("error adding listener to epoll, errno = %d", errno);
+		return 1;
+	}
+
+	serv->timer_fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (serv->timer_fd == -1) {
+		ELOG("error creating timerfd, errno = %d", errno);
+		return 1;
+	}
+
+	its.it_value.tv_sec = SERV_HOUSEKEEPING_SEC;
+	its.it_interval.tv_sec = SERV_HOUSEKEEPING_SEC;
+	if (timerfd_settime(serv->timer_fd, 0, &its, NULL)) {
+		ELOG("error setting timerfd, errno = %d", errno);
+		return 1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &epoll_timer_tag;
+	if (epoll_ctl(serv->epoll_fd, EPOLL_CTL_ADD, serv->timer_fd, &ev)) {
+		ELOG("error adding timerfd to epoll, errno = %d", errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Detach the station from the server loop. The socket itself is closed
+ * when the last reference to the station is dropped */
+static void wave_ipcs_remove_station(wv_ipserver *ipserver, wv_ipstation *station)
+{
+	int num_pending;
+
+	STA_SEND_LOCK(station);
+	num_pending = list_get_size(station->pending_msgs);
+	num_pending += list_get_size(station->pending_replies);
+	num_pending += station->partial_msg ? 1 : 0;
+	__atomic_sub_fetch(&ipserver->station_has_pending_msgs, num_pending,
+			   __ATOMIC_RELAXED);
+	wave_ipcs_sta_set_pending(ipserver, station, 0);
+	station->is_connected = 0;
+	STA_SEND_UNLOCK(station);
+
+	epoll_ctl(ipserver->epoll_fd, EPOLL_CTL_DEL, station->socket, NULL);
+	ipserver->stations[station->index] = NULL;
+	ipserver->num_stas--;
+
+	wave_ipcs_removing_client(ipserver, station);
+	wave_ipcs_sta_decref(station);
+}
+
 wv_ipc_ret wave_ipcs_create(wv_ipserver **handle_p, const char *server_name)
 {
 	wv_ipserver *serv;
@@ -141,6 +259,8 @@ wv_ipc_ret wave_ipcs_create(wv_ipserver **handle_p, const char *server_name)
 		return WAVE_IPC_ERROR;
 
 	memset(serv, 0, sizeof(wv_ipserver));
+	serv->epoll_fd = -1;
+	serv->timer_fd = -1;
 
 	pthread_mutex_init(&serv->pending_lock, NULL);
 
@@ -175,18 +295,22 @@ wv_ipc_ret wave_ipcs_create(wv_ipserver **handle_p, const char *server_name)
 		goto close;
 	}
 
-	if ((serv->resp_list = list_init()) == NULL)
+	if (wave_ipcs_epoll_init(serv))
+		goto close;
+
+	serv->resp_table = hash_table_init(RESP_TABLE_INIT_BUCKETS, hash_u32, hash_u32_cmp);
+	if (serv->resp_table == NULL)
 		goto close;
 
-	pthread_mutex_init(&serv->resp_cond_lock, NULL);
-	pthread_mutex_init(&serv->resp_list_lock, NULL);
-	pthread_cond_init(&serv->resp_cond, NULL);
+	pthread_mutex_init(&serv->resp_lock, NULL);
 
 	*handle_p = serv;
 	return WAVE_IPC_SUCCESS;
 close:
-	if (serv->resp_list)
-		list_free(serv->resp_list);
+	if (serv->timer_fd != -1)
+		close(serv->timer_fd);
+	if (serv->epoll_fd != -1)
+		close(serv->epoll_fd);
 	close(serv->listener_socket);
 free:
 	pthread_mutex_destroy(&serv->pending_lock);
@@ -216,12 +340,13 @@ wv_ipc_ret wave_ipcs_delete(wv_ipserver **handle_p)
 		ipserver->stations[i] = NULL;
 	}
 
+	close(ipserver->timer_fd);
+	close(ipserver->epoll_fd);
+
 	pthread_mutex_destroy(&ipserver->pending_lock);
 
-	pthread_cond_destroy(&ipserver->resp_cond);
-	pthread_mutex_destroy(&ipserver->resp_list_lock);
-	pthread_mutex_destroy(&ipserver->resp_cond_lock);
-	list_free(ipserver->resp_list);
+	pthread_mutex_destroy(&ipserver->resp_lock);
+	hash_table_free(ipserver->resp_table);
 
 	free(ipserver);
 
@@ -234,23 +359,15 @@ static void wave_ipcs_handle_response_from_client(wv_ipserver *ipserv,
 						  wv_ipc_msg *resp,
 						  ipc_header *resp_hdr)
 {
-	cmd_response *cs = NULL;
-	uint8_t response_seq_num = resp_hdr->header[1];
+	cmd_response *cs;
+	uint32_t response_seq_num = ipc_header_get_seq_num(resp_hdr);
 	int notify = 1;
 
-	pthread_mutex_lock(&ipserv->resp_cond_lock);
-	pthread_mutex_lock(&ipserv->resp_list_lock);
-	list_foreach_start(ipserv->resp_list, tmp, cmd_response)
-		if (tmp->seq_num == response_seq_num &&
-		    tmp->ipsta == ipsta) {
-			cs = tmp;
-			break;
-		}
-	list_foreach_end
-	if (!cs) {
-		pthread_mutex_unlock(&ipserv->resp_list_lock);
-		pthread_mutex_unlock(&ipserv->resp_cond_lock);
-		ELOG("response to seq num %d from '%s'was thrown",
+	pthread_mutex_lock(&ipserv->resp_lock);
+	cs = (cmd_response*)hash_table_find(ipserv->resp_table, &response_seq_num);
+	if (!cs || cs->ipsta != ipsta) {
+		pthread_mutex_unlock(&ipserv->resp_lock);
+		ELOG("response to seq num %u from '%s'was thrown",
 		     response_seq_num, wave_ipcs_sta_name(ipsta));
 		wave_ipc_msg_put(resp);
 		return;
@@ -285,21 +402,18 @@ static void wave_ipcs_handle_response_from_client(wv_ipserver *ipserv,
 		cs->response = resp;
 	}
 
-	pthread_mutex_unlock(&ipserv->resp_list_lock);
+	/* wake only the caller waiting for this response */
 	if (notify)
-		pthread_cond_broadcast(&ipserv->resp_cond);
-	pthread_mutex_unlock(&ipserv->resp_cond_lock);
+		pthread_cond_signal(&cs->cond);
+	pthread_mutex_unlock(&ipserv->resp_lock);
 }
 
-static wv_ipc_ret wave_ipcs_handle_station_msg(wv_ipserver *ipserver, int index)
+static wv_ipc_ret wave_ipcs_handle_station_msg(wv_ipserver *ipserver,
+					       wv_ipstation *station,
+					       wv_ipc_msg *msg, wv_ipc_ret ret)
 {
-	wv_ipstation *station = ipserver->stations[index];
-	int num_pending = 0;
-	wv_ipc_msg *msg = NULL;
-	wv_ipc_ret ret;
 	ipc_header hdr;
 
-	ret = wave_ipc_recv_msg(station->socket, &msg);
 	if (ret == WAVE_IPC_DISCONNECTED) {
 		LOG(1, "station '%s' disconnected", wave_ipcs_sta_name(station));
 		goto disconnect;
@@ -316,12 +430,14 @@ static wv_ipc_ret wave_ipcs_handle_station_msg(wv_ipserver *ipserver, int index)
 
 	switch (hdr.header[0]) {
 	case WAVE_IPC_MSG_CMD:
-		if (wave_ipcs_cmd_async(ipserver, station, hdr.header[1], msg)) {
+		wave_ipc_msg_set_deadline(msg, ipc_header_get_deadline(&hdr));
+		if (wave_ipcs_cmd_async(ipserver, station, ipc_header_get_seq_num(&hdr), msg)) {
 			ELOG("upper layer returned err on cmd from '%s'",
 			     wave_ipcs_sta_name(station));
 
 			if (WAVE_IPC_SUCCESS !=
-			    wave_ipcs_send_req_failed_to(ipserver, station, hdr.header[1])) {
+			    wave_ipcs_send_req_failed_to(ipserver, station,
+							 ipc_header_get_seq_num(&hdr))) {
 				ELOG("send_req_failed_to returned err");
 				goto disconnect;
 			}
@@ -342,42 +458,64 @@ static wv_ipc_ret wave_ipcs_handle_station_msg(wv_ipserver *ipserver, int index)
 	return WAVE_IPC_SUCCESS;
 
 disconnect:
-	PEND_MSGS_LOCK(ipserver);
-	num_pending = list_get_size(station->pending_msgs);
-	num_pending += list_get_size(station->pending_replies);
-	ipserver->station_has_pending_msgs -= num_pending;
-	station->is_connected = 0;
-	PEND_MSGS_UNLOCK(ipserver);
-
-	wave_ipcs_removing_client(ipserver, station);
-	wave_ipcs_sta_decref(station);
-	ipserver->stations[index] = NULL;
+	wave_ipcs_remove_station(ipserver, station);
 
 	return WAVE_IPC_DISCONNECTED;
 }
 
+/* Sockets are registered edge-triggered, so read until no data is left */
+static void wave_ipcs_handle_station_input(wv_ipserver *ipserver,
+					   wv_ipstation *station)
+{
+	wv_ipc_msg *msg;
+	wv_ipc_ret ret;
+
+	while (!wave_ipcs_stop_cond(ipserver)) {
+		msg = NULL;
+		ret = wave_ipc_rx_recv(station->rx, station->socket, MSG_DONTWAIT, &msg);
+		if (ret == WAVE_IPC_CMD_WOULD_BLOCK)
+			break;
+
+		/* msg, EOF or error: the latter two disconnect the station */
+		if (wave_ipcs_handle_station_msg(ipserver, station, msg, ret) != WAVE_IPC_SUCCESS)
+			break;
+	}
+}
+
+/* Must be called with the station's send_lock held */
 static void wave_ipcs_sta_resend_pending(wv_ipserver *ipserver, wv_ipstation *sta)
 {
 	wv_ipc_ret ret = WAVE_IPC_SUCCESS;
-	int failed_on_first = 1;
 	l_list *pending_list = sta->pending_replies;
 
+	if (sta->partial_msg) {
+		ret = wave_ipc_send_msg_from(sta->socket, sta->partial_msg,
+					     MSG_DONTWAIT, &sta->partial_offset);
+		if (ret != WAVE_IPC_SUCCESS)
+			goto out;
+
+		__atomic_sub_fetch(&ipserver->station_has_pending_msgs, 1, __ATOMIC_RELAXED);
+		sta->resend_attempts = 0;
+		wave_ipc_msg_put(sta->partial_msg);
+		sta->partial_msg = NULL;
+	}
+
 again:
 	list_foreach_start(pending_list, msg, wv_ipc_msg)
-		ret = wave_ipc_send_msg(sta->socket, msg, MSG_DONTWAIT);
-		if (ret != WAVE_IPC_SUCCESS) {
-			if (failed_on_first) {
-				sta->resend_attempts++;
-				LOG(1, "station %s is still blocking, resend attempts=%d",
-				    wave_ipcs_sta_name(sta), sta->resend_attempts);
-			}
+		size_t offset = 0;
 
-			break;
+		ret = wave_ipc_send_msg_from(sta->socket, msg, MSG_DONTWAIT, &offset);
+		if (ret == WAVE_IPC_CMD_WOULD_BLOCK && offset) {
+			/* the reference moves from the list to partial_msg */
+			sta->partial_msg = msg;
+			sta->partial_offset = offset;
+			list_foreach_remove_current_entry()
 		}
+		if (ret != WAVE_IPC_SUCCESS)
+			break;
 
-		ipserver->station_has_pending_msgs--;
+		__atomic_sub_fetch(&ipserver->station_has_pending_msgs, 1, __ATOMIC_RELAXED);
 		sta->resend_attempts = 0;
-		failed_on_first = 0;
 		wave_ipc_msg_put(msg);
 		list_foreach_remove_current_entry()
 	list_foreach_end
@@ -387,16 +525,19 @@ again:
 		goto again;
 	}
 
-	sta->has_pending_msgs = list_get_size(sta->pending_replies) ? 1 : 0;
-	if (!sta->has_pending_msgs)
-		sta->has_pending_msgs = list_get_size(sta->pending_msgs) ? 1 : 0;
-	if (!sta->has_pending_msgs)
-		LOG(1, "station %s exited blocking state", wave_ipcs_sta_name(sta));
+out:
+	if (sta->partial_msg || list_get_size(sta->pending_replies) ||
+	    list_get_size(sta->pending_msgs))
+		return;
+
+	wave_ipcs_sta_set_pending(ipserver, sta, 0);
+	LOG(1, "station %s exited blocking state", wave_ipcs_sta_name(sta));
 }
 
 static wv_ipc_ret wave_ipcs_accept_new_client(wv_ipserver *ipserver)
 {
 	struct sockaddr_un sockaddr;
+	struct epoll_event ev = { 0 };
 	wv_ipstation *station;
 	unsigned int len;
 	int i;
@@ -406,6 +547,7 @@ static wv_ipc_ret wave_ipcs_accept_new_client(wv_ipserver *ipserver)
 		return WAVE_IPC_ERROR;
 
 	memset(station, 0, sizeof(wv_ipstation));
+	pthread_mutex_init(&station->send_lock, NULL);
 
 	len = sizeof(sockaddr);
 	station->socket = accept(ipserver->listener_socket,
@@ -421,6 +563,10 @@ static wv_ipc_ret wave_ipcs_accept_new_client(wv_ipserver *ipserver)
 	if (!station->pending_replies)
 		goto err;
 
+	station->rx = wave_ipc_rx_create();
+	if (!station->rx)
+		goto err;
+
 	strncpy_s(station->name, sizeof(station->name),
 		  sockaddr.sun_path + 1, sizeof(station->name) - 1);
 
@@ -437,8 +583,19 @@ static wv_ipc_ret wave_ipcs_accept_new_client(wv_ipserver *ipserver)
 	if (i == IPC_CLIENT_ARR_SIZE)
 		goto err;
 
+	/* edge-triggered: EPOLLOUT reports the socket becoming writable again
+	 * and drives the flush of the pending messages */
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.ptr = station;
+	if (epoll_ctl(ipserver->epoll_fd, EPOLL_CTL_ADD, station->socket, &ev)) {
+		ELOG("error adding client to epoll, errno = %d", errno);
+		goto err;
+	}
+
+	station->index = i;
 	station->is_connected = 1;
 	ipserver->stations[i] = station;
+	ipserver->num_stas++;
 	wave_ipcs_sta_incref(ipserver->stations[i]);
 	wave_ipcs_adding_client(ipserver, ipserver->stations[i]);
 
@@ -451,15 +608,60 @@ err:
 		list_free(station->pending_msgs);
 	if (station->pending_replies)
 		list_free(station->pending_replies);
+	wave_ipc_rx_destroy(station->rx);
+	pthread_mutex_destroy(&station->send_lock);
 	free(station);
 	return WAVE_IPC_ERROR;
 }
 
+static void wave_ipcs_housekeeping(wv_ipserver *ipserver)
+{
+	uint64_t expirations;
+	int i;
+
+	if (read(ipserver->timer_fd, &expirations, sizeof(expirations)) == -1 &&
+	    errno != EAGAIN)
+		ELOG("error reading timerfd, errno = %d", errno);
+
+	if (!ipserver->num_blocking_stas)
+		return;
+
+	for (i = 0; i < IPC_CLIENT_ARR_SIZE; i++) {
+		wv_ipstation *sta = ipserver->stations[i];
+		int stuck;
+
+		if (sta == NULL)
+			continue;
+
+		STA_SEND_LOCK(sta);
+		if (!sta->has_pending_msgs) {
+			STA_SEND_UNLOCK(sta);
+			continue;
+		}
+
+		/* flushing is driven by EPOLLOUT, this is only a fallback */
+		wave_ipcs_sta_resend_pending(ipserver, sta);
+		if (sta->has_pending_msgs) {
+			sta->resend_attempts++;
+			LOG(1, "station %s is still blocking, resend attempts=%d",
+			    wave_ipcs_sta_name(sta), sta->resend_attempts);
+		}
+		stuck = (sta->resend_attempts >= STA_MAX_RESEND_ATTEMPTS);
+		STA_SEND_UNLOCK(sta);
+
+		if (stuck) {
+			/* client is probably stuck -> remove it */
+			ELOG("removing station %s due to not not receiving msgs",
+			     wave_ipcs_sta_name(sta));
+			wave_ipcs_remove_station(ipserver, sta);
+		}
+	}
+}
+
 wv_ipc_ret wave_ipcs_run(wv_ipserver *handle, wv_ipserver_callbacks *callbacks)
 {
-	wv_ipstation **stations;
-	struct timespec next_resend_ts;
-	int next_resend_ts_set = 0;
+	struct epoll_event events[SERV_EPOLL_MAX_EVENTS];
+	int i;
 
 	if (handle == NULL || handle->listener_socket == -1)
 		return WAVE_IPC_ERROR;
@@ -472,188 +674,149 @@ wv_ipc_ret wave_ipcs_run(wv_ipserver *handle, wv_ipserver_callbacks *callbacks)
 
 	memcpy_s(&handle->clbacks, sizeof(wv_ipserver_callbacks),
 		 callbacks, sizeof(wv_ipserver_callbacks));
-	stations = handle->stations;
 
 	handle->thread_id = pthread_self();
 
-	while (!wave_ipcs_stop_cond(handle)) {
-		fd_set rfds;
-		struct timeval tv;
-		int ret, i, highest_fd;
-
-		FD_ZERO(&rfds);
-		FD_SET(handle->listener_socket, &rfds);
-		highest_fd = handle->listener_socket;
-
-		for (i = 0; i < IPC_CLIENT_ARR_SIZE; i++) {
-			int clinet_fd;
-
-			if (stations[i] == NULL)
-				continue;
-
-			clinet_fd = stations[i]->socket;
-			if (clinet_fd == -1)
-				return WAVE_IPC_ERROR;
-
-			FD_SET(clinet_fd, &rfds);
-			if (clinet_fd > highest_fd)
-				highest_fd = clinet_fd;
-		}
+	/* Input left unread by a previous run won't trigger a new edge */
+	for (i = 0; i < IPC_CLIENT_ARR_SIZE && !wave_ipcs_stop_cond(handle); i++) {
+		if (handle->stations[i])
+			wave_ipcs_handle_station_input(handle, handle->stations[i]);
+	}
 
-		if (handle->station_has_pending_msgs)
-			tv.tv_sec = 1;
-		else
-			tv.tv_sec = 2;
-		tv.tv_usec = 0;
+	while (!wave_ipcs_stop_cond(handle)) {
+		int num_events, housekeeping = 0;
 
-		ret = select(highest_fd + 1, &rfds, NULL, NULL, &tv);
-		if (ret == -1 && errno == EINTR) {
-			ELOG("select() returned EINTR");
-			usleep(1000);
+		/* the housekeeping timer wakes the loop up periodically */
+		num_events = epoll_wait(handle->epoll_fd, events,
+					SERV_EPOLL_MAX_EVENTS, -1);
+		if (num_events == -1 && errno == EINTR) {
+			ELOG("epoll_wait() returned EINTR");
 			continue;
-		} else if (ret == -1) {
-			BUG("select() returned error (errno=%d)", errno);
+		} else if (num_events == -1) {
+			BUG("epoll_wait() returned error (errno=%d)", errno);
+			handle->thread_id = 0;
 			return WAVE_IPC_ERROR;
-		} else if (ret == 0)
-			goto pending;
+		}
 
-		if (FD_ISSET(handle->listener_socket, &rfds))
-			wave_ipcs_accept_new_client(handle);
+		for (i = 0; i < num_events; i++) {
+			void *ptr = events[i].data.ptr;
+			wv_ipstation *sta;
 
-		for (i = 0; i < IPC_CLIENT_ARR_SIZE; i++) {
-			if (stations[i] == NULL)
+			if (ptr == &epoll_listener_tag) {
+				wave_ipcs_accept_new_client(handle);
 				continue;
+			}
 
-			if (!FD_ISSET(stations[i]->socket, &rfds))
+			if (ptr == &epoll_timer_tag) {
+				/* handled after the stations, may remove some */
+				housekeeping = 1;
 				continue;
-
-			wave_ipcs_handle_station_msg(handle, i);
-		}
-
-pending:
-		if (handle->station_has_pending_msgs) {
-
-			if (!next_resend_ts_set) {
-				clock_gettime(CLOCK_BOOTTIME, &next_resend_ts);
-				next_resend_ts.tv_sec += 1;
-				next_resend_ts_set = 1;
-			} else {
-				struct timespec now_ts;
-
-				clock_gettime(CLOCK_BOOTTIME, &now_ts);
-				if (now_ts.tv_sec < next_resend_ts.tv_sec ||
-				    (now_ts.tv_sec == next_resend_ts.tv_sec &&
-				     now_ts.tv_nsec < next_resend_ts.tv_nsec))
-					continue; /* woke up too early */
-
-				clock_gettime(CLOCK_BOOTTIME, &next_resend_ts);
-				next_resend_ts.tv_sec += 1;
 			}
 
-			PEND_MSGS_LOCK(handle);
-			for (i = 0; i < IPC_CLIENT_ARR_SIZE; i++) {
-				wv_ipstation *sta = stations[i];
-
-				if (sta == NULL)
-					continue;
-
-				if (sta->has_pending_msgs) {
+			sta = (wv_ipstation*)ptr;
+			if (events[i].events & EPOLLOUT) {
+				STA_SEND_LOCK(sta);
+				if (sta->has_pending_msgs)
 					wave_ipcs_sta_resend_pending(handle, sta);
-				} else
-					continue;
-
-				if (sta->resend_attempts >= 10) {
-					/* client is probably stuck -> remove it */
-					int num_pending = 0;
-
-					num_pending = list_get_size(sta->pending_msgs);
-					num_pending += list_get_size(sta->pending_replies);
-					handle->station_has_pending_msgs -= num_pending;
-
-					ELOG("removing station %s due to not not receiving msgs",
-					     wave_ipcs_sta_name(sta));
-					sta->is_connected = 0;
-					wave_ipcs_removing_client(handle, sta);
-					wave_ipcs_sta_decref(sta);
-					stations[i] = NULL;
-				}
+				STA_SEND_UNLOCK(sta);
 			}
 
-			if (!handle->station_has_pending_msgs)
-				next_resend_ts_set = 0;
-			PEND_MSGS_UNLOCK(handle);
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+				wave_ipcs_handle_station_input(handle, sta);
 		}
+
+		if (housekeeping)
+			wave_ipcs_housekeeping(handle);
 	}
 	handle->thread_id = 0;
 
 	return WAVE_IPC_SUCCESS;
 }
 
+/* Must be called with the station's send_lock held. Queue a reference to
+ * msg, of which 'offset' bytes were already sent. The msg is shared with the
+ * caller and the other stations it is queued to */
 static wv_ipc_ret wave_ipcs_send_would_block(wv_ipserver *ipserver,
 					     wv_ipstation *ipsta, wv_ipc_msg *msg,
-					     l_list *pending_list)
+					     l_list *pending_list, size_t offset)
 {
-	int print_log = 0;
-	wv_ipc_msg *dup_msg = wave_ipc_msg_dup(msg);
-	if (dup_msg == NULL)
-		return WAVE_IPC_ERROR;
-
-	PEND_MSGS_LOCK(ipserver);
-	if (!ipsta->is_connected) {
-		PEND_MSGS_UNLOCK(ipserver);
-		return WAVE_IPC_DISCONNECTED;
-	}
-
-	if (ipserver->station_has_pending_msgs >= MAX_NUM_PENDING_IPC_MSGS &&
-	    (list_get_size(ipsta->pending_msgs) +
-	     list_get_size(ipsta->pending_replies)) >= STA_MAX_NUM_PENDING_ON_SERV_LIMIT) {
+	if (offset) {
+		/* The head of msg is on the wire already, it can't be dropped.
+		 * msg was sent directly, so no other msg is pending or partial */
+		ipsta->partial_msg = wave_ipc_msg_get(msg);
+		ipsta->partial_offset = offset;
+	} else if (__atomic_load_n(&ipserver->station_has_pending_msgs, __ATOMIC_RELAXED) >=
+		   MAX_NUM_PENDING_IPC_MSGS &&
+		   (list_get_size(ipsta->pending_msgs) +
+		    list_get_size(ipsta->pending_replies)) >= STA_MAX_NUM_PENDING_ON_SERV_LIMIT) {
 		LOG(2, "can't store more pending messages for '%s', limit reached",
 		    wave_ipcs_sta_name(ipsta));
-		wave_ipc_msg_put(dup_msg);
-		PEND_MSGS_UNLOCK(ipserver);
+		ipsta->dropped_msgs++;
+		return WAVE_IPC_ERROR;
+	} else if (list_push_back(pending_list, msg)) {
+		ipsta->dropped_msgs++;
 		return WAVE_IPC_ERROR;
+	} else {
+		wave_ipc_msg_get(msg);
 	}
 
-	list_push_back(pending_list, dup_msg);
-	if (!ipsta->has_pending_msgs) {
-		print_log = 1;
-		ipsta->has_pending_msgs = 1;
-	}
+	__atomic_add_fetch(&ipserver->station_has_pending_msgs, 1, __ATOMIC_RELAXED);
+	if (ipsta->has_pending_msgs)
+		return WAVE_IPC_SUCCESS;
 
-	ipserver->station_has_pending_msgs++;
-	PEND_MSGS_UNLOCK(ipserver);
+	wave_ipcs_sta_set_pending(ipserver, ipsta, 1);
 
-	if (print_log)
+	/* The socket may have become writable (and its EPOLLOUT edge consumed)
+	 * after our send failed but before the msg was queued; retry under the
+	 * lock so that any later edge is guaranteed to see the queued msg */
+	wave_ipcs_sta_resend_pending(ipserver, ipsta);
+	if (ipsta->has_pending_msgs)
 		ELOG("station %s became blocking", wave_ipcs_sta_name(ipsta));
 
 	return WAVE_IPC_SUCCESS;
 }
 
-static wv_ipc_ret wave_ipcs_send_reply(wv_ipserver *ipserver, wv_ipstation *ipsta,
-				       wv_ipc_msg *reply)
+/* The socket is a stream shared by all the threads sending to the station.
+ * A msg is written directly only if nothing is pending, and under the
+ * station's send_lock, so msgs never interleave on the wire. Direct writes
+ * don't block, and sends to different stations don't wait for each other */
+static wv_ipc_ret wave_ipcs_sta_send(wv_ipserver *ipserver, wv_ipstation *ipsta,
+				     wv_ipc_msg *msg, l_list *pending_list)
 {
 	wv_ipc_ret ret = WAVE_IPC_ERROR;
-	int socket;
+	size_t offset = 0;
 
-	socket = ipsta->socket;
-	if (socket == -1)
-		goto err;
+	STA_SEND_LOCK(ipsta);
+	if (ipsta->socket == -1)
+		goto out;
+
+	if (!ipsta->is_connected) {
+		ret = WAVE_IPC_DISCONNECTED;
+		goto out;
+	}
 
 	if (!ipsta->has_pending_msgs)
-		ret = wave_ipc_send_msg(socket, reply, MSG_DONTWAIT);
+		ret = wave_ipc_send_msg_from(ipsta->socket, msg, MSG_DONTWAIT, &offset);
 	else
 		ret = WAVE_IPC_CMD_WOULD_BLOCK;
 
 	if (ret == WAVE_IPC_CMD_WOULD_BLOCK)
-		ret = wave_ipcs_send_would_block(ipserver, ipsta, reply,
-						 ipsta->pending_replies);
+		ret = wave_ipcs_send_would_block(ipserver, ipsta, msg,
+						 pending_list, offset);
 
-err:
+out:
+	STA_SEND_UNLOCK(ipsta);
 	return ret;
 }
 
+static wv_ipc_ret wave_ipcs_send_reply(wv_ipserver *ipserver, wv_ipstation *ipsta,
+				       wv_ipc_msg *reply)
+{
+	return wave_ipcs_sta_send(ipserver, ipsta, reply, ipsta->pending_replies);
+}
+
 wv_ipc_ret wave_ipcs_send_response_to(wv_ipserver *handle, wv_ipstation *ipsta,
-				      uint8_t seq_num, wv_ipc_msg *reply,
+				      uint32_t seq_num, wv_ipc_msg *reply,
 				      uint8_t has_more)
 {
 	ipc_header resp_hdr = { 0 };
@@ -667,8 +830,8 @@ wv_ipc_ret wave_ipcs_send_response_to(wv_ipserver *handle, wv_ipstation *ipsta,
 		goto err;
 
 	resp_hdr.header[0] = WAVE_IPC_MSG_RESP;
-	resp_hdr.header[1] = seq_num;
 	resp_hdr.header[2] = has_more;
+	ipc_header_set_seq_num(&resp_hdr, seq_num);
 	if (ipc_header_push(reply, &resp_hdr))
 		goto err;
 
@@ -679,7 +842,7 @@ err:
 }
 
 wv_ipc_ret wave_ipcs_send_req_failed_to(wv_ipserver *handle, wv_ipstation *ipsta,
-					uint8_t seq_num)
+					uint32_t seq_num)
 {
 	wv_ipc_msg *reply = NULL;
 	ipc_header resp_hdr = { 0 };
@@ -697,7 +860,7 @@ wv_ipc_ret wave_ipcs_send_req_failed_to(wv_ipserver *handle, wv_ipstation *ipsta
 		goto err;
 
 	resp_hdr.header[0] = WAVE_IPC_MSG_REQ_FAIL;
-	resp_hdr.header[1] = seq_num;
+	ipc_header_set_seq_num(&resp_hdr, seq_num);
 	if (ipc_header_push(reply, &resp_hdr))
 		goto err;
 
@@ -710,8 +873,8 @@ err:
 }
 
 static wv_ipc_ret _wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
-					 uint8_t seq_num, wv_ipc_msg *cmd,
-					 wv_ipc_msg **reply)
+					 uint32_t seq_num, wv_ipc_msg *cmd,
+					 wv_ipc_msg **reply, uint64_t deadline_ms)
 {
 	wv_ipc_ret ret;
 	int cw_res = 0;
@@ -726,32 +889,35 @@ static wv_ipc_ret _wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipst
 	resp_handle->response = NULL;
 	resp_handle->status = RESP_NONE;
 	resp_handle->seq_num = seq_num;
-
-	pthread_mutex_lock(&handle->resp_list_lock);
-	list_push_front(handle->resp_list, resp_handle);
-	pthread_mutex_unlock(&handle->resp_list_lock);
-
-	ret = wave_ipc_send_msg(ipsta->socket, cmd, MSG_DONTWAIT);
-	if (ret != WAVE_IPC_SUCCESS) {
-		ELOG("failed to send command to '%s'", wave_ipcs_sta_name(ipsta));
-		goto response;
+	if (wave_ipc_cond_init_monotonic(&resp_handle->cond)) {
+		free(resp_handle);
+		return WAVE_IPC_ERROR;
 	}
 
-	pthread_mutex_lock(&handle->resp_cond_lock);
-	clock_gettime(CLOCK_REALTIME, &ts);
-	ts.tv_sec += 10;
-	while (resp_handle->status == RESP_NONE) {
-		cw_res = pthread_cond_timedwait(&handle->resp_cond,
-						&handle->resp_cond_lock, &ts);
-		if (cw_res != 0) break;
+	pthread_mutex_lock(&handle->resp_lock);
+	if (hash_table_insert(handle->resp_table, &resp_handle->seq_num, resp_handle)) {
+		pthread_mutex_unlock(&handle->resp_lock);
+		ELOG("seq num %u is already waiting for a response", seq_num);
+		ret = WAVE_IPC_ERROR;
+		goto free;
 	}
+	pthread_mutex_unlock(&handle->resp_lock);
 
-	pthread_mutex_unlock(&handle->resp_cond_lock);
+	ret = wave_ipcs_sta_send(handle, ipsta, cmd, ipsta->pending_msgs);
+	if (ret != WAVE_IPC_SUCCESS)
+		ELOG("failed to send command to '%s'", wave_ipcs_sta_name(ipsta));
 
-response:
-	pthread_mutex_lock(&handle->resp_list_lock);
-	list_remove(handle->resp_list, resp_handle);
-	pthread_mutex_unlock(&handle->resp_list_lock);
+	pthread_mutex_lock(&handle->resp_lock);
+	if (ret == WAVE_IPC_SUCCESS) {
+		wave_ipc_ms_to_timespec(deadline_ms, &ts);
+		while (resp_handle->status == RESP_NONE) {
+			cw_res = pthread_cond_timedwait(&resp_handle->cond,
+							&handle->resp_lock, &ts);
+			if (cw_res != 0) break;
+		}
+	}
+	hash_table_remove(handle->resp_table, &resp_handle->seq_num);
+	pthread_mutex_unlock(&handle->resp_lock);
 
 	if (ret != WAVE_IPC_SUCCESS)
 		goto free;
@@ -768,16 +934,22 @@ response:
 	}
 
 	*reply = resp_handle->response;
+	resp_handle->response = NULL;
 free:
+	/* a partial response of a failed or timed out command */
+	if (resp_handle->response)
+		wave_ipc_msg_put(resp_handle->response);
+	pthread_cond_destroy(&resp_handle->cond);
 	free(resp_handle);
 	return ret;
 }
 
-wv_ipc_ret wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
-				 wv_ipc_msg *cmd, wv_ipc_msg **reply)
+static wv_ipc_ret ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
+				   wv_ipc_msg *cmd, wv_ipc_msg **reply,
+				   uint64_t deadline_ms)
 {
 	ipc_header cmd_hdr = { 0 };
-	uint8_t seq_num;
+	uint32_t seq_num;
 
 	if (ipsta == NULL || cmd == NULL || handle == NULL || reply == NULL)
 		return WAVE_IPC_ERROR;
@@ -798,11 +970,34 @@ wv_ipc_ret wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
 	seq_num = __atomic_add_fetch(&handle->cmd_seq_num, 1, __ATOMIC_SEQ_CST);
 
 	cmd_hdr.header[0] = WAVE_IPC_MSG_CMD;
-	cmd_hdr.header[1] = seq_num;
+	ipc_header_set_seq_num(&cmd_hdr, seq_num);
+	if (ipc_header_set_deadline(&cmd_hdr, deadline_ms)) {
+		ELOG("deadline of the command to '%s' has already passed",
+		     wave_ipcs_sta_name(ipsta));
+		return WAVE_IPC_ERROR;
+	}
 	if (ipc_header_push(cmd, &cmd_hdr))
 		return WAVE_IPC_ERROR;
 
-	return _wave_ipcs_send_cmd_to(handle, ipsta, seq_num, cmd, reply);
+	return _wave_ipcs_send_cmd_to(handle, ipsta, seq_num, cmd, reply, deadline_ms);
+}
+
+wv_ipc_ret wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
+				 wv_ipc_msg *cmd, wv_ipc_msg **reply)
+{
+	return ipcs_send_cmd_to(handle, ipsta, cmd, reply,
+				wave_ipc_now_ms() + WAVE_IPCS_CMD_TIMEOUT_SECS * 1000ULL);
+}
+
+wv_ipc_ret wave_ipcs_send_cmd_to_deadline(wv_ipserver *handle, wv_ipstation *ipsta,
+					  wv_ipc_msg *cmd, wv_ipc_msg **reply,
+					  const struct timespec *deadline)
+{
+	if (deadline == NULL)
+		return wave_ipcs_send_cmd_to(handle, ipsta, cmd, reply);
+
+	return ipcs_send_cmd_to(handle, ipsta, cmd, reply,
+				wave_ipc_timespec_to_ms(deadline));
 }
 
 wv_ipc_ret wave_ipcs_send_event_all(wv_ipserver *handle, wv_ipc_msg *event)
@@ -849,30 +1044,10 @@ wv_ipc_ret wave_ipcs_push_event_header(wv_ipc_msg *event)
 
 wv_ipc_ret wave_ipcs_send_to(wv_ipserver *handle, wv_ipc_msg *event, wv_ipstation *ipsta)
 {
-	int socket;
-	wv_ipc_ret ret = WAVE_IPC_ERROR;
-
-	if (event == NULL)
+	if (event == NULL || handle == NULL || ipsta == NULL)
 		return WAVE_IPC_ERROR;
 
-	if (handle == NULL || ipsta == NULL)
-		goto err;
-
-	socket = ipsta->socket;
-	if (socket == -1)
-		goto err;
-
-	if (!ipsta->has_pending_msgs)
-		ret = wave_ipc_send_msg(socket, event, MSG_DONTWAIT);
-	else
-		ret = WAVE_IPC_CMD_WOULD_BLOCK;
-
-	if (ret == WAVE_IPC_CMD_WOULD_BLOCK)
-		ret = wave_ipcs_send_would_block(handle, ipsta, event,
-						 ipsta->pending_msgs);
-
-err:
-	return ret;
+	return wave_ipcs_sta_send(handle, ipsta, event, ipsta->pending_msgs);
 }
 
 wv_ipc_ret wave_ipcs_sta_incref(wv_ipstation *ipclient)
@@ -896,6 +1071,11 @@ wv_ipc_ret wave_ipcs_sta_decref(wv_ipstation *ipclient)
 		l_list *pending_list;
 		close(ipclient->socket);
 
+		if (ipclient->partial_msg)
+			wave_ipc_msg_put(ipclient->partial_msg);
+		wave_ipc_rx_destroy(ipclient->rx);
+		pthread_mutex_destroy(&ipclient->send_lock);
+
 		pending_list = ipclient->pending_replies;
 again:
 		list_foreach_start(pending_list, msg, wv_ipc_msg)
@@ -914,6 +1094,22 @@ again:
 	return WAVE_IPC_SUCCESS;
 }
 
+wv_ipc_ret wave_ipcs_sta_get_stats(wv_ipserver *handle, wv_ipstation *ipsta,
+				   wv_ipstation_stats *stats)
+{
+	if (handle == NULL || ipsta == NULL || stats == NULL)
+		return WAVE_IPC_ERROR;
+
+	STA_SEND_LOCK(ipsta);
+	stats->pending_msgs = list_get_size(ipsta->pending_msgs);
+	stats->pending_msgs += ipsta->partial_msg ? 1 : 0;
+	stats->pending_replies = list_get_size(ipsta->pending_replies);
+	stats->dropped_msgs = ipsta->dropped_msgs;
+	STA_SEND_UNLOCK(ipsta);
+
+	return WAVE_IPC_SUCCESS;
+}
+
 const char* wave_ipcs_sta_name(wv_ipstation *ipsta)
 {
 	return ipsta ? ipsta->name : "<err>";
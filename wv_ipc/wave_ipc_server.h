@@ -14,14 +14,26 @@
 #include "wave_ipc.h"
 #include "wave_ipc_core.h"
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct _wv_ipserver wv_ipserver;
 typedef struct _wv_ipstation wv_ipstation;
 
+/* Messages waiting for the station's socket to become writable, and the
+ * messages dropped since the station connected */
+typedef struct _wv_ipstation_stats
+{
+	size_t pending_msgs;
+	size_t pending_replies;
+	uint64_t dropped_msgs;
+} wv_ipstation_stats;
+
+/* cmd_async() gets the command with the deadline its sender has set, if
+ * any, see wave_ipc_msg_get_deadline() */
 typedef struct _wv_ipserver_callbacks
 {
 	int (*cmd_async)(wv_ipserver *ipserv, wv_ipstation *ipsta,
-			 uint8_t seq_num, wv_ipc_msg *cmd);
+			 uint32_t seq_num, wv_ipc_msg *cmd);
 	int (*stop_cond)(wv_ipserver *ipserv);
 	int (*adding_client)(wv_ipserver *ipserv, wv_ipstation *ipsta);
 	int (*removing_client)(wv_ipserver *ipserv, wv_ipstation *ipsta);
@@ -33,14 +45,22 @@ wv_ipc_ret wave_ipcs_delete(wv_ipserver **handle_p);
 wv_ipc_ret wave_ipcs_run(wv_ipserver *handle, wv_ipserver_callbacks *callbacks);
 
 wv_ipc_ret wave_ipcs_send_response_to(wv_ipserver *handle, wv_ipstation *ipsta,
-				      uint8_t seq_num, wv_ipc_msg *reply,
+				      uint32_t seq_num, wv_ipc_msg *reply,
 				      uint8_t has_more);
 wv_ipc_ret wave_ipcs_send_req_failed_to(wv_ipserver *handle, wv_ipstation *ipsta,
-					uint8_t seq_num);
+					uint32_t seq_num);
+
+#define WAVE_IPCS_CMD_TIMEOUT_SECS	(10)
 
 wv_ipc_ret wave_ipcs_send_cmd_to(wv_ipserver *handle, wv_ipstation *ipsta,
 				 wv_ipc_msg *cmd, wv_ipc_msg **reply);
 
+/* Give up at 'deadline', an absolute CLOCK_MONOTONIC time. The station gets
+ * the deadline with the command. NULL means WAVE_IPCS_CMD_TIMEOUT_SECS */
+wv_ipc_ret wave_ipcs_send_cmd_to_deadline(wv_ipserver *handle, wv_ipstation *ipsta,
+					  wv_ipc_msg *cmd, wv_ipc_msg **reply,
+					  const struct timespec *deadline);
+
 wv_ipc_ret wave_ipcs_send_event_all(wv_ipserver *handle, wv_ipc_msg *event);
 wv_ipc_ret wave_ipcs_send_event_to(wv_ipserver *handle, wv_ipc_msg *event,
 				   wv_ipstation *ipsta);
@@ -61,6 +81,8 @@ wv_ipc_ret wave_ipcs_push_event_header(wv_ipc_msg *event);
 wv_ipc_ret wave_ipcs_sta_incref(wv_ipstation *ipclient);
 wv_ipc_ret wave_ipcs_sta_decref(wv_ipstation *ipclient);
 const char* wave_ipcs_sta_name(wv_ipstation *ipsta);
+wv_ipc_ret wave_ipcs_sta_get_stats(wv_ipserver *handle, wv_ipstation *ipsta,
+				   wv_ipstation_stats *stats);
 
 /* Internal reference to user-defined data */
 struct _wv_ipstation_data {
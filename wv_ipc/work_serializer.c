@@ -11,15 +11,17 @@
 #include "work_serializer.h"
 #include "pthread.h"
 #include "linked_list.h"
+#include "hash_table.h"
 #include "logs.h"
 
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #define ASYNC_WORK_LIST_MAX_SIZE	(500)
-#define DELAYED_WORK_LIST_MAX_SIZE	(200)
+#define TIMERS_INIT_SIZE		(16)
 
 typedef enum {
 	SERIALIZER_PAUSED,
@@ -35,9 +37,34 @@ typedef struct _work_serializer {
 	unsigned num_ops;
 
 	l_list *work_list;
-	l_list *delayed_work_list;
 	pthread_mutex_t work_lock;
 	pthread_cond_t work_cond;
+
+	/* limit of the async works and what to do when it is reached. Blocked
+	 * producers wait on space_cond, signaled when a work is taken. On stop
+	 * they fail, and the last one to leave signals space_cond again */
+	serializer_overflow_policy overflow_policy;
+	size_t max_async;
+	unsigned int block_timeout_ms;
+	unsigned int blocked_producers;
+	pthread_cond_t space_cond;
+
+	/* delayed works, a binary min-heap ordered by expiry. Handles are never
+	 * reused, timer_ids maps a handle to its work */
+	struct _work **timers;
+	size_t num_timers;
+	size_t timers_size;
+	hash_table *timer_ids;
+	serializer_timer last_timer;
+
+	/* statistics, protected by work_lock */
+	size_t max_queued;
+	uint64_t executed;
+	uint64_t wait_total_us;
+	uint64_t wait_max_us;
+	uint64_t overflow_blocked;
+	uint64_t overflow_dropped;
+	uint64_t overflow_coalesced;
 } work_serializer;
 
 typedef enum {
@@ -57,6 +84,10 @@ typedef struct _work {
 	struct timespec ts;
 	work_state_t state;
 	int result;
+
+	/* delayed works only */
+	serializer_timer timer;
+	size_t heap_idx;
 } work_t;
 
 static inline int _is_delayed_work_before(work_t *work, struct timespec *ts)
@@ -67,6 +98,132 @@ static inline int _is_delayed_work_before(work_t *work, struct timespec *ts)
 	return 0;
 }
 
+/* Works with the same expiry run in the order they were added */
+static inline int _is_timer_before(work_t *a, work_t *b)
+{
+	if (_is_delayed_work_before(a, &b->ts))
+		return 1;
+	if (_is_delayed_work_before(b, &a->ts))
+		return 0;
+	return a->timer < b->timer;
+}
+
+/* The timers functions below must be called with work_lock held */
+static inline void _timer_set(work_serializer *s, size_t i, work_t *work)
+{
+	s->timers[i] = work;
+	work->heap_idx = i;
+}
+
+static void _timer_sift_up(work_serializer *s, size_t i)
+{
+	work_t *work = s->timers[i];
+
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (!_is_timer_before(work, s->timers[parent]))
+			break;
+		_timer_set(s, i, s->timers[parent]);
+		i = parent;
+	}
+	_timer_set(s, i, work);
+}
+
+static void _timer_sift_down(work_serializer *s, size_t i)
+{
+	work_t *work = s->timers[i];
+
+	while (1) {
+		size_t child = 2 * i + 1;
+
+		if (child >= s->num_timers)
+			break;
+		if (child + 1 < s->num_timers &&
+		    _is_timer_before(s->timers[child + 1], s->timers[child]))
+			child++;
+		if (!_is_timer_before(s->timers[child], work))
+			break;
+		_timer_set(s, i, s->timers[child]);
+		i = child;
+	}
+	_timer_set(s, i, work);
+}
+
+static int _timer_push(work_serializer *s, work_t *work)
+{
+	if (s->num_timers == s->timers_size) {
+		size_t size = s->timers_size ? s->timers_size * 2 : TIMERS_INIT_SIZE;
+		work_t **timers = realloc(s->timers, size * sizeof(work_t*));
+
+		if (timers == NULL)
+			return 1;
+		s->timers = timers;
+		s->timers_size = size;
+	}
+
+	work->timer = ++s->last_timer;
+	if (hash_table_insert(s->timer_ids, &work->timer, work))
+		return 1;
+
+	_timer_set(s, s->num_timers++, work);
+	_timer_sift_up(s, work->heap_idx);
+
+	return 0;
+}
+
+static work_t * _timer_remove(work_serializer *s, size_t i)
+{
+	work_t *work = s->timers[i];
+
+	hash_table_remove(s->timer_ids, &work->timer);
+
+	if (i != --s->num_timers) {
+		_timer_set(s, i, s->timers[s->num_timers]);
+		if (i > 0 && _is_timer_before(s->timers[i], s->timers[(i - 1) / 2]))
+			_timer_sift_up(s, i);
+		else
+			_timer_sift_down(s, i);
+	}
+
+	return work;
+}
+
+/* Removes the timers 'match' returns non zero for and frees them, keeps the
+ * rest as a heap. Returns the number of removed timers */
+static size_t _timers_remove_if(work_serializer *s,
+				int (*match)(work_serializer *s, work_t *work, void *arg),
+				void *arg)
+{
+	size_t i, n = 0, removed;
+
+	for (i = 0; i < s->num_timers; i++) {
+		work_t *work = s->timers[i];
+
+		if (!match(s, work, arg)) {
+			s->timers[n++] = work;
+			continue;
+		}
+
+		hash_table_remove(s->timer_ids, &work->timer);
+		if (s->ops[work->id].free_func)
+			s->ops[work->id].free_func(work->obj, work->ctx);
+		free(work);
+	}
+
+	removed = s->num_timers - n;
+	s->num_timers = n;
+
+	if (removed) {
+		for (i = 0; i < n; i++)
+			s->timers[i]->heap_idx = i;
+		for (i = n / 2; i > 0; i--)
+			_timer_sift_down(s, i - 1);
+	}
+
+	return removed;
+}
+
 static inline void _add_time_to_timespec(struct timespec *ts,
 					 unsigned int secs,
 					 unsigned int msecs)
@@ -80,10 +237,29 @@ static inline void _add_time_to_timespec(struct timespec *ts,
 	}
 }
 
+/* Must be called with work_lock held, for works taken from work_list. The
+ * creation time of the work is kept in its ts */
+static void _account_work_wait(work_serializer *s, work_t *work)
+{
+	struct timespec now;
+	int64_t wait_us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait_us = (int64_t)(now.tv_sec - work->ts.tv_sec) * 1000000 +
+		  (now.tv_nsec - work->ts.tv_nsec) / 1000;
+	if (wait_us < 0)
+		wait_us = 0;
+
+	s->executed++;
+	s->wait_total_us += wait_us;
+	if ((uint64_t)wait_us > s->wait_max_us)
+		s->wait_max_us = wait_us;
+}
+
 static void* serializer_work_thread(void *obj)
 {
 	work_serializer *s = (work_serializer*)obj;
-	struct timespec ts, *ts_ptr;
+	struct timespec ts;
 	int cw_res = 0, work_res;
 	work_t *work = NULL;
 	void *ret = NULL;
@@ -99,6 +275,11 @@ static void* serializer_work_thread(void *obj)
 			/* Take a waiting work from the list. Sync'ed works (WORK_WAITING_FOR_FINISH) 
 				are always placed at the top of list */
 			work = list_pop_front(s->work_list);
+			if (work) {
+				_account_work_wait(s, work);
+				if (s->blocked_producers)
+					pthread_cond_signal(&s->space_cond);
+			}
 			if (work && work->state == WORK_WAITING_FOR_FINISH) {
 				pthread_mutex_unlock(&s->work_lock);
 				/* Sync'ed work, need to execute immediately*/
@@ -109,24 +290,23 @@ static void* serializer_work_thread(void *obj)
 				break;
 
 			/* No SYNC or ASYNC works, check the list of the delayed works */
-			clock_gettime(CLOCK_REALTIME, &ts);
+			clock_gettime(CLOCK_MONOTONIC, &ts);
 
-			work = list_peek_front(s->delayed_work_list);
+			work = s->num_timers ? s->timers[0] : NULL;
 			if (work && _is_delayed_work_before(work, &ts)) {
 				/* Time for the delayed work comes, let's execute it */
-				work = list_pop_front(s->delayed_work_list);
+				work = _timer_remove(s, 0);
 				break;
 			} else if (work && work->ts.tv_sec < ts.tv_sec + 10)
-				ts_ptr = &work->ts;
-			else {
+				/* copied, the timer may be cancelled while waiting */
+				ts = work->ts;
+			else
 				ts.tv_sec += 10;
-				ts_ptr = &ts;
-			}
 
 			/* Wait for the arrival of a new task or the next delayed task */
 			work = NULL;
 			cw_res = pthread_cond_timedwait(&s->work_cond,
-							&s->work_lock, ts_ptr);
+							&s->work_lock, &ts);
 
 		} while (cw_res == 0 && !s->stop);
 
@@ -182,6 +362,7 @@ work_serializer * serializer_create(work_ops_t *ops, unsigned num_ops,
 				    int start_now)
 {
 	work_serializer *s;
+	pthread_condattr_t attr;
 
 	if (ops == NULL || num_ops == 0)
 		return NULL;
@@ -200,10 +381,24 @@ work_serializer * serializer_create(work_ops_t *ops, unsigned num_ops,
 	}
 	memcpy(s->ops, ops, num_ops * sizeof(work_ops_t));
 
+	s->timer_ids = hash_table_init(TIMERS_INIT_SIZE, hash_u64, hash_u64_cmp);
+	if (s->timer_ids == NULL) {
+		free(s->ops);
+		free(s);
+		return NULL;
+	}
+
 	s->work_list = list_init();
-	s->delayed_work_list = list_init();
 	pthread_mutex_init(&s->work_lock, NULL);
-	pthread_cond_init(&s->work_cond, NULL);
+	/* deadlines of the works don't move with the wall clock */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s->work_cond, &attr);
+	pthread_cond_init(&s->space_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	s->overflow_policy = SERIALIZER_OVERFLOW_BLOCK;
+	s->max_async = ASYNC_WORK_LIST_MAX_SIZE;
 
 	if (start_now) {
 		s->state = SERIALIZER_RUNNING;
@@ -216,8 +411,9 @@ work_serializer * serializer_create(work_ops_t *ops, unsigned num_ops,
 
 int serializer_destroy(work_serializer *s)
 {
-	work_t *work, *delayed_work;
+	work_t *work;
 	work_ops_t *ops;
+	size_t i;
 
 	if (s == NULL)
 		return 1;
@@ -225,12 +421,17 @@ int serializer_destroy(work_serializer *s)
 	pthread_mutex_lock(&s->work_lock);
 	s->stop = 1;
 	pthread_cond_signal(&s->work_cond);
+	/* blocked producers must leave before space_cond is destroyed */
+	pthread_cond_broadcast(&s->space_cond);
+	while (s->blocked_producers)
+		pthread_cond_wait(&s->space_cond, &s->work_lock);
 	pthread_mutex_unlock(&s->work_lock);
 	if (s->state == SERIALIZER_RUNNING)
 		pthread_join(s->thread_id, NULL);
 
 	pthread_mutex_destroy(&s->work_lock);
 	pthread_cond_destroy(&s->work_cond);
+	pthread_cond_destroy(&s->space_cond);
 
 	ops = s->ops;
 
@@ -241,15 +442,16 @@ int serializer_destroy(work_serializer *s)
 		free(work);
 	}
 
-	while ((delayed_work = list_pop_front(s->delayed_work_list))) {
-		if (ops[delayed_work->id].free_func)
-			ops[delayed_work->id].free_func(delayed_work->obj,
-							delayed_work->ctx);
-		free(delayed_work);
+	for (i = 0; i < s->num_timers; i++) {
+		work = s->timers[i];
+		if (ops[work->id].free_func)
+			ops[work->id].free_func(work->obj, work->ctx);
+		free(work);
 	}
 
 	list_free(s->work_list);
-	list_free(s->delayed_work_list);
+	free(s->timers);
+	hash_table_free(s->timer_ids);
 	free(s->ops);
 	free(s);
 
@@ -264,7 +466,8 @@ static void _fill_basic_work_data(work_t * work, unsigned id, void *work_obj,
 	work->ctx = ctx;
 	work->result = 0;
 	work->state = state;
-	clock_gettime(CLOCK_REALTIME, &work->ts);
+	work->timer = SERIALIZER_NO_TIMER;
+	clock_gettime(CLOCK_MONOTONIC, &work->ts);
 }
 
 static work_t * _create_new_work(unsigned id, void *work_obj, void *ctx,
@@ -278,70 +481,42 @@ static work_t * _create_new_work(unsigned id, void *work_obj, void *ctx,
 	return work;
 }
 
+/* Must be called with work_lock held after a work was queued */
+static void _serializer_notify(work_serializer *s)
+{
+	if (list_get_size(s->work_list) > s->max_queued)
+		s->max_queued = list_get_size(s->work_list);
+
+	if (s->state == SERIALIZER_PAUSED) {
+		s->state = SERIALIZER_RUNNING;
+		pthread_create(&s->thread_id, NULL, serializer_work_thread, s);
+	} else
+		pthread_cond_signal(&s->work_cond);
+}
+
 static int _serializer_exec_work(work_serializer *s, work_t *work, int *res,
 				 unsigned int timeout_ms)
 {
 	int inserted = 0, abandoned = 0;
 	int cw_res = 0;
 	struct timespec ts;
-	int trying_to_insert_again = 0;
-
-again:
-	if (trying_to_insert_again)
-		usleep(200 * 1000);
-	trying_to_insert_again = 1;
 
 	pthread_mutex_lock(&s->work_lock);
 
-	if (work->state == WORK_ASYNC) {
-		if (list_get_size(s->work_list) >= ASYNC_WORK_LIST_MAX_SIZE) {
-			pthread_mutex_unlock(&s->work_lock);
-			goto again;
-		}
-
-		if (list_push_back(s->work_list, work))
-			goto insert_err;
-	} else if (work->state == WORK_DELAYED) {
-		if (list_get_size(s->delayed_work_list) >= DELAYED_WORK_LIST_MAX_SIZE) {
-			pthread_mutex_unlock(&s->work_lock);
-			goto again;
-		}
-
-		list_foreach_start(s->delayed_work_list, work_entry, work_t)
-		if (_is_delayed_work_before(work, &work_entry->ts)) {
-			if (list_foreach_insert_before_current(work))
-				goto insert_err;
-			inserted = 1;
-			break;
-		}
-		list_foreach_end
-		if (!inserted && list_push_back(s->delayed_work_list, work))
-			goto insert_err;
-	} else {
-		list_foreach_start(s->work_list, work_entry, work_t)
-		if (work_entry->state != WORK_WAITING_FOR_FINISH) {
-			if (list_foreach_insert_before_current(work))
-				goto insert_err;
-			inserted = 1;
-			break;
-		}
-		list_foreach_end
-		if (!inserted && list_push_back(s->work_list, work))
+	list_foreach_start(s->work_list, work_entry, work_t)
+	if (work_entry->state != WORK_WAITING_FOR_FINISH) {
+		if (list_foreach_insert_before_current(work))
 			goto insert_err;
+		inserted = 1;
+		break;
 	}
+	list_foreach_end
+	if (!inserted && list_push_back(s->work_list, work))
+		goto insert_err;
 
-	if (s->state == SERIALIZER_PAUSED) {
-		s->state = SERIALIZER_RUNNING;
-		pthread_create(&s->thread_id, NULL, serializer_work_thread, s);
-	} else
-		pthread_cond_signal(&s->work_cond);
-
-	if (work->state == WORK_ASYNC || work->state == WORK_DELAYED) {
-		pthread_mutex_unlock(&s->work_lock);
-		return 0;
-	}
+	_serializer_notify(s);
 
-	clock_gettime(CLOCK_REALTIME, &ts);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 	_add_time_to_timespec(&ts, 0, timeout_ms);
 	while (cw_res == 0 && work->state == WORK_WAITING_FOR_FINISH) {
 		cw_res = pthread_cond_timedwait(&s->work_cond,
@@ -406,42 +581,267 @@ int serializer_exec_work(work_serializer *s, unsigned id,
 	return _serializer_exec_work(s, work, res, timeout_ms);
 }
 
+/* Must be called with work_lock held. Returns a queued async work which can
+ * be coalesced with 'work', or NULL */
+static work_t * _find_coalesced_work(work_serializer *s, work_t *work, void *key)
+{
+	cmp_key cmp_func = s->ops[work->id].cmp_func;
+
+	if (key == NULL || cmp_func == NULL)
+		return NULL;
+
+	list_foreach_start(s->work_list, work_entry, work_t)
+		if (work_entry->state == WORK_ASYNC && work_entry->id == work->id &&
+		    work_entry->ctx == work->ctx && !cmp_func(work_entry->obj, key))
+			return work_entry;
+	list_foreach_end
+
+	return NULL;
+}
+
+/* Must be called with work_lock held, waits for room in the queue up to the
+ * block timeout. Returns 0 if there is room, 1 on timeout or if the
+ * serializer is being destroyed */
+static int _wait_for_space(work_serializer *s)
+{
+	struct timespec ts;
+	int cw_res = 0;
+
+	s->overflow_blocked++;
+	if (s->block_timeout_ms) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		_add_time_to_timespec(&ts, 0, s->block_timeout_ms);
+	}
+
+	s->blocked_producers++;
+	while (cw_res == 0 && !s->stop &&
+	       list_get_size(s->work_list) >= s->max_async) {
+		if (s->block_timeout_ms)
+			cw_res = pthread_cond_timedwait(&s->space_cond,
+							&s->work_lock, &ts);
+		else
+			cw_res = pthread_cond_wait(&s->space_cond, &s->work_lock);
+	}
+	s->blocked_producers--;
+
+	if (s->stop) {
+		/* serializer_destroy() waits for the last one */
+		if (s->blocked_producers == 0)
+			pthread_cond_broadcast(&s->space_cond);
+		return 1;
+	}
+
+	return list_get_size(s->work_list) >= s->max_async;
+}
+
+static int _serializer_exec_work_async(work_serializer *s, work_t *work, void *key)
+{
+	work_t *evicted = NULL, *coalesced;
+	int dropped = 0;
+
+	pthread_mutex_lock(&s->work_lock);
+
+	/* the serializer can't wait for itself, its own works may exceed the
+	 * limit */
+	if (list_get_size(s->work_list) < s->max_async ||
+	    pthread_self() == s->thread_id || s->ops[work->id].unlimited)
+		goto queue;
+
+	switch (s->overflow_policy) {
+	case SERIALIZER_OVERFLOW_COALESCE:
+		coalesced = _find_coalesced_work(s, work, key);
+		if (coalesced) {
+			/* the queued work takes the new object, the old one is
+			 * freed with the new work */
+			void *obj = coalesced->obj;
+
+			coalesced->obj = work->obj;
+			work->obj = obj;
+			evicted = work;
+			s->overflow_coalesced++;
+			pthread_mutex_unlock(&s->work_lock);
+			goto free_evicted;
+		}
+		/* nothing to coalesce with, wait for room */
+		/* fall through */
+	case SERIALIZER_OVERFLOW_BLOCK:
+		dropped = _wait_for_space(s);
+		break;
+	case SERIALIZER_OVERFLOW_DROP_OLDEST:
+		list_foreach_start(s->work_list, work_entry, work_t)
+			if (work_entry->state == WORK_ASYNC &&
+			    !s->ops[work_entry->id].unlimited) {
+				list_foreach_remove_current_entry();
+				evicted = work_entry;
+				break;
+			}
+		list_foreach_end
+		dropped = (evicted == NULL);
+		break;
+	case SERIALIZER_OVERFLOW_DROP_NEWEST:
+	default:
+		dropped = 1;
+		break;
+	}
+
+	if (dropped || evicted)
+		s->overflow_dropped++;
+
+	if (dropped) {
+		pthread_mutex_unlock(&s->work_lock);
+		free(work);
+		return 1;
+	}
+
+queue:
+	if (list_push_back(s->work_list, work)) {
+		pthread_mutex_unlock(&s->work_lock);
+		free(work);
+		dropped = 1;
+		goto free_evicted;
+	}
+
+	_serializer_notify(s);
+	pthread_mutex_unlock(&s->work_lock);
+
+free_evicted:
+	if (evicted) {
+		if (s->ops[evicted->id].free_func)
+			s->ops[evicted->id].free_func(evicted->obj, evicted->ctx);
+		free(evicted);
+	}
+
+	return dropped;
+}
+
+int serializer_exec_work_async_key(work_serializer *s, unsigned id,
+				   void *work_obj, void *ctx, void *key)
+{
+	work_t *work;
+
+	if (s == NULL || s->num_ops <= id)
+		return 1;
+
+	work = _create_new_work(id, work_obj, ctx, WORK_ASYNC);
+	if (work == NULL)
+		return 1;
+
+	return _serializer_exec_work_async(s, work, key);
+}
+
 int serializer_exec_work_async(work_serializer *s, unsigned id,
 			       void *work_obj, void *ctx)
+{
+	return serializer_exec_work_async_key(s, id, work_obj, ctx, NULL);
+}
+
+int serializer_set_overflow_policy(work_serializer *s,
+				   serializer_overflow_policy policy,
+				   size_t max_async, unsigned int block_timeout_ms)
+{
+	if (s == NULL || max_async == 0 ||
+	    policy < SERIALIZER_OVERFLOW_BLOCK || policy > SERIALIZER_OVERFLOW_COALESCE)
+		return 1;
+
+	pthread_mutex_lock(&s->work_lock);
+	s->overflow_policy = policy;
+	s->max_async = max_async;
+	s->block_timeout_ms = block_timeout_ms;
+	/* the limit may have grown */
+	pthread_cond_broadcast(&s->space_cond);
+	pthread_mutex_unlock(&s->work_lock);
+
+	return 0;
+}
+
+int serializer_add_delayed_work_ex(work_serializer *s, unsigned id,
+				   void *work_obj, void *ctx,
+				   unsigned int secs, unsigned int msecs,
+				   serializer_timer *timer)
 {
 	work_t *work;
 
 	if (s == NULL || s->num_ops <= id)
 		return 1;
 
-	work = _create_new_work(id, work_obj, ctx, WORK_ASYNC);
+	work = _create_new_work(id, work_obj, ctx, WORK_DELAYED);
 	if (work == NULL)
 		return 1;
 
-	return _serializer_exec_work(s, work, NULL, 0);
+	_add_time_to_timespec(&work->ts, secs, msecs);
+
+	pthread_mutex_lock(&s->work_lock);
+
+	if (_timer_push(s, work)) {
+		pthread_mutex_unlock(&s->work_lock);
+		ELOG("failed to add delayed work");
+		free(work);
+		return 1;
+	}
+
+	/* set before the work may run and clear it */
+	if (timer)
+		*timer = work->timer;
+
+	_serializer_notify(s);
+	pthread_mutex_unlock(&s->work_lock);
+
+	return 0;
 }
 
 int serializer_add_delayed_work(work_serializer *s, unsigned id,
 				void *work_obj, void *ctx,
 				unsigned int secs, unsigned int msecs)
+{
+	return serializer_add_delayed_work_ex(s, id, work_obj, ctx,
+					      secs, msecs, NULL);
+}
+
+int serializer_cancel_timer(work_serializer *s, serializer_timer timer)
 {
 	work_t *work;
 
-	if (s == NULL || s->num_ops <= id)
+	if (s == NULL || timer == SERIALIZER_NO_TIMER)
 		return 1;
 
-	work = _create_new_work(id, work_obj, ctx, WORK_DELAYED);
+	pthread_mutex_lock(&s->work_lock);
+
+	work = (work_t*)hash_table_find(s->timer_ids, &timer);
+	if (work)
+		_timer_remove(s, work->heap_idx);
+
+	pthread_mutex_unlock(&s->work_lock);
+
 	if (work == NULL)
 		return 1;
 
-	_add_time_to_timespec(&work->ts, secs, msecs);
+	if (s->ops[work->id].free_func)
+		s->ops[work->id].free_func(work->obj, work->ctx);
+	free(work);
+
+	return 0;
+}
+
+typedef struct _cancel_key {
+	unsigned id;
+	void *key;
+	void *ctx;
+} cancel_key;
 
-	return _serializer_exec_work(s, work, NULL, 0);
+static int _match_delayed_work(work_serializer *s, work_t *work, void *arg)
+{
+	cancel_key *ck = (cancel_key*)arg;
+
+	return ck->id == work->id && ck->ctx == work->ctx &&
+	       (!s->ops[ck->id].cmp_func ||
+		!s->ops[ck->id].cmp_func(work->obj, ck->key));
 }
 
 int serializer_cancel_delayed_work(work_serializer *s, unsigned id,
 				   void *key, void *ctx)
 {
+	cancel_key ck = { id, key, ctx };
+
 	if (s == NULL || s->num_ops <= id)
 		return 1;
 
@@ -451,26 +851,20 @@ int serializer_cancel_delayed_work(work_serializer *s, unsigned id,
 	}
 
 	pthread_mutex_lock(&s->work_lock);
-
-	list_foreach_start(s->delayed_work_list, work, work_t)
-		if (id == work->id && ctx == work->ctx &&
-		    (!s->ops[id].cmp_func ||
-		     !s->ops[id].cmp_func(work->obj, key))) {
-			list_foreach_remove_current_entry();
-			if (s->ops[id].free_func)
-				s->ops[id].free_func(work->obj, work->ctx);
-			free(work);
-		}
-	list_foreach_end
-
+	_timers_remove_if(s, _match_delayed_work, &ck);
 	pthread_mutex_unlock(&s->work_lock);
 
 	return 0;
 }
 
+static int _match_ctx(work_serializer *s, work_t *work, void *ctx)
+{
+	(void)s;
+	return work->ctx == ctx;
+}
+
 int serializer_stop_all_by_ctx(work_serializer *s, void *ctx)
 {
-	l_list *list;
 	int need_notify = 0;
 
 	if (s == NULL)
@@ -481,27 +875,28 @@ int serializer_stop_all_by_ctx(work_serializer *s, void *ctx)
 		return 1;
 	}
 
-	list = s->work_list;
 	pthread_mutex_lock(&s->work_lock);
 
-again:
 	list_foreach_start(s->work_list, work, work_t)
 		if (ctx == work->ctx) {
+			int aborted = (work->state == WORK_WAITING_FOR_FINISH);
+
 			list_foreach_remove_current_entry();
-			if (work->state == WORK_WAITING_FOR_FINISH) {
-				work->state = WORK_ABORTED;
-				need_notify = 1;
-			}
 			if (s->ops[work->id].free_func)
 				s->ops[work->id].free_func(work->obj, work->ctx);
-			if (work->state != WORK_WAITING_FOR_FINISH)
+			/* an aborted sync work is freed by its waiter */
+			if (aborted) {
+				work->state = WORK_ABORTED;
+				need_notify = 1;
+			} else
 				free(work);
 		}
 	list_foreach_end
-	if (list == s->work_list) {
-		list = s->delayed_work_list;
-		goto again;
-	}
+
+	_timers_remove_if(s, _match_ctx, ctx);
+
+	if (s->blocked_producers)
+		pthread_cond_broadcast(&s->space_cond);
 
 	if (need_notify)
 		pthread_cond_broadcast(&s->work_cond);
@@ -511,6 +906,26 @@ again:
 	return 0;
 }
 
+int serializer_get_stats(work_serializer *s, serializer_stats *stats)
+{
+	if (s == NULL || stats == NULL)
+		return 1;
+
+	pthread_mutex_lock(&s->work_lock);
+	stats->queued = list_get_size(s->work_list);
+	stats->max_queued = s->max_queued;
+	stats->delayed = s->num_timers;
+	stats->executed = s->executed;
+	stats->wait_total_us = s->wait_total_us;
+	stats->wait_max_us = s->wait_max_us;
+	stats->overflow_blocked = s->overflow_blocked;
+	stats->overflow_dropped = s->overflow_dropped;
+	stats->overflow_coalesced = s->overflow_coalesced;
+	pthread_mutex_unlock(&s->work_lock);
+
+	return 0;
+}
+
 int serializer_is_running(work_serializer *s)
 {
 	if (s == NULL)
@@ -11,21 +11,66 @@
 #ifndef __WAVE_WORK_SERIALIZER__H__
 #define __WAVE_WORK_SERIALIZER__H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct _work_serializer work_serializer;
 
+/* Handle of a delayed work, never reused by the serializer */
+typedef uint64_t serializer_timer;
+#define SERIALIZER_NO_TIMER	(0)
+
 typedef int (*work_cb) (work_serializer *s, void *work_obj, void *ctx);
 typedef int (*free_cb) (void *work_obj, void *ctx);
 typedef int (*cmp_key) (void *work_obj, void *key);
 
+/* Async works of an 'unlimited' op are queued even when the queue is full,
+ * for works that must not be lost or wait (e.g. releasing a client) */
 typedef struct _work_ops {
 	work_cb work_func;
 	free_cb free_func;
 	cmp_key cmp_func;
+	int unlimited;
 } work_ops_t;
 
+/* What serializer_exec_work_async() does when the queue of async works is
+ * full:
+ * BLOCK - waits for room, up to the block timeout (0 - forever).
+ * DROP_NEWEST - fails, the caller keeps the work object.
+ * DROP_OLDEST - frees the oldest queued limited async work to make room.
+ * COALESCE - replaces the object of a queued work of the same id and ctx
+ *	      which matches the key (by the cmp_func of the work), otherwise
+ *	      blocks.
+ * Sync works, works of unlimited ops and works queued from the serializer
+ * context aren't limited */
+typedef enum {
+	SERIALIZER_OVERFLOW_BLOCK,
+	SERIALIZER_OVERFLOW_DROP_NEWEST,
+	SERIALIZER_OVERFLOW_DROP_OLDEST,
+	SERIALIZER_OVERFLOW_COALESCE,
+} serializer_overflow_policy;
+
+/* Counters are kept from the creation of the serializer. The wait of a work
+ * is the time from its queuing until the serializer takes it.
+ * overflow_blocked counts producers that waited for room, overflow_dropped
+ * counts works dropped by the policy or after the block timeout */
+typedef struct _serializer_stats {
+	size_t queued;
+	size_t max_queued;
+	size_t delayed;
+	uint64_t executed;
+	uint64_t wait_total_us;
+	uint64_t wait_max_us;
+	uint64_t overflow_blocked;
+	uint64_t overflow_dropped;
+	uint64_t overflow_coalesced;
+} serializer_stats;
+
 work_serializer * serializer_create(work_ops_t *ops, unsigned num_ops,
 				    int start_now);
 
+/* Producers blocked for room in the queue fail, destroy returns after they
+ * left the serializer */
 int serializer_destroy(work_serializer *s);
 
 int serializer_exec_work(work_serializer *s, unsigned id,
@@ -35,15 +80,39 @@ int serializer_exec_work(work_serializer *s, unsigned id,
 int serializer_exec_work_async(work_serializer *s, unsigned id,
 			       void *work_obj, void *ctx);
 
+/* Same as serializer_exec_work_async(), 'key' identifies the work for the
+ * COALESCE policy */
+int serializer_exec_work_async_key(work_serializer *s, unsigned id,
+				   void *work_obj, void *ctx, void *key);
+
+/* Defaults to BLOCK without timeout, with up to 500 queued works */
+int serializer_set_overflow_policy(work_serializer *s,
+				   serializer_overflow_policy policy,
+				   size_t max_async, unsigned int block_timeout_ms);
+
 int serializer_add_delayed_work(work_serializer *s, unsigned id,
 				void *work_obj, void *ctx,
 				unsigned int secs, unsigned int msecs);
 
+/* Same as serializer_add_delayed_work(), sets 'timer' (if not NULL) to the
+ * handle of the work before it may run */
+int serializer_add_delayed_work_ex(work_serializer *s, unsigned id,
+				   void *work_obj, void *ctx,
+				   unsigned int secs, unsigned int msecs,
+				   serializer_timer *timer);
+
+/* Cancels a delayed work by its handle and frees it, may be called from any
+ * context. Returns 1 if the work already ran or was cancelled */
+int serializer_cancel_timer(work_serializer *s, serializer_timer timer);
+
+/* Cancels all delayed works of 'id' and 'ctx' that match 'key' */
 int serializer_cancel_delayed_work(work_serializer *s, unsigned id,
 				   void *key, void *ctx);
 
 int serializer_stop_all_by_ctx(work_serializer *s, void *ctx);
 
+int serializer_get_stats(work_serializer *s, serializer_stats *stats);
+
 int serializer_is_running(work_serializer *s);
 
 /* Check if this function is called from the serializer thread contexts */